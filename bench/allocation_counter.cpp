@@ -0,0 +1,41 @@
+// The replacements are kept in their own file so that they are never inlined
+// into the code being measured.
+
+#include "allocation_counter.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+std::size_t allocationCountTotal = 0;
+std::size_t allocationBytesTotal = 0;
+
+std::size_t lightspeed::allocationCount() {
+  return allocationCountTotal;
+}
+
+std::size_t lightspeed::allocationBytes() {
+  return allocationBytesTotal;
+}
+
+void* operator new(std::size_t size) {
+  ++allocationCountTotal;
+  allocationBytesTotal += size;
+  void* pointer = std::malloc(size == 0 ? 1 : size);
+  if (pointer == nullptr) {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  std::free(pointer);
+}
@@ -0,0 +1,23 @@
+#ifndef __LIGHTSPEED_BENCH_ALLOCATION_COUNTER_H_
+#define __LIGHTSPEED_BENCH_ALLOCATION_COUNTER_H_
+
+#include <cstddef>
+
+namespace lightspeed {
+
+/**
+ * \brief Returns how many times the global operator new has been called.
+ * 
+ * The count only includes allocations in programs that link in the counter,
+ * which replaces the global allocation functions. It isn't thread safe.
+ */
+std::size_t allocationCount();
+
+/**
+ * \brief Returns the total number of bytes asked of the global operator new.
+ */
+std::size_t allocationBytes();
+
+}
+
+#endif
@@ -0,0 +1,511 @@
+// Times the kernels that run for every entity on every frame, sweeping over
+// the number of entities, the length of their histories, and how fast they
+// move. For each case it reports the time per operation, how many heap
+// allocations were made per operation (and how many bytes they asked for),
+// and a model of how many bytes each operation has to touch, so that the
+// throughput can be compared against the memory bandwidth. It also times how
+// fast generated stress scenes are instantiated as they grow.
+//
+// Usage: lightspeed_bench [--filter <text>] [--output <file>] [--repeats <n>]
+//
+// Only the kernels whose names contain the filter text are run. The results
+// are written as JSON to the output file, or to the standard output if there
+// isn't one. Progress is written to the standard error.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/timeline_component.h"
+
+#include "event/event_batch.h"
+#include "event/relativistic_update_event.h"
+
+#include "system/timeline_system.h"
+
+#include "allocation_counter.h"
+#include "light_cone.h"
+#include "mesh.h"
+#include "quaternion.h"
+#include "scene.h"
+#include "scene_generator.h"
+#include "timeline_packing.h"
+#include "utility.h"
+#include "vector.h"
+
+// Each case is timed in batches that take at least this long, so that the
+// overhead of reading the clock doesn't matter.
+#define MIN_BATCH_NANOSECONDS (2e6)
+// Cases with more timeline entries than this in total are skipped, since they
+// would take hundreds of megabytes.
+#define MAX_TIMELINE_ENTRIES (1 << 20)
+#define DELTA (1.0 / 60.0)
+
+using namespace lightspeed;
+
+// Stops the compiler from optimizing away results that are never used.
+volatile double benchSink = 0.0;
+
+struct Measurement {
+  // The median over the batches.
+  double nanoseconds;
+  double allocations;
+  double allocatedBytes;
+  // Modelled rather than measured, from the data that the kernel has to read
+  // and write.
+  double touchedBytes;
+  std::size_t operations;
+};
+
+struct Case {
+  std::string name;
+  std::vector<std::pair<std::string, double> > parameters;
+  Measurement measurement;
+};
+
+struct Options {
+  std::string filter;
+  std::string output;
+  unsigned int repeats;
+};
+
+typedef std::pair<double, BodyComponent> TimelineEntry;
+
+// Runs a kernel that performs a number of operations each time it is called,
+// and measures it per operation.
+template<typename Kernel>
+Measurement measure(
+    Options const& options,
+    Kernel kernel,
+    std::size_t operationsPerCall,
+    double touchedBytesPerOperation) {
+  
+  typedef std::chrono::steady_clock Clock;
+  auto elapsed = [](Clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(
+      Clock::now() - start).count();
+  };
+  
+  // Warm up the caches, and work out how many calls fit in a batch.
+  auto start = Clock::now();
+  kernel();
+  double once = std::max(elapsed(start), 1.0);
+  std::size_t calls = std::max(
+    (std::size_t) std::ceil(MIN_BATCH_NANOSECONDS / once),
+    (std::size_t) 1);
+  for (std::size_t i = 1; i < std::min(calls, (std::size_t) 16); ++i) {
+    kernel();
+  }
+  
+  std::vector<double> batches;
+  std::size_t startCount = allocationCount();
+  std::size_t startBytes = allocationBytes();
+  for (unsigned int repeat = 0; repeat < options.repeats; ++repeat) {
+    start = Clock::now();
+    for (std::size_t i = 0; i < calls; ++i) {
+      kernel();
+    }
+    batches.push_back(elapsed(start) / (calls * operationsPerCall));
+  }
+  
+  double operations = (double) options.repeats * calls * operationsPerCall;
+  std::sort(batches.begin(), batches.end());
+  Measurement measurement;
+  measurement.nanoseconds = batches[batches.size() / 2];
+  measurement.allocations = (allocationCount() - startCount) / operations;
+  measurement.allocatedBytes = (allocationBytes() - startBytes) / operations;
+  measurement.touchedBytes = touchedBytesPerOperation;
+  measurement.operations = (std::size_t) operations;
+  return measurement;
+}
+
+void report(
+    std::vector<Case>& cases,
+    std::string name,
+    std::vector<std::pair<std::string, double> > parameters,
+    Measurement measurement) {
+  
+  std::fprintf(stderr, "%-24s", name.c_str());
+  for (auto const& parameter : parameters) {
+    std::fprintf(stderr, " %s=%g", parameter.first.c_str(), parameter.second);
+  }
+  std::fprintf(
+    stderr,
+    "  %.2f ns/op, %.3f allocs/op\n",
+    measurement.nanoseconds,
+    measurement.allocations);
+  
+  Case result = { name, parameters, measurement };
+  cases.push_back(result);
+}
+
+// Creates a timeline for a body moving along the x axis at a fraction of the
+// speed of light, with entries spaced DELTA apart and the newest one now.
+TimelineComponent<BodyComponent> makeTimeline(
+    std::size_t history,
+    double beta) {
+  
+  TimelineComponent<BodyComponent> timeline((history - 0.5) * DELTA);
+  double speed = beta * LIGHT_SPEED;
+  Vector momentum(speed / std::sqrt(1.0 - beta * beta), 0.0, 0.0);
+  for (std::size_t i = 0; i < history; ++i) {
+    double time = -(double) (history - 1 - i) * DELTA;
+    BodyComponent body(
+      Vector(speed * time, 0.0, 0.0),
+      Quaternion(1.0, Vector()),
+      momentum);
+    timeline.timeline.push_back(std::make_pair(time, body));
+  }
+  return timeline;
+}
+
+void benchQuaternionRotate(Options const& options, std::vector<Case>& cases) {
+  
+  std::size_t const counts[] = { 64, 4096, 262144 };
+  std::mt19937 random(1);
+  std::normal_distribution<double> normal;
+  
+  for (std::size_t count : counts) {
+    std::vector<Quaternion> rotations(count);
+    std::vector<Vector> vectors(count);
+    std::vector<Vector> rotated(count);
+    for (std::size_t i = 0; i < count; ++i) {
+      Quaternion rotation(
+        normal(random),
+        Vector(normal(random), normal(random), normal(random)));
+      rotations[i] = rotation.unit();
+      vectors[i] = Vector(normal(random), normal(random), normal(random));
+    }
+    
+    double touched = sizeof(Quaternion) + 2 * sizeof(Vector);
+    for (int unit = 0; unit < 2; ++unit) {
+      Measurement measurement = measure(
+        options,
+        [&, unit]() {
+          if (unit) {
+            for (std::size_t i = 0; i < count; ++i) {
+              rotated[i] = rotations[i].rotateUnit(vectors[i]);
+            }
+          }
+          else {
+            for (std::size_t i = 0; i < count; ++i) {
+              rotated[i] = rotations[i].rotate(vectors[i]);
+            }
+          }
+          benchSink = benchSink + rotated[count / 2].x;
+        },
+        count,
+        touched);
+      report(
+        cases,
+        "quaternion_rotate",
+        { { "count", (double) count }, { "unit", (double) unit } },
+        measurement);
+    }
+  }
+}
+
+void benchTimelineReceive(Options const& options, std::vector<Case>& cases) {
+  
+  std::size_t const entityCounts[] = { 100, 1000, 10000 };
+  std::size_t const histories[] = { 16, 128, 1024 };
+  double const betas[] = { 0.0, 0.9 };
+  
+  for (std::size_t entityCount : entityCounts) {
+    for (std::size_t history : histories) {
+      if (entityCount * history > MAX_TIMELINE_ENTRIES) {
+        continue;
+      }
+      for (double beta : betas) {
+        entityx::EventManager events;
+        entityx::EntityManager entities(events);
+        TimelineSystem<BodyComponent> system;
+        system.configure(entities, events);
+        
+        // Start from the steady state, where every update adds one entry and
+        // culls another.
+        TimelineComponent<BodyComponent> timeline =
+          makeTimeline(history, beta);
+        for (std::size_t i = 0; i < entityCount; ++i) {
+          entityx::Entity entity = entities.create();
+          entity.assign<BodyComponent>(timeline.timeline.back().second);
+          entity.assign<TimelineComponent<BodyComponent> >(timeline);
+        }
+        
+        // Every entry has its time shifted, which touches the whole entry
+        // since they are smaller than a cache line.
+        double touched = (history + 1) * sizeof(TimelineEntry) +
+          sizeof(BodyComponent);
+        std::vector<RelativisticUpdateEvent> updates(
+          1,
+          RelativisticUpdateEvent(DELTA, DELTA));
+        Measurement measurement = measure(
+          options,
+          [&system, &updates]() {
+            system.receive(EventBatch<RelativisticUpdateEvent>(updates));
+          },
+          entityCount,
+          touched);
+        report(
+          cases,
+          "timeline_receive",
+          {
+            { "entities", (double) entityCount },
+            { "history", (double) history },
+            { "beta", beta }
+          },
+          measurement);
+      }
+    }
+  }
+}
+
+void benchFillTimeline(Options const& options, std::vector<Case>& cases) {
+  
+  std::size_t const histories[] = { 16, 128, 1024, 4096 };
+  
+  for (std::size_t history : histories) {
+    TimelineComponent<BodyComponent> timeline = makeTimeline(history, 0.5);
+    double touched =
+      sizeof(TimelineEntry) + TIMELINE_ENTRY_FLOATS * sizeof(float);
+    
+    // Reusing the buffer is what the render system does. Not reusing it shows
+    // what it would cost to allocate a new buffer for every draw.
+    std::vector<float> data;
+    for (int reuse = 0; reuse < 2; ++reuse) {
+      Measurement measurement = measure(
+        options,
+        [&timeline, &data, reuse]() {
+          if (reuse) {
+            packTimeline(timeline, Vector(), data);
+            benchSink = benchSink + data.back();
+          }
+          else {
+            std::vector<float> fresh;
+            packTimeline(timeline, Vector(), fresh);
+            benchSink = benchSink + fresh.back();
+          }
+        },
+        history,
+        touched);
+      report(
+        cases,
+        "fill_timeline",
+        { { "history", (double) history }, { "reuse", (double) reuse } },
+        measurement);
+    }
+  }
+}
+
+void benchLightConeSolve(Options const& options, std::vector<Case>& cases) {
+  
+  std::size_t const histories[] = { 16, 128, 1024, 16384 };
+  double const betas[] = { 0.0, 0.5, 0.9, 0.99 };
+  std::size_t const observerCount = 1024;
+  std::mt19937 random(1);
+  std::normal_distribution<double> normal;
+  
+  for (std::size_t history : histories) {
+    for (double beta : betas) {
+      TimelineComponent<BodyComponent> timeline =
+        makeTimeline(history, beta);
+      Vector velocity(beta * LIGHT_SPEED, 0.0, 0.0);
+      double span = (history - 1) * DELTA;
+      
+      // Place the observers so that their light cones cross the timeline
+      // somewhere in the middle of it.
+      std::uniform_real_distribution<double> crossing(
+        -0.9 * span,
+        -0.05 * span);
+      std::vector<Vector> observers(observerCount);
+      std::vector<double> exactGuesses(observerCount);
+      for (std::size_t i = 0; i < observerCount; ++i) {
+        double time = crossing(random);
+        Vector direction(normal(random), normal(random), normal(random));
+        observers[i] = time * velocity -
+          time * LIGHT_SPEED * direction.unit();
+        exactGuesses[i] = retardedTime(-observers[i], velocity);
+      }
+      
+      // The search looks at no more than a couple of entries for every
+      // doubling of the history.
+      double touched = (2.0 * std::ceil(std::log2((double) history)) + 2.0) *
+        sizeof(TimelineEntry);
+      for (int guess = 0; guess < 2; ++guess) {
+        Measurement measurement = measure(
+          options,
+          [&, guess]() {
+            LightConeCrossing result;
+            double sum = 0.0;
+            for (std::size_t i = 0; i < observerCount; ++i) {
+              double guessTime = guess ? exactGuesses[i] : 0.0;
+              if (findLightConeCrossing(
+                  timeline,
+                  observers[i],
+                  guessTime,
+                  result)) {
+                sum += result.lower + result.fraction;
+              }
+            }
+            benchSink = benchSink + sum;
+          },
+          observerCount,
+          touched);
+        report(
+          cases,
+          "light_cone_solve",
+          {
+            { "history", (double) history },
+            { "beta", beta },
+            { "guess", (double) guess }
+          },
+          measurement);
+      }
+    }
+  }
+}
+
+void benchSceneInstantiate(Options const& options, std::vector<Case>& cases) {
+  
+  std::size_t const entityCounts[] = { 1024, 16384 };
+  double const histories[] = { 0.0, 10.0 };
+  
+  for (std::size_t entityCount : entityCounts) {
+    for (double history : histories) {
+      // The scene is generated from a fixed seed, so every run instantiates
+      // exactly the same entities.
+      GeneratorParameters parameters;
+      parameters.entities = entityCount;
+      parameters.speeds = GeneratorParameters::Speeds::RAPIDITY;
+      parameters.speed = 0.99;
+      parameters.history = history;
+      SceneBuilder builder;
+      generateScene(parameters, builder);
+      MeshArena meshes;
+      Scene scene(builder, meshes);
+      
+      std::size_t samples = history > 0.0 ?
+        (std::size_t) std::ceil(history / parameters.sampleInterval) : 0;
+      double touched = sizeof(scene_format::Entity) +
+        samples * (sizeof(scene_format::Sample) + sizeof(TimelineEntry));
+      Measurement measurement = measure(
+        options,
+        [&scene, entityCount]() {
+          entityx::EventManager events;
+          entityx::EntityManager entities(events);
+          benchSink = benchSink + scene.instantiate(entities, 0, entityCount);
+        },
+        entityCount,
+        touched);
+      report(
+        cases,
+        "scene_instantiate",
+        { { "entities", (double) entityCount }, { "history", history } },
+        measurement);
+    }
+  }
+}
+
+void writeJson(std::FILE* file, std::vector<Case> const& cases) {
+  
+  std::fprintf(file, "{\n  \"benchmarks\": [");
+  for (std::size_t i = 0; i < cases.size(); ++i) {
+    Case const& result = cases[i];
+    Measurement const& measurement = result.measurement;
+    std::fprintf(file, "%s\n    {\n", i == 0 ? "" : ",");
+    std::fprintf(file, "      \"name\": \"%s\",\n", result.name.c_str());
+    std::fprintf(file, "      \"parameters\": {");
+    for (std::size_t j = 0; j < result.parameters.size(); ++j) {
+      std::fprintf(
+        file,
+        "%s\"%s\": %.17g",
+        j == 0 ? " " : ", ",
+        result.parameters[j].first.c_str(),
+        result.parameters[j].second);
+    }
+    std::fprintf(file, " },\n");
+    std::fprintf(
+      file,
+      "      \"ns_per_op\": %.6g,\n"
+      "      \"allocations_per_op\": %.6g,\n"
+      "      \"allocated_bytes_per_op\": %.6g,\n"
+      "      \"bytes_touched_per_op\": %.6g,\n"
+      "      \"operations\": %lu\n"
+      "    }",
+      measurement.nanoseconds,
+      measurement.allocations,
+      measurement.allocatedBytes,
+      measurement.touchedBytes,
+      (unsigned long) measurement.operations);
+  }
+  std::fprintf(file, "\n  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+  
+  Options options = { "", "", 5 };
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    if (argument == "--filter" && i + 1 < argc) {
+      options.filter = argv[++i];
+    }
+    else if (argument == "--output" && i + 1 < argc) {
+      options.output = argv[++i];
+    }
+    else if (argument == "--repeats" && i + 1 < argc) {
+      options.repeats = std::max(std::atoi(argv[++i]), 1);
+    }
+    else {
+      std::fprintf(
+        stderr,
+        "usage: %s [--filter <text>] [--output <file>] [--repeats <n>]\n",
+        argv[0]);
+      return 1;
+    }
+  }
+  
+  struct Kernel {
+    char const* name;
+    void (*run)(Options const&, std::vector<Case>&);
+  };
+  Kernel const kernels[] = {
+    { "quaternion_rotate", benchQuaternionRotate },
+    { "timeline_receive", benchTimelineReceive },
+    { "fill_timeline", benchFillTimeline },
+    { "light_cone_solve", benchLightConeSolve },
+    { "scene_instantiate", benchSceneInstantiate }
+  };
+  
+  std::vector<Case> cases;
+  for (Kernel const& kernel : kernels) {
+    if (std::strstr(kernel.name, options.filter.c_str()) != nullptr) {
+      kernel.run(options, cases);
+    }
+  }
+  
+  std::FILE* file = stdout;
+  if (!options.output.empty()) {
+    file = std::fopen(options.output.c_str(), "w");
+    if (file == nullptr) {
+      std::fprintf(stderr, "couldn't open %s\n", options.output.c_str());
+      return 1;
+    }
+  }
+  writeJson(file, cases);
+  if (file != stdout) {
+    std::fclose(file);
+  }
+  
+  return 0;
+}
@@ -0,0 +1,43 @@
+// Checks that a scene can be generated with every kind of motion when the
+// rest of the parameters are left at their defaults, so that the defaults
+// don't drift out of what the generator accepts.
+
+#include <cstdio>
+#include <exception>
+
+#include "scene.h"
+#include "scene_generator.h"
+
+using namespace lightspeed;
+
+int main() {
+  
+  typedef GeneratorParameters::Motion Motion;
+  
+  struct Kind {
+    char const* name;
+    Motion motion;
+  };
+  Kind const kinds[] = {
+    { "inertial", Motion::INERTIAL },
+    { "oscillating", Motion::OSCILLATING },
+    { "charged", Motion::CHARGED }
+  };
+  
+  int failures = 0;
+  for (Kind const& kind : kinds) {
+    GeneratorParameters parameters;
+    parameters.motion = kind.motion;
+    try {
+      SceneBuilder builder;
+      generateScene(parameters, builder);
+      std::printf("%-12s ok\n", kind.name);
+    }
+    catch (std::exception const& exception) {
+      std::printf("%-12s failed: %s\n", kind.name, exception.what());
+      ++failures;
+    }
+  }
+  
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+// Compares the integration methods against the exact solution for hyperbolic
+// motion (a body starting from rest under a constant force), which is the
+// worst case for the first order method since the velocity changes fastest
+// near the speed of light.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "component/integrator_component.h"
+
+#include "integrator.h"
+#include "utility.h"
+#include "vector.h"
+
+using namespace lightspeed;
+
+struct Result {
+  double positionError;
+  double momentumError;
+  unsigned long evaluations;
+  unsigned long substeps;
+  double nanoseconds;
+};
+
+// Gives the exact state at a time under a constant force along the x axis.
+PhaseState hyperbolicMotion(double force, double time) {
+  double momentum = force * time;
+  double energy = std::sqrt(LIGHT_SPEED * LIGHT_SPEED + momentum * momentum);
+  return PhaseState(
+    Vector(LIGHT_SPEED / force * (energy - LIGHT_SPEED), 0.0, 0.0),
+    Vector(momentum, 0.0, 0.0));
+}
+
+Result run(
+    IntegratorComponent integrator,
+    double force,
+    double duration,
+    double delta) {
+  
+  Result result = { 0.0, 0.0, 0, 0, 0.0 };
+  PhaseState state;
+  ForceFunction forceFunction =
+    [force, &result](double time, PhaseState const& state) {
+      ++result.evaluations;
+      return Vector(force, 0.0, 0.0);
+    };
+  
+  unsigned long steps = (unsigned long) std::ceil(duration / delta);
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < steps; ++i) {
+    result.substeps += integrate(state, forceFunction, delta, integrator);
+  }
+  auto end = std::chrono::steady_clock::now();
+  
+  PhaseState exact = hyperbolicMotion(force, steps * delta);
+  result.positionError = (state.position - exact.position).norm();
+  result.momentumError = (state.momentum - exact.momentum).norm();
+  result.nanoseconds =
+    std::chrono::duration<double, std::nano>(end - start).count() / steps;
+  return result;
+}
+
+int main(int argc, char** argv) {
+  
+  IntegrationMethod const EULER = IntegrationMethod::EULER;
+  IntegrationMethod const RUNGE_KUTTA = IntegrationMethod::RUNGE_KUTTA;
+  
+  double const duration = 10.0;
+  double const forces[] = { 1.0, 10.0, 100.0 };
+  double const deltas[] = { 1.0 / 240.0, 1.0 / 60.0, 1.0 / 15.0, 1.0 / 4.0 };
+  
+  struct Method {
+    char const* name;
+    IntegratorComponent integrator;
+  };
+  Method const methods[] = {
+    { "euler", IntegratorComponent(EULER, 0.0, 1) },
+    { "rk4 1e-6", IntegratorComponent(RUNGE_KUTTA, 1e-6, 64) },
+    { "rk4 1e-9", IntegratorComponent(RUNGE_KUTTA, 1e-9, 64) },
+    { "rk4 1e-12", IntegratorComponent(RUNGE_KUTTA, 1e-12, 256) }
+  };
+  
+  std::printf(
+    "%-10s %8s %8s %8s %12s %12s %10s %10s\n",
+    "method", "force", "gamma", "delta",
+    "pos error", "mom error", "evals/upd", "ns/upd");
+  for (double force : forces) {
+    double finalGamma = std::sqrt(1.0 + std::pow(force * duration, 2.0));
+    for (double delta : deltas) {
+      for (Method const& method : methods) {
+        Result result = run(method.integrator, force, duration, delta);
+        double updates = std::ceil(duration / delta);
+        std::printf(
+          "%-10s %8.1f %8.1f %8.4f %12.3e %12.3e %10.1f %10.1f\n",
+          method.name, force, finalGamma, delta,
+          result.positionError, result.momentumError,
+          result.evaluations / updates, result.nanoseconds);
+      }
+    }
+  }
+  
+  return 0;
+}
@@ -35,6 +35,49 @@ struct BodyComponent final {
   
 };
 
+/**
+ * \brief Finds the state of a body part of the way between two states, such
+ * as when resampling a timeline. The rotation is interpolated along the
+ * shorter way around.
+ */
+inline BodyComponent interpolate(
+    BodyComponent const& lhs,
+    BodyComponent const& rhs,
+    double fraction) {
+  Quaternion rotation = rhs.rotation;
+  if (lhs.rotation.dot(rotation) < 0.0) {
+    rotation = -rotation;
+  }
+  return BodyComponent(
+    lhs.position + fraction * (rhs.position - lhs.position),
+    (lhs.rotation + fraction * (rotation - lhs.rotation)).unit(),
+    lhs.momentum + fraction * (rhs.momentum - lhs.momentum));
+}
+
+/**
+ * \brief Like interpolate, except that the position follows a cubic curve
+ * that matches the velocities of both states, given the time between them.
+ * This follows curved paths much more closely when the states are far apart.
+ */
+inline BodyComponent interpolateHermite(
+    BodyComponent const& lhs,
+    BodyComponent const& rhs,
+    double fraction,
+    double duration) {
+  double s = fraction;
+  double s2 = s * s;
+  double s3 = s2 * s;
+  Vector lhsVelocity = lhs.momentum * LIGHT_SPEED / lhs.energy;
+  Vector rhsVelocity = rhs.momentum * LIGHT_SPEED / rhs.energy;
+  BodyComponent result = interpolate(lhs, rhs, fraction);
+  result.position =
+    (2.0 * s3 - 3.0 * s2 + 1.0) * lhs.position +
+    (s3 - 2.0 * s2 + s) * duration * lhsVelocity +
+    (3.0 * s2 - 2.0 * s3) * rhs.position +
+    (s3 - s2) * duration * rhsVelocity;
+  return result;
+}
+
 }
 
 #endif
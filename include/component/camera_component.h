@@ -11,7 +11,11 @@ struct CameraComponent final {
       fov(M_PI / 4.0),
       aspectRatio(1.0),
       clipNear(0.1),
-      clipFar(100.0) {
+      clipFar(100.0),
+      viewportX(0.0),
+      viewportY(0.0),
+      viewportWidth(1.0),
+      viewportHeight(1.0) {
   }
   
   CameraComponent(
@@ -22,7 +26,11 @@ struct CameraComponent final {
       fov(fov),
       aspectRatio(aspectRatio),
       clipNear(clipNear),
-      clipFar(clipFar) {
+      clipFar(clipFar),
+      viewportX(0.0),
+      viewportY(0.0),
+      viewportWidth(1.0),
+      viewportHeight(1.0) {
   }
   
   double fov;
@@ -30,6 +38,15 @@ struct CameraComponent final {
   double clipNear;
   double clipFar;
   
+  // The part of the window that the camera draws to, as fractions of the
+  // width and height of the window measured from its bottom left corner. Each
+  // camera can have its own part, so that several observers can be shown at
+  // once.
+  double viewportX;
+  double viewportY;
+  double viewportWidth;
+  double viewportHeight;
+  
 };
 
 }
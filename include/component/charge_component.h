@@ -0,0 +1,25 @@
+#ifndef __LIGHTSPEED_CHARGE_COMPONENT_H_
+#define __LIGHTSPEED_CHARGE_COMPONENT_H_
+
+namespace lightspeed {
+
+/**
+ * \brief Lets a body produce a field, and feel the fields of other bodies.
+ */
+struct ChargeComponent final {
+  
+  ChargeComponent() :
+      charge(0.0) {
+  }
+  
+  ChargeComponent(double charge) :
+      charge(charge) {
+  }
+  
+  double charge;
+  
+};
+
+}
+
+#endif
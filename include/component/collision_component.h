@@ -0,0 +1,31 @@
+#ifndef __LIGHTSPEED_COLLISION_COMPONENT_H_
+#define __LIGHTSPEED_COLLISION_COMPONENT_H_
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Gives a body a box shaped collision volume.
+ * 
+ * The box is centered on the body and rotated with it, and it is measured in
+ * the rest frame of the body, so it is contracted along the direction of
+ * motion when it moves.
+ */
+struct CollisionComponent final {
+  
+  CollisionComponent() :
+      halfExtents() {
+  }
+  
+  CollisionComponent(Vector halfExtents) :
+      halfExtents(halfExtents) {
+  }
+  
+  Vector halfExtents;
+  
+};
+
+}
+
+#endif
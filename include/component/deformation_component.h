@@ -0,0 +1,69 @@
+#ifndef __LIGHTSPEED_DEFORMATION_COMPONENT_H_
+#define __LIGHTSPEED_DEFORMATION_COMPONENT_H_
+
+#include <array>
+#include <cstddef>
+
+namespace lightspeed {
+
+/**
+ * \brief The most morph targets that a model can have.
+ */
+static constexpr std::size_t MORPH_TARGET_COUNT = 4;
+
+/**
+ * \brief Stores how far the mesh of an entity is blended towards each of the
+ * morph targets of its model.
+ * 
+ * Each vertex is moved towards the same vertex of every target by that
+ * target's weight. Only the weights change over time, so a timeline of this
+ * component animates a model for a few floats per entry. The bounds of the
+ * model are only kept if the weights aren't negative and add up to no more
+ * than one.
+ */
+struct DeformationComponent final {
+  
+  DeformationComponent() :
+      weights() {
+    weights.fill(0.0f);
+  }
+  
+  DeformationComponent(std::array<float, MORPH_TARGET_COUNT> weights) :
+      weights(weights) {
+  }
+  
+  std::array<float, MORPH_TARGET_COUNT> weights;
+  
+};
+
+/**
+ * \brief Blends the weights of two deformations, such as when resampling a
+ * timeline.
+ */
+inline DeformationComponent interpolate(
+    DeformationComponent const& lhs,
+    DeformationComponent const& rhs,
+    double fraction) {
+  DeformationComponent result;
+  for (std::size_t i = 0; i < MORPH_TARGET_COUNT; ++i) {
+    result.weights[i] = static_cast<float>(
+      lhs.weights[i] + fraction * (rhs.weights[i] - lhs.weights[i]));
+  }
+  return result;
+}
+
+/**
+ * \brief The weights don't have a rate of change to match, so they are
+ * blended in the same way as by interpolate.
+ */
+inline DeformationComponent interpolateHermite(
+    DeformationComponent const& lhs,
+    DeformationComponent const& rhs,
+    double fraction,
+    double duration) {
+  return interpolate(lhs, rhs, fraction);
+}
+
+}
+
+#endif
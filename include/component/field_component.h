@@ -0,0 +1,26 @@
+#ifndef __LIGHTSPEED_FIELD_COMPONENT_H_
+#define __LIGHTSPEED_FIELD_COMPONENT_H_
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Stores the electric and magnetic fields at the position of a body,
+ * produced by every other charged body.
+ */
+struct FieldComponent final {
+  
+  FieldComponent() :
+      electric(),
+      magnetic() {
+  }
+  
+  Vector electric;
+  Vector magnetic;
+  
+};
+
+}
+
+#endif
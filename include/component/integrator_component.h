@@ -0,0 +1,51 @@
+#ifndef __LIGHTSPEED_INTEGRATOR_COMPONENT_H_
+#define __LIGHTSPEED_INTEGRATOR_COMPONENT_H_
+
+namespace lightspeed {
+
+enum class IntegrationMethod {
+  // A single first order step per update, with the momentum updated before the
+  // position.
+  EULER,
+  // Fourth order Runge-Kutta, with the step size chosen adaptively so that the
+  // estimated local error stays below the tolerance.
+  RUNGE_KUTTA
+};
+
+/**
+ * \brief Selects how the motion of an accelerating body is integrated.
+ * 
+ * Bodies without this component are integrated with the first order Euler
+ * method. The last accepted substep is remembered so that the next update can
+ * start from a step size that is already known to work.
+ */
+struct IntegratorComponent final {
+  
+  IntegratorComponent() :
+      method(IntegrationMethod::RUNGE_KUTTA),
+      tolerance(1e-9),
+      maxSubsteps(64),
+      substep(0.0) {
+  }
+  
+  IntegratorComponent(
+      IntegrationMethod method,
+      double tolerance,
+      unsigned int maxSubsteps) :
+      method(method),
+      tolerance(tolerance),
+      maxSubsteps(maxSubsteps),
+      substep(0.0) {
+  }
+  
+  IntegrationMethod method;
+  double tolerance;
+  unsigned int maxSubsteps;
+  
+  double substep;
+  
+};
+
+}
+
+#endif
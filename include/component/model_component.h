@@ -1,33 +1,43 @@
 #ifndef __LIGHTSPEED_MODEL_COMPONENT_H_
 #define __LIGHTSPEED_MODEL_COMPONENT_H_
 
-#include <initializer_list>
+#include <vector>
 
-#include "vertex.h"
-#include "texture.h"
+#include "mesh.h"
 
 namespace lightspeed {
 
+/**
+ * \brief Stores the geometry of an entity.
+ * 
+ * The geometry itself lives in a MeshArena and is shared between every entity
+ * with the same shape, so the component is only a handle to it.
+ * 
+ * A model can also have morph targets, which are meshes with the same number
+ * of vertices that the mesh is blended towards by a DeformationComponent.
+ */
 struct ModelComponent final {
   
   ModelComponent() :
-      vertices(),
-      textures() {
+      mesh(),
+      morphTargets() {
   }
   
-  ModelComponent(
-      std::initializer_list<Vertex> vertices,
-      std::initializer_list<Texture*> textures) :
-      vertices(vertices),
-      textures(textures) {
+  ModelComponent(Mesh mesh) :
+      mesh(mesh),
+      morphTargets() {
   }
   
-  std::vector<Vertex> vertices;
-  std::vector<Texture*> textures;
+  ModelComponent(Mesh mesh, std::vector<Mesh> morphTargets) :
+      mesh(mesh),
+      morphTargets(morphTargets) {
+  }
+  
+  Mesh mesh;
+  std::vector<Mesh> morphTargets;
   
 };
 
 }
 
 #endif
-
@@ -1,32 +1,222 @@
 #ifndef __LIGHTSPEED_TIMELINE_COMPONENT_H_
 #define __LIGHTSPEED_TIMELINE_COMPONENT_H_
 
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <deque>
 #include <utility>
+#include <vector>
+
+#include "memory_tracker.h"
 
 namespace lightspeed {
 
+/**
+ * \brief The memory category that the entries of every timeline are counted
+ * under.
+ */
+struct TimelineMemory final {
+  static char const* name() {
+    return "TimelineComponent";
+  }
+};
+
+/**
+ * \brief How values are found between the entries of a timeline.
+ */
+enum class TimelineInterpolation {
+  // Straight between the entries, using interpolate().
+  LINEAR,
+  // Along a cubic that matches the rates of change at the entries, using
+  // interpolateHermite().
+  HERMITE
+};
+
 /**
  * \brief Stores a history of the past values of a component of an entity over
  * time.
  * 
  * The history takes the form of a map from times to the value of the component
  * at that time. Only values up to a certain age are stored.
+ * 
+ * If the sample interval is positive, the entries lie on a regular grid of
+ * proper time that is spaced by the interval, however often the timeline is
+ * updated. The newest entry may then be the current value, which lies off the
+ * grid (see hasCurrent). If the interval is zero, the TimelineSystem's default
+ * is used, and if that is also zero then an entry is added on every update.
  */
 template<typename T>
 struct TimelineComponent final {
   
-  TimelineComponent(double timeInterval) :
+  typedef std::pair<double, T> Entry;
+  
+  TimelineComponent(double timeInterval, double sampleInterval = 0.0) :
       timeline(),
-      timeInterval(timeInterval) {
+      timeInterval(timeInterval),
+      sampleInterval(sampleInterval),
+      hasCurrent(false) {
   }
   
-  std::deque<std::pair<double, T> > timeline;
+  /**
+   * \brief The number of entries that lie on the grid, which excludes the
+   * current value.
+   */
+  std::size_t sampleCount() const {
+    return timeline.size() - (hasCurrent ? 1 : 0);
+  }
+  
+  /**
+   * \brief Finds the last grid entry at or before a time directly from the
+   * spacing of the grid, without searching. The result is clamped to the
+   * grid entries, and is only meaningful if the sample interval is positive.
+   */
+  std::size_t sampleBefore(double time) const {
+    std::size_t count = sampleCount();
+    if (count == 0) {
+      return 0;
+    }
+    double index = std::floor(
+      (time - timeline.front().first) / sampleInterval);
+    if (!(index > 0.0)) {
+      return 0;
+    }
+    if (index >= count - 1) {
+      return count - 1;
+    }
+    return static_cast<std::size_t>(index);
+  }
+  
+  /**
+   * \brief Finds the entry that a time lies after, so that the time lies
+   * between it and the next entry. On a sampling grid this is found directly,
+   * and otherwise by a binary search. The result is clamped so that there is
+   * always a next entry, which means the timeline needs at least two entries.
+   */
+  std::size_t entryBefore(double time) const {
+    std::size_t last = timeline.size() - 1;
+    std::size_t index;
+    if (sampleInterval > 0.0) {
+      index = std::min(sampleBefore(time), last - 1);
+      // The grid times build up rounding error, so fix up an index that has
+      // landed next to the right one.
+      if (index > 0 && timeline[index].first > time) {
+        --index;
+      }
+      else if (index + 1 < last && timeline[index + 1].first <= time) {
+        ++index;
+      }
+    }
+    else {
+      auto it = std::upper_bound(
+        timeline.begin(),
+        timeline.end(),
+        time,
+        [](double value, Entry const& entry) {
+          return value < entry.first;
+        });
+      index = std::min<std::size_t>(
+        std::max<std::ptrdiff_t>(it - timeline.begin(), 1) - 1,
+        last - 1);
+    }
+    return index;
+  }
+  
+  /**
+   * \brief Interpolates between an entry and the next one at a time, which is
+   * clamped to lie between them.
+   */
+  T sampleAfter(
+      std::size_t index,
+      double time,
+      TimelineInterpolation interpolation) const {
+    Entry const& lower = timeline[index];
+    Entry const& upper = timeline[index + 1];
+    double duration = upper.first - lower.first;
+    double fraction = (duration > 0.0) ? (time - lower.first) / duration : 0.0;
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    if (interpolation == TimelineInterpolation::HERMITE) {
+      return interpolateHermite(lower.second, upper.second, fraction, duration);
+    }
+    return interpolate(lower.second, upper.second, fraction);
+  }
+  
+  /**
+   * \brief Finds the value at a time (relative to the present) by
+   * interpolating between the entries on either side of it. Times outside of
+   * the timeline are clamped to its ends. Returns false if the timeline is
+   * empty.
+   */
+  bool sampleAt(
+      double time,
+      T& result,
+      TimelineInterpolation interpolation =
+        TimelineInterpolation::LINEAR) const {
+    if (timeline.size() < 2) {
+      if (!timeline.empty()) {
+        result = timeline.front().second;
+      }
+      return !timeline.empty();
+    }
+    result = sampleAfter(entryBefore(time), time, interpolation);
+    return true;
+  }
+  
+  /**
+   * \brief Finds the values at many times at once, in the same way as
+   * sampleAt. The times can be in any order, but times in increasing order
+   * are found by stepping along the timeline rather than by lookups.
+   */
+  bool sampleAt(
+      std::vector<double> const& times,
+      std::vector<T>& results,
+      TimelineInterpolation interpolation =
+        TimelineInterpolation::LINEAR) const {
+    results.clear();
+    if (timeline.size() < 2) {
+      if (!timeline.empty()) {
+        results.assign(times.size(), timeline.front().second);
+      }
+      return !timeline.empty();
+    }
+    
+    // Only a few steps are taken before falling back on a lookup, so that a
+    // large jump doesn't cost more than searching.
+    std::size_t const maxSteps = 4;
+    std::size_t last = timeline.size() - 1;
+    std::size_t index = 0;
+    results.reserve(times.size());
+    for (std::size_t i = 0; i < times.size(); ++i) {
+      double time = times[i];
+      if (i > 0 && time >= timeline[index].first) {
+        std::size_t steps = 0;
+        while (index + 1 < last && timeline[index + 1].first <= time &&
+               steps < maxSteps) {
+          ++index;
+          ++steps;
+        }
+        if (index + 1 < last && timeline[index + 1].first <= time) {
+          index = entryBefore(time);
+        }
+      }
+      else {
+        index = entryBefore(time);
+      }
+      results.push_back(sampleAfter(index, time, interpolation));
+    }
+    return true;
+  }
+  
+  std::deque<Entry, TrackingAllocator<Entry, TimelineMemory> > timeline;
   double timeInterval;
+  // The spacing of the entries in proper time, or zero for one entry on each
+  // update.
+  double sampleInterval;
+  // Whether the newest entry is the current value rather than a grid sample.
+  bool hasCurrent;
   
 };
 
 }
 
 #endif
-
@@ -0,0 +1,68 @@
+#ifndef __LIGHTSPEED_ENTITY_BATCH_H_
+#define __LIGHTSPEED_ENTITY_BATCH_H_
+
+#include <cstddef>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+namespace lightspeed {
+
+namespace entity_batch_detail {
+
+inline void assignAll(entityx::Entity entity) {
+}
+
+template<typename Component, typename... Components>
+void assignAll(
+    entityx::Entity entity,
+    Component const& component,
+    Components const&... components) {
+  entity.assign<Component>(component);
+  assignAll(entity, components...);
+}
+
+}
+
+/**
+ * \brief Creates many entities at once, such as a volley of projectiles, each
+ * with its own copy of the same components, and adds them to a list.
+ *
+ * The components can be changed afterwards, for instance to spread the
+ * entities out. None of the systems do any work on the GPU for new entities
+ * until the next frame, when everything spawned since the last frame is
+ * handled together.
+ */
+template<typename... Components>
+void spawnBatch(
+    entityx::EntityManager& entities,
+    std::size_t count,
+    std::vector<entityx::Entity>& spawned,
+    Components const&... components) {
+  spawned.reserve(spawned.size() + count);
+  for (std::size_t index = 0; index < count; ++index) {
+    entityx::Entity entity = entities.create();
+    entity_batch_detail::assignAll(entity, components...);
+    spawned.push_back(entity);
+  }
+}
+
+/**
+ * \brief Destroys every entity in a list that hasn't already been destroyed,
+ * and empties the list.
+ *
+ * The GPU buffers of the entities are kept to be reused by the next entities
+ * that are spawned, rather than being deleted.
+ */
+inline void despawnBatch(std::vector<entityx::Entity>& entities) {
+  for (entityx::Entity entity : entities) {
+    if (entity.valid()) {
+      entity.destroy();
+    }
+  }
+  entities.clear();
+}
+
+}
+
+#endif
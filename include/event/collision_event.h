@@ -0,0 +1,39 @@
+#ifndef __LIGHTSPEED_COLLISION_EVENT_H_
+#define __LIGHTSPEED_COLLISION_EVENT_H_
+
+#include <entityx/entityx.h>
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Emitted once per update for every pair of bodies that are overlapping
+ * in the resting frame.
+ */
+struct CollisionEvent final : public entityx::Event<CollisionEvent> {
+  
+  CollisionEvent(
+      entityx::Entity first,
+      entityx::Entity second,
+      Vector normal,
+      double depth) :
+      first(first),
+      second(second),
+      normal(normal),
+      depth(depth) {
+  }
+  
+  entityx::Entity first;
+  entityx::Entity second;
+  // The direction that the second body would have to move in to separate the
+  // two bodies as quickly as possible.
+  Vector normal;
+  // How far the second body would have to move along the normal.
+  double depth;
+  
+};
+
+}
+
+#endif
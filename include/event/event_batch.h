@@ -0,0 +1,31 @@
+#ifndef __LIGHTSPEED_EVENT_BATCH_H_
+#define __LIGHTSPEED_EVENT_BATCH_H_
+
+#include <vector>
+
+#include <entityx/entityx.h>
+
+namespace lightspeed {
+
+/**
+ * \brief Emitted by an EventQueue with every event of one type that was
+ * queued since it was last flushed, in the order they were queued.
+ * 
+ * A receiver handles the whole batch at once, so that it can go through the
+ * entities a single time however many events there are. The events are only
+ * valid while the batch is being received.
+ */
+template<typename E>
+struct EventBatch final : public entityx::Event<EventBatch<E> > {
+  
+  explicit EventBatch(std::vector<E> const& events) :
+      events(events) {
+  }
+  
+  std::vector<E> const& events;
+  
+};
+
+}
+
+#endif
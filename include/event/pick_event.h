@@ -0,0 +1,30 @@
+#ifndef __LIGHTSPEED_PICK_EVENT_H_
+#define __LIGHTSPEED_PICK_EVENT_H_
+
+#include <entityx/entityx.h>
+
+namespace lightspeed {
+
+/**
+ * \brief Emitted when an observer picks an entity by looking at it and
+ * clicking.
+ */
+struct PickEvent final : public entityx::Event<PickEvent> {
+  
+  PickEvent(entityx::Entity observer, entityx::Entity entity, double distance) :
+      observer(observer),
+      entity(entity),
+      distance(distance) {
+  }
+  
+  entityx::Entity observer;
+  entityx::Entity entity;
+  // How far the light from the entity travelled to reach the observer, in the
+  // resting frame.
+  double distance;
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __LIGHTSPEED_EVENT_QUEUE_H_
+#define __LIGHTSPEED_EVENT_QUEUE_H_
+
+#include <cstddef>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "event/event_batch.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Holds events back until it is flushed, and then emits each type of
+ * event once as an EventBatch, rather than once per event.
+ * 
+ * Events that only matter for their latest value, such as where the mouse
+ * is, can replace the one already queued instead, so a burst of them costs
+ * the same as a single one. The space for the events is kept between
+ * flushes, so that queueing doesn't allocate once it has settled.
+ * 
+ * This class cannot be copied in any way.
+ */
+class EventQueue final {
+  
+public:
+  
+  EventQueue() = default;
+  EventQueue(EventQueue const&) = delete;
+  void operator=(EventQueue const&) = delete;
+  
+  /**
+   * \brief Queues an event after every other event of its type.
+   */
+  template<typename E>
+  void push(E const& event) {
+    channel<E>().pending.push_back(event);
+  }
+  
+  /**
+   * \brief Queues an event in place of any others of its type.
+   */
+  template<typename E>
+  void replace(E const& event) {
+    std::vector<E>& pending = channel<E>().pending;
+    pending.clear();
+    pending.push_back(event);
+  }
+  
+  /**
+   * \brief Emits a batch of every type of event that has been queued, in the
+   * order that the types were first queued. Events queued while the batches
+   * are being received wait for the next flush.
+   */
+  void flush(entityx::EventManager& events);
+  
+private:
+  
+  // The events of a single type. They are moved aside to be emitted, so that
+  // receivers can queue more of them in the meantime.
+  struct BaseChannel {
+    virtual ~BaseChannel() = default;
+    virtual void flush(entityx::EventManager& events) = 0;
+  };
+  
+  template<typename E>
+  struct Channel final : public BaseChannel {
+    void flush(entityx::EventManager& events) override {
+      if (pending.empty()) {
+        return;
+      }
+      delivering.swap(pending);
+      events.emit<EventBatch<E> >(delivering);
+      delivering.clear();
+    }
+    std::vector<E> pending;
+    std::vector<E> delivering;
+  };
+  
+  template<typename E>
+  Channel<E>& channel() {
+    std::type_index type(typeid(E));
+    auto found = m_indices.find(type);
+    if (found == m_indices.end()) {
+      found = m_indices.insert(std::make_pair(type, m_channels.size())).first;
+      m_channels.emplace_back(new Channel<E>());
+    }
+    return static_cast<Channel<E>&>(*m_channels[found->second]);
+  }
+  
+  std::vector<std::unique_ptr<BaseChannel> > m_channels;
+  std::unordered_map<std::type_index, std::size_t> m_indices;
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef __LIGHTSPEED_FOUR_VECTOR_H_
+#define __LIGHTSPEED_FOUR_VECTOR_H_
+
+#include <cmath>
+
+#include "utility.h"
+#include "vector.h"
+#include "vector4.h"
+
+namespace lightspeed {
+
+/**
+ * \brief A vector in spacetime, such as an event or a four-momentum.
+ * 
+ * The time component is stored multiplied by the speed of light, so that all
+ * four components have the same units. Products use the Minkowski metric with
+ * signature (+, -, -, -), so timelike vectors have a positive norm.
+ */
+template<typename T>
+struct FourVector final {
+  
+  constexpr FourVector() :
+      components() {
+  }
+  
+  constexpr FourVector(T timeComponent, Vector3<T> space) :
+      components(space, timeComponent) {
+  }
+  
+  constexpr explicit FourVector(Vector4<T> const& components) :
+      components(components) {
+  }
+  
+  /**
+   * \brief Creates the four-vector of an event at a time and position.
+   */
+  static constexpr FourVector event(T time, Vector3<T> position) {
+    return FourVector(T(LIGHT_SPEED) * time, position);
+  }
+  
+  /**
+   * \brief Creates the four-momentum of a body with unit rest mass.
+   */
+  static FourVector momentum(Vector3<T> momentum) {
+    return FourVector(
+      std::sqrt(T(LIGHT_SPEED * LIGHT_SPEED) + momentum.normSq()),
+      momentum);
+  }
+  
+  /**
+   * \brief Returns the time component, which is the time multiplied by the
+   * speed of light (or the energy divided by it for a four-momentum).
+   */
+  constexpr T timeComponent() const {
+    return components.w;
+  }
+  
+  constexpr T time() const {
+    return components.w / T(LIGHT_SPEED);
+  }
+  
+  constexpr Vector3<T> space() const {
+    return components.xyz();
+  }
+  
+  /**
+   * \brief Returns the velocity that a four-momentum (or four-velocity)
+   * corresponds to.
+   */
+  constexpr Vector3<T> velocity() const {
+    return space() * (T(LIGHT_SPEED) / components.w);
+  }
+  
+  constexpr FourVector operator+() const {
+    return *this;
+  }
+  
+  constexpr FourVector operator-() const {
+    return FourVector(-components);
+  }
+  
+  FourVector& operator+=(FourVector const& rhs) {
+    components += rhs.components;
+    return *this;
+  }
+  
+  FourVector& operator-=(FourVector const& rhs) {
+    components -= rhs.components;
+    return *this;
+  }
+  
+  FourVector& operator*=(T rhs) {
+    components *= rhs;
+    return *this;
+  }
+  
+  FourVector& operator/=(T rhs) {
+    components /= rhs;
+    return *this;
+  }
+  
+  /**
+   * \brief The Minkowski inner product.
+   */
+  constexpr T dot(FourVector const& rhs) const {
+    return components.w * rhs.components.w - space().dot(rhs.space());
+  }
+  
+  /**
+   * \brief The Minkowski norm, which is positive for timelike vectors, zero
+   * for lightlike vectors, and negative for spacelike vectors.
+   */
+  constexpr T normSq() const {
+    return dot(*this);
+  }
+  
+  constexpr bool isTimelike() const {
+    return normSq() > T(0);
+  }
+  
+  constexpr bool isSpacelike() const {
+    return normSq() < T(0);
+  }
+  
+  // The spatial components are stored first, followed by the time component.
+  Vector4<T> components;
+  
+};
+
+template<typename T>
+constexpr FourVector<T> operator+(
+    FourVector<T> const& lhs,
+    FourVector<T> const& rhs) {
+  return FourVector<T>(lhs.components + rhs.components);
+}
+template<typename T>
+constexpr FourVector<T> operator-(
+    FourVector<T> const& lhs,
+    FourVector<T> const& rhs) {
+  return FourVector<T>(lhs.components - rhs.components);
+}
+template<typename T>
+constexpr FourVector<T> operator*(
+    FourVector<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return FourVector<T>(lhs.components * rhs);
+}
+template<typename T>
+constexpr FourVector<T> operator*(
+    typename NonDeduced<T>::Type lhs,
+    FourVector<T> const& rhs) {
+  return FourVector<T>(lhs * rhs.components);
+}
+template<typename T>
+constexpr FourVector<T> operator/(
+    FourVector<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return FourVector<T>(lhs.components / rhs);
+}
+
+/**
+ * \brief Returns the Lorentz factor of a velocity.
+ */
+template<typename T>
+T lorentzFactor(Vector3<T> const& velocity) {
+  return T(1) / std::sqrt(
+    T(1) - velocity.normSq() / T(LIGHT_SPEED * LIGHT_SPEED));
+}
+
+}
+
+#endif
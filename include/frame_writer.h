@@ -0,0 +1,133 @@
+#ifndef __LIGHTSPEED_FRAME_WRITER_H_
+#define __LIGHTSPEED_FRAME_WRITER_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "memory_tracker.h"
+
+namespace lightspeed {
+
+/**
+ * \brief The kinds of image file that a FrameWriter can write.
+ */
+enum class FrameFormat {
+  // Binary PPM files, which are just the raw pixels after a short header.
+  PPM,
+  // PNG files, compressed quickly rather than well.
+  PNG
+};
+
+/**
+ * \brief Writes frames to a numbered sequence of image files on background
+ * threads, so that recording doesn't hold up drawing.
+ *
+ * The frames are rows of 8 bit RGB pixels from the bottom of the image up, as
+ * they are read back from OpenGL. Their buffers are recycled once they have
+ * been written, so a recording settles into not allocating at all.
+ *
+ * This class cannot be copied in any way.
+ */
+class FrameWriter final {
+  
+public:
+  
+  /**
+   * \param prefix Put in front of the number of each frame to get its file
+   * name, such as "capture/frame_" for "capture/frame_000042.png".
+   * \param threads The number of background threads that write frames.
+   * \param maxQueued The most frames that can be waiting to be written. Once
+   * this many are waiting, submitting another waits for one to be written
+   * rather than dropping it, so that none are missing from the recording.
+   */
+  FrameWriter(
+    std::string prefix,
+    FrameFormat format,
+    std::size_t threads = 2,
+    std::size_t maxQueued = 8);
+  FrameWriter(FrameWriter const&) = delete;
+  void operator=(FrameWriter const&) = delete;
+  
+  /**
+   * \brief Waits for every frame submitted so far to be written.
+   */
+  ~FrameWriter();
+  
+  /**
+   * \brief Gives a buffer for the pixels of the next frame, reusing one from
+   * a frame that has already been written if there is one.
+   * 
+   * The memory of the frames is only counted if their buffers come from here.
+   */
+  std::vector<uint8_t> acquire(std::size_t bytes);
+  
+  /**
+   * \brief Queues a frame to be written with the next number in the sequence.
+   *
+   * \throws std::runtime_error if an earlier frame couldn't be written.
+   */
+  void submit(
+    std::size_t width,
+    std::size_t height,
+    std::vector<uint8_t> pixels);
+  
+  /**
+   * \brief Returns the number of frames that have been written so far.
+   */
+  std::size_t written() const;
+  
+  /**
+   * \brief Returns the number of times that submitting a frame had to wait
+   * for the writers to catch up.
+   */
+  std::size_t stalls() const;
+  
+private:
+  
+  struct Frame {
+    std::size_t index;
+    std::size_t width;
+    std::size_t height;
+    std::vector<uint8_t> pixels;
+  };
+  
+  void run();
+  // Writes a frame to its file, using the buffers to encode it in.
+  void write(
+    Frame const& frame,
+    std::vector<uint8_t>& rows,
+    std::vector<uint8_t>& compressed) const;
+  
+  std::string m_prefix;
+  FrameFormat m_format;
+  std::size_t m_maxQueued;
+  std::size_t m_submitted;
+  
+  // Shared between the threads, and protected by the mutex.
+  mutable std::mutex m_mutex;
+  std::condition_variable m_queuedCondition;
+  std::condition_variable m_writtenCondition;
+  std::deque<Frame> m_queue;
+  std::vector<std::vector<uint8_t> > m_free;
+  std::size_t m_written;
+  std::size_t m_stalls;
+  std::string m_error;
+  bool m_stopping;
+  
+  // The frames waiting to be written, along with the buffers waiting to be
+  // reused.
+  MemoryCounter& m_memory;
+  
+  std::vector<std::thread> m_threads;
+  
+};
+
+}
+
+#endif
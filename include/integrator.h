@@ -0,0 +1,72 @@
+#ifndef __LIGHTSPEED_INTEGRATOR_H_
+#define __LIGHTSPEED_INTEGRATOR_H_
+
+#include <functional>
+
+#include "component/integrator_component.h"
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief The position and momentum of a body, which together determine how it
+ * moves.
+ */
+struct PhaseState final {
+  
+  PhaseState() :
+      position(),
+      momentum() {
+  }
+  
+  PhaseState(Vector position, Vector momentum) :
+      position(position),
+      momentum(momentum) {
+  }
+  
+  Vector position;
+  Vector momentum;
+  
+};
+
+/**
+ * \brief Gives the force on a body at a time (relative to the start of the
+ * step) given its current state.
+ */
+typedef std::function<Vector(double, PhaseState const&)> ForceFunction;
+
+/**
+ * \brief Advances the state by a single first order step.
+ */
+PhaseState eulerStep(
+  PhaseState const& state,
+  ForceFunction const& force,
+  double time,
+  double delta);
+
+/**
+ * \brief Advances the state by a single fourth order Runge-Kutta step.
+ */
+PhaseState rungeKuttaStep(
+  PhaseState const& state,
+  ForceFunction const& force,
+  double time,
+  double delta);
+
+/**
+ * \brief Advances the state by the full amount of time using the method
+ * selected by the integrator, and returns the number of substeps taken.
+ * 
+ * The step size of the integrator is updated so that the next call can start
+ * with a suitable substep.
+ */
+unsigned int integrate(
+  PhaseState& state,
+  ForceFunction const& force,
+  double delta,
+  IntegratorComponent& integrator);
+
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef __LIGHTSPEED_LIGHT_CONE_H_
+#define __LIGHTSPEED_LIGHT_CONE_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "component/body_component.h"
+#include "component/timeline_component.h"
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Where the past light cone of an event crosses a timeline, given as
+ * two neighbouring entries and how far between them the crossing is.
+ */
+struct LightConeCrossing final {
+  
+  LightConeCrossing() :
+      lower(0),
+      upper(0),
+      fraction(0.0) {
+  }
+  
+  std::size_t lower;
+  std::size_t upper;
+  double fraction;
+  
+};
+
+/**
+ * \brief A point in space at a time relative to the present, from which the
+ * past is looked at.
+ */
+struct ObserverEvent final {
+  
+  explicit ObserverEvent(Vector position, double time = 0.0) :
+      position(position),
+      time(time) {
+  }
+  
+  Vector position;
+  double time;
+  
+};
+
+/**
+ * \brief Finds how long ago (as a negative time) light must have left a
+ * uniformly moving body to arrive at a point now, given the offset of the body
+ * from the point.
+ */
+double retardedTime(Vector const& offset, Vector const& velocity);
+
+/**
+ * \brief Converts a direction that an observer moving at a velocity is
+ * looking in (in their own frame) into the direction in the resting frame that
+ * the light seen there comes from.
+ */
+Vector restDirection(Vector const& direction, Vector const& velocity);
+
+/**
+ * \brief Finds where the past light cone of the present moment at a position
+ * crosses a timeline.
+ * 
+ * The guess is the time (relative to the present) at which the crossing is
+ * expected to be, such as from retardedTime. A good guess means that only a
+ * few entries need to be looked at, but any guess will give the right answer.
+ * Returns false if the light cone crosses before the timeline begins (or the
+ * timeline is too short to have a crossing).
+ */
+bool findLightConeCrossing(
+  TimelineComponent<BodyComponent> const& timeline,
+  Vector const& position,
+  double guessTime,
+  LightConeCrossing& crossing);
+
+/**
+ * \brief Finds where the past light cone of an event crosses a timeline, in
+ * the same way as for the present moment at a position.
+ */
+bool findLightConeCrossing(
+  TimelineComponent<BodyComponent> const& timeline,
+  ObserverEvent const& event,
+  double guessTime,
+  LightConeCrossing& crossing);
+
+/**
+ * \brief Finds the state of a body that can be seen from an event, along with
+ * the time that the light left it, by interpolating the timeline where the
+ * past light cone of the event crosses it.
+ * 
+ * The search starts from where the body would be seen if it had kept moving
+ * uniformly since its newest entry. Returns false if the light cone crosses
+ * before the timeline begins.
+ */
+bool retardedSample(
+  TimelineComponent<BodyComponent> const& timeline,
+  ObserverEvent const& event,
+  TimelineComponent<BodyComponent>::Entry& sample,
+  TimelineInterpolation interpolation = TimelineInterpolation::LINEAR);
+
+/**
+ * \brief Follows a light ray backwards in time from an event, and finds how
+ * far along it the ray first passes within a radius of a body, as it was when
+ * the light passed it. Before the timeline begins, the body is either held at
+ * its oldest entry or isn't there at all.
+ * 
+ * Returns false if the ray doesn't come within the radius before the distance.
+ */
+bool lightRayHit(
+  TimelineComponent<BodyComponent> const& timeline,
+  ObserverEvent const& event,
+  Vector const& direction,
+  double radius,
+  double distance,
+  bool holdOldestEntry,
+  double& hitDistance);
+
+/**
+ * \brief Finds the states of a body that can be seen from many events at
+ * once, in the same way as retardedSample. Each search starts from the
+ * crossing of the event before it if that is found, which makes nearby events
+ * cheap. Returns how many of the events have a crossing, and whether each one
+ * does in found.
+ */
+std::size_t retardedSamples(
+  TimelineComponent<BodyComponent> const& timeline,
+  std::vector<ObserverEvent> const& events,
+  std::vector<TimelineComponent<BodyComponent>::Entry>& samples,
+  std::vector<bool>& found,
+  TimelineInterpolation interpolation = TimelineInterpolation::LINEAR);
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef __LIGHTSPEED_LIGHT_CONE_TRACER_H_
+#define __LIGHTSPEED_LIGHT_CONE_TRACER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/camera_component.h"
+
+#include "thread_pool.h"
+
+namespace lightspeed {
+
+/**
+ * \brief An image made by the LightConeTracer, stored as rows of 8 bit RGB
+ * pixels from the top of the image down.
+ */
+struct TracedImage final {
+  
+  TracedImage() :
+      width(0),
+      height(0),
+      pixels() {
+  }
+  
+  TracedImage(std::size_t width, std::size_t height) :
+      width(width),
+      height(height),
+      pixels(3 * width * height, 0) {
+  }
+  
+  /**
+   * \brief Writes the image as a binary PPM file.
+   */
+  void writePpm(std::ostream& stream) const;
+  
+  std::size_t width;
+  std::size_t height;
+  std::vector<uint8_t> pixels;
+  
+};
+
+/**
+ * \brief Describes how the LightConeTracer splits up its work.
+ */
+struct TracerOptions final {
+  
+  TracerOptions() :
+      threads(0),
+      tileSize(32),
+      coarsestStep(8) {
+  }
+  
+  // The number of threads to trace on, or zero for one per core.
+  std::size_t threads;
+  // The width of the square tiles that the image is divided into. Each tile
+  // is traced by a single thread, against only the entities that could be
+  // seen in it.
+  std::size_t tileSize;
+  // The image is first traced at one pixel in every block of this width
+  // (which is a power of two), and then refined by halving the blocks until
+  // every pixel has been traced.
+  std::size_t coarsestStep;
+  
+};
+
+/**
+ * \brief Draws what an observer sees by following light backwards from each
+ * pixel until it meets an entity, without any graphics hardware.
+ *
+ * Between two timeline entries an entity is taken to move uniformly, so each
+ * ray is Lorentz transformed into the rest frame of the entity, where its mesh
+ * is still and the ray can be intersected with its triangles exactly. Unlike
+ * the rasterizer, the edges of the meshes are curved correctly however coarse
+ * the meshes are, so the images can be used as a reference.
+ *
+ * The entities need the vertices of their meshes, so this can't be used with
+ * meshes that have been uploaded (and discarded) by the RenderSystem. Morph
+ * targets aren't applied. This class cannot be copied in any way.
+ */
+class LightConeTracer final {
+  
+public:
+  
+  /**
+   * \brief Called after each pass of refinement with the image so far, and
+   * the width of the blocks that it was traced at.
+   */
+  typedef std::function<void(TracedImage const&, std::size_t)> Progress;
+  
+  explicit LightConeTracer(TracerOptions const& options = TracerOptions());
+  LightConeTracer(LightConeTracer const&) = delete;
+  void operator=(LightConeTracer const&) = delete;
+  
+  /**
+   * \brief Traces the entities with bodies, models and timelines as seen by an
+   * observer through a camera, at the present moment. The image should
+   * already have its size, and the viewport of the camera is ignored.
+   */
+  void render(
+    entityx::EntityManager& entities,
+    BodyComponent const& observer,
+    CameraComponent const& camera,
+    TracedImage& image,
+    Progress const& progress = Progress());
+  
+private:
+  
+  TracerOptions m_options;
+  ThreadPool m_pool;
+  
+};
+
+}
+
+#endif
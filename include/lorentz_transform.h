@@ -0,0 +1,144 @@
+#ifndef __LIGHTSPEED_LORENTZ_TRANSFORM_H_
+#define __LIGHTSPEED_LORENTZ_TRANSFORM_H_
+
+#include <cmath>
+
+#include "four_vector.h"
+#include "quaternion.h"
+#include "utility.h"
+#include "vector.h"
+#include "vector4.h"
+
+namespace lightspeed {
+
+/**
+ * \brief A linear transformation between the coordinates of two inertial
+ * frames, made up of boosts and rotations.
+ * 
+ * The transformation is stored as a 4x4 matrix acting on the components of a
+ * FourVector (so the time component comes last). Composing two transforms is
+ * a single matrix product, and since every Lorentz transform preserves the
+ * metric, the inverse only needs a transpose and some sign changes.
+ */
+template<typename T>
+struct LorentzTransform final {
+  
+  /**
+   * \brief Creates the identity transform.
+   */
+  constexpr LorentzTransform() :
+      rows {
+        Vector4<T>(1, 0, 0, 0),
+        Vector4<T>(0, 1, 0, 0),
+        Vector4<T>(0, 0, 1, 0),
+        Vector4<T>(0, 0, 0, 1) } {
+  }
+  
+  constexpr LorentzTransform(
+      Vector4<T> const& row0,
+      Vector4<T> const& row1,
+      Vector4<T> const& row2,
+      Vector4<T> const& row3) :
+      rows { row0, row1, row2, row3 } {
+  }
+  
+  /**
+   * \brief Creates the transform into the frame of an observer moving at a
+   * velocity.
+   */
+  static LorentzTransform boost(Vector3<T> const& velocity) {
+    Vector3<T> beta = velocity / T(LIGHT_SPEED);
+    T gamma = lorentzFactor(velocity);
+    // This is (gamma - 1) / beta^2, written so that it is defined at rest.
+    T k = gamma * gamma / (gamma + T(1));
+    return LorentzTransform(
+      Vector4<T>(
+        T(1) + k * beta.x * beta.x,
+        k * beta.x * beta.y,
+        k * beta.x * beta.z,
+        -gamma * beta.x),
+      Vector4<T>(
+        k * beta.y * beta.x,
+        T(1) + k * beta.y * beta.y,
+        k * beta.y * beta.z,
+        -gamma * beta.y),
+      Vector4<T>(
+        k * beta.z * beta.x,
+        k * beta.z * beta.y,
+        T(1) + k * beta.z * beta.z,
+        -gamma * beta.z),
+      Vector4<T>(-gamma * beta, gamma));
+  }
+  
+  /**
+   * \brief Creates a transform that rotates space by a unit quaternion.
+   */
+  static constexpr LorentzTransform rotation(
+      BasicQuaternion<T> const& rotation) {
+    return fromColumns(
+      rotation.rotateUnit(Vector3<T>(1, 0, 0)),
+      rotation.rotateUnit(Vector3<T>(0, 1, 0)),
+      rotation.rotateUnit(Vector3<T>(0, 0, 1)));
+  }
+  
+  constexpr FourVector<T> operator*(FourVector<T> const& rhs) const {
+    return FourVector<T>(Vector4<T>(
+      rows[0].dot(rhs.components),
+      rows[1].dot(rhs.components),
+      rows[2].dot(rhs.components),
+      rows[3].dot(rhs.components)));
+  }
+  
+  /**
+   * \brief Composes two transforms, so that rhs is applied first.
+   */
+  constexpr LorentzTransform operator*(LorentzTransform const& rhs) const {
+    return LorentzTransform(
+      rhs.combineRows(rows[0]),
+      rhs.combineRows(rows[1]),
+      rhs.combineRows(rows[2]),
+      rhs.combineRows(rows[3]));
+  }
+  
+  LorentzTransform& operator*=(LorentzTransform const& rhs) {
+    return (*this = *this * rhs);
+  }
+  
+  constexpr LorentzTransform inverse() const {
+    return LorentzTransform(
+      Vector4<T>(rows[0].x, rows[1].x, rows[2].x, -rows[3].x),
+      Vector4<T>(rows[0].y, rows[1].y, rows[2].y, -rows[3].y),
+      Vector4<T>(rows[0].z, rows[1].z, rows[2].z, -rows[3].z),
+      Vector4<T>(-rows[0].w, -rows[1].w, -rows[2].w, rows[3].w));
+  }
+  
+  Vector4<T> rows[4];
+  
+private:
+  
+  static constexpr LorentzTransform fromColumns(
+      Vector3<T> const& x,
+      Vector3<T> const& y,
+      Vector3<T> const& z) {
+    return LorentzTransform(
+      Vector4<T>(x.x, y.x, z.x, 0),
+      Vector4<T>(x.y, y.y, z.y, 0),
+      Vector4<T>(x.z, y.z, z.z, 0),
+      Vector4<T>(0, 0, 0, 1));
+  }
+  
+  // Sums the rows weighted by the components of a vector, which gives a row
+  // of the product of another transform with this one.
+  constexpr Vector4<T> combineRows(Vector4<T> const& weights) const {
+    return
+      weights.x * rows[0] +
+      weights.y * rows[1] +
+      weights.z * rows[2] +
+      weights.w * rows[3];
+  }
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __LIGHTSPEED_MEMORY_TRACKER_H_
+#define __LIGHTSPEED_MEMORY_TRACKER_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace lightspeed {
+
+/**
+ * \brief A snapshot of how much memory one category is using.
+ */
+struct MemoryUsage final {
+  
+  MemoryUsage() :
+      category(),
+      bytes(0),
+      peakBytes(0),
+      allocations(0) {
+  }
+  
+  std::string category;
+  std::size_t bytes;
+  // The most bytes that the category has held at once.
+  std::size_t peakBytes;
+  // The number of allocations that haven't been freed yet.
+  std::size_t allocations;
+  
+};
+
+/**
+ * \brief Keeps track of the memory used by one category of objects.
+ * 
+ * Counting is lock free, so it can be done from any thread on every
+ * allocation. This class cannot be copied in any way. Counters are created
+ * by (and live as long as) the MemoryTracker.
+ */
+class MemoryCounter final {
+  
+public:
+  
+  explicit MemoryCounter(std::string category);
+  MemoryCounter(MemoryCounter const&) = delete;
+  void operator=(MemoryCounter const&) = delete;
+  
+  void allocate(std::size_t bytes);
+  void deallocate(std::size_t bytes);
+  
+  /**
+   * \brief Changes the size of an allocation without changing the number of
+   * allocations, such as when a buffer is resized.
+   */
+  void resize(std::size_t oldBytes, std::size_t newBytes);
+  
+  MemoryUsage usage() const;
+  
+  /**
+   * \brief Sets the high-water mark to the current number of bytes.
+   */
+  void resetPeak();
+  
+private:
+  
+  void updatePeak(std::size_t bytes);
+  
+  std::string m_category;
+  std::atomic<std::size_t> m_bytes;
+  std::atomic<std::size_t> m_peakBytes;
+  std::atomic<std::size_t> m_allocations;
+  
+};
+
+/**
+ * \brief Collects the memory counters of every category, so that the memory
+ * use of the whole program can be queried in one place.
+ * 
+ * This class cannot be copied in any way. There is a single instance of it.
+ */
+class MemoryTracker final {
+  
+public:
+  
+  static MemoryTracker& instance();
+  
+  MemoryTracker(MemoryTracker const&) = delete;
+  void operator=(MemoryTracker const&) = delete;
+  
+  /**
+   * \brief Returns the counter for a category, creating it if it doesn't
+   * exist. The reference stays valid for the rest of the program, so it
+   * should be looked up once and kept rather than looked up every time.
+   */
+  MemoryCounter& counter(std::string const& category);
+  
+  /**
+   * \brief Returns the usage of a category, which is empty if nothing has
+   * been counted under it.
+   */
+  MemoryUsage usage(std::string const& category) const;
+  
+  /**
+   * \brief Returns the usage of every category, in the order they were
+   * created.
+   */
+  std::vector<MemoryUsage> usage() const;
+  
+  /**
+   * \brief Sets the high-water mark of every category to its current usage.
+   */
+  void resetPeaks();
+  
+  /**
+   * \brief Writes the usage of every category as a table, with a total.
+   */
+  void dump(std::ostream& stream) const;
+  
+private:
+  
+  MemoryTracker();
+  
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<MemoryCounter> > m_counters;
+  
+};
+
+/**
+ * \brief An allocator for standard containers that counts everything it
+ * allocates under a category.
+ * 
+ * The category is given by a type with a static name() function, so that the
+ * allocator doesn't need any state. It isn't final, since the containers may
+ * derive from their allocator.
+ */
+template<typename T, typename Category>
+struct TrackingAllocator {
+  
+  typedef T value_type;
+  
+  template<typename U>
+  struct rebind {
+    typedef TrackingAllocator<U, Category> other;
+  };
+  
+  TrackingAllocator() {
+  }
+  
+  template<typename U>
+  TrackingAllocator(TrackingAllocator<U, Category> const& other) {
+  }
+  
+  T* allocate(std::size_t count) {
+    counter().allocate(count * sizeof(T));
+    return static_cast<T*>(::operator new(count * sizeof(T)));
+  }
+  
+  void deallocate(T* pointer, std::size_t count) {
+    counter().deallocate(count * sizeof(T));
+    ::operator delete(pointer);
+  }
+  
+  static MemoryCounter& counter() {
+    static MemoryCounter& counter =
+      MemoryTracker::instance().counter(Category::name());
+    return counter;
+  }
+  
+};
+
+template<typename T, typename U, typename Category>
+bool operator==(
+    TrackingAllocator<T, Category> const& lhs,
+    TrackingAllocator<U, Category> const& rhs) {
+  return true;
+}
+template<typename T, typename U, typename Category>
+bool operator!=(
+    TrackingAllocator<T, Category> const& lhs,
+    TrackingAllocator<U, Category> const& rhs) {
+  return false;
+}
+
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef __LIGHTSPEED_MESH_H_
+#define __LIGHTSPEED_MESH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include "memory_tracker.h"
+#include "texture.h"
+#include "vector.h"
+#include "vertex.h"
+
+namespace lightspeed {
+
+class MeshArena;
+
+/**
+ * \brief A reference counted handle to an immutable mesh stored in a
+ * MeshArena.
+ * 
+ * Copying a handle is cheap and shares the same mesh. The mesh is freed once
+ * the last handle to it is destroyed. The vertices can be discarded before
+ * then (for example once they have been uploaded to the GPU), after which
+ * only the number of vertices, the radius and the textures are available.
+ */
+class Mesh final {
+  
+public:
+  
+  /**
+   * \brief Creates a handle that doesn't refer to any mesh.
+   */
+  Mesh();
+  Mesh(Mesh const& other);
+  Mesh& operator=(Mesh const& other);
+  ~Mesh();
+  
+  explicit operator bool() const;
+  bool operator==(Mesh const& rhs) const;
+  bool operator!=(Mesh const& rhs) const;
+  
+  /**
+   * \brief Returns a number that identifies the mesh among all of the living
+   * meshes in its arena.
+   */
+  std::size_t id() const;
+  
+  /**
+   * \brief Returns the number of handles that refer to the mesh.
+   */
+  std::size_t useCount() const;
+  
+  /**
+   * \brief Returns the vertices of the mesh, or NULL if they have been
+   * discarded.
+   */
+  Vertex const* vertices() const;
+  std::size_t vertexCount() const;
+  
+  /**
+   * \brief Returns the largest distance from the origin to any vertex.
+   */
+  double radius() const;
+  
+  std::vector<Texture*> const& textures() const;
+  
+  /**
+   * \brief Frees the vertices of the mesh, which are no longer needed once
+   * they live somewhere else. This affects every handle to the mesh.
+   */
+  void discardVertices() const;
+  
+private:
+  
+  friend class MeshArena;
+  
+  Mesh(MeshArena* arena, uint32_t index);
+  
+  MeshArena* m_arena;
+  uint32_t m_index;
+  
+};
+
+/**
+ * \brief Stores the vertices of many meshes together in large blocks, so that
+ * creating a mesh rarely needs an allocation of its own.
+ * 
+ * The space used by a block is reused once every mesh in it has been freed or
+ * had its vertices discarded. Meshes can also borrow vertices from elsewhere
+ * (such as a memory mapped scene file) as long as they outlive the mesh.
+ * 
+ * The arena must outlive every handle to its meshes, and it should only be
+ * used from a single thread. This class cannot be copied in any way. It should
+ * be passed by reference or by pointer.
+ */
+class MeshArena final {
+  
+public:
+  
+  /**
+   * \param blockSize The number of vertices in each block. Meshes larger than
+   * this are given a block of their own.
+   */
+  MeshArena(std::size_t blockSize = 65536);
+  MeshArena(MeshArena const&) = delete;
+  void operator=(MeshArena const&) = delete;
+  ~MeshArena();
+  
+  /**
+   * \brief Creates a mesh from a copy of some vertices.
+   */
+  Mesh create(
+    Vertex const* vertices,
+    std::size_t vertexCount,
+    std::initializer_list<Texture*> textures = { });
+  Mesh create(
+    std::vector<Vertex> const& vertices,
+    std::initializer_list<Texture*> textures = { });
+  
+  /**
+   * \brief Creates a mesh that refers to vertices stored somewhere else.
+   */
+  Mesh borrow(
+    Vertex const* vertices,
+    std::size_t vertexCount,
+    std::initializer_list<Texture*> textures = { });
+  
+  /**
+   * \brief Returns the number of meshes that are still alive.
+   */
+  std::size_t meshCount() const;
+  
+  /**
+   * \brief Returns the number of bytes held by the blocks, whether or not
+   * they are in use.
+   */
+  std::size_t reservedBytes() const;
+  
+  /**
+   * \brief Returns the number of bytes taken up by the vertices of living
+   * meshes.
+   */
+  std::size_t usedBytes() const;
+  
+private:
+  
+  friend class Mesh;
+  
+  // Borrowed meshes, and meshes whose vertices have been discarded, don't
+  // belong to any block.
+  static std::size_t const NO_BLOCK = static_cast<std::size_t>(-1);
+  
+  struct Record {
+    Vertex const* vertices;
+    std::size_t vertexCount;
+    double radius;
+    std::vector<Texture*> textures;
+    std::size_t block;
+    std::size_t references;
+  };
+  
+  struct Block {
+    std::unique_ptr<Vertex[]> vertices;
+    std::size_t capacity;
+    std::size_t used;
+    // The number of meshes whose vertices are stored in this block.
+    std::size_t meshes;
+  };
+  
+  Mesh add(
+    Vertex const* vertices,
+    std::size_t vertexCount,
+    std::size_t block,
+    std::initializer_list<Texture*> textures);
+  std::size_t allocate(std::size_t vertexCount);
+  
+  void retain(uint32_t index);
+  void release(uint32_t index);
+  void discard(uint32_t index);
+  
+  std::size_t m_blockSize;
+  std::vector<Record> m_records;
+  std::vector<uint32_t> m_freeRecords;
+  std::vector<Block> m_blocks;
+  std::size_t m_usedVertices;
+  // Counts the blocks, which is where the vertices of models live until they
+  // are uploaded.
+  MemoryCounter& m_memory;
+  
+};
+
+/**
+ * \brief Creates the triangles of a box centered on the origin.
+ */
+std::vector<Vertex> boxMesh(Vector dimensions);
+
+/**
+ * \brief Creates the triangles of a sphere centered on the origin, with the
+ * given number of segments around its equator (and half as many from pole to
+ * pole), so that the number of triangles can be scaled up and down.
+ */
+std::vector<Vertex> sphereMesh(double radius, unsigned int segments);
+
+}
+
+#endif
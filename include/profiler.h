@@ -0,0 +1,188 @@
+#ifndef __LIGHTSPEED_PROFILER_H_
+#define __LIGHTSPEED_PROFILER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Scopes are only timed when the build defines LIGHTSPEED_PROFILING. Otherwise
+// the macros expand to nothing, so that the instrumentation costs nothing.
+#ifdef LIGHTSPEED_PROFILING
+ #define LIGHTSPEED_PROFILE_JOIN_(a, b) a##b
+ #define LIGHTSPEED_PROFILE_JOIN(a, b) LIGHTSPEED_PROFILE_JOIN_(a, b)
+ #define PROFILE_SCOPE(name) \
+   ::lightspeed::ProfileScope LIGHTSPEED_PROFILE_JOIN(profileScope, __LINE__)( \
+     name)
+ #define PROFILE_THREAD(name) \
+   ::lightspeed::Profiler::instance().nameThread(name)
+#else
+ #define PROFILE_SCOPE(name) ((void) 0)
+ #define PROFILE_THREAD(name) ((void) 0)
+#endif
+
+namespace lightspeed {
+
+/**
+ * \brief A span of time spent in a named scope on a single thread.
+ */
+struct ProfileEvent final {
+  
+  ProfileEvent() :
+      name(NULL),
+      start(0),
+      duration(0) {
+  }
+  
+  ProfileEvent(char const* name, uint64_t start, uint64_t duration) :
+      name(name),
+      start(start),
+      duration(duration) {
+  }
+  
+  // The name must be a string literal (or otherwise live forever).
+  char const* name;
+  // In nanoseconds, since the profiler was created.
+  uint64_t start;
+  uint64_t duration;
+  
+};
+
+/**
+ * \brief The time spent in all of the scopes with the same name.
+ */
+struct ProfileSummary final {
+  
+  ProfileSummary() :
+      name(),
+      count(0),
+      total(0.0),
+      max(0.0) {
+  }
+  
+  std::string name;
+  std::size_t count;
+  // In seconds.
+  double total;
+  double max;
+  
+};
+
+/**
+ * \brief Collects the time spent in each instrumented scope, for every thread.
+ * 
+ * Each thread records into its own ring buffer, which only holds the most
+ * recent events. The buffers are only shared with whoever is exporting them,
+ * so recording never has to wait on another thread in practice.
+ * 
+ * This class cannot be copied in any way. There is a single instance of it.
+ */
+class Profiler final {
+  
+public:
+  
+  /**
+   * \brief The number of events that each thread keeps.
+   */
+  static std::size_t const BUFFER_SIZE = 16384;
+  
+  static Profiler& instance();
+  
+  Profiler(Profiler const&) = delete;
+  void operator=(Profiler const&) = delete;
+  
+  /**
+   * \brief Returns the number of nanoseconds since the profiler was created.
+   */
+  uint64_t now() const;
+  
+  void record(char const* name, uint64_t start, uint64_t end);
+  
+  /**
+   * \brief Gives the current thread a name in the trace.
+   */
+  void nameThread(char const* name);
+  
+  /**
+   * \brief Writes every event still in the buffers in the Chrome trace event
+   * format, which can be opened by chrome://tracing or Perfetto.
+   */
+  void writeChromeTrace(std::ostream& stream) const;
+  
+  /**
+   * \brief Adds up the events that ended in the last window seconds by name,
+   * with the names taking the most time first.
+   */
+  std::vector<ProfileSummary> summary(double window) const;
+  
+  /**
+   * \brief Writes the summary as a table, with the times averaged per second.
+   */
+  void writeSummary(std::ostream& stream, double window) const;
+  
+private:
+  
+  struct ThreadBuffer {
+    std::mutex mutex;
+    std::vector<ProfileEvent> events;
+    // The total number of events ever recorded, so the next event goes at
+    // this modulo the size of the buffer.
+    std::size_t recorded;
+    std::size_t thread;
+    char const* name;
+  };
+  
+  Profiler();
+  
+  ThreadBuffer& threadBuffer();
+  
+  // Copies out the events of a buffer, oldest first.
+  static void collect(
+    ThreadBuffer& buffer,
+    std::vector<ProfileEvent>& events);
+  
+  std::chrono::steady_clock::time_point m_epoch;
+  
+  // The buffers are never freed, so that the events of threads that have
+  // finished can still be exported.
+  mutable std::mutex m_mutex;
+  std::vector<std::unique_ptr<ThreadBuffer> > m_buffers;
+  
+};
+
+/**
+ * \brief Records the time from its construction to its destruction under a
+ * name. Use the PROFILE_SCOPE macro rather than this directly, so that it
+ * compiles out when profiling is disabled.
+ */
+class ProfileScope final {
+  
+public:
+  
+  explicit ProfileScope(char const* name) :
+      m_name(name),
+      m_start(Profiler::instance().now()) {
+  }
+  
+  ProfileScope(ProfileScope const&) = delete;
+  void operator=(ProfileScope const&) = delete;
+  
+  ~ProfileScope() {
+    Profiler& profiler = Profiler::instance();
+    profiler.record(m_name, m_start, profiler.now());
+  }
+  
+private:
+  
+  char const* m_name;
+  uint64_t m_start;
+  
+};
+
+}
+
+#endif
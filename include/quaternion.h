@@ -1,73 +1,191 @@
 #ifndef __LIGHTSPEED_QUATERNION_H_
 #define __LIGHTSPEED_QUATERNION_H_
 
-#include "vector.h"
+#include <cmath>
 
+#include "utility.h"
 #include "vector.h"
 
 namespace lightspeed {
 
-struct Quaternion final {
+/**
+ * \brief A quaternion with components of type T, stored as a real part and a
+ * pure (vector) part.
+ * 
+ * Quaternions that are known to have unit length (such as rotations) can use
+ * the methods ending in Unit, which skip the normalization.
+ */
+template<typename T>
+struct BasicQuaternion final {
   
-  Quaternion() :
+  constexpr BasicQuaternion() :
       pure(),
-      real(0.0) {
+      real(0) {
   }
   
-  Quaternion(double real, Vector pure) :
+  constexpr BasicQuaternion(T real, Vector3<T> pure) :
       pure(pure),
       real(real) {
   }
   
-  Quaternion operator+() const;
-  Quaternion operator-() const;
+  template<typename U>
+  constexpr explicit BasicQuaternion(BasicQuaternion<U> const& other) :
+      pure(Vector3<T>(other.pure)),
+      real(static_cast<T>(other.real)) {
+  }
+  
+  constexpr BasicQuaternion operator+() const {
+    return *this;
+  }
+  
+  constexpr BasicQuaternion operator-() const {
+    return BasicQuaternion(-real, -pure);
+  }
   
-  Quaternion& operator+=(Quaternion const& rhs);
-  Quaternion& operator-=(Quaternion const& rhs);
-  Quaternion& operator*=(Quaternion const& rhs);
-  Quaternion& operator/=(Quaternion const& rhs);
+  BasicQuaternion& operator+=(BasicQuaternion const& rhs) {
+    real += rhs.real;
+    pure += rhs.pure;
+    return *this;
+  }
   
-  Quaternion& operator*=(double rhs);
-  Quaternion& operator/=(double rhs);
+  BasicQuaternion& operator-=(BasicQuaternion const& rhs) {
+    real -= rhs.real;
+    pure -= rhs.pure;
+    return *this;
+  }
   
-  double dot(Quaternion const& rhs) const;
-  Quaternion conjugate() const;
-  Quaternion inverse() const;
-  double norm() const;
-  double normSq() const;
-  Quaternion unit() const;
+  BasicQuaternion& operator*=(BasicQuaternion const& rhs) {
+    return (*this = *this * rhs);
+  }
   
-  Vector rotate(Vector const& vec) const;
+  BasicQuaternion& operator/=(BasicQuaternion const& rhs) {
+    return (*this = *this * rhs.inverse());
+  }
   
-  Vector pure;
-  double real;
+  BasicQuaternion& operator*=(T rhs) {
+    real *= rhs;
+    pure *= rhs;
+    return *this;
+  }
+  
+  BasicQuaternion& operator/=(T rhs) {
+    real /= rhs;
+    pure /= rhs;
+    return *this;
+  }
+  
+  constexpr T dot(BasicQuaternion const& rhs) const {
+    return real * rhs.real + pure.dot(rhs.pure);
+  }
+  
+  constexpr BasicQuaternion conjugate() const {
+    return BasicQuaternion(real, -pure);
+  }
+  
+  constexpr BasicQuaternion inverse() const {
+    return BasicQuaternion(real / normSq(), -pure / normSq());
+  }
+  
+  /**
+   * \brief The inverse of a unit quaternion, which is just its conjugate.
+   */
+  constexpr BasicQuaternion inverseUnit() const {
+    return conjugate();
+  }
+  
+  T norm() const {
+    return std::sqrt(normSq());
+  }
+  
+  constexpr T normSq() const {
+    return real * real + pure.normSq();
+  }
+  
+  BasicQuaternion unit() const {
+    return *this / norm();
+  }
+  
+  /**
+   * \brief Rotates a vector by the quaternion (which doesn't need to have unit
+   * length), without going through any quaternion products.
+   */
+  constexpr Vector3<T> rotate(Vector3<T> const& vec) const {
+    return (
+      (real * real - pure.normSq()) * vec +
+      T(2) * pure.dot(vec) * pure +
+      T(2) * real * pure.cross(vec)) / normSq();
+  }
+  
+  /**
+   * \brief Rotates a vector by a unit quaternion. This is the cheapest way to
+   * apply a rotation, taking two cross products and no divisions.
+   */
+  constexpr Vector3<T> rotateUnit(Vector3<T> const& vec) const {
+    return rotateUnit(vec, T(2) * pure.cross(vec));
+  }
+  
+  Vector3<T> pure;
+  T real;
+  
+private:
+  
+  constexpr Vector3<T> rotateUnit(
+      Vector3<T> const& vec,
+      Vector3<T> const& twice) const {
+    return vec + real * twice + pure.cross(twice);
+  }
   
 };
 
-inline Quaternion operator+(Quaternion lhs, Quaternion const& rhs) {
-  return (lhs += rhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator+(
+    BasicQuaternion<T> const& lhs,
+    BasicQuaternion<T> const& rhs) {
+  return BasicQuaternion<T>(lhs.real + rhs.real, lhs.pure + rhs.pure);
 }
-inline Quaternion operator-(Quaternion lhs, Quaternion const& rhs) {
-  return (lhs -= rhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator-(
+    BasicQuaternion<T> const& lhs,
+    BasicQuaternion<T> const& rhs) {
+  return BasicQuaternion<T>(lhs.real - rhs.real, lhs.pure - rhs.pure);
 }
-inline Quaternion operator*(Quaternion lhs, Quaternion const& rhs) {
-  return (lhs *= rhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator*(
+    BasicQuaternion<T> const& lhs,
+    BasicQuaternion<T> const& rhs) {
+  return BasicQuaternion<T>(
+    lhs.real * rhs.real - lhs.pure.dot(rhs.pure),
+    lhs.real * rhs.pure + rhs.real * lhs.pure + lhs.pure.cross(rhs.pure));
 }
-inline Quaternion operator/(Quaternion lhs, Quaternion const& rhs) {
-  return (lhs /= rhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator/(
+    BasicQuaternion<T> const& lhs,
+    BasicQuaternion<T> const& rhs) {
+  return lhs * rhs.inverse();
 }
 
-inline Quaternion operator*(Quaternion lhs, double rhs) {
-  return (lhs *= rhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator*(
+    BasicQuaternion<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return BasicQuaternion<T>(lhs.real * rhs, lhs.pure * rhs);
 }
-inline Quaternion operator*(double lhs, Quaternion rhs) {
-  return (rhs *= lhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator*(
+    typename NonDeduced<T>::Type lhs,
+    BasicQuaternion<T> const& rhs) {
+  return BasicQuaternion<T>(lhs * rhs.real, lhs * rhs.pure);
 }
-inline Quaternion operator/(Quaternion lhs, double rhs) {
-  return (lhs /= rhs);
+template<typename T>
+constexpr BasicQuaternion<T> operator/(
+    BasicQuaternion<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return BasicQuaternion<T>(lhs.real / rhs, lhs.pure / rhs);
 }
 
+typedef BasicQuaternion<double> Quaternion;
+typedef BasicQuaternion<float> Quaternionf;
+
 }
 
 #endif
-
@@ -0,0 +1,292 @@
+#ifndef __LIGHTSPEED_SCENE_H_
+#define __LIGHTSPEED_SCENE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "mesh.h"
+#include "quaternion.h"
+#include "vector.h"
+#include "vertex.h"
+
+namespace lightspeed {
+
+/**
+ * \brief The layout of the records stored in a binary scene file.
+ * 
+ * A scene file starts with a header, which gives the location of four arrays:
+ * the meshes, the vertices that the meshes refer to, the entities, and the
+ * initial timeline entries of the entities. Everything is stored in the native
+ * byte order and aligned to 8 bytes, so that the arrays can be used directly
+ * from a memory mapping of the file.
+ */
+namespace scene_format {
+  
+  static char const MAGIC[8] = { 'L', 'S', 'S', 'C', 'E', 'N', 'E', '\0' };
+  static uint32_t const VERSION = 1;
+  
+  static uint32_t const NO_MESH = 0xFFFFFFFF;
+  
+  static uint32_t const FLAG_TIMELINE = 1 << 0;
+  static uint32_t const FLAG_COLLISION = 1 << 1;
+  static uint32_t const FLAG_CHARGE = 1 << 2;
+  
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t meshCount;
+    uint64_t meshOffset;
+    uint64_t vertexCount;
+    uint64_t vertexOffset;
+    uint64_t entityCount;
+    uint64_t entityOffset;
+    uint64_t sampleCount;
+    uint64_t sampleOffset;
+  };
+  
+  struct Mesh {
+    uint64_t firstVertex;
+    uint64_t vertexCount;
+  };
+  
+  struct Entity {
+    uint32_t mesh;
+    uint32_t flags;
+    double position[3];
+    // Stored as the real part followed by the pure part.
+    double rotation[4];
+    double momentum[3];
+    double timeInterval;
+    double collision[3];
+    double charge;
+    uint64_t firstSample;
+    uint64_t sampleCount;
+  };
+  
+  struct Sample {
+    // Relative to the present, so this should be zero or negative.
+    double time;
+    double position[3];
+    double rotation[4];
+    double momentum[3];
+  };
+
+}
+
+class SceneBuilder;
+
+/**
+ * \brief A scene file that has been memory mapped.
+ * 
+ * Opening a scene only maps the file and checks that the header is sensible,
+ * so it takes the same amount of time no matter how large the scene is. The
+ * meshes borrow their vertices directly from the mapping, so the Scene must
+ * stay alive for as long as any entities created from it.
+ * 
+ * This class cannot be copied in any way. It should be passed by reference or
+ * by pointer.
+ */
+class Scene final {
+  
+public:
+  
+  /**
+   * \brief Maps a scene file, throwing std::runtime_error if it can't be read
+   * or isn't a valid scene.
+   * 
+   * \param meshes The arena that the meshes of the scene are added to as they
+   * are needed. It must outlive the scene.
+   */
+  Scene(std::string fileName, MeshArena& meshes);
+  
+  /**
+   * \brief Creates a scene from a builder without going through a file, such
+   * as one that was generated when the program started. The scene is laid out
+   * in memory exactly as it would be in the file.
+   */
+  Scene(SceneBuilder const& builder, MeshArena& meshes);
+  
+  Scene(Scene const&) = delete;
+  void operator=(Scene const&) = delete;
+  ~Scene();
+  
+  std::size_t meshCount() const;
+  std::size_t entityCount() const;
+  
+  Vertex const* meshVertices(std::size_t mesh) const;
+  std::size_t meshVertexCount(std::size_t mesh) const;
+  
+  /**
+   * \brief Returns a handle to one of the meshes of the scene, which is shared
+   * by every entity that uses it.
+   */
+  Mesh mesh(std::size_t index) const;
+  
+  scene_format::Entity const& entity(std::size_t index) const;
+  scene_format::Sample const* samples(std::size_t index) const;
+  
+  /**
+   * \brief Creates the entities with indices in a range, and returns how many
+   * were created.
+   */
+  std::size_t instantiate(
+    entityx::EntityManager& entities,
+    std::size_t first,
+    std::size_t count) const;
+  
+  /**
+   * \brief Creates a single entity as it would be after some amount of time
+   * has passed since the scene started.
+   * 
+   * The scene only describes the state of the entity at the start, so it is
+   * assumed to have moved inertially since then. The timeline is seeded with
+   * the stored entries that are still recent enough, followed by the state of
+   * the entity at the start of the scene.
+   */
+  entityx::Entity instantiateEntity(
+    entityx::EntityManager& entities,
+    std::size_t index,
+    double time) const;
+  
+  /**
+   * \brief Reads through the parts of the file used by an entity, so that the
+   * pages are already in memory when it is instantiated.
+   */
+  void prefetch(std::size_t index) const;
+  
+private:
+  
+  // Finds the arrays in the data and checks that they are sensible, throwing
+  // std::runtime_error (naming the scene) if they aren't.
+  void attach(std::string const& name);
+  
+  void* m_data;
+  std::size_t m_size;
+  // Holds the data when the scene was built in memory rather than mapped. It
+  // is made of 8 byte words so that the arrays stay aligned.
+  std::vector<uint64_t> m_buffer;
+  
+  scene_format::Header const* m_header;
+  scene_format::Mesh const* m_meshes;
+  Vertex const* m_vertices;
+  scene_format::Entity const* m_entities;
+  scene_format::Sample const* m_samples;
+  
+  // Handles to the meshes are only created once they are first needed.
+  MeshArena* m_meshArena;
+  mutable std::vector<Mesh> m_meshHandles;
+  
+};
+
+/**
+ * \brief Builds up a scene in memory so that it can be written to a file.
+ */
+class SceneBuilder final {
+  
+public:
+  
+  /**
+   * \brief The description of a single entity to be added to the scene.
+   */
+  struct EntityDescription {
+    
+    EntityDescription();
+    
+    // Either an index returned by addMesh, or NO_MESH.
+    uint32_t mesh;
+    Vector position;
+    Quaternion rotation;
+    Vector momentum;
+    // A time interval of zero means that the entity has no timeline.
+    double timeInterval;
+    // A zero vector means that the entity can't collide.
+    Vector collision;
+    double charge;
+  
+  };
+  
+  uint32_t addMesh(std::vector<Vertex> const& vertices);
+  uint32_t addBoxMesh(Vector dimensions);
+  
+  void addEntity(EntityDescription const& entity);
+  
+  /**
+   * \brief Adds an entry to the timeline of the most recently added entity.
+   * Entries should be added from oldest to newest.
+   */
+  void addSample(
+    double time,
+    Vector position,
+    Quaternion rotation,
+    Vector momentum);
+  
+  std::size_t meshCount() const;
+  std::size_t entityCount() const;
+  
+  /**
+   * \brief Writes the scene to a file, throwing std::runtime_error on failure.
+   */
+  void write(std::string fileName) const;
+  
+  /**
+   * \brief Writes the scene in the file format to a stream.
+   */
+  void write(std::ostream& stream) const;
+  
+  /**
+   * \brief Writes the scene in the file format straight into a buffer of 8
+   * byte words, which is resized to fit it, and returns its size in bytes.
+   */
+  std::size_t write(std::vector<uint64_t>& buffer) const;
+  
+private:
+  
+  // Lays out the arrays of the scene in the file.
+  scene_format::Header header() const;
+  
+  std::vector<scene_format::Mesh> m_meshes;
+  std::vector<Vertex> m_vertices;
+  std::vector<scene_format::Entity> m_entities;
+  std::vector<scene_format::Sample> m_samples;
+  
+};
+
+/**
+ * \brief Reads a text description of a scene into a builder.
+ * 
+ * Each line of the description is a command followed by its arguments, and
+ * anything after a '#' is ignored. The commands are:
+ * 
+ *     box <name> <dx> <dy> <dz>
+ *     mesh <name>
+ *     vertex <x> <y> <z>
+ *     end
+ *     entity <mesh> [key=value ...]
+ *     grid <mesh> count=<nx>,<ny>,<nz> spacing=<x>,<y>,<z> [key=value ...]
+ *     sample time=<t> [position=...] [rotation=...] [momentum=...]
+ *     generate [name=value ...]
+ * 
+ * A mesh is made up of the vertex commands between mesh and end, taken three
+ * at a time as triangles. The mesh "none" gives an entity with no model. The
+ * entity keys are position, rotation (real part first), momentum, timeline
+ * (the time interval), collision (half extents) and charge, where vectors are
+ * written as comma separated numbers. For a grid, the position is that of the
+ * first entity. Samples are added to the most recent entity. The generate
+ * command adds a procedurally generated scene, with the parameters described
+ * by setGeneratorParameter.
+ * 
+ * Throws std::runtime_error with the line number if the description is
+ * invalid.
+ */
+void parseSceneDescription(std::istream& input, SceneBuilder& builder);
+
+}
+
+#endif
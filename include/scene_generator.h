@@ -0,0 +1,142 @@
+#ifndef __LIGHTSPEED_SCENE_GENERATOR_H_
+#define __LIGHTSPEED_SCENE_GENERATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "scene.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Describes a procedurally generated scene, for stress testing.
+ *
+ * Every parameter has a default, so only the ones of interest need to be
+ * given. The same parameters (including the seed) always produce the same
+ * scene, on any machine.
+ */
+struct GeneratorParameters final {
+  
+  enum class Layout {
+    // Evenly spaced through a cube.
+    GRID,
+    // Spread evenly through a cube.
+    UNIFORM,
+    // Spread over the surface of a sphere around the player.
+    SHELL,
+    // Gathered around a number of randomly placed centers.
+    CLUSTERED
+  };
+  
+  enum class Speeds {
+    // Every entity moves at the maximum speed.
+    FIXED,
+    // Speeds are spread evenly up to the maximum speed.
+    UNIFORM,
+    // Rapidities are spread evenly up to that of the maximum speed, which
+    // puts many more entities close to the speed of light.
+    RAPIDITY
+  };
+  
+  enum class Motion {
+    // Entities have always moved in straight lines.
+    INERTIAL,
+    // The history of each entity oscillates along a random axis, so that
+    // their timelines are curved.
+    OSCILLATING,
+    // Entities are given random charges, so that they accelerate each other
+    // while the scene runs.
+    CHARGED
+  };
+  
+  GeneratorParameters() :
+      seed(1),
+      entities(1000),
+      meshes(4),
+      detail(0),
+      size(0.5),
+      collision(false),
+      layout(Layout::UNIFORM),
+      extent(50.0),
+      clusters(8),
+      clearance(2.0),
+      speeds(Speeds::FIXED),
+      speed(0.0),
+      motion(Motion::INERTIAL),
+      amplitude(0.1),
+      period(2.0),
+      charge(0.1),
+      history(10.0),
+      sampleInterval(0.1) {
+  }
+  
+  uint64_t seed;
+  
+  std::size_t entities;
+  // The number of different meshes that the entities share.
+  std::size_t meshes;
+  // Zero gives boxes, and anything else gives spheres with that many
+  // segments around their equators.
+  unsigned int detail;
+  // The largest width of a mesh. The meshes range in size up to this.
+  double size;
+  bool collision;
+  
+  Layout layout;
+  // Half the width of the region that the entities are placed in.
+  double extent;
+  std::size_t clusters;
+  // No entities are placed closer than this to the player at the origin.
+  double clearance;
+  
+  Speeds speeds;
+  // As a fraction of the speed of light.
+  double speed;
+  
+  Motion motion;
+  // The oscillation reaches 2 pi amplitude / period on top of the drift,
+  // which the defaults keep under the speed of light for drifts up to about
+  // 0.68.
+  double amplitude;
+  double period;
+  double charge;
+  
+  // How far back the timelines go, and how far apart the samples that are
+  // stored in the scene for that history are. No samples are stored if the
+  // interval is zero.
+  double history;
+  double sampleInterval;
+  
+};
+
+/**
+ * \brief Sets one of the parameters by name from its text, throwing
+ * std::runtime_error if the name or the value isn't valid.
+ *
+ * The names are those of the fields, except that sampleInterval is "samples".
+ * The enumerations are written in lower case, such as "layout=shell".
+ */
+void setGeneratorParameter(
+  GeneratorParameters& parameters,
+  std::string const& name,
+  std::string const& value);
+
+/**
+ * \brief Sets parameters from a list of name=value pairs separated by commas
+ * or spaces, such as "entities=10000,speed=0.9".
+ */
+void parseGeneratorParameters(
+  std::string const& text,
+  GeneratorParameters& parameters);
+
+/**
+ * \brief Adds the meshes and entities of a generated scene to a builder.
+ */
+void generateScene(
+  GeneratorParameters const& parameters,
+  SceneBuilder& builder);
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef __LIGHTSPEED_SHADER_COUNTERS_H_
+#define __LIGHTSPEED_SHADER_COUNTERS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "internal/opengl.h"
+
+#include "memory_tracker.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Where the counters of one timeline in one view came from, so that
+ * they can be reported once they have been read back.
+ */
+struct ShaderCounterSource {
+  // The index of the counters, which is the same as that of the hint.
+  std::size_t index;
+  uint64_t entity;
+  std::size_t view;
+  // How far the entity was from the observer of the view.
+  double distance;
+};
+
+/**
+ * \brief Reads back how much work the vertex shader did to find the light
+ * cone crossing of every timeline in every view, and reports it.
+ *
+ * The counters are only compiled into the shader when they are turned on,
+ * since every vertex adds to them atomically. After each frame they are
+ * copied into one of a ring of buffers and reset, and the copy is only read
+ * once the GPU has signalled that it is done, a few frames later, so that
+ * reading them never waits for the frame to finish.
+ *
+ * Every timeline that was drawn in a frame gets a row in the CSV file, with
+ * how many vertices were drawn, how many entries they checked in all, how
+ * many found the crossing near where the last frame did, how many had to
+ * search the whole timeline, how many couldn't intersect the light cone
+ * between two entries, and a histogram of the entries checked per vertex.
+ *
+ * This class cannot be copied in any way.
+ */
+class ShaderCounters final {
+  
+public:
+  
+  /**
+   * \brief Opens the CSV file that every frame is written to.
+   *
+   * \throws std::runtime_error if the file can't be opened.
+   */
+  explicit ShaderCounters(std::string fileName);
+  ShaderCounters(ShaderCounters const&) = delete;
+  void operator=(ShaderCounters const&) = delete;
+  
+  /**
+   * \brief The line to put after the version of a shader to compile the
+   * counters into it.
+   */
+  static std::string shaderDefines();
+  
+  void initialize();
+  /**
+   * \brief Reads back every frame that is still waiting, and cleans up.
+   */
+  void finalize();
+  
+  /**
+   * \brief Makes room for the counters of a frame and binds them, before
+   * anything is drawn.
+   */
+  void begin(std::size_t counters);
+  
+  /**
+   * \brief Starts copying the counters of the frame that was just drawn, and
+   * reports any earlier frames that have finished copying.
+   */
+  void end(std::size_t frame, std::vector<ShaderCounterSource> sources);
+  
+  /**
+   * \brief Writes the entities that checked the most entries since the last
+   * summary, and starts counting again.
+   */
+  void writeSummary(std::ostream& stream, std::size_t count = 10);
+  
+private:
+  
+  // A copy of the counters of a frame that is waiting to be read back.
+  struct Readback {
+    GLuint buffer;
+    std::size_t bytes;
+    GLsync fence;
+    std::size_t frame;
+    std::vector<ShaderCounterSource> sources;
+  };
+  
+  // The counters of one entity, added up over every frame and view since the
+  // last summary, and the nearest that it came to an observer.
+  struct Totals {
+    uint64_t vertices;
+    uint64_t steps;
+    uint64_t fullSearches;
+    uint64_t discriminantFailures;
+    double distance;
+  };
+  
+  // Maps a readback that has finished copying and reports its counters.
+  void readBack(Readback& readback);
+  
+  std::ofstream m_file;
+  GLuint m_buffer;
+  std::size_t m_bytes;
+  std::vector<Readback> m_readbacks;
+  std::size_t m_next;
+  std::vector<GLuint> m_values;
+  
+  std::unordered_map<uint64_t, Totals> m_totals;
+  std::size_t m_stalls;
+  
+  MemoryCounter& m_memory;
+  
+};
+
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include <entityx/entityx.h>
 
+#include "event/event_batch.h"
 #include "event/relativistic_update_event.h"
 
 namespace lightspeed {
@@ -21,7 +22,7 @@ public:
     entityx::EventManager& events,
     entityx::TimeDelta delta) override;
   
-  void receive(RelativisticUpdateEvent const& event);
+  void receive(EventBatch<RelativisticUpdateEvent> const& batch);
   
 private:
   
@@ -0,0 +1,87 @@
+#ifndef __LIGHTSPEED_CAPTURE_SYSTEM_H_
+#define __LIGHTSPEED_CAPTURE_SYSTEM_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "internal/opengl.h"
+
+#include "event/finalize_event.h"
+#include "event/initialize_event.h"
+#include "event/render_event.h"
+
+#include "frame_writer.h"
+#include "memory_tracker.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Records every frame that is drawn to a sequence of image files.
+ *
+ * Each frame is read back into one of a ring of pixel buffers, which the GPU
+ * fills in while it goes on with the next frames. A buffer is only mapped when
+ * it comes around again a few frames later, by which point the copy has
+ * finished, so reading it never waits for the GPU. The pixels are then handed
+ * to a FrameWriter to be encoded and written on background threads.
+ *
+ * It has to be added after the RenderSystem, so that it receives each render
+ * event after the frame has been drawn.
+ */
+class CaptureSystem final : public entityx::System<CaptureSystem>,
+                            public entityx::Receiver<CaptureSystem> {
+                              
+public:
+  
+  /**
+   * \param prefix Put in front of the number of each frame to get its file
+   * name.
+   */
+  CaptureSystem(std::string prefix, FrameFormat format);
+  CaptureSystem(CaptureSystem const&) = delete;
+  void operator=(CaptureSystem const&) = delete;
+  
+  void configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) override;
+  
+  void update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) override;
+  
+  void receive(InitializeEvent const& event);
+  void receive(FinalizeEvent const& event);
+  void receive(RenderEvent const& event);
+  
+private:
+  
+  // A pixel buffer that a frame has been read back into, if it is pending.
+  struct CaptureBuffer {
+    GLuint buffer;
+    std::size_t bytes;
+    std::size_t width;
+    std::size_t height;
+    bool pending;
+  };
+  
+  // Maps a pending buffer and passes its frame to the writer.
+  void readBack(CaptureBuffer& capture);
+  
+  std::string m_prefix;
+  FrameFormat m_format;
+  // Stopped if a frame couldn't be written, so that the rest are dropped.
+  std::unique_ptr<FrameWriter> m_writer;
+  std::vector<CaptureBuffer> m_buffers;
+  std::size_t m_frame;
+  
+  MemoryCounter& m_memory;
+  
+};
+
+}
+
+#endif
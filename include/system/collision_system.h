@@ -0,0 +1,83 @@
+#ifndef __LIGHTSPEED_COLLISION_SYSTEM_H_
+#define __LIGHTSPEED_COLLISION_SYSTEM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/collision_component.h"
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Finds bodies whose collision volumes overlap and emits a
+ * CollisionEvent for each pair.
+ * 
+ * Overlaps are found at a single moment of time in the resting frame. The
+ * broadphase sorts the bodies along one axis (sweep and prune), keeping the
+ * order from the last update so that re-sorting is cheap when bodies move
+ * coherently. Pairs that overlap along every axis are then tested exactly,
+ * using the length contracted shape of each body.
+ */
+class CollisionSystem final : public entityx::System<CollisionSystem>,
+                              public entityx::Receiver<CollisionSystem> {
+  
+public:
+  
+  CollisionSystem() :
+      m_axis(0) {
+  }
+  
+  void configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) override;
+  
+  void update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) override;
+  
+  void receive(
+    entityx::ComponentAddedEvent<CollisionComponent> const& event);
+  void receive(
+    entityx::ComponentRemovedEvent<CollisionComponent> const& event);
+  
+private:
+  
+  // The shape of a body at the current time. The box is stored as its center
+  // and three edge vectors (from the center to the middle of a face), which
+  // can describe any rotated and contracted box.
+  struct Proxy {
+    entityx::Entity entity;
+    bool active;
+    Vector center;
+    Vector edges[3];
+  };
+  
+  // The bounding box of a proxy. These are kept separate from the proxies and
+  // sorted along the sweep axis, so that the sweep only has to go through a
+  // small amount of memory.
+  struct SweepEntry {
+    double min[3];
+    double max[3];
+    std::size_t proxy;
+  };
+  
+  entityx::EntityManager* m_entities;
+  entityx::EventManager* m_events;
+  
+  std::vector<Proxy> m_proxies;
+  std::vector<SweepEntry> m_sweep;
+  std::unordered_set<uint64_t> m_removed;
+  int m_axis;
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef __LIGHTSPEED_INTERACTION_SYSTEM_H_
+#define __LIGHTSPEED_INTERACTION_SYSTEM_H_
+
+#include <cstddef>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/timeline_component.h"
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Calculates the fields that charged bodies produce at each other's
+ * positions, taking into account the time it takes for the fields to travel.
+ * 
+ * The field of each body is the Lienard-Wiechert field (without the radiation
+ * term) of the body at its retarded position, which is found from its
+ * timeline. To avoid comparing every pair of bodies, the sources are put into
+ * an octree, and any node that appears small enough from the receiver is
+ * treated as a pair of uniformly moving pseudo-bodies (one for the positive
+ * charges in it and one for the negative charges). The opening angle controls
+ * how small a node has to appear, and an angle of zero gives the exact result.
+ * 
+ * The fields are stored in the FieldComponent of each charged body, and should
+ * be calculated before the bodies are moved. The acceleration system turns them
+ * into a force on any charged body that also has an AccelerationComponent.
+ */
+class InteractionSystem final : public entityx::System<InteractionSystem> {
+  
+public:
+  
+  /**
+   * \param coupling The strength of the interaction. A negative coupling makes
+   * like charges attract.
+   * \param openingAngle The largest size of a node divided by its distance for
+   * the node to be approximated.
+   * \param softening A length added to all distances so that the field stays
+   * finite when bodies pass through each other.
+   */
+  InteractionSystem(
+      double coupling = 1.0,
+      double openingAngle = 0.5,
+      double softening = 0.01) :
+      m_coupling(coupling),
+      m_openingAngle(openingAngle),
+      m_softening(softening) {
+  }
+  
+  void update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) override;
+  
+  void setOpeningAngle(double openingAngle) {
+    m_openingAngle = openingAngle;
+  }
+  
+  double openingAngle() const {
+    return m_openingAngle;
+  }
+  
+private:
+  
+  // A body that produces a field.
+  struct Source {
+    entityx::Entity entity;
+    double charge;
+    Vector position;
+    Vector velocity;
+    TimelineComponent<BodyComponent> const* timeline;
+  };
+  
+  // The charge in part of a node, treated as if it were a single body moving
+  // uniformly.
+  struct Aggregate {
+    double charge;
+    Vector position;
+    Vector velocity;
+  };
+  
+  struct Node {
+    Vector center;
+    double halfSize;
+    int children[8];
+    std::size_t first;
+    std::size_t count;
+    Aggregate positive;
+    Aggregate negative;
+  };
+  
+  int buildNode(
+    Vector center,
+    double halfSize,
+    std::size_t first,
+    std::size_t count,
+    unsigned int depth);
+  void addSourceField(
+    Source const& source,
+    Vector const& position,
+    Vector& electric,
+    Vector& magnetic) const;
+  void addUniformField(
+    Aggregate const& aggregate,
+    Vector const& position,
+    Vector& electric,
+    Vector& magnetic) const;
+  void addField(
+    double charge,
+    Vector const& retardedPosition,
+    Vector const& velocity,
+    Vector const& position,
+    Vector& electric,
+    Vector& magnetic) const;
+  
+  double m_coupling;
+  double m_openingAngle;
+  double m_softening;
+  
+  std::vector<Source> m_sources;
+  std::vector<std::size_t> m_order;
+  std::vector<Node> m_nodes;
+  
+};
+
+}
+
+#endif
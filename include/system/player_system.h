@@ -3,8 +3,8 @@
 
 #include <entityx/entityx.h>
 
+#include "event/event_batch.h"
 #include "event/keyboard_event.h"
-#include "event/mouse_button_event.h"
 #include "event/mouse_position_event.h"
 
 namespace lightspeed {
@@ -28,9 +28,10 @@ public:
     entityx::EventManager& events,
     entityx::TimeDelta delta) override;
   
-  void receive(KeyboardEvent const& event);
-  void receive(MouseButtonEvent const& event);
-  void receive(MousePositionEvent const& event);
+  // The input arrives in batches once per frame, so that every event in a
+  // batch is handled in a single pass over the players.
+  void receive(EventBatch<KeyboardEvent> const& batch);
+  void receive(EventBatch<MousePositionEvent> const& batch);
   
 private:
   
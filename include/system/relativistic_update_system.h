@@ -3,8 +3,14 @@
 
 #include <entityx/entityx.h>
 
+#include "event_queue.h"
+
 namespace lightspeed {
 
+/**
+ * \brief Works out how much time has passed for every player, and sends it to
+ * the systems that move the world forward as a single batch of updates.
+ */
 class RelativisticUpdateSystem final :
     public entityx::System<RelativisticUpdateSystem> {
   
@@ -15,6 +21,10 @@ public:
     entityx::EventManager& events,
     entityx::TimeDelta delta) override;
   
+private:
+  
+  EventQueue m_updates;
+  
 };
 
 }
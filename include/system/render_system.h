@@ -1,13 +1,17 @@
 #ifndef __LIGHTSPEED_RENDER_SYSTEM_H_
 #define __LIGHTSPEED_RENDER_SYSTEM_H_
 
+#include <cstddef>
 #include <unordered_map>
+#include <vector>
 
 #include <entityx/entityx.h>
 
 #include "internal/opengl.h"
 
 #include "component/body_component.h"
+#include "component/camera_component.h"
+#include "component/deformation_component.h"
 #include "component/model_component.h"
 #include "component/timeline_component.h"
 
@@ -15,13 +19,73 @@
 #include "event/initialize_event.h"
 #include "event/render_event.h"
 
+#include "system/worldline_system.h"
+
+#include "memory_tracker.h"
+#include "mesh.h"
+#include "shader_counters.h"
+#include "vector.h"
+
 namespace lightspeed {
 
+/**
+ * \brief Draws the scene as seen by every entity with a camera component.
+ * 
+ * Each camera draws to its own viewport. The timelines and meshes are only
+ * uploaded once per frame however many cameras there are, and when the GPU
+ * can choose the viewport from the vertex shader, every view of an entity is
+ * drawn with a single instanced draw call.
+ * 
+ * Adding and removing components never calls into OpenGL directly. New meshes
+ * are uploaded together on the next frame, and the buffers of removed
+ * timelines are kept in a pool to be reused by the next timelines, so that
+ * spawning and despawning many entities at once stays cheap.
+ * 
+ * With occlusion culling, the depth of each frame is reduced into a pyramid
+ * where every texel holds the farthest depth beneath it. On the next frame a
+ * compute shader tests a sphere around where each entity appears to be
+ * against the pyramid, and writes the indirect draw command of each entity
+ * with no instances if it is hidden, so that none of its vertices are shaded.
+ * Entities that come out from behind others show up a frame late.
+ */
 class RenderSystem final : public entityx::System<RenderSystem>,
                            public entityx::Receiver<RenderSystem> {
-  
+                             
 public:
   
+  /**
+   * \param worldlines If provided, it is used to skip entities that can't be
+   * seen by any camera. Otherwise every entity is drawn.
+   * \param occlusionCulling Whether to skip entities hidden behind others.
+   * \param counters If provided, the shaders are compiled with counters of
+   * how much work they do, which are read back into it after every frame.
+   */
+  RenderSystem(
+      WorldlineSystem const* worldlines = nullptr,
+      bool occlusionCulling = true,
+      ShaderCounters* counters = nullptr) :
+      m_worldlines(worldlines),
+      m_counters(counters),
+      m_frame(0),
+      m_origin(),
+      m_hintSlots(0),
+      m_hintCapacity(0),
+      m_hintViews(0),
+      m_multiViewport(false),
+      m_maxViewports(1),
+      m_occlusionCulling(occlusionCulling),
+      m_targetWidth(0),
+      m_targetHeight(0),
+      m_hiZLevels(0),
+      m_hiZValid(false),
+      m_cullBytes(0),
+      m_meshMemory(MemoryTracker::instance().counter("GPU mesh buffers")),
+      m_timelineMemory(
+        MemoryTracker::instance().counter("GPU timeline buffers")),
+      m_occlusionMemory(
+        MemoryTracker::instance().counter("GPU occlusion buffers")) {
+  }
+  
   void configure(
     entityx::EntityManager& entities,
     entityx::EventManager& events) override;
@@ -50,10 +114,155 @@ private:
   entityx::EntityManager* m_entities;
   entityx::EventManager* m_events;
   
-  std::unordered_map<ModelComponent const*, GLuint> m_vertexBuffers;
+  WorldlineSystem const* m_worldlines;
+  ShaderCounters* m_counters;
+  
+  // A vertex buffer shared by every model with the same mesh. The handle keeps
+  // the mesh alive for as long as the buffer exists, since its vertices are
+  // discarded once they have been uploaded.
+  struct MeshBuffer {
+    Mesh mesh;
+    GLuint buffer;
+    std::size_t models;
+  };
+  
+  // A shader storage buffer that the timeline of a single entity is uploaded
+  // to on every frame, taken from the pool when it is first uploaded. The
+  // frame is the last one it was uploaded in, so that it is only uploaded once
+  // no matter how many views it is in. The hint slot is where the search for
+  // the light cone crossing of each view starts from. The positions in the
+  // buffer are relative to the origin. If the entity is deformed, the weights
+  // of its morph targets at each entry go in a second buffer, which is only
+  // taken once it is needed.
+  struct TimelineBuffer {
+    GLuint buffer;
+    std::size_t bytes;
+    std::size_t frame;
+    std::size_t hintSlot;
+    Vector origin;
+    GLuint weightBuffer;
+    std::size_t weightBytes;
+  };
+  
+  // One of the cameras, and the entities that it might be able to see.
+  struct View {
+    CameraComponent camera;
+    BodyComponent body;
+    std::vector<entityx::Entity> visible;
+  };
+  
+  // Uploads the timeline of an entity if it hasn't been already this frame,
+  // and adds it to the draw list. When culling, the entity is drawn with one
+  // of the commands written by the culling pass.
+  void upload(entityx::Entity entity);
+  void draw(entityx::Entity entity, std::size_t views, std::size_t command);
+  
+  // Uploads a mesh if no other model is using it yet, or otherwise counts one
+  // more model using it. Releasing it counts one less, and the buffer is
+  // cleaned up on the next update once nothing uses the mesh.
+  void acquireMesh(Mesh const& mesh);
+  void releaseMesh(Mesh const& mesh);
+  
+  // Makes sure that the hint buffer has room for every slot in every view,
+  // forgetting the hints if it has to be laid out again.
+  void reserveHints();
+  
+  // Uploads the meshes added since the last frame, and clears the hints of
+  // reused slots, a whole run of slots at a time.
+  void flushPending();
+  
+  // A buffer given back to the pool, and the size of the storage it still
+  // holds. Taking one generates a whole block of new buffers if the pool is
+  // empty.
+  struct PooledBuffer {
+    GLuint buffer;
+    std::size_t bytes;
+  };
+  PooledBuffer takeBuffer();
+  void giveBuffer(GLuint buffer, std::size_t bytes);
+  
+  // Makes the framebuffer and the depth pyramid the size of the window. The
+  // pyramid can't be used until it has been built again.
+  void resizeTargets(int width, int height);
+  // Writes an indirect draw command for every draw that is about to be made,
+  // in the same order, with no instances if the entity is hidden in every
+  // view that it would be drawn to.
+  void cull(RenderEvent const& event, bool multiViewport);
+  // Reduces the depth of the frame that was just drawn into the pyramid, for
+  // culling the next frame.
+  void buildHiZ();
+  
+  std::unordered_map<std::size_t, MeshBuffer> m_meshBuffers;
+  // The meshes whose buffers haven't been uploaded yet.
+  std::vector<std::size_t> m_pendingMeshes;
+  std::vector<PooledBuffer> m_bufferPool;
   std::unordered_map<
-    TimelineComponent<BodyComponent> const*, GLuint> m_timelineBuffers;
+    TimelineComponent<BodyComponent> const*, TimelineBuffer> m_timelineBuffers;
+  // Reused for packing every timeline, so that drawing doesn't allocate.
+  std::vector<GLfloat> m_timelineData;
+  std::vector<GLfloat> m_weightData;
+  
+  // The views are kept between frames so that their lists can be reused.
+  std::vector<View> m_views;
+  std::vector<GLfloat> m_viewData;
+  GLuint m_viewBuffer;
+  // Every entity that is visible in at least one view.
+  std::vector<entityx::Entity> m_drawList;
+  std::size_t m_frame;
+  // Where the first view is this frame. Everything is drawn relative to it, so
+  // that only small positions are handled by the GPU.
+  Vector m_origin;
+  
+  // Where the light cone crossing of each timeline was found in each view on
+  // the last frame, counted back from the newest entry, so that the shader
+  // only has to search near there. Each timeline has a slot of one hint per
+  // view, and the slots of removed timelines are reused.
+  GLuint m_hintBuffer;
+  std::size_t m_hintSlots;
+  std::size_t m_hintCapacity;
+  std::size_t m_hintViews;
+  std::vector<std::size_t> m_freeHintSlots;
+  // Slots that have been reused since the last frame, whose old hints have to
+  // be cleared before anything is drawn.
+  std::vector<std::size_t> m_staleHintSlots;
+  
+  // Whether every view can be drawn at once, by choosing the viewport in the
+  // vertex shader.
+  bool m_multiViewport;
+  GLint m_maxViewports;
+  
+  // The scene is drawn to its own framebuffer when culling, so that its depth
+  // can be read back by the GPU, and then copied to the window.
+  bool m_occlusionCulling;
+  GLuint m_framebuffer;
+  GLuint m_colorBuffer;
+  GLuint m_depthTexture;
+  GLuint m_hiZTexture;
+  int m_targetWidth;
+  int m_targetHeight;
+  GLint m_hiZLevels;
+  // Whether the pyramid holds the depth of the last frame.
+  bool m_hiZValid;
+  
+  // What the culling pass reads: the vertex count, first view, view count and
+  // first sphere of each draw, a sphere around each entity in each view it is
+  // drawn to, and the viewport of each view in pixels. It writes the commands.
+  GLuint m_cullDrawBuffer;
+  GLuint m_sphereBuffer;
+  GLuint m_viewportBuffer;
+  GLuint m_commandBuffer;
+  std::vector<GLuint> m_cullDraws;
+  std::vector<GLfloat> m_sphereData;
+  std::vector<GLfloat> m_viewportData;
+  std::size_t m_cullBytes;
+  
+  // The sizes of all of the buffers on the GPU.
+  MemoryCounter& m_meshMemory;
+  MemoryCounter& m_timelineMemory;
+  MemoryCounter& m_occlusionMemory;
   GLuint m_renderRelativisticShader;
+  GLuint m_hiZBuildShader;
+  GLuint m_hiZCullShader;
   
 };
 
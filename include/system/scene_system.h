@@ -0,0 +1,57 @@
+#ifndef __LIGHTSPEED_SCENE_SYSTEM_H_
+#define __LIGHTSPEED_SCENE_SYSTEM_H_
+
+#include <cstddef>
+#include <memory>
+
+#include <entityx/entityx.h>
+
+#include "scene.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Creates the entities of a scene file a chunk at a time, so that a
+ * large scene doesn't stall the first frame.
+ * 
+ * The system keeps the scene alive, since the models of the entities refer to
+ * meshes inside of it.
+ */
+class SceneSystem final : public entityx::System<SceneSystem> {
+  
+public:
+  
+  SceneSystem(
+    std::shared_ptr<Scene const> scene,
+    std::size_t chunkSize = 1024);
+  
+  void configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) override;
+  
+  void update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) override;
+  
+  /**
+   * \brief Returns whether every entity in the scene has been created.
+   */
+  bool done() const;
+  
+  std::shared_ptr<Scene const> scene() const;
+  
+private:
+  
+  entityx::EntityManager* m_entities;
+  entityx::EventManager* m_events;
+  
+  std::shared_ptr<Scene const> m_scene;
+  std::size_t m_chunkSize;
+  std::size_t m_next;
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef __LIGHTSPEED_STREAMING_SYSTEM_H_
+#define __LIGHTSPEED_STREAMING_SYSTEM_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "event/event_batch.h"
+#include "event/relativistic_update_event.h"
+
+#include "scene.h"
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Keeps only the parts of a scene that the player could see in memory.
+ * 
+ * The entities of the scene are divided into cells by their starting position.
+ * A cell is loaded once the worldtube swept out by its entities comes within
+ * the render distance along the past light cone of the player, and unloaded
+ * once it moves back out (with some slack so that cells on the boundary don't
+ * flicker in and out). Loaded cells are created as if their entities had moved
+ * inertially since the scene started.
+ * 
+ * Deciding which cells are needed and reading them in from the scene file is
+ * done on a background thread. Only creating and destroying the entities is
+ * left to the update, since the entity manager and OpenGL can only be used
+ * from the main thread, and at most a fixed number of entities are created
+ * per update.
+ */
+class StreamingSystem final : public entityx::System<StreamingSystem>,
+                              public entityx::Receiver<StreamingSystem> {
+                                
+public:
+  
+  /**
+   * \param cellSize The width of each cell.
+   * \param renderDistance How far back along the past light cone of the
+   * player entities are loaded.
+   * \param budget The largest number of entities created in a single update.
+   */
+  StreamingSystem(
+    std::shared_ptr<Scene const> scene,
+    double cellSize = 16.0,
+    double renderDistance = 100.0,
+    std::size_t budget = 1024);
+  StreamingSystem(StreamingSystem const&) = delete;
+  void operator=(StreamingSystem const&) = delete;
+  ~StreamingSystem();
+  
+  void configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) override;
+  
+  void update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) override;
+  
+  void receive(EventBatch<RelativisticUpdateEvent> const& batch);
+  
+  /**
+   * \brief Returns the number of cells that the scene was divided into, or
+   * zero if the background thread hasn't finished dividing it yet.
+   */
+  std::size_t cellCount() const;
+  
+  /**
+   * \brief Returns the number of cells whose entities currently exist.
+   */
+  std::size_t loadedCellCount() const;
+  
+  /**
+   * \brief Waits until the background thread has divided up the scene and
+   * answered the most recent update.
+   * 
+   * Normally the updates never wait, so how quickly entities are loaded
+   * depends on how fast the updates are compared to the background thread.
+   * Calling this after every update makes the loading the same on every run,
+   * which is useful when the simulation isn't running in real time.
+   */
+  void synchronize() const;
+  
+  double time() const {
+    return m_time;
+  }
+  
+private:
+  
+  // A group of entities that are close together at the start of the scene.
+  struct Cell {
+    std::vector<std::size_t> entities;
+    Vector min;
+    Vector max;
+    // The fastest that any entity in the cell moves.
+    double speed;
+    // The largest distance from the center of an entity to its surface.
+    double radius;
+  };
+  
+  // An instruction from the background thread to the update, which are
+  // carried out in the order they were given.
+  struct Command {
+    std::size_t cell;
+    bool load;
+    // How many of the entities of the cell have been created so far.
+    std::size_t progress;
+  };
+  
+  void run();
+  void partition();
+  bool inRange(
+    Cell const& cell,
+    Vector position,
+    double time,
+    double slack) const;
+  
+  entityx::EntityManager* m_entities;
+  entityx::EventManager* m_events;
+  
+  std::shared_ptr<Scene const> m_scene;
+  double m_cellSize;
+  double m_renderDistance;
+  std::size_t m_budget;
+  double m_time;
+  
+  // The cells are filled in by the background thread before it sends any
+  // commands, and don't change afterwards. Only the background thread keeps
+  // track of which of them should be resident.
+  std::vector<Cell> m_cells;
+  std::vector<bool> m_resident;
+  
+  // Only touched by the update.
+  std::unordered_map<std::size_t, std::vector<entityx::Entity> > m_loaded;
+  std::deque<Command> m_pending;
+  
+  // Shared between the two threads, and protected by the mutex.
+  mutable std::mutex m_mutex;
+  mutable std::condition_variable m_condition;
+  std::deque<Command> m_commands;
+  bool m_requested;
+  Vector m_requestPosition;
+  double m_requestTime;
+  bool m_stopping;
+  bool m_partitioned;
+  std::size_t m_cellCount;
+  // Counts the requests made by the updates, and the last one that the
+  // background thread has finished with.
+  std::size_t m_requestSerial;
+  std::size_t m_answeredSerial;
+  
+  std::thread m_thread;
+  
+};
+
+}
+
+#endif
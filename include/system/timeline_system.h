@@ -1,14 +1,18 @@
 #ifndef __LIGHTSPEED_TIMELINE_SYSTEM_H_
 #define __LIGHTSPEED_TIMELINE_SYSTEM_H_
 
+#include <algorithm>
 #include <utility>
 
 #include <entityx/entityx.h>
 
 #include "component/timeline_component.h"
 
+#include "event/event_batch.h"
 #include "event/relativistic_update_event.h"
 
+#include "profiler.h"
+
 namespace lightspeed {
 
 template<typename T>
@@ -17,6 +21,17 @@ class TimelineSystem final : public entityx::System<TimelineSystem<T> >,
   
 public:
   
+  /**
+   * \brief Creates the system, with the sample interval that is used by any
+   * timeline that doesn't have its own. An interval of zero adds an entry to
+   * those timelines on every update, whatever the frame rate.
+   */
+  explicit TimelineSystem(double sampleInterval = 0.0) :
+      m_entities(nullptr),
+      m_events(nullptr),
+      m_sampleInterval(sampleInterval) {
+  }
+  
   void configure(
       entityx::EntityManager& entities,
       entityx::EventManager& events) override {
@@ -24,25 +39,45 @@ public:
     m_entities = &entities;
     m_events = &events;
     
-    events.subscribe<RelativisticUpdateEvent>(*this);
+    events.subscribe<EventBatch<RelativisticUpdateEvent> >(*this);
   }
   
-  void receive(RelativisticUpdateEvent const& event) {
+  void receive(EventBatch<RelativisticUpdateEvent> const& batch) {
+    
+    PROFILE_SCOPE("TimelineSystem::receive");
     
     // For each entity with a timeline component, add the current value into the
     // timeline so that it can be retrieved later. If there are any values in
-    // the timeline that are older than should be stored, remove them.
+    // the timeline that are older than should be stored, remove them. Only the
+    // value after the whole batch is known, so the batch is added as a single
+    // step rather than recording that value at the times in between.
+    double deltaPrime = 0.0;
+    for (RelativisticUpdateEvent const& event : batch.events) {
+      deltaPrime += event.deltaPrime;
+    }
+    double sampleInterval = m_sampleInterval;
     m_entities->each<TimelineComponent<T>, T>(
-      [event](entityx::Entity entity, TimelineComponent<T>& timeline, T value) {
+      [deltaPrime, sampleInterval](
+          entityx::Entity entity,
+          TimelineComponent<T>& timeline,
+          T value) {
+        
+        if (timeline.sampleInterval <= 0.0) {
+          timeline.sampleInterval = sampleInterval;
+        }
+        if (timeline.sampleInterval > 0.0) {
+          appendSample(timeline, value, deltaPrime);
+          return;
+        }
         
         // Add the new entry to the timeline.
-        timeline.timeline.push_back(std::make_pair(event.deltaPrime, value));
+        timeline.timeline.push_back(std::make_pair(deltaPrime, value));
         
         // Shift the old entries backwards in time, and cull any of the entries
         // that are older than a certain amount.
         unsigned int i = timeline.timeline.size() - 1;
         do {
-          timeline.timeline[i].first -= event.deltaPrime;
+          timeline.timeline[i].first -= deltaPrime;
           if (timeline.timeline[i].first < -timeline.timeInterval) {
             timeline.timeline.pop_front();
           }
@@ -58,8 +93,73 @@ public:
   
 private:
   
+  /**
+   * \brief Advances a timeline on a sampling grid by an amount of proper
+   * time. Samples are interpolated between the last known value and the new
+   * one at every grid point that has been passed, so the grid is the same
+   * whether the updates are short or long. This needs an interpolate()
+   * function for T, like the one for BodyComponent.
+   */
+  static void appendSample(
+      TimelineComponent<T>& timeline,
+      T const& value,
+      double delta) {
+    auto& entries = timeline.timeline;
+    double interval = timeline.sampleInterval;
+    if (entries.empty()) {
+      entries.push_back(std::make_pair(0.0, value));
+      timeline.hasCurrent = false;
+      return;
+    }
+    
+    // The last known value is the starting point of the interpolation. If it
+    // wasn't a grid sample it only stood in for the current value, which is
+    // replaced now.
+    typename TimelineComponent<T>::Entry previous = entries.back();
+    if (timeline.hasCurrent) {
+      entries.pop_back();
+    }
+    for (auto& entry : entries) {
+      entry.first -= delta;
+    }
+    previous.first -= delta;
+    if (entries.empty()) {
+      entries.push_back(previous);
+    }
+    
+    // The grid point after the newest sample can be found directly, so there
+    // is no searching involved however many points have been passed.
+    double next = entries.back().first + interval;
+    while (next <= 0.0) {
+      double fraction = (previous.first < 0.0) ?
+        (next - previous.first) / -previous.first :
+        1.0;
+      fraction = std::min(std::max(fraction, 0.0), 1.0);
+      entries.push_back(
+        std::make_pair(next, interpolate(previous.second, value, fraction)));
+      next += interval;
+    }
+    
+    // Keep the current value at the end unless it lies on the grid, so that
+    // the newest position of the entity can always be seen.
+    timeline.hasCurrent = (entries.back().first < 0.0);
+    if (timeline.hasCurrent) {
+      entries.push_back(std::make_pair(0.0, value));
+    }
+    
+    while (!entries.empty() && entries.front().first < -timeline.timeInterval) {
+      entries.pop_front();
+    }
+    // If the interval is longer than the history, only the current value can
+    // be left, and the grid starts again from it.
+    if (entries.size() == 1 && timeline.hasCurrent) {
+      timeline.hasCurrent = false;
+    }
+  }
+  
   entityx::EntityManager* m_entities;
   entityx::EventManager* m_events;
+  double m_sampleInterval;
   
 };
 
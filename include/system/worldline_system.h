@@ -0,0 +1,120 @@
+#ifndef __LIGHTSPEED_WORLDLINE_SYSTEM_H_
+#define __LIGHTSPEED_WORLDLINE_SYSTEM_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/camera_component.h"
+#include "component/timeline_component.h"
+
+#include "event/event_batch.h"
+#include "event/mouse_button_event.h"
+#include "event/relativistic_update_event.h"
+
+#include "worldline_tree.h"
+
+namespace lightspeed {
+
+/**
+ * \brief Keeps a WorldlineTree up to date with the timelines of every entity,
+ * so that the entities an observer could see can be found quickly.
+ * 
+ * Times in the tree are measured from when the system started, rather than
+ * relative to the present like the timelines themselves. Clicking the mouse
+ * picks the entity in the center of the view and emits a PickEvent. Clicks
+ * within the same frame are merged into one pick.
+ */
+class WorldlineSystem final : public entityx::System<WorldlineSystem>,
+                              public entityx::Receiver<WorldlineSystem> {
+  
+public:
+  
+  /**
+   * \param holdOldestSample Whether entities should be treated as having been
+   * at their oldest timeline entry for all earlier times. This matches how the
+   * renderer draws entities whose light hasn't reached the observer yet.
+   */
+  WorldlineSystem(bool holdOldestSample = true) :
+      m_holdOldestSample(holdOldestSample),
+      m_time(0.0) {
+  }
+  
+  void configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) override;
+  
+  void update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) override;
+  
+  void receive(EventBatch<RelativisticUpdateEvent> const& batch);
+  void receive(EventBatch<MouseButtonEvent> const& batch);
+  
+  void receive(
+    entityx::ComponentRemovedEvent<
+      TimelineComponent<BodyComponent> > const& event);
+  
+  /**
+   * \brief Finds every entity that could appear within the view of a camera.
+   */
+  void queryVisible(
+    BodyComponent const& observer,
+    CameraComponent const& camera,
+    std::vector<entityx::Entity>& result) const;
+  
+  /**
+   * \brief Finds the entity seen by an observer in a direction (relative to
+   * the observer's rotation).
+   */
+  bool pick(
+    BodyComponent const& observer,
+    Vector const& direction,
+    double distance,
+    entityx::Entity& hit,
+    double& hitDistance) const;
+  
+  WorldlineTree const& tree() const {
+    return m_tree;
+  }
+  
+  double time() const {
+    return m_time;
+  }
+  
+private:
+  
+  // The tight bounds of an entity, along with what is needed to keep them up
+  // to date without going through the whole timeline each time.
+  struct Worldtube {
+    WorldtubeBounds bounds;
+    double radius;
+    double lastTime;
+    std::size_t lastSize;
+    std::size_t culled;
+  };
+  
+  void rebuild(
+    entityx::Entity entity,
+    TimelineComponent<BodyComponent> const& timeline,
+    Worldtube& worldtube) const;
+  
+  entityx::EntityManager* m_entities;
+  entityx::EventManager* m_events;
+  
+  bool m_holdOldestSample;
+  double m_time;
+  
+  WorldlineTree m_tree;
+  std::unordered_map<uint64_t, Worldtube> m_worldtubes;
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef __LIGHTSPEED_THREAD_POOL_H_
+#define __LIGHTSPEED_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lightspeed {
+
+/**
+ * \brief A fixed set of worker threads that split up loops between them.
+ * 
+ * The threads are started once and wait between jobs, so a job can be run
+ * many times (such as once per frame) without creating threads each time. The
+ * calling thread works on the job as well. This class cannot be copied in any
+ * way.
+ */
+class ThreadPool final {
+  
+public:
+  
+  /**
+   * \param threads The number of threads to run jobs on, including the one
+   * that calls parallelFor. Zero uses one per core.
+   */
+  explicit ThreadPool(std::size_t threads = 0);
+  ThreadPool(ThreadPool const&) = delete;
+  void operator=(ThreadPool const&) = delete;
+  ~ThreadPool();
+  
+  /**
+   * \brief Returns the number of threads that jobs are run on.
+   */
+  std::size_t size() const;
+  
+  /**
+   * \brief Calls a function with every index from zero up to a count, spread
+   * over the threads in no particular order, and returns once every call has
+   * finished. The function is called with the index and the thread (from
+   * zero up to the size of the pool) that it is running on.
+   * 
+   * Only one job can run at a time, so this must not be called from inside a
+   * job or from several threads at once.
+   */
+  void parallelFor(
+    std::size_t count,
+    std::function<void(std::size_t, std::size_t)> const& job);
+  
+private:
+  
+  void run(std::size_t thread);
+  void work(std::size_t thread);
+  
+  std::vector<std::thread> m_threads;
+  
+  // The job being run, which the workers take indices from until they run
+  // out. The generation tells the workers that a new job has started.
+  std::function<void(std::size_t, std::size_t)> const* m_job;
+  std::size_t m_count;
+  std::atomic<std::size_t> m_next;
+  
+  // Shared between the threads, and protected by the mutex.
+  std::mutex m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_finish;
+  std::size_t m_generation;
+  std::size_t m_busy;
+  bool m_stop;
+  
+};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __LIGHTSPEED_TIMELINE_PACKING_H_
+#define __LIGHTSPEED_TIMELINE_PACKING_H_
+
+#include <cstddef>
+#include <vector>
+
+#include "component/body_component.h"
+#include "component/deformation_component.h"
+#include "component/timeline_component.h"
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief The number of floats that each timeline entry is packed into.
+ */
+static constexpr std::size_t TIMELINE_ENTRY_FLOATS = 12;
+
+/**
+ * \brief The width of the chunks that space is divided into for packing. It
+ * is a power of two, so that the origins of the chunks are exact as floats.
+ */
+static constexpr double TIMELINE_CHUNK_SIZE = 1024.0;
+
+/**
+ * \brief Finds the corner of the chunk that a position is in. A timeline is
+ * packed relative to the chunk of its newest entry, so that its positions
+ * stay small however far the timeline is from the origin of the world.
+ */
+Vector chunkOrigin(Vector const& position);
+
+/**
+ * \brief Packs a timeline into the layout that the shaders expect, with its
+ * positions relative to an origin.
+ * 
+ * Each entry becomes three groups of four floats: the position and the time,
+ * the momentum and the energy, and the pure and real parts of the rotation.
+ * The data is resized to fit, so passing in the same vector every time means
+ * that it only needs to be allocated when a timeline grows past its capacity.
+ * 
+ * The positions are made relative to the origin before they are rounded to
+ * floats, so they keep their precision. Moving the observer doesn't change
+ * the packed data, only the offset of the origin that is drawn with it.
+ */
+void packTimeline(
+  TimelineComponent<BodyComponent> const& timeline,
+  Vector const& origin,
+  std::vector<float>& data);
+
+/**
+ * \brief Packs the morph target weights of a deformation timeline at the
+ * times of the entries of another timeline, so that the shaders can find them
+ * at the same index as the rest of the state of the body.
+ * 
+ * Each entry becomes MORPH_TARGET_COUNT floats. The deformation timeline is
+ * interpolated between its own entries, so the two timelines don't need to
+ * have been sampled at the same times. The data is resized to fit.
+ */
+void packWeights(
+  TimelineComponent<BodyComponent> const& timeline,
+  TimelineComponent<DeformationComponent> const& deformations,
+  std::vector<float>& data);
+
+}
+
+#endif
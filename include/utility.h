@@ -3,9 +3,16 @@
 
 namespace lightspeed {
   
-  static const double LIGHT_SPEED = 1.0;
+  static constexpr double LIGHT_SPEED = 1.0;
+  
+  /**
+   * \brief Wraps a type so that it isn't used for template argument deduction.
+   */
+  template<typename T>
+  struct NonDeduced {
+    typedef T Type;
+  };
   
 }
 
 #endif
-
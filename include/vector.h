@@ -1,59 +1,145 @@
 #ifndef __LIGHTSPEED_VECTOR_H_
 #define __LIGHTSPEED_VECTOR_H_
 
+#include <cmath>
+
+#include "utility.h"
+
 namespace lightspeed {
 
-struct Vector final {
+/**
+ * \brief A vector in three dimensional space, with components of type T.
+ * 
+ * Everything is defined in the header so that it can be inlined into the
+ * systems that use it, and everything that doesn't modify the vector can be
+ * used in constant expressions.
+ */
+template<typename T>
+struct Vector3 final {
   
-  Vector() :
-      x(0.0),
-      y(0.0),
-      z(0.0) {
+  constexpr Vector3() :
+      x(0),
+      y(0),
+      z(0) {
   }
   
-  Vector(double x, double y, double z) :
+  constexpr Vector3(T x, T y, T z) :
       x(x),
       y(y),
       z(z) {
   }
   
-  Vector operator+() const;
-  Vector operator-() const;
+  template<typename U>
+  constexpr explicit Vector3(Vector3<U> const& other) :
+      x(static_cast<T>(other.x)),
+      y(static_cast<T>(other.y)),
+      z(static_cast<T>(other.z)) {
+  }
+  
+  constexpr Vector3 operator+() const {
+    return *this;
+  }
+  
+  constexpr Vector3 operator-() const {
+    return Vector3(-x, -y, -z);
+  }
+  
+  Vector3& operator+=(Vector3 const& rhs) {
+    x += rhs.x;
+    y += rhs.y;
+    z += rhs.z;
+    return *this;
+  }
   
-  Vector& operator+=(Vector const& rhs);
-  Vector& operator-=(Vector const& rhs);
-  Vector& operator*=(double rhs);
-  Vector& operator/=(double rhs);
+  Vector3& operator-=(Vector3 const& rhs) {
+    x -= rhs.x;
+    y -= rhs.y;
+    z -= rhs.z;
+    return *this;
+  }
   
-  double dot(Vector const& rhs) const;
-  Vector cross(Vector const& rhs) const;
-  double norm() const;
-  double normSq() const;
-  Vector unit() const;
+  Vector3& operator*=(T rhs) {
+    x *= rhs;
+    y *= rhs;
+    z *= rhs;
+    return *this;
+  }
   
-  double x;
-  double y;
-  double z;
+  Vector3& operator/=(T rhs) {
+    x /= rhs;
+    y /= rhs;
+    z /= rhs;
+    return *this;
+  }
+  
+  constexpr T dot(Vector3 const& rhs) const {
+    return x * rhs.x + y * rhs.y + z * rhs.z;
+  }
+  
+  constexpr Vector3 cross(Vector3 const& rhs) const {
+    return Vector3(
+      y * rhs.z - rhs.y * z,
+      z * rhs.x - rhs.z * x,
+      x * rhs.y - rhs.x * y);
+  }
+  
+  T norm() const {
+    return std::sqrt(normSq());
+  }
+  
+  constexpr T normSq() const {
+    return dot(*this);
+  }
+  
+  Vector3 unit() const {
+    return *this / norm();
+  }
+  
+  /**
+   * \brief Multiplies the vectors component by component.
+   */
+  constexpr Vector3 scale(Vector3 const& rhs) const {
+    return Vector3(x * rhs.x, y * rhs.y, z * rhs.z);
+  }
+  
+  T x;
+  T y;
+  T z;
   
 };
 
-inline Vector operator+(Vector lhs, Vector const& rhs) {
-  return (lhs += rhs);
+// The scalar arguments aren't used to deduce the type, so that (for example)
+// a double vector can be multiplied by an integer.
+template<typename T>
+constexpr Vector3<T> operator+(Vector3<T> const& lhs, Vector3<T> const& rhs) {
+  return Vector3<T>(lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z);
 }
-inline Vector operator-(Vector lhs, Vector const& rhs) {
-  return (lhs -= rhs);
+template<typename T>
+constexpr Vector3<T> operator-(Vector3<T> const& lhs, Vector3<T> const& rhs) {
+  return Vector3<T>(lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z);
 }
-inline Vector operator*(Vector lhs, double rhs) {
-  return (lhs *= rhs);
+template<typename T>
+constexpr Vector3<T> operator*(
+    Vector3<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return Vector3<T>(lhs.x * rhs, lhs.y * rhs, lhs.z * rhs);
 }
-inline Vector operator*(double lhs, Vector rhs) {
-  return (rhs *= lhs);
+template<typename T>
+constexpr Vector3<T> operator*(
+    typename NonDeduced<T>::Type lhs,
+    Vector3<T> const& rhs) {
+  return Vector3<T>(lhs * rhs.x, lhs * rhs.y, lhs * rhs.z);
 }
-inline Vector operator/(Vector lhs, double rhs) {
-  return (lhs /= rhs);
+template<typename T>
+constexpr Vector3<T> operator/(
+    Vector3<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return Vector3<T>(lhs.x / rhs, lhs.y / rhs, lhs.z / rhs);
 }
 
+typedef Vector3<double> Vector;
+typedef Vector3<float> Vector3f;
+
 }
 
 #endif
-
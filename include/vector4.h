@@ -0,0 +1,157 @@
+#ifndef __LIGHTSPEED_VECTOR4_H_
+#define __LIGHTSPEED_VECTOR4_H_
+
+#include <cmath>
+
+#include "utility.h"
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief A vector with four components of type T.
+ * 
+ * The vector is aligned so that the compiler can load and operate on several
+ * components with a single SIMD instruction. The alignment is capped at 16
+ * bytes, since that is all that dynamic allocations guarantee. It is used as
+ * the storage for four-vectors, with the same layout as the shaders use.
+ */
+template<typename T>
+struct alignas(4 * sizeof(T) < 16 ? 4 * sizeof(T) : 16) Vector4 final {
+  
+  constexpr Vector4() :
+      x(0),
+      y(0),
+      z(0),
+      w(0) {
+  }
+  
+  constexpr Vector4(T x, T y, T z, T w) :
+      x(x),
+      y(y),
+      z(z),
+      w(w) {
+  }
+  
+  constexpr Vector4(Vector3<T> const& xyz, T w) :
+      x(xyz.x),
+      y(xyz.y),
+      z(xyz.z),
+      w(w) {
+  }
+  
+  template<typename U>
+  constexpr explicit Vector4(Vector4<U> const& other) :
+      x(static_cast<T>(other.x)),
+      y(static_cast<T>(other.y)),
+      z(static_cast<T>(other.z)),
+      w(static_cast<T>(other.w)) {
+  }
+  
+  constexpr Vector3<T> xyz() const {
+    return Vector3<T>(x, y, z);
+  }
+  
+  constexpr Vector4 operator+() const {
+    return *this;
+  }
+  
+  constexpr Vector4 operator-() const {
+    return Vector4(-x, -y, -z, -w);
+  }
+  
+  Vector4& operator+=(Vector4 const& rhs) {
+    x += rhs.x;
+    y += rhs.y;
+    z += rhs.z;
+    w += rhs.w;
+    return *this;
+  }
+  
+  Vector4& operator-=(Vector4 const& rhs) {
+    x -= rhs.x;
+    y -= rhs.y;
+    z -= rhs.z;
+    w -= rhs.w;
+    return *this;
+  }
+  
+  Vector4& operator*=(T rhs) {
+    x *= rhs;
+    y *= rhs;
+    z *= rhs;
+    w *= rhs;
+    return *this;
+  }
+  
+  Vector4& operator/=(T rhs) {
+    x /= rhs;
+    y /= rhs;
+    z /= rhs;
+    w /= rhs;
+    return *this;
+  }
+  
+  constexpr T dot(Vector4 const& rhs) const {
+    return x * rhs.x + y * rhs.y + z * rhs.z + w * rhs.w;
+  }
+  
+  T norm() const {
+    return std::sqrt(normSq());
+  }
+  
+  constexpr T normSq() const {
+    return dot(*this);
+  }
+  
+  Vector4 unit() const {
+    return *this / norm();
+  }
+  
+  /**
+   * \brief Multiplies the vectors component by component.
+   */
+  constexpr Vector4 scale(Vector4 const& rhs) const {
+    return Vector4(x * rhs.x, y * rhs.y, z * rhs.z, w * rhs.w);
+  }
+  
+  T x;
+  T y;
+  T z;
+  T w;
+  
+};
+
+template<typename T>
+constexpr Vector4<T> operator+(Vector4<T> const& lhs, Vector4<T> const& rhs) {
+  return Vector4<T>(lhs.x + rhs.x, lhs.y + rhs.y, lhs.z + rhs.z, lhs.w + rhs.w);
+}
+template<typename T>
+constexpr Vector4<T> operator-(Vector4<T> const& lhs, Vector4<T> const& rhs) {
+  return Vector4<T>(lhs.x - rhs.x, lhs.y - rhs.y, lhs.z - rhs.z, lhs.w - rhs.w);
+}
+template<typename T>
+constexpr Vector4<T> operator*(
+    Vector4<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return Vector4<T>(lhs.x * rhs, lhs.y * rhs, lhs.z * rhs, lhs.w * rhs);
+}
+template<typename T>
+constexpr Vector4<T> operator*(
+    typename NonDeduced<T>::Type lhs,
+    Vector4<T> const& rhs) {
+  return Vector4<T>(lhs * rhs.x, lhs * rhs.y, lhs * rhs.z, lhs * rhs.w);
+}
+template<typename T>
+constexpr Vector4<T> operator/(
+    Vector4<T> const& lhs,
+    typename NonDeduced<T>::Type rhs) {
+  return Vector4<T>(lhs.x / rhs, lhs.y / rhs, lhs.z / rhs, lhs.w / rhs);
+}
+
+typedef Vector4<double> Vector4d;
+typedef Vector4<float> Vector4f;
+
+}
+
+#endif
@@ -1,27 +1,30 @@
 #ifndef __LIGHTSPEED_VERTEX_H_
 #define __LIGHTSPEED_VERTEX_H_
 
-#include <internal/opengl.h>
+#include <cstdint>
 
 namespace lightspeed {
 
 /**
  * \brief Stores the data associated with a single vertex.
+ * 
+ * The fields have the same sizes as the OpenGL types that the render system
+ * reads them as, but the struct doesn't depend on OpenGL so that the
+ * simulation can be built without it.
  */
 struct Vertex final {
   
-  GLfloat x;
-  GLfloat y;
-  GLfloat z;
+  float x;
+  float y;
+  float z;
   
-  GLuint textureIndex;
+  uint32_t textureIndex;
   
-  GLfloat u;
-  GLfloat v;
+  float u;
+  float v;
   
 };
 
 }
 
 #endif
-
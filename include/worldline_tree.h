@@ -0,0 +1,160 @@
+#ifndef __LIGHTSPEED_WORLDLINE_TREE_H_
+#define __LIGHTSPEED_WORLDLINE_TREE_H_
+
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "vector.h"
+
+namespace lightspeed {
+
+/**
+ * \brief An axis aligned box in spacetime, bounding the region of space that an
+ * entity occupied over an interval of time.
+ */
+struct WorldtubeBounds final {
+  
+  WorldtubeBounds();
+  WorldtubeBounds(Vector min, Vector max, double timeMin, double timeMax);
+  
+  /**
+   * \brief Creates bounds containing a sphere at a single moment in time.
+   */
+  static WorldtubeBounds event(Vector position, double radius, double time);
+  
+  bool contains(WorldtubeBounds const& other) const;
+  WorldtubeBounds merge(WorldtubeBounds const& other) const;
+  
+  /**
+   * \brief A measure of the size of the bounds, used to decide how the tree is
+   * structured. The time extent is converted to a distance using the speed of
+   * light.
+   */
+  double cost() const;
+  
+  Vector min;
+  Vector max;
+  double timeMin;
+  double timeMax;
+  
+};
+
+/**
+ * \brief A bounding volume hierarchy over the worldtubes of entities.
+ * 
+ * Each entity is stored with a "fat" version of its bounds, so that the tree
+ * only has to be restructured when the entity grows outside of the padding.
+ * Queries are done in the resting coordinate frame, which can describe the
+ * past light cone of any observer regardless of how they are moving.
+ */
+class WorldlineTree final {
+  
+public:
+  
+  WorldlineTree();
+  
+  /**
+   * \brief Adds an entity to the tree, or updates its bounds if it is already
+   * present.
+   * 
+   * If the stored bounds of the entity no longer contain the new bounds, the
+   * entity is reinserted using the fat bounds, which should contain the new
+   * bounds with some padding.
+   * 
+   * \return Whether the tree had to be restructured.
+   */
+  bool update(
+    entityx::Entity entity,
+    WorldtubeBounds const& bounds,
+    WorldtubeBounds const& fatBounds);
+  void remove(entityx::Entity entity);
+  void clear();
+  
+  bool contains(entityx::Entity entity) const;
+  std::size_t size() const;
+  
+  /**
+   * \brief Finds every entity that could intersect the past light cone of an
+   * event, out to a certain distance.
+   */
+  void queryPastLightCone(
+    Vector const& position,
+    double time,
+    double distance,
+    std::vector<entityx::Entity>& result) const;
+  
+  /**
+   * \brief Finds every entity that could intersect the part of the past light
+   * cone of an event that lies within a cone of directions.
+   * 
+   * The direction and half angle describe where light must arrive from in the
+   * resting frame, so any aberration must already have been applied.
+   */
+  void queryVisible(
+    Vector const& position,
+    double time,
+    double distance,
+    Vector const& direction,
+    double halfAngle,
+    std::vector<entityx::Entity>& result) const;
+  
+  /**
+   * \brief Tests whether a ray hits an entity before a distance along it,
+   * storing how far along the ray it does if so.
+   */
+  typedef std::function<bool(entityx::Entity, double, double&)> RayTest;
+  
+  /**
+   * \brief Follows a light ray backwards in time from an event, and finds the
+   * first entity that it hits.
+   * 
+   * The bounds in the tree only decide which entities are worth testing, since
+   * they cover the whole history of each entity. Whether the ray actually hits
+   * an entity, and where, is left to the test.
+   * 
+   * \return Whether anything was hit. If so, the entity and the distance along
+   * the ray are stored.
+   */
+  bool raycast(
+    Vector const& position,
+    double time,
+    Vector const& direction,
+    double distance,
+    RayTest const& test,
+    entityx::Entity& hit,
+    double& hitDistance) const;
+  
+private:
+  
+  struct Node {
+    WorldtubeBounds bounds;
+    entityx::Entity entity;
+    int parent;
+    int left;
+    int right;
+    int height;
+  };
+  
+  int allocateNode();
+  void freeNode(int node);
+  void insertLeaf(int leaf);
+  void removeLeaf(int leaf);
+  void refit(int node);
+  int balance(int node);
+  
+  bool isLeaf(int node) const;
+  
+  std::vector<Node> m_nodes;
+  std::vector<int> m_freeNodes;
+  std::unordered_map<uint64_t, int> m_leaves;
+  int m_root;
+  
+};
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #version 430
+#extension GL_ARB_shader_viewport_layer_array : enable
 
 // This structure represents the state of a body at a specific moment in time.
 struct Transform {
@@ -11,13 +12,89 @@ struct Transform {
   vec4 rotation;
 };
 
+// Everything about one of the views of the scene being drawn this frame.
+struct View {
+  Transform observer;
+  layout(row_major) mat4 projection;
+};
+
 layout (std430, binding = 0) readonly buffer Timeline {
   Transform history[];
 };
 
-layout(location = 0) uniform Transform observer;
-layout(location = 3) uniform mat4 projection;
+// Every view shares the same timelines. When the views can be drawn together,
+// each instance of the mesh is drawn into a different view (and viewport).
+// Otherwise the views are drawn one at a time, starting from firstView.
+layout (std430, binding = 1) readonly buffer Views {
+  View views[];
+};
+
+// Where the search for the light cone crossing starts in each view, counted
+// back from the newest entry. They are written back at the end of the search,
+// so that the next frame can start where this one finished.
+layout (std430, binding = 2) buffer Hints {
+  uint hints[];
+};
+
+// The same layout as a Vertex on the CPU, so that the meshes of the morph
+// targets can be read straight out of their vertex buffers.
+struct MeshVertex {
+  float x;
+  float y;
+  float z;
+  uint textureIndex;
+  float u;
+  float v;
+};
+
+// Deformed models blend each vertex towards the same vertex of each of their
+// morph targets, using the weights stored alongside each entry of the history.
+const int MAX_MORPH_TARGETS = 4;
+
+layout (std430, binding = 3) readonly buffer MorphTarget {
+  MeshVertex vertices[];
+} morphTargets[MAX_MORPH_TARGETS];
+
+layout (std430, binding = 7) readonly buffer Weights {
+  vec4 weights[];
+};
+
 layout(location = 4) uniform float lightspeed;
+layout(location = 5) uniform int firstView;
+layout(location = 6) uniform uint hintBase;
+// The positions in the history and of the observers are relative to different
+// origins, so that they stay small enough to be precise as floats. This is
+// where the origin of the history is, relative to that of the observers.
+layout(location = 7) uniform vec3 timelineOrigin;
+// How many morph targets the model has, or zero if it isn't deformed.
+layout(location = 8) uniform int morphTargetCount;
+
+#ifdef SHADER_COUNTERS
+// How much work finding the crossing took, added up over the vertices of each
+// timeline in each view, at the same index as the hints. They are only
+// compiled in when the shader counters are turned on. The histogram counts
+// the vertices by how many entries they had to check, in powers of two.
+const uint COUNTER_FIELDS = 13u;
+const uint COUNTER_VERTICES = 0u;
+const uint COUNTER_STEPS = 1u;
+const uint COUNTER_WARM_STARTS = 2u;
+const uint COUNTER_FULL_SEARCHES = 3u;
+const uint COUNTER_DISCRIMINANT_FAILURES = 4u;
+const uint COUNTER_HISTOGRAM = 5u;
+const int COUNTER_HISTOGRAM_BUCKETS = 8;
+
+layout (std430, binding = 12) buffer Counters {
+  uint counters[];
+};
+
+uint searchSteps = 0u;
+bool warmStart = false;
+bool fullSearch = false;
+bool discriminantFailed = false;
+#endif
+
+// How far the search walks from the last crossing before giving up on it.
+const uint WARM_START_STEPS = 8u;
 
 layout(location = 0) in vec4 position;
 
@@ -48,96 +125,184 @@ float minkowskiLength(in vec4 a) {
   return minkowskiDot(a, a);
 }
 
-void main() {
+// Finds where the vertex is in the model at one of the entries of the history,
+// before it is moved or rotated. Each entry has its own weights, so the shape
+// of the model at the light cone crossing is blended between two entries in
+// the same way as its position.
+vec3 deformedPosition(in uint index) {
+  vec3 result = position.xyz;
+  if (morphTargetCount > 0) {
+    vec4 weight = weights[index];
+    for (int target = 0; target < morphTargetCount; ++target) {
+      MeshVertex vertex = morphTargets[target].vertices[gl_VertexID];
+      result += weight[target] *
+                (vec3(vertex.x, vertex.y, vertex.z) - position.xyz);
+    }
+  }
+  return result;
+}
+
+// Transforms a vertex of the mesh, as it was at one of the entries of the
+// history, into the frame of the observer.
+vec4 observedPosition(in uint index, in Transform observer) {
+  
+  vec4 nextPosition = vec4(0.0);
+  Transform objectTransform = history[index];
+  
+  // Calculate the velocity first.
+  vec3 objectVelocity = objectTransform.momentum.xyz /
+                        objectTransform.momentum.w;
+  
+  // Perform the rotation first.
+  nextPosition.xyz = applyQuaternion(
+    objectTransform.rotation,
+    deformedPosition(index));
+  
+  // Then apply the scaling along the velocity direction due to length
+  // contraction of the object.
+  vec3 objectBeta = objectVelocity / lightspeed;
+  vec3 objectBetaDir = normalize(objectBeta);
+  if (objectBeta == 0.0) {
+    objectBetaDir = vec3(1.0, 0.0, 0.0);
+  }
+  float scaleFactor = sqrt(1.0 - dot(objectBeta, objectBeta));
+  
+  vec3 parallelComponent = dot(objectBetaDir, nextPosition.xyz) *
+                           objectBetaDir;
+  vec3 perpendicularComponent = nextPosition.xyz - parallelComponent;
+  nextPosition.xyz = perpendicularComponent +
+                     scaleFactor * parallelComponent;
+  
+  // Finally, translate the object to the position it should be in.
+  nextPosition += objectTransform.position;
+  nextPosition.xyz += timelineOrigin;
+  
+  // Now the vertex has been transformed into the rest frame, but we have to
+  // Lorentz transform it into the observer's frame.
+  
+  // First calculate the observer's velocity.
+  vec3 observerVelocity = observer.momentum.xyz / observer.momentum.w;
+  
+  // Then the point is translated.
+  nextPosition -= observer.position;
+  
+  // Then the boost/Lorentz transformation is applied.
+  vec3 beta = observerVelocity / lightspeed;
+  vec3 betaDir = normalize(beta);
+  if (beta.x == 0.0 && beta.y == 0.0 && beta.z == 0.0) {
+    betaDir = vec3(1.0, 0.0, 0.0);
+  }
+  float gamma = 1.0 / sqrt(1.0 - dot(beta, beta));
+  
+  parallelComponent = dot(betaDir, nextPosition.xyz) * betaDir;
+  perpendicularComponent = nextPosition.xyz - parallelComponent;
+  float timeComponent = nextPosition.w;
+  
+  // These are just the Lorentz transforms in 3 spatial dimensions.
+  nextPosition.xyz =
+    perpendicularComponent +
+    gamma * (parallelComponent - observerVelocity * timeComponent);
+  nextPosition.w =
+    gamma * (timeComponent - dot(beta, parallelComponent) / lightspeed);
+  
+  // Finally, the transformed position is rotated.
+  vec4 inverse;
+  inverse.w = observer.rotation.w;
+  inverse.xyz = -observer.rotation.xyz;
+  inverse /= dot(inverse, observer.rotation);
+  nextPosition.xyz = applyQuaternion(inverse, nextPosition.xyz);
+  return nextPosition;
+}
+
+// Checks whether the light from a position in the frame of the observer has
+// reached them yet, which is when the position is timelike.
+bool lightHasArrived(in uint index, in Transform observer) {
+#ifdef SHADER_COUNTERS
+  ++searchSteps;
+#endif
+  return minkowskiLength(observedPosition(index, observer)) > 0.0;
+}
+
+// Finds the newest entry of the history whose light has reached the observer
+// (or the oldest entry if there isn't one), starting from where it was found
+// on the last frame. The crossing moves by no more than an entry or two
+// between frames, so a short walk from there is almost always enough. If the
+// walk doesn't find it, the whole history is searched from the newest entry.
+uint findCrossing(in uint count, in uint hint, in Transform observer) {
+  
+  if (hint < count) {
+    uint i = count - 1u - hint;
+    if (lightHasArrived(i, observer)) {
+      for (uint step = 0u; step < WARM_START_STEPS; ++step) {
+        if (i + 1u == count || !lightHasArrived(i + 1u, observer)) {
+#ifdef SHADER_COUNTERS
+          warmStart = true;
+#endif
+          return i;
+        }
+        ++i;
+      }
+    }
+    else {
+      for (uint step = 0u; step < WARM_START_STEPS; ++step) {
+        if (i == 0u) {
+#ifdef SHADER_COUNTERS
+          warmStart = true;
+#endif
+          return 0u;
+        }
+        --i;
+        if (lightHasArrived(i, observer)) {
+#ifdef SHADER_COUNTERS
+          warmStart = true;
+#endif
+          return i;
+        }
+      }
+    }
+  }
   
   // Go through the history, from the newest to oldest position.
-  uint i = history.length();
+#ifdef SHADER_COUNTERS
+  fullSearch = true;
+#endif
+  uint i = count;
+  while (i != 0u) {
+    --i;
+    if (lightHasArrived(i, observer)) {
+      return i;
+    }
+  }
+  return 0u;
+}
+
+void main() {
+  
+  int viewIndex = firstView + gl_InstanceID;
+  Transform observer = views[viewIndex].observer;
+  uint hintIndex = hintBase + uint(viewIndex);
+  
+  // The crossing is between the entry that was found and the one after it.
+  uint count = uint(history.length());
   vec4 lastPosition;
   vec4 nextPosition;
   vec4 currentPosition;
   bool hasNextPosition = false;
   bool hasLastPosition = false;
-  bool intersectsCone = false;
-  
-  while (i != 0) {
-    
-    --i;
-    
-    if (hasNextPosition) {
-      lastPosition = nextPosition;
+  if (count != 0u) {
+    uint crossing = findCrossing(count, hints[hintIndex], observer);
+    nextPosition = observedPosition(crossing, observer);
+    hasNextPosition = true;
+    if (crossing + 1u < count) {
+      lastPosition = observedPosition(crossing + 1u, observer);
       hasLastPosition = true;
     }
     
-    nextPosition = vec4(0.0);
-    Transform objectTransform = history[i];
-    
-    // Calculate the velocity first.
-    vec3 objectVelocity = objectTransform.momentum.xyz /
-                          objectTransform.momentum.w;
-    
-    // Perform the rotation first.
-    nextPosition.xyz = applyQuaternion(objectTransform.rotation, position.xyz);
-    
-    // Then apply the scaling along the velocity direction due to length
-    // contraction of the object.
-    vec3 objectBeta = objectVelocity / lightspeed;
-    vec3 objectBetaDir = normalize(objectBeta);
-    if (objectBeta == 0.0) {
-      objectBetaDir = vec3(1.0, 0.0, 0.0);
-    }
-    float scaleFactor = sqrt(1.0 - dot(objectBeta, objectBeta));
-    
-    vec3 parallelComponent = dot(objectBetaDir, nextPosition.xyz) *
-                             objectBetaDir;
-    vec3 perpendicularComponent = nextPosition.xyz - parallelComponent;
-    nextPosition.xyz = perpendicularComponent +
-                       scaleFactor * parallelComponent;
-    
-    // Finally, translate the object to the position it should be in.
-    nextPosition += objectTransform.position;
-    
-    // Now the vertex has been transformed into the rest frame, but we have to
-    // Lorentz transform it into the observer's frame.
-    
-    // First calculate the observer's velocity.
-    vec3 observerVelocity = observer.momentum.xyz / observer.momentum.w;
-    
-    // Then the point is translated.
-    nextPosition -= observer.position;
-    
-    // Then the boost/Lorentz transformation is applied.
-    vec3 beta = observerVelocity / lightspeed;
-    vec3 betaDir = normalize(beta);
-    if (beta.x == 0.0 && beta.y == 0.0 && beta.z == 0.0) {
-      betaDir = vec3(1.0, 0.0, 0.0);
-    }
-    float gamma = 1.0 / sqrt(1.0 - dot(beta, beta));
-    
-    parallelComponent = dot(betaDir, nextPosition.xyz) * betaDir;
-    perpendicularComponent = nextPosition.xyz - parallelComponent;
-    float timeComponent = nextPosition.w;
-    
-    // These are just the Lorentz transforms in 3 spatial dimensions.
-    nextPosition.xyz =
-      perpendicularComponent +
-      gamma * (parallelComponent - observerVelocity * timeComponent);
-    nextPosition.w =
-      gamma * (timeComponent - dot(beta, parallelComponent) / lightspeed);
-    
-    // Finally, the transformed position is rotated.
-    vec4 inverse;
-    inverse.w = observer.rotation.w;
-    inverse.xyz = -observer.rotation.xyz;
-    inverse /= dot(inverse, observer.rotation);
-    nextPosition.xyz = applyQuaternion(inverse, nextPosition.xyz);
-    
-    // Now we check to see if the transformed position is timelike. If it is
-    // timelike, then the light from the position has reached the observer.
-    if (minkowskiLength(nextPosition) > 0.0) {
-      break;
+    // Every vertex of the entity ends up near the same place, so only one of
+    // them needs to remember it for the next frame.
+    if (gl_VertexID == 0) {
+      hints[hintIndex] = count - 1u - crossing;
     }
-    
-    hasNextPosition = true;
   }
   
   // Now, take the two positions (lastPosition and nextPosition) and find the
@@ -151,6 +316,9 @@ void main() {
     float c = minkowskiLength(lastPosition);
     float discriminant = b * b - 4 * a * c;
     if (discriminant < 0.0) {
+#ifdef SHADER_COUNTERS
+      discriminantFailed = true;
+#endif
       currentPosition = nextPosition;
     }
     else {
@@ -185,6 +353,24 @@ void main() {
   currentPosition.w = 1.0;
   
   // Return the projected result.
-  gl_Position = projection * currentPosition;
+  gl_Position = views[viewIndex].projection * currentPosition;
+#ifdef GL_ARB_shader_viewport_layer_array
+  gl_ViewportIndex = gl_InstanceID;
+#endif
+  
+#ifdef SHADER_COUNTERS
+  uint base = COUNTER_FIELDS * hintIndex;
+  int bucket = min(
+    findMSB(max(searchSteps, 1u)),
+    COUNTER_HISTOGRAM_BUCKETS - 1);
+  atomicAdd(counters[base + COUNTER_VERTICES], 1u);
+  atomicAdd(counters[base + COUNTER_STEPS], searchSteps);
+  atomicAdd(counters[base + COUNTER_WARM_STARTS], warmStart ? 1u : 0u);
+  atomicAdd(counters[base + COUNTER_FULL_SEARCHES], fullSearch ? 1u : 0u);
+  atomicAdd(
+    counters[base + COUNTER_DISCRIMINANT_FAILURES],
+    discriminantFailed ? 1u : 0u);
+  atomicAdd(counters[base + COUNTER_HISTOGRAM + uint(bucket)], 1u);
+#endif
 }
 
@@ -0,0 +1,21 @@
+#include "event_queue.h"
+
+#include <cstddef>
+
+#include <entityx/entityx.h>
+
+#include "profiler.h"
+
+using namespace lightspeed;
+
+void EventQueue::flush(entityx::EventManager& events) {
+  
+  PROFILE_SCOPE("EventQueue::flush");
+  
+  // Receivers can queue types that haven't been seen before, which are left
+  // for the next flush along with everything else they queue.
+  std::size_t count = m_channels.size();
+  for (std::size_t i = 0; i < count; ++i) {
+    m_channels[i]->flush(events);
+  }
+}
@@ -0,0 +1,262 @@
+#include "frame_writer.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+#include "memory_tracker.h"
+#include "profiler.h"
+
+// The number of digits that the frame numbers are padded to in file names.
+#define FRAME_DIGITS (6)
+
+using namespace lightspeed;
+
+void writeBigEndian(std::ostream& stream, uint32_t value);
+void writePngChunk(
+  std::ostream& stream,
+  char const* type,
+  uint8_t const* contents,
+  std::size_t length);
+
+FrameWriter::FrameWriter(
+    std::string prefix,
+    FrameFormat format,
+    std::size_t threads,
+    std::size_t maxQueued) :
+    m_prefix(prefix),
+    m_format(format),
+    m_maxQueued(std::max<std::size_t>(maxQueued, 1)),
+    m_submitted(0),
+    m_mutex(),
+    m_queuedCondition(),
+    m_writtenCondition(),
+    m_queue(),
+    m_free(),
+    m_written(0),
+    m_stalls(0),
+    m_error(),
+    m_stopping(false),
+    m_memory(MemoryTracker::instance().counter("Captured frames")),
+    m_threads() {
+  for (std::size_t thread = 0; thread < std::max<std::size_t>(threads, 1);
+       ++thread) {
+    m_threads.emplace_back(&FrameWriter::run, this);
+  }
+}
+
+FrameWriter::~FrameWriter() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_queuedCondition.notify_all();
+  for (std::thread& thread : m_threads) {
+    thread.join();
+  }
+  for (std::vector<uint8_t> const& buffer : m_free) {
+    m_memory.deallocate(buffer.size());
+  }
+}
+
+std::vector<uint8_t> FrameWriter::acquire(std::size_t bytes) {
+  std::vector<uint8_t> buffer;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_free.empty()) {
+      buffer = std::move(m_free.back());
+      m_free.pop_back();
+    }
+  }
+  m_memory.resize(buffer.size(), bytes);
+  buffer.resize(bytes);
+  return buffer;
+}
+
+void FrameWriter::submit(
+    std::size_t width,
+    std::size_t height,
+    std::vector<uint8_t> pixels) {
+  
+  std::unique_lock<std::mutex> lock(m_mutex);
+  if (m_queue.size() >= m_maxQueued) {
+    ++m_stalls;
+    m_writtenCondition.wait(lock, [this]() {
+      return m_queue.size() < m_maxQueued || !m_error.empty();
+    });
+  }
+  if (!m_error.empty()) {
+    throw std::runtime_error(m_error);
+  }
+  Frame frame = { m_submitted++, width, height, std::move(pixels) };
+  m_queue.push_back(std::move(frame));
+  lock.unlock();
+  m_queuedCondition.notify_one();
+}
+
+std::size_t FrameWriter::written() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_written;
+}
+
+std::size_t FrameWriter::stalls() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_stalls;
+}
+
+void FrameWriter::run() {
+  
+  PROFILE_THREAD("frame writer");
+  // Each thread keeps its own space for encoding frames, which grows to the
+  // size of the largest frame and then stays there.
+  std::vector<uint8_t> rows;
+  std::vector<uint8_t> compressed;
+  while (true) {
+    Frame frame;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_queuedCondition.wait(lock, [this]() {
+        return m_stopping || !m_queue.empty();
+      });
+      // Everything that was submitted gets written before stopping.
+      if (m_queue.empty()) {
+        return;
+      }
+      frame = std::move(m_queue.front());
+      m_queue.pop_front();
+    }
+    
+    std::string error;
+    try {
+      write(frame, rows, compressed);
+    }
+    catch (std::runtime_error const& exception) {
+      error = exception.what();
+    }
+    
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      ++m_written;
+      if (m_error.empty()) {
+        m_error = error;
+      }
+      m_free.push_back(std::move(frame.pixels));
+    }
+    m_writtenCondition.notify_all();
+  }
+}
+
+void FrameWriter::write(
+    Frame const& frame,
+    std::vector<uint8_t>& rows,
+    std::vector<uint8_t>& compressed) const {
+  
+  PROFILE_SCOPE("FrameWriter::write");
+  char number[32];
+  std::snprintf(
+    number,
+    sizeof(number),
+    "%0*lu",
+    FRAME_DIGITS,
+    (unsigned long) frame.index);
+  std::string fileName = m_prefix + number +
+    (m_format == FrameFormat::PNG ? ".png" : ".ppm");
+  std::ofstream file(fileName, std::ios::binary);
+  if (!file) {
+    throw std::runtime_error("Couldn't write the frame to " + fileName + ".");
+  }
+  
+  // The rows are read back from the bottom of the image up, but both formats
+  // store them from the top down.
+  std::size_t rowBytes = 3 * frame.width;
+  if (m_format == FrameFormat::PPM) {
+    file << "P6\n" << frame.width << ' ' << frame.height << "\n255\n";
+    for (std::size_t row = frame.height; row-- > 0;) {
+      file.write(
+        reinterpret_cast<char const*>(frame.pixels.data() + row * rowBytes),
+        rowBytes);
+    }
+  }
+  else {
+    // Every row of a PNG starts with the filter used on it, which is left as
+    // none since filtering costs more time than it saves in compression.
+    rows.clear();
+    for (std::size_t row = frame.height; row-- > 0;) {
+      uint8_t const* begin = frame.pixels.data() + row * rowBytes;
+      rows.push_back(0);
+      rows.insert(rows.end(), begin, begin + rowBytes);
+    }
+    uLongf compressedBytes = compressBound(rows.size());
+    compressed.resize(compressedBytes);
+    if (compress2(
+        compressed.data(),
+        &compressedBytes,
+        rows.data(),
+        rows.size(),
+        Z_BEST_SPEED) != Z_OK) {
+      throw std::runtime_error("Couldn't compress the frame " + fileName + ".");
+    }
+    
+    // The header gives the size, a bit depth of 8, and RGB color, with the
+    // default compression, filtering and no interlacing.
+    static uint8_t const signature[] = {
+      0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'
+    };
+    uint8_t header[] = {
+      0, 0, 0, 0,
+      0, 0, 0, 0,
+      8, 2, 0, 0, 0
+    };
+    for (int byte = 0; byte < 4; ++byte) {
+      header[byte] = (frame.width >> (24 - 8 * byte)) & 0xFF;
+      header[4 + byte] = (frame.height >> (24 - 8 * byte)) & 0xFF;
+    }
+    file.write(reinterpret_cast<char const*>(signature), sizeof(signature));
+    writePngChunk(file, "IHDR", header, sizeof(header));
+    writePngChunk(file, "IDAT", compressed.data(), compressedBytes);
+    writePngChunk(file, "IEND", NULL, 0);
+  }
+  if (!file) {
+    throw std::runtime_error("Couldn't write the frame to " + fileName + ".");
+  }
+}
+
+void writeBigEndian(std::ostream& stream, uint32_t value) {
+  char bytes[] = {
+    (char) ((value >> 24) & 0xFF),
+    (char) ((value >> 16) & 0xFF),
+    (char) ((value >> 8) & 0xFF),
+    (char) (value & 0xFF)
+  };
+  stream.write(bytes, sizeof(bytes));
+}
+
+void writePngChunk(
+    std::ostream& stream,
+    char const* type,
+    uint8_t const* contents,
+    std::size_t length) {
+  
+  // The checksum covers the type and the contents, but not the length. Zlib
+  // resets it when given no contents, so empty chunks leave them out.
+  uLong crc = crc32(0, Z_NULL, 0);
+  crc = crc32(crc, reinterpret_cast<Bytef const*>(type), 4);
+  if (length > 0) {
+    crc = crc32(crc, contents, length);
+  }
+  writeBigEndian(stream, length);
+  stream.write(type, 4);
+  stream.write(reinterpret_cast<char const*>(contents), length);
+  writeBigEndian(stream, crc);
+}
@@ -0,0 +1,438 @@
+// Steps the simulation without a window or any graphics, so that large scenes
+// can be run on machines that can't render. At the end it reports how fast
+// the simulation ran and how much memory it used. It can also trace an image
+// of what the player sees at the end, on the CPU.
+//
+// Usage: lightspeed_headless [--steps <n>] [--delta <seconds>]
+//                            [--speed <fraction of c>] [--stream]
+//                            [--sample-rate <hz>] [--players <n>]
+//                            [--state <file>]
+//                            [--render <file.ppm>] [--render-size <w>x<h>]
+//                            [--render-threads <n>]
+//                            [--trace <file>] [--profile]
+//                            [--generate <parameters> | scene]
+
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <entityx/entityx.h>
+
+#include "component/acceleration_component.h"
+#include "component/body_component.h"
+#include "component/camera_component.h"
+#include "component/collision_component.h"
+#include "component/deformation_component.h"
+#include "component/integrator_component.h"
+#include "component/model_component.h"
+#include "component/player_component.h"
+#include "component/timeline_component.h"
+
+#include "system/acceleration_system.h"
+#include "system/collision_system.h"
+#include "system/interaction_system.h"
+#include "system/movement_system.h"
+#include "system/relativistic_update_system.h"
+#include "system/scene_system.h"
+#include "system/streaming_system.h"
+#include "system/timeline_system.h"
+
+#include "entity_batch.h"
+#include "light_cone_tracer.h"
+#include "memory_tracker.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "scene.h"
+#include "scene_generator.h"
+#include "utility.h"
+#include "vector.h"
+
+#define RESULT_SUCCESS (0)
+#define RESULT_FAILURE (-1)
+
+// Stands in for any key, since nothing is ever pressed.
+#define NO_KEY (-1)
+
+using namespace lightspeed;
+
+struct HeadlessOptions {
+  unsigned long steps;
+  double delta;
+  double speed;
+  bool stream;
+  double sampleRate;
+  std::size_t players;
+  std::string stateFileName;
+  std::string renderFileName;
+  std::size_t renderWidth;
+  std::size_t renderHeight;
+  std::size_t renderThreads;
+  std::string traceFileName;
+  bool printProfile;
+  std::string generate;
+  std::string sceneFileName;
+};
+
+HeadlessOptions parseHeadlessOptions(int argc, char** argv);
+void createHeadlessPlayer(
+  entityx::EntityManager& entities,
+  double speed,
+  Vector position);
+bool writeHeadlessState(
+  entityx::EntityManager& entities,
+  std::string const& fileName);
+void createHeadlessGrid(entityx::EntityManager& entities, MeshArena& meshes);
+bool renderHeadless(
+  entityx::EntityManager& entities,
+  HeadlessOptions const& options);
+
+int main(int argc, char** argv) {
+  
+  HeadlessOptions options = parseHeadlessOptions(argc, argv);
+  
+  MeshArena meshes;
+  std::shared_ptr<Scene const> scene;
+  if (!options.generate.empty()) {
+    try {
+      GeneratorParameters parameters;
+      parseGeneratorParameters(options.generate, parameters);
+      SceneBuilder builder;
+      generateScene(parameters, builder);
+      scene = std::make_shared<Scene>(builder, meshes);
+    }
+    catch (std::runtime_error const& error) {
+      std::cerr << error.what() << '\n';
+      return RESULT_FAILURE;
+    }
+  }
+  else if (!options.sceneFileName.empty()) {
+    try {
+      scene = std::make_shared<Scene>(options.sceneFileName, meshes);
+    }
+    catch (std::runtime_error const& error) {
+      std::cerr << error.what() << '\n';
+      return RESULT_FAILURE;
+    }
+  }
+  
+  entityx::EventManager events;
+  entityx::EntityManager entities(events);
+  entityx::SystemManager systems(entities, events);
+  
+  // The same systems as the application, minus the ones that need input or
+  // graphics.
+  std::shared_ptr<StreamingSystem> streaming;
+  if (scene && options.stream) {
+    streaming = std::make_shared<StreamingSystem>(scene);
+    systems.add(streaming);
+  }
+  else if (scene) {
+    systems.add<SceneSystem>(scene);
+  }
+  systems.add<AccelerationSystem>();
+  systems.add<MovementSystem>();
+  systems.add<InteractionSystem>();
+  systems.add<RelativisticUpdateSystem>();
+  systems.add<CollisionSystem>();
+  double sampleInterval =
+    (options.sampleRate > 0.0) ? 1.0 / options.sampleRate : 0.0;
+  systems.add<TimelineSystem<BodyComponent> >(sampleInterval);
+  systems.add<TimelineSystem<DeformationComponent> >(sampleInterval);
+  systems.configure();
+  
+  // Every player sends its own update each step, with the time dilation of
+  // its own speed, so extra players are spread out at slower speeds.
+  for (std::size_t player = 0; player < options.players; ++player) {
+    double fraction =
+      (double) (options.players - player) / options.players;
+    createHeadlessPlayer(
+      entities,
+      fraction * options.speed,
+      Vector(2.0 * player, 0.0, 0.0));
+  }
+  if (!scene) {
+    createHeadlessGrid(entities, meshes);
+  }
+  
+  PROFILE_THREAD("main");
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long step = 0; step < options.steps; ++step) {
+    PROFILE_SCOPE("step");
+    systems.update_all(options.delta);
+    
+    // Steps aren't taken in real time, so wait for the streaming to keep up
+    // with them. Otherwise what gets loaded would depend on the machine.
+    if (streaming) {
+      streaming->synchronize();
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  double seconds = std::chrono::duration<double>(end - start).count();
+  
+  std::size_t entityCount = 0;
+  entities.each<BodyComponent>(
+    [&entityCount](entityx::Entity entity, BodyComponent& body) {
+      ++entityCount;
+    });
+  
+  // The peak resident set size is given in kilobytes on Linux.
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  
+  std::printf("steps               %lu\n", options.steps);
+  std::printf("simulated time      %.3f s\n", options.steps * options.delta);
+  std::printf("wall time           %.3f s\n", seconds);
+  std::printf("steps per second    %.1f\n", options.steps / seconds);
+  std::printf("entities            %lu\n", (unsigned long) entityCount);
+  std::printf(
+    "entity steps/s      %.3e\n",
+    entityCount * (options.steps / seconds));
+  std::printf("peak resident       %ld KiB\n", (long) usage.ru_maxrss);
+  std::fflush(stdout);
+  
+  std::cout << '\n';
+  MemoryTracker::instance().dump(std::cout);
+  
+  // The summary covers the whole run, so it is given per second of wall time.
+  if (options.printProfile) {
+    std::cout << '\n';
+    Profiler::instance().writeSummary(std::cout, seconds);
+  }
+  if (!options.stateFileName.empty() &&
+      !writeHeadlessState(entities, options.stateFileName)) {
+    return RESULT_FAILURE;
+  }
+  if (!options.renderFileName.empty() && !renderHeadless(entities, options)) {
+    return RESULT_FAILURE;
+  }
+  if (!options.traceFileName.empty()) {
+    std::ofstream file(options.traceFileName);
+    if (!file) {
+      std::cerr << "Couldn't write the trace to " << options.traceFileName
+                << '\n';
+      return RESULT_FAILURE;
+    }
+    Profiler::instance().writeChromeTrace(file);
+  }
+  
+  return RESULT_SUCCESS;
+}
+
+HeadlessOptions parseHeadlessOptions(int argc, char** argv) {
+  
+  HeadlessOptions options =
+    { 600, 1.0 / 60.0, 0.0, false, 0.0, 1, "", "", 640, 480, 0, "", false, "",
+      "" };
+  for (int i = 1; i < argc; ++i) {
+    std::string argument = argv[i];
+    bool hasValue = (i + 1 < argc);
+    if (argument == "--steps" && hasValue) {
+      options.steps = std::strtoul(argv[++i], NULL, 10);
+    }
+    else if (argument == "--delta" && hasValue) {
+      options.delta = std::atof(argv[++i]);
+    }
+    else if (argument == "--speed" && hasValue) {
+      options.speed = std::atof(argv[++i]);
+    }
+    else if (argument == "--stream") {
+      options.stream = true;
+    }
+    else if (argument == "--sample-rate" && hasValue) {
+      options.sampleRate = std::atof(argv[++i]);
+    }
+    else if (argument == "--players" && hasValue) {
+      options.players = std::strtoul(argv[++i], NULL, 10);
+    }
+    else if (argument == "--state" && hasValue) {
+      options.stateFileName = argv[++i];
+    }
+    else if (argument == "--render" && hasValue) {
+      options.renderFileName = argv[++i];
+    }
+    else if (argument == "--render-size" && hasValue) {
+      char* end = NULL;
+      options.renderWidth = std::strtoul(argv[++i], &end, 10);
+      options.renderHeight =
+        (*end == 'x') ? std::strtoul(end + 1, NULL, 10) : 0;
+    }
+    else if (argument == "--render-threads" && hasValue) {
+      options.renderThreads = std::strtoul(argv[++i], NULL, 10);
+    }
+    else if (argument == "--trace" && hasValue) {
+      options.traceFileName = argv[++i];
+    }
+    else if (argument == "--profile") {
+      options.printProfile = true;
+    }
+    else if (argument == "--generate" && hasValue) {
+      options.generate = argv[++i];
+    }
+    else if (argument.compare(0, 2, "--") != 0 &&
+             options.sceneFileName.empty()) {
+      options.sceneFileName = argument;
+    }
+    else {
+      std::cerr << "usage: " << argv[0]
+                << " [--steps <n>] [--delta <seconds>]"
+                << " [--speed <fraction of c>] [--stream]"
+                << " [--sample-rate <hz>] [--players <n>]"
+                << " [--state <file>]"
+                << " [--render <file.ppm>] [--render-size <w>x<h>]"
+                << " [--render-threads <n>]"
+                << " [--trace <file>] [--profile]"
+                << " [--generate <parameters> | scene]\n";
+      std::exit(RESULT_FAILURE);
+    }
+  }
+  
+  if (options.delta <= 0.0 || options.speed < 0.0 || options.speed >= 1.0 ||
+      options.sampleRate < 0.0 || options.players == 0 ||
+      options.renderWidth == 0 || options.renderHeight == 0) {
+    std::cerr << "The time step must be positive, the speed must be less "
+              << "than the speed of light, the sample rate can't be "
+              << "negative, there must be a player, and the image can't be "
+              << "empty.\n";
+    std::exit(RESULT_FAILURE);
+  }
+#ifndef LIGHTSPEED_PROFILING
+  if (options.printProfile || !options.traceFileName.empty()) {
+    std::cerr << "Profiling isn't enabled in this build. Configure with "
+              << "-DLIGHTSPEED_PROFILING=ON to use it.\n";
+  }
+#endif
+  return options;
+}
+
+void createHeadlessPlayer(
+    entityx::EntityManager& entities,
+    double speed,
+    Vector position) {
+  
+  // The player coasts forwards (along -z) at the given speed, which exercises
+  // the time dilation and (when streaming) the loading of new cells.
+  double momentum = speed * LIGHT_SPEED / std::sqrt(1.0 - speed * speed);
+  entityx::Entity player = entities.create();
+  player.assign<AccelerationComponent>();
+  player.assign<BodyComponent>(
+    position,
+    Quaternion(1.0, Vector()),
+    Vector(0.0, 0.0, -momentum));
+  player.assign<IntegratorComponent>();
+  player.assign<PlayerComponent>(
+    NO_KEY,
+    NO_KEY,
+    NO_KEY,
+    NO_KEY,
+    NO_KEY,
+    NO_KEY,
+    0.002,
+    0.5);
+}
+
+bool writeHeadlessState(
+    entityx::EntityManager& entities,
+    std::string const& fileName) {
+  
+  // Every digit is written, so that the files from two builds only match if
+  // they stepped the bodies in exactly the same way.
+  std::FILE* file = std::fopen(fileName.c_str(), "w");
+  if (file == NULL) {
+    std::cerr << "Couldn't write the state to " << fileName << '\n';
+    return false;
+  }
+  entities.each<BodyComponent>(
+    [file](entityx::Entity entity, BodyComponent& body) {
+      std::fprintf(
+        file,
+        "%llu %.17g %.17g %.17g %.17g %.17g %.17g\n",
+        (unsigned long long) entity.id().id(),
+        body.position.x,
+        body.position.y,
+        body.position.z,
+        body.momentum.x,
+        body.momentum.y,
+        body.momentum.z);
+    });
+  std::fclose(file);
+  return true;
+}
+
+void createHeadlessGrid(entityx::EntityManager& entities, MeshArena& meshes) {
+  
+  // The same grid of boxes that the application starts with, spawned all at
+  // once and then spread out.
+  Vector dimensions(0.5, 0.5, 0.5);
+  Mesh mesh = meshes.create(boxMesh(dimensions));
+  std::vector<entityx::Entity> boxes;
+  spawnBatch(
+    entities,
+    11 * 11,
+    boxes,
+    BodyComponent(),
+    CollisionComponent(dimensions / 2.0),
+    ModelComponent(mesh),
+    TimelineComponent<BodyComponent>(10.0));
+  for (int i = -5; i <= +5; ++i) {
+    for (int j = -5; j <= +5; ++j) {
+      entityx::Entity box = boxes[11 * (i + 5) + (j + 5)];
+      box.component<BodyComponent>()->position = Vector(i, j, -5.0);
+    }
+  }
+}
+
+bool renderHeadless(
+    entityx::EntityManager& entities,
+    HeadlessOptions const& options) {
+  
+  // The image is traced from the player, through a camera with the same shape
+  // as the image.
+  BodyComponent observer;
+  entities.each<PlayerComponent, BodyComponent>(
+    [&observer](
+        entityx::Entity entity,
+        PlayerComponent& player,
+        BodyComponent& body) {
+      observer = body;
+    });
+  CameraComponent camera;
+  camera.aspectRatio = (double) options.renderHeight / options.renderWidth;
+  
+  TracerOptions tracerOptions;
+  tracerOptions.threads = options.renderThreads;
+  LightConeTracer tracer(tracerOptions);
+  TracedImage image(options.renderWidth, options.renderHeight);
+  auto start = std::chrono::steady_clock::now();
+  tracer.render(
+    entities,
+    observer,
+    camera,
+    image,
+    [&start](TracedImage const& image, std::size_t step) {
+      double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+      std::printf(
+        "traced 1/%-2lu        %.3f s\n",
+        (unsigned long) step,
+        seconds);
+    });
+  
+  std::ofstream file(options.renderFileName, std::ios::binary);
+  image.writePpm(file);
+  if (!file) {
+    std::cerr << "Couldn't write the image to " << options.renderFileName
+              << '\n';
+    return false;
+  }
+  return true;
+}
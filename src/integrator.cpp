@@ -0,0 +1,167 @@
+#include "integrator.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "component/integrator_component.h"
+
+#include "utility.h"
+#include "vector.h"
+
+// The largest and smallest factors that the substep can change by at once.
+#define STEP_GROWTH_MAX (4.0)
+#define STEP_GROWTH_MIN (0.2)
+// A safety factor so that the chosen substep is slightly smaller than the
+// estimate, reducing the number of rejected substeps.
+#define STEP_SAFETY (0.9)
+
+using namespace lightspeed;
+
+// Calculates the velocity of a body from its momentum.
+Vector bodyVelocity(Vector const& momentum);
+// Estimates the size of the difference between two states, relative to the
+// size of the states themselves.
+double phaseError(PhaseState const& a, PhaseState const& b);
+
+PhaseState lightspeed::eulerStep(
+    PhaseState const& state,
+    ForceFunction const& force,
+    double time,
+    double delta) {
+  
+  // The momentum is updated first, and then the position is updated using the
+  // new momentum.
+  PhaseState result;
+  result.momentum = state.momentum + delta * force(time, state);
+  result.position = state.position + delta * bodyVelocity(result.momentum);
+  return result;
+}
+
+PhaseState lightspeed::rungeKuttaStep(
+    PhaseState const& state,
+    ForceFunction const& force,
+    double time,
+    double delta) {
+  
+  // The derivative of the position is the velocity, and the derivative of the
+  // momentum is the force.
+  PhaseState k1(
+    bodyVelocity(state.momentum),
+    force(time, state));
+  
+  PhaseState s2(
+    state.position + delta / 2.0 * k1.position,
+    state.momentum + delta / 2.0 * k1.momentum);
+  PhaseState k2(
+    bodyVelocity(s2.momentum),
+    force(time + delta / 2.0, s2));
+  
+  PhaseState s3(
+    state.position + delta / 2.0 * k2.position,
+    state.momentum + delta / 2.0 * k2.momentum);
+  PhaseState k3(
+    bodyVelocity(s3.momentum),
+    force(time + delta / 2.0, s3));
+  
+  PhaseState s4(
+    state.position + delta * k3.position,
+    state.momentum + delta * k3.momentum);
+  PhaseState k4(
+    bodyVelocity(s4.momentum),
+    force(time + delta, s4));
+  
+  PhaseState result;
+  result.position = state.position + delta / 6.0 * (
+    k1.position + 2.0 * k2.position + 2.0 * k3.position + k4.position);
+  result.momentum = state.momentum + delta / 6.0 * (
+    k1.momentum + 2.0 * k2.momentum + 2.0 * k3.momentum + k4.momentum);
+  return result;
+}
+
+unsigned int lightspeed::integrate(
+    PhaseState& state,
+    ForceFunction const& force,
+    double delta,
+    IntegratorComponent& integrator) {
+  
+  if (delta <= 0.0) {
+    return 0;
+  }
+  
+  if (integrator.method == IntegrationMethod::EULER) {
+    state = eulerStep(state, force, 0.0, delta);
+    return 1;
+  }
+  
+  // The substep is never allowed to become so small that more than the maximum
+  // number of substeps would be needed.
+  unsigned int maxSubsteps = std::max(integrator.maxSubsteps, 1u);
+  double minStep = delta / maxSubsteps;
+  
+  // Start with the substep that worked last time, if there is one.
+  double step = integrator.substep;
+  if (!(step > 0.0)) {
+    step = delta;
+  }
+  step = std::max(step, minStep);
+  
+  double time = 0.0;
+  unsigned int substeps = 0;
+  while (time < delta) {
+    
+    // Don't step past the end of the update.
+    bool truncated = (step >= delta - time);
+    double h = truncated ? delta - time : step;
+    
+    // The error is estimated by comparing one full step with two half steps.
+    // Since the method is fourth order, the two half steps are more accurate
+    // by a factor of 2^4 - 1 = 15.
+    PhaseState full = rungeKuttaStep(state, force, time, h);
+    PhaseState half = rungeKuttaStep(state, force, time, h / 2.0);
+    half = rungeKuttaStep(half, force, time + h / 2.0, h / 2.0);
+    double error = phaseError(full, half) / 15.0;
+    
+    bool accepted = (error <= integrator.tolerance || h <= minStep);
+    if (accepted) {
+      // The difference between the two results can be used to cancel out the
+      // leading error term (Richardson extrapolation).
+      state.position = half.position + (half.position - full.position) / 15.0;
+      state.momentum = half.momentum + (half.momentum - full.momentum) / 15.0;
+      time = truncated ? delta : time + h;
+      ++substeps;
+    }
+    
+    // Choose the next substep based on how large the error was compared to the
+    // tolerance.
+    double growth = STEP_GROWTH_MAX;
+    if (error > 0.0) {
+      growth = STEP_SAFETY * std::pow(integrator.tolerance / error, 0.2);
+      growth = std::min(std::max(growth, STEP_GROWTH_MIN), STEP_GROWTH_MAX);
+    }
+    double nextStep = std::max(h * growth, minStep);
+    
+    // If the final substep was only small because it reached the end of the
+    // update, then it says nothing bad about the original substep.
+    if (accepted && truncated) {
+      nextStep = std::max(nextStep, step);
+    }
+    step = nextStep;
+  }
+  
+  integrator.substep = step;
+  return substeps;
+}
+
+Vector bodyVelocity(Vector const& momentum) {
+  double energy = std::sqrt(LIGHT_SPEED * LIGHT_SPEED + momentum.normSq());
+  return momentum * LIGHT_SPEED / energy;
+}
+
+double phaseError(PhaseState const& a, PhaseState const& b) {
+  
+  double positionError = (a.position - b.position).norm() /
+                         (1.0 + a.position.norm());
+  double momentumError = (a.momentum - b.momentum).norm() /
+                         (1.0 + a.momentum.norm());
+  return std::max(positionError, momentumError);
+}
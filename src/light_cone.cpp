@@ -0,0 +1,414 @@
+#include "light_cone.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "component/body_component.h"
+#include "component/timeline_component.h"
+
+#include "four_vector.h"
+#include "lorentz_transform.h"
+#include "utility.h"
+#include "vector.h"
+
+// The number of steps taken to move a crossing onto the curved path between
+// two entries, when they are interpolated with a cubic.
+#define HERMITE_CROSSING_STEPS 4
+
+using namespace lightspeed;
+
+double crossingLateness(
+  TimelineComponent<BodyComponent> const& timeline,
+  LightConeCrossing const& crossing,
+  ObserverEvent const& event,
+  double fraction);
+bool retardedSampleFrom(
+  TimelineComponent<BodyComponent> const& timeline,
+  ObserverEvent const& event,
+  double guessTime,
+  TimelineComponent<BodyComponent>::Entry& sample,
+  TimelineInterpolation interpolation);
+// Finds where a backwards light ray from an event first comes within a radius
+// of a body moving uniformly from a position at the first of two times until
+// the second, out to a distance.
+bool rayHitsPath(
+  ObserverEvent const& event,
+  Vector const& direction,
+  Vector const& position,
+  Vector const& velocity,
+  double timeMin,
+  double timeMax,
+  double radius,
+  double distance,
+  double& hitDistance);
+// Finds how far a point has to move from an offset to a sphere at the origin,
+// up to a length, to enter it. A point that starts inside enters it at once.
+bool pointEntersSphere(
+  Vector const& offset,
+  Vector const& step,
+  double radius,
+  double length,
+  double& along);
+
+double lightspeed::retardedTime(Vector const& offset, Vector const& velocity) {
+  
+  // The retarded time t satisfies |d + u t| = -c t, which is a quadratic. The
+  // negative root is the one that is needed.
+  double a = std::min(
+    velocity.normSq() - LIGHT_SPEED * LIGHT_SPEED,
+    -1e-12);
+  double b = 2.0 * offset.dot(velocity);
+  double c = offset.normSq();
+  double discriminant = std::max(b * b - 4.0 * a * c, 0.0);
+  return (-b + std::sqrt(discriminant)) / (2.0 * a);
+}
+
+Vector lightspeed::restDirection(Vector const& direction, Vector const& velocity) {
+  
+  if (velocity.normSq() == 0.0) {
+    return direction;
+  }
+  
+  // Follow the light ray backwards in time in the observer's frame, and then
+  // Lorentz transform it into the resting frame.
+  FourVector<double> ray = FourVector<double>::event(
+    -1.0,
+    LIGHT_SPEED * direction);
+  return (LorentzTransform<double>::boost(-velocity) * ray).space().unit();
+}
+
+bool lightspeed::findLightConeCrossing(
+    TimelineComponent<BodyComponent> const& component,
+    Vector const& position,
+    double guessTime,
+    LightConeCrossing& crossing) {
+  return findLightConeCrossing(
+    component,
+    ObserverEvent(position),
+    guessTime,
+    crossing);
+}
+
+bool lightspeed::findLightConeCrossing(
+    TimelineComponent<BodyComponent> const& component,
+    ObserverEvent const& event,
+    double guessTime,
+    LightConeCrossing& crossing) {
+  
+  // The amount by which an entry misses the light cone increases steadily from
+  // oldest to newest, so the crossing can be found with a binary search.
+  auto const& timeline = component.timeline;
+  auto lateness = [&timeline, &event](std::size_t i) {
+    return timeline[i].first - event.time +
+      (event.position - timeline[i].second.position).norm() / LIGHT_SPEED;
+  };
+  
+  if (timeline.size() < 2 || lateness(0) >= 0.0) {
+    return false;
+  }
+  
+  // Turn the guess into an entry. On a sampling grid the entry is found
+  // exactly from the spacing, and otherwise by assuming that the entries are
+  // evenly spaced in time. The crossing is then bracketed by searching
+  // outwards from the guess, which usually only takes a couple of steps.
+  std::size_t last = timeline.size() - 1;
+  std::size_t guess;
+  if (component.sampleInterval > 0.0) {
+    guess = std::min(component.sampleBefore(guessTime), last - 1);
+  }
+  else {
+    double startTime = timeline.front().first;
+    double endTime = timeline.back().first;
+    double fraction = (endTime > startTime) ?
+      (guessTime - startTime) / (endTime - startTime) :
+      0.0;
+    fraction = std::min(std::max(fraction, 0.0), 1.0);
+    guess = std::min((std::size_t) (fraction * last), last - 1);
+  }
+  
+  std::size_t lower;
+  std::size_t upper;
+  double lowerLateness;
+  double upperLateness;
+  double guessLateness = lateness(guess);
+  if (guessLateness < 0.0) {
+    // Search forwards for an entry that isn't late.
+    lower = guess;
+    lowerLateness = guessLateness;
+    std::size_t step = 1;
+    upper = std::min(guess + step, last);
+    upperLateness = lateness(upper);
+    while (upperLateness < 0.0 && upper < last) {
+      lower = upper;
+      lowerLateness = upperLateness;
+      step *= 2;
+      upper = std::min(upper + step, last);
+      upperLateness = lateness(upper);
+    }
+  }
+  else {
+    // Search backwards for an entry that is late. The oldest entry is known to
+    // be late already.
+    upper = guess;
+    upperLateness = guessLateness;
+    std::size_t step = 1;
+    lower = (guess > step) ? guess - step : 0;
+    lowerLateness = lateness(lower);
+    while (lowerLateness >= 0.0) {
+      upper = lower;
+      upperLateness = lowerLateness;
+      step *= 2;
+      lower = (lower > step) ? lower - step : 0;
+      lowerLateness = lateness(lower);
+    }
+  }
+  
+  // Then narrow down the bracket with a binary search.
+  while (upper - lower > 1) {
+    std::size_t middle = (lower + upper) / 2;
+    double middleLateness = lateness(middle);
+    if (middleLateness < 0.0) {
+      lower = middle;
+      lowerLateness = middleLateness;
+    }
+    else {
+      upper = middle;
+      upperLateness = middleLateness;
+    }
+  }
+  
+  crossing.lower = lower;
+  crossing.upper = upper;
+  crossing.fraction = lowerLateness / (lowerLateness - upperLateness);
+  return true;
+}
+
+bool lightspeed::retardedSample(
+    TimelineComponent<BodyComponent> const& timeline,
+    ObserverEvent const& event,
+    TimelineComponent<BodyComponent>::Entry& sample,
+    TimelineInterpolation interpolation) {
+  
+  if (timeline.timeline.empty()) {
+    return false;
+  }
+  
+  // Guess by assuming that the body has kept moving uniformly since its newest
+  // entry, up to the time of the event.
+  auto const& newest = timeline.timeline.back();
+  Vector velocity = newest.second.momentum * LIGHT_SPEED / newest.second.energy;
+  Vector offset = newest.second.position +
+    velocity * (event.time - newest.first) -
+    event.position;
+  double guessTime = event.time + retardedTime(offset, velocity);
+  return retardedSampleFrom(
+    timeline,
+    event,
+    guessTime,
+    sample,
+    interpolation);
+}
+
+std::size_t lightspeed::retardedSamples(
+    TimelineComponent<BodyComponent> const& timeline,
+    std::vector<ObserverEvent> const& events,
+    std::vector<TimelineComponent<BodyComponent>::Entry>& samples,
+    std::vector<bool>& found,
+    TimelineInterpolation interpolation) {
+  
+  samples.assign(events.size(), TimelineComponent<BodyComponent>::Entry());
+  found.assign(events.size(), false);
+  std::size_t count = 0;
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    if (i > 0 && found[i - 1]) {
+      // The light from a nearby event left at about the same time, shifted by
+      // the difference in the times of the events.
+      double guessTime =
+        samples[i - 1].first + (events[i].time - events[i - 1].time);
+      found[i] = retardedSampleFrom(
+        timeline,
+        events[i],
+        guessTime,
+        samples[i],
+        interpolation);
+    }
+    else {
+      found[i] = retardedSample(timeline, events[i], samples[i], interpolation);
+    }
+    if (found[i]) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+bool lightspeed::lightRayHit(
+    TimelineComponent<BodyComponent> const& timeline,
+    ObserverEvent const& event,
+    Vector const& direction,
+    double radius,
+    double distance,
+    bool holdOldestEntry,
+    double& hitDistance) {
+  
+  auto const& entries = timeline.timeline;
+  if (entries.empty()) {
+    return false;
+  }
+  
+  // The body moves uniformly between each pair of entries, and they are gone
+  // through from the newest so that the first hit is the nearest one.
+  for (std::size_t i = entries.size(); i-- != 0;) {
+    double timeMax = entries[i].first;
+    Vector velocity;
+    if (i + 1 < entries.size()) {
+      timeMax = entries[i + 1].first;
+      if (timeMax > entries[i].first) {
+        velocity =
+          (entries[i + 1].second.position - entries[i].second.position) /
+          (timeMax - entries[i].first);
+      }
+    }
+    if (rayHitsPath(
+        event,
+        direction,
+        entries[i].second.position,
+        velocity,
+        entries[i].first,
+        timeMax,
+        radius,
+        distance,
+        hitDistance)) {
+      return true;
+    }
+  }
+  
+  return holdOldestEntry && rayHitsPath(
+    event,
+    direction,
+    entries.front().second.position,
+    Vector(),
+    -std::numeric_limits<double>::infinity(),
+    entries.front().first,
+    radius,
+    distance,
+    hitDistance);
+}
+
+bool rayHitsPath(
+    ObserverEvent const& event,
+    Vector const& direction,
+    Vector const& position,
+    Vector const& velocity,
+    double timeMin,
+    double timeMax,
+    double radius,
+    double distance,
+    double& hitDistance) {
+  
+  // The point on the ray a distance s back is at the time of the event less
+  // s / c, so the offset from it to the body is linear in s, and it enters the
+  // sphere around the body where a quadratic is zero.
+  double start = std::max((event.time - timeMax) * LIGHT_SPEED, 0.0);
+  double end = std::min((event.time - timeMin) * LIGHT_SPEED, distance);
+  if (start > end) {
+    return false;
+  }
+  double time = event.time - start / LIGHT_SPEED;
+  Vector offset = position +
+    (std::isfinite(timeMin) ? velocity * (time - timeMin) : Vector()) -
+    (event.position + start * direction);
+  Vector step = -velocity / LIGHT_SPEED - direction;
+  double along;
+  if (!pointEntersSphere(offset, step, radius, end - start, along)) {
+    return false;
+  }
+  hitDistance = start + along;
+  return true;
+}
+
+bool pointEntersSphere(
+    Vector const& offset,
+    Vector const& step,
+    double radius,
+    double length,
+    double& along) {
+  
+  double c = offset.normSq() - radius * radius;
+  if (c <= 0.0) {
+    along = 0.0;
+    return true;
+  }
+  double a = step.normSq();
+  double b = offset.dot(step);
+  double discriminant = b * b - a * c;
+  if (a == 0.0 || b >= 0.0 || discriminant < 0.0) {
+    return false;
+  }
+  along = (-b - std::sqrt(discriminant)) / a;
+  return along <= length;
+}
+
+double crossingLateness(
+    TimelineComponent<BodyComponent> const& timeline,
+    LightConeCrossing const& crossing,
+    ObserverEvent const& event,
+    double fraction) {
+  double lowerTime = timeline.timeline[crossing.lower].first;
+  double upperTime = timeline.timeline[crossing.upper].first;
+  double time = lowerTime + fraction * (upperTime - lowerTime);
+  BodyComponent body = timeline.sampleAfter(
+    crossing.lower,
+    time,
+    TimelineInterpolation::HERMITE);
+  return time - event.time +
+    (event.position - body.position).norm() / LIGHT_SPEED;
+}
+
+bool retardedSampleFrom(
+    TimelineComponent<BodyComponent> const& timeline,
+    ObserverEvent const& event,
+    double guessTime,
+    TimelineComponent<BodyComponent>::Entry& sample,
+    TimelineInterpolation interpolation) {
+  
+  LightConeCrossing crossing;
+  if (!findLightConeCrossing(timeline, event, guessTime, crossing)) {
+    return false;
+  }
+  
+  // The crossing is found on the straight lines between the entries. A curved
+  // path crosses the light cone in a slightly different place, which is found
+  // by false position, since the crossing is already bracketed.
+  double fraction = crossing.fraction;
+  if (interpolation == TimelineInterpolation::HERMITE) {
+    double lower = 0.0;
+    double upper = 1.0;
+    double lowerLateness = crossingLateness(timeline, crossing, event, lower);
+    double upperLateness = crossingLateness(timeline, crossing, event, upper);
+    for (int step = 0; step < HERMITE_CROSSING_STEPS; ++step) {
+      double lateness = crossingLateness(timeline, crossing, event, fraction);
+      if (lateness < 0.0) {
+        lower = fraction;
+        lowerLateness = lateness;
+      }
+      else {
+        upper = fraction;
+        upperLateness = lateness;
+      }
+      fraction = lower +
+        (upper - lower) * lowerLateness / (lowerLateness - upperLateness);
+    }
+  }
+  
+  double lowerTime = timeline.timeline[crossing.lower].first;
+  double upperTime = timeline.timeline[crossing.upper].first;
+  sample.first = lowerTime + fraction * (upperTime - lowerTime);
+  sample.second = timeline.sampleAfter(
+    crossing.lower,
+    sample.first,
+    interpolation);
+  return true;
+}
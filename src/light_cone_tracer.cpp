@@ -0,0 +1,513 @@
+#include "light_cone_tracer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/camera_component.h"
+#include "component/model_component.h"
+#include "component/timeline_component.h"
+
+#include "four_vector.h"
+#include "lorentz_transform.h"
+#include "profiler.h"
+#include "quaternion.h"
+#include "thread_pool.h"
+#include "utility.h"
+#include "vector.h"
+#include "vertex.h"
+#include "worldline_tree.h"
+
+// How bright a surface is when the light leaving it grazes it, compared to
+// when it leaves straight out of it.
+#define TRACER_AMBIENT (0.2)
+
+// Segments faster than this (as a fraction of the speed of light) are slowed
+// down to it, since rounding in a timeline can make them seem faster than
+// light.
+#define TRACER_MAX_BETA (0.999999)
+
+using namespace lightspeed;
+
+// A stretch of a timeline over which the entity moves uniformly. Its rest
+// frame is centered on the event where it starts.
+struct TracedSegment {
+  LorentzTransform<double> boost;
+  Vector position;
+  double time;
+  Quaternion rotation;
+  double timeMin;
+  double timeMax;
+};
+
+// Everything the threads need to know about an entity, gathered before they
+// start so that they don't touch the entity manager.
+struct TracedEntity {
+  Vertex const* vertices;
+  std::size_t vertexCount;
+  double radius;
+  std::vector<TracedSegment> segments;
+};
+
+// A part of the image, and the entities that could be seen in it.
+struct TracerTile {
+  std::size_t x0;
+  std::size_t y0;
+  std::size_t x1;
+  std::size_t y1;
+  std::vector<std::size_t> entities;
+};
+
+// The direction that a ray through a pixel leaves the observer in, in the
+// resting frame.
+struct TracerCamera {
+  LorentzTransform<double> boost;
+  Quaternion rotation;
+  double tanHorz;
+  double tanVert;
+  std::size_t width;
+  std::size_t height;
+};
+
+std::size_t tracerFirstLaterThan(
+  TimelineComponent<BodyComponent> const& timeline,
+  Vector const& position,
+  double lateness);
+bool tracerSegments(
+  TimelineComponent<BodyComponent> const& timeline,
+  Vector const& position,
+  double radius,
+  std::vector<TracedSegment>& segments,
+  WorldtubeBounds& bounds);
+TracedSegment tracerSegment(
+  BodyComponent const& body,
+  Vector const& velocity,
+  double time,
+  double timeMin,
+  double timeMax);
+Vector tracerDirection(TracerCamera const& camera, double x, double y);
+bool traceSegment(
+  TracedEntity const& entity,
+  TracedSegment const& segment,
+  Vector const& position,
+  Vector const& direction,
+  double distanceMin,
+  double& distance,
+  double& shade);
+uint8_t traceRay(
+  std::vector<TracedEntity> const& entities,
+  std::vector<std::size_t> const& candidates,
+  Vector const& position,
+  Vector const& direction,
+  double distanceMin,
+  double distanceMax);
+
+void TracedImage::writePpm(std::ostream& stream) const {
+  stream << "P6\n" << width << ' ' << height << "\n255\n";
+  stream.write(
+    reinterpret_cast<char const*>(pixels.data()),
+    pixels.size());
+}
+
+LightConeTracer::LightConeTracer(TracerOptions const& options) :
+    m_options(options),
+    m_pool(options.threads) {
+  
+  // The blocks of the coarsest pass have to fit inside the tiles, so that
+  // each pixel is only ever written by one thread.
+  std::size_t step = 1;
+  while (step < m_options.coarsestStep) {
+    step *= 2;
+  }
+  m_options.coarsestStep = step;
+  m_options.tileSize = std::max(m_options.tileSize, step);
+  m_options.tileSize = (m_options.tileSize + step - 1) / step * step;
+}
+
+void LightConeTracer::render(
+    entityx::EntityManager& entities,
+    BodyComponent const& observer,
+    CameraComponent const& camera,
+    TracedImage& image,
+    Progress const& progress) {
+  
+  PROFILE_SCOPE("LightConeTracer::render");
+  
+  // Gather the parts of the timelines that lie near the past light cone of the
+  // observer, and put them in a tree so that each tile can find the entities
+  // that it might see.
+  std::vector<TracedEntity> traced;
+  std::unordered_map<uint64_t, std::size_t> indices;
+  WorldlineTree tree;
+  entities.each<ModelComponent, TimelineComponent<BodyComponent> >(
+    [&](
+        entityx::Entity entity,
+        ModelComponent& model,
+        TimelineComponent<BodyComponent>& timeline) {
+      
+      if (!model.mesh || model.mesh.vertices() == NULL) {
+        return;
+      }
+      TracedEntity tracedEntity = {
+        model.mesh.vertices(),
+        model.mesh.vertexCount(),
+        model.mesh.radius(),
+        std::vector<TracedSegment>()
+      };
+      WorldtubeBounds bounds;
+      if (!tracerSegments(
+          timeline,
+          observer.position,
+          tracedEntity.radius,
+          tracedEntity.segments,
+          bounds)) {
+        return;
+      }
+      indices[entity.id().id()] = traced.size();
+      traced.push_back(tracedEntity);
+      tree.update(entity, bounds, bounds);
+    });
+  
+  Vector velocity = observer.momentum * LIGHT_SPEED / observer.energy;
+  TracerCamera tracerCamera = {
+    LorentzTransform<double>::boost(-velocity),
+    observer.rotation.unit(),
+    std::tan(camera.fov / camera.aspectRatio / 2.0),
+    std::tan(camera.fov / 2.0),
+    image.width,
+    image.height
+  };
+  
+  std::vector<TracerTile> tiles;
+  std::size_t tileSize = m_options.tileSize;
+  for (std::size_t y = 0; y < image.height; y += tileSize) {
+    for (std::size_t x = 0; x < image.width; x += tileSize) {
+      TracerTile tile = {
+        x,
+        y,
+        std::min(x + tileSize, image.width),
+        std::min(y + tileSize, image.height),
+        std::vector<std::size_t>()
+      };
+      tiles.push_back(tile);
+    }
+  }
+  
+  // Each tile is bounded by a circular cone around the directions of points
+  // along its edges. Aberration bends the edges slightly, so the cone is made
+  // a pixel wider than it needs to be.
+  double pixelAngle = 2.0 * std::atan(
+    2.0 * std::max(
+      tracerCamera.tanHorz / image.width,
+      tracerCamera.tanVert / image.height));
+  m_pool.parallelFor(
+    tiles.size(),
+    [&](std::size_t index, std::size_t thread) {
+      
+      PROFILE_SCOPE("LightConeTracer tile query");
+      TracerTile& tile = tiles[index];
+      double xs[] = {
+        (double) tile.x0,
+        (tile.x0 + tile.x1) / 2.0,
+        (double) tile.x1
+      };
+      double ys[] = {
+        (double) tile.y0,
+        (tile.y0 + tile.y1) / 2.0,
+        (double) tile.y1
+      };
+      Vector directions[9];
+      Vector axis;
+      for (int i = 0; i < 9; ++i) {
+        directions[i] = tracerDirection(tracerCamera, xs[i % 3], ys[i / 3]);
+        axis += directions[i];
+      }
+      double halfAngle = M_PI;
+      if (axis.normSq() > 1e-12) {
+        axis = axis.unit();
+        halfAngle = 0.0;
+        for (Vector const& direction : directions) {
+          halfAngle = std::max(
+            halfAngle,
+            std::acos(std::min(std::max(axis.dot(direction), -1.0), 1.0)));
+        }
+        halfAngle = std::min(halfAngle + pixelAngle, M_PI);
+      }
+      
+      std::vector<entityx::Entity> visible;
+      tree.queryVisible(
+        observer.position,
+        0.0,
+        camera.clipFar,
+        axis,
+        halfAngle,
+        visible);
+      for (entityx::Entity entity : visible) {
+        tile.entities.push_back(indices.at(entity.id().id()));
+      }
+    });
+  
+  // Each pass traces the pixels at the corners of blocks half as wide as the
+  // last pass, skipping those already traced, and fills their blocks in so
+  // that the image is complete (if blocky) after every pass.
+  for (std::size_t step = m_options.coarsestStep; step != 0; step /= 2) {
+    bool first = (step == m_options.coarsestStep);
+    m_pool.parallelFor(
+      tiles.size(),
+      [&](std::size_t index, std::size_t thread) {
+        
+        PROFILE_SCOPE("LightConeTracer tile");
+        TracerTile const& tile = tiles[index];
+        for (std::size_t y = tile.y0; y < tile.y1; y += step) {
+          for (std::size_t x = tile.x0; x < tile.x1; x += step) {
+            if (!first && x % (2 * step) == 0 && y % (2 * step) == 0) {
+              continue;
+            }
+            Vector direction = tracerDirection(tracerCamera, x + 0.5, y + 0.5);
+            uint8_t value = traceRay(
+              traced,
+              tile.entities,
+              observer.position,
+              direction,
+              camera.clipNear,
+              camera.clipFar);
+            std::size_t yEnd = std::min(y + step, tile.y1);
+            std::size_t xEnd = std::min(x + step, tile.x1);
+            for (std::size_t fillY = y; fillY < yEnd; ++fillY) {
+              uint8_t* row = image.pixels.data() + 3 * fillY * image.width;
+              std::fill(row + 3 * x, row + 3 * xEnd, value);
+            }
+          }
+        }
+      });
+    if (progress) {
+      progress(image, step);
+    }
+  }
+}
+
+std::size_t tracerFirstLaterThan(
+    TimelineComponent<BodyComponent> const& timeline,
+    Vector const& position,
+    double lateness) {
+  // How late each entry is for the light cone increases from oldest to
+  // newest, so the first one past a lateness is found by bisection.
+  auto const& entries = timeline.timeline;
+  std::size_t lower = 0;
+  std::size_t upper = entries.size();
+  while (lower < upper) {
+    std::size_t middle = (lower + upper) / 2;
+    double middleLateness = entries[middle].first +
+      (position - entries[middle].second.position).norm() / LIGHT_SPEED;
+    if (middleLateness > lateness) {
+      upper = middle;
+    }
+    else {
+      lower = middle + 1;
+    }
+  }
+  return lower;
+}
+
+bool tracerSegments(
+    TimelineComponent<BodyComponent> const& timeline,
+    Vector const& position,
+    double radius,
+    std::vector<TracedSegment>& segments,
+    WorldtubeBounds& bounds) {
+  
+  auto const& entries = timeline.timeline;
+  if (entries.empty()) {
+    return false;
+  }
+  
+  // Only the entries within the light travel time across the entity of the
+  // light cone can be seen, along with the entries on either side of them.
+  double margin = radius / LIGHT_SPEED;
+  std::size_t start = tracerFirstLaterThan(timeline, position, -margin);
+  std::size_t end = tracerFirstLaterThan(timeline, position, margin);
+  start = (start > 0) ? start - 1 : 0;
+  end = std::min(end, entries.size() - 1);
+  
+  // Before the timeline begins, the entity is held at its oldest entry, like
+  // it is by the rasterizer.
+  bounds = WorldtubeBounds::event(
+    entries[start].second.position,
+    radius,
+    entries[start].first);
+  if (start == 0) {
+    segments.push_back(tracerSegment(
+      entries.front().second,
+      Vector(),
+      entries.front().first,
+      -std::numeric_limits<double>::infinity(),
+      entries.front().first));
+    bounds.timeMin = -std::numeric_limits<double>::infinity();
+  }
+  for (std::size_t i = start; i < end; ++i) {
+    double duration = entries[i + 1].first - entries[i].first;
+    bounds = bounds.merge(WorldtubeBounds::event(
+      entries[i + 1].second.position,
+      radius,
+      entries[i + 1].first));
+    if (duration <= 0.0) {
+      continue;
+    }
+    Vector velocity =
+      (entries[i + 1].second.position - entries[i].second.position) /
+      duration;
+    double maxSpeed = TRACER_MAX_BETA * LIGHT_SPEED;
+    if (velocity.norm() > maxSpeed) {
+      velocity *= maxSpeed / velocity.norm();
+    }
+    segments.push_back(tracerSegment(
+      entries[i].second,
+      velocity,
+      entries[i].first,
+      entries[i].first,
+      entries[i + 1].first));
+  }
+  return !segments.empty();
+}
+
+TracedSegment tracerSegment(
+    BodyComponent const& body,
+    Vector const& velocity,
+    double time,
+    double timeMin,
+    double timeMax) {
+  TracedSegment segment = {
+    LorentzTransform<double>::boost(velocity),
+    body.position,
+    time,
+    body.rotation.unit(),
+    timeMin,
+    timeMax
+  };
+  return segment;
+}
+
+Vector tracerDirection(TracerCamera const& camera, double x, double y) {
+  // The same projection as the rasterizer, with the rows of the image going
+  // from the top down.
+  double ndcX = 2.0 * x / camera.width - 1.0;
+  double ndcY = 1.0 - 2.0 * y / camera.height;
+  Vector direction = camera.rotation.rotateUnit(Vector(
+    ndcX * camera.tanHorz,
+    ndcY * camera.tanVert,
+    -1.0)).unit();
+  FourVector<double> ray = FourVector<double>::event(
+    -1.0,
+    LIGHT_SPEED * direction);
+  return (camera.boost * ray).space().unit();
+}
+
+bool traceSegment(
+    TracedEntity const& entity,
+    TracedSegment const& segment,
+    Vector const& position,
+    Vector const& direction,
+    double distanceMin,
+    double& distance,
+    double& shade) {
+  
+  // The ray only meets the segment while the segment lasts. Following the ray
+  // back a distance goes back in time by the distance over the speed of light.
+  double lower = std::max(distanceMin, -LIGHT_SPEED * segment.timeMax);
+  double upper = std::min(distance, -LIGHT_SPEED * segment.timeMin);
+  if (lower >= upper) {
+    return false;
+  }
+  
+  // Move the ray into the frame where the entity is at rest at the origin and
+  // unrotated. It is still a straight line through the mesh, and distances
+  // along it still measure the same points.
+  FourVector<double> start = FourVector<double>::event(
+    -segment.time,
+    position - segment.position);
+  FourVector<double> step(-1.0, direction);
+  Quaternion inverse = segment.rotation.inverseUnit();
+  Vector origin = inverse.rotateUnit((segment.boost * start).space());
+  Vector ray = inverse.rotateUnit((segment.boost * step).space());
+  
+  // Skip the mesh if the ray doesn't come near enough to it.
+  double closest = std::min(
+    std::max(-origin.dot(ray) / ray.normSq(), lower),
+    upper);
+  if ((origin + closest * ray).normSq() > entity.radius * entity.radius) {
+    return false;
+  }
+  
+  bool hit = false;
+  for (std::size_t i = 0; i + 2 < entity.vertexCount; i += 3) {
+    Vertex const& v0 = entity.vertices[i];
+    Vertex const& v1 = entity.vertices[i + 1];
+    Vertex const& v2 = entity.vertices[i + 2];
+    Vector p0(v0.x, v0.y, v0.z);
+    Vector edge1 = Vector(v1.x, v1.y, v1.z) - p0;
+    Vector edge2 = Vector(v2.x, v2.y, v2.z) - p0;
+    
+    // The Moller-Trumbore intersection, which gives the distance along the
+    // ray directly.
+    Vector p = ray.cross(edge2);
+    double determinant = edge1.dot(p);
+    if (std::abs(determinant) < 1e-15) {
+      continue;
+    }
+    Vector offset = origin - p0;
+    double u = offset.dot(p) / determinant;
+    if (u < 0.0 || u > 1.0) {
+      continue;
+    }
+    Vector q = offset.cross(edge1);
+    double v = ray.dot(q) / determinant;
+    if (v < 0.0 || u + v > 1.0) {
+      continue;
+    }
+    double s = edge2.dot(q) / determinant;
+    if (s < lower || s >= upper) {
+      continue;
+    }
+    
+    upper = s;
+    distance = s;
+    Vector normal = edge1.cross(edge2).unit();
+    shade = TRACER_AMBIENT +
+      (1.0 - TRACER_AMBIENT) * std::abs(normal.dot(ray.unit()));
+    hit = true;
+  }
+  return hit;
+}
+
+uint8_t traceRay(
+    std::vector<TracedEntity> const& entities,
+    std::vector<std::size_t> const& candidates,
+    Vector const& position,
+    Vector const& direction,
+    double distanceMin,
+    double distanceMax) {
+  double distance = distanceMax;
+  double shade = 0.0;
+  for (std::size_t index : candidates) {
+    TracedEntity const& entity = entities[index];
+    for (TracedSegment const& segment : entity.segments) {
+      traceSegment(
+        entity,
+        segment,
+        position,
+        direction,
+        distanceMin,
+        distance,
+        shade);
+    }
+  }
+  return (uint8_t) std::lround(255.0 * std::min(std::max(shade, 0.0), 1.0));
+}
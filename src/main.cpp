@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
 #include <initializer_list>
 #include <iostream>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
@@ -10,6 +14,9 @@
 #include "component/acceleration_component.h"
 #include "component/body_component.h"
 #include "component/camera_component.h"
+#include "component/collision_component.h"
+#include "component/deformation_component.h"
+#include "component/integrator_component.h"
 #include "component/model_component.h"
 #include "component/player_component.h"
 #include "component/timeline_component.h"
@@ -22,12 +29,26 @@
 #include "event/render_event.h"
 
 #include "system/acceleration_system.h"
+#include "system/capture_system.h"
+#include "system/collision_system.h"
+#include "system/interaction_system.h"
 #include "system/movement_system.h"
 #include "system/player_system.h"
 #include "system/relativistic_update_system.h"
 #include "system/render_system.h"
+#include "system/scene_system.h"
+#include "system/streaming_system.h"
 #include "system/timeline_system.h"
+#include "system/worldline_system.h"
 
+#include "event_queue.h"
+#include "frame_writer.h"
+#include "memory_tracker.h"
+#include "mesh.h"
+#include "profiler.h"
+#include "scene.h"
+#include "scene_generator.h"
+#include "shader_counters.h"
 #include "texture.h"
 #include "vector.h"
 #include "vertex.h"
@@ -35,21 +56,65 @@
 #define RESULT_SUCCESS (0)
 #define RESULT_FAILURE (-1)
 
+// How often the profiling and memory summaries are printed, in seconds.
+#define SUMMARY_INTERVAL (5.0)
+
 using namespace lightspeed;
 
+// The geometry shared between entities. It is declared first so that it
+// outlives every entity.
+MeshArena meshes;
+
 // Variables to do with the entity component system framework.
 entityx::EventManager events;
 entityx::EntityManager entities(events);
 entityx::SystemManager systems(entities, events);
 
+// The input since the last frame, which is handed to the systems all at once
+// before they are updated. Only the latest mouse position is kept.
+EventQueue input;
+
+// The scene given on the command line (as a file, or as the parameters of a
+// generated scene), if any, and whether it should be streamed in around the
+// player rather than created all at once.
+std::shared_ptr<Scene const> scene;
+bool streamScene = false;
+
+// The number of observers, which split the window between them. The first is
+// the player, and the others stay at rest beside where the player starts.
+unsigned int observerCount = 1;
+
+// The proper-time interval between the samples stored in each timeline, or
+// zero to store a sample on every frame.
+double sampleInterval = 0.0;
+
+// Where to write the frames of a recording (as a prefix of their file names),
+// if anything is being recorded, and what kind of image to write them as.
+std::string recordPrefix;
+FrameFormat recordFormat = FrameFormat::PNG;
+
+// Whether entities hidden behind others are skipped when drawing.
+bool occlusionCulling = true;
+
+// Where the shader counters are written, if they are turned on.
+std::unique_ptr<ShaderCounters> shaderCounters;
+
+// Where to write the profiling trace when the program exits, and whether to
+// print summaries of the profiling and the memory use while running.
+std::string traceFileName;
+bool printProfile = false;
+bool printMemory = false;
+
 // Functions that set up the scene.
 void createScene();
 void createPlayer();
-void createBox(Vector position, Vector dimensions);
+void createObserver(unsigned int index);
+void createBox(Vector position, Vector dimensions, Mesh mesh);
 
 // Event handling functions.
 void onGlfwError(int error, char const* description);
 void onGlError(int error);
+void writeTrace();
 
 void onInitialize(GLFWwindow* window);
 void onFinalize(GLFWwindow* window);
@@ -66,6 +131,72 @@ void onKeyboard(
 
 int main(int argc, char** argv) {
   
+  // Map the scene file before creating the window, so that a bad file doesn't
+  // flash up an empty window.
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--stream") {
+      streamScene = true;
+      continue;
+    }
+    if (std::string(argv[i]) == "--trace" && i + 1 < argc) {
+      traceFileName = argv[++i];
+      continue;
+    }
+    if (std::string(argv[i]) == "--profile") {
+      printProfile = true;
+      continue;
+    }
+    if (std::string(argv[i]) == "--memory") {
+      printMemory = true;
+      continue;
+    }
+    if (std::string(argv[i]) == "--observers" && i + 1 < argc) {
+      observerCount = std::max(std::atoi(argv[++i]), 1);
+      continue;
+    }
+    if (std::string(argv[i]) == "--shader-counters" && i + 1 < argc) {
+      shaderCounters.reset(new ShaderCounters(argv[++i]));
+      continue;
+    }
+    if (std::string(argv[i]) == "--no-occlusion") {
+      occlusionCulling = false;
+      continue;
+    }
+    if (std::string(argv[i]) == "--record" && i + 1 < argc) {
+      recordPrefix = argv[++i];
+      continue;
+    }
+    if (std::string(argv[i]) == "--record-format" && i + 1 < argc) {
+      std::string format = argv[++i];
+      if (format != "png" && format != "ppm") {
+        std::cerr << "Frames can only be recorded as png or ppm." << '\n';
+        exit(RESULT_FAILURE);
+      }
+      recordFormat = (format == "png") ? FrameFormat::PNG : FrameFormat::PPM;
+      continue;
+    }
+    if (std::string(argv[i]) == "--sample-rate" && i + 1 < argc) {
+      double rate = std::atof(argv[++i]);
+      sampleInterval = (rate > 0.0) ? 1.0 / rate : 0.0;
+      continue;
+    }
+    try {
+      if (std::string(argv[i]) == "--generate" && i + 1 < argc) {
+        GeneratorParameters parameters;
+        parseGeneratorParameters(argv[++i], parameters);
+        SceneBuilder builder;
+        generateScene(parameters, builder);
+        scene = std::make_shared<Scene>(builder, meshes);
+        continue;
+      }
+      scene = std::make_shared<Scene>(argv[i], meshes);
+    }
+    catch (std::runtime_error const& error) {
+      std::cerr << error.what() << '\n';
+      exit(RESULT_FAILURE);
+    }
+  }
+  
   // Initialize GLFW.
   if (!glfwInit()) {
     std::cerr << "GLFW failed to initialize." << '\n';
@@ -106,11 +237,22 @@ int main(int argc, char** argv) {
   
   // Set up the entities and components.
   createScene();
+
+#ifndef LIGHTSPEED_PROFILING
+  if (printProfile || !traceFileName.empty()) {
+    std::cerr << "Profiling isn't enabled in this build. Configure with "
+              << "-DLIGHTSPEED_PROFILING=ON to use it." << '\n';
+  }
+#endif
+  PROFILE_THREAD("main");
   
   // Enter the main program loop.
   double previousTime = glfwGetTime();
+  double previousSummaryTime = previousTime;
   while (!glfwWindowShouldClose(window)) {
     
+    PROFILE_SCOPE("frame");
+    
     // First check for any errors.
     GLenum error = glGetError();
     if (error != GL_NO_ERROR) {
@@ -131,12 +273,29 @@ int main(int argc, char** argv) {
     onRender(window, width, height);
     
     // Swap the buffers and poll any window or keyboard events.
-    glfwPollEvents();
-    glfwSwapBuffers(window);
+    {
+      PROFILE_SCOPE("present");
+      glfwPollEvents();
+      glfwSwapBuffers(window);
+    }
+    
+    if (currentTime - previousSummaryTime >= SUMMARY_INTERVAL) {
+      if (printProfile) {
+        Profiler::instance().writeSummary(std::cerr, SUMMARY_INTERVAL);
+      }
+      if (printMemory) {
+        MemoryTracker::instance().dump(std::cerr);
+      }
+      if (shaderCounters) {
+        shaderCounters->writeSummary(std::cerr);
+      }
+      previousSummaryTime = currentTime;
+    }
   }
   
   // Clean up the entity component system framework.
   onFinalize(window);
+  writeTrace();
   
   // Clean up GLFW.
   glfwDestroyWindow(window);
@@ -148,11 +307,22 @@ int main(int argc, char** argv) {
 void createScene() {
   
   createPlayer();
+  for (unsigned int index = 1; index < observerCount; ++index) {
+    createObserver(index);
+  }
+  
+  // The scene or streaming system creates the entities from the scene file
+  // instead.
+  if (scene) {
+    return;
+  }
   
-  // Create 121 boxes arrayed in a grid.
+  // Create 121 boxes arrayed in a grid, all sharing the same mesh.
+  Vector dimensions(0.5, 0.5, 0.5);
+  Mesh mesh = meshes.create(boxMesh(dimensions), { NULL });
   for (int i = -5; i <= +5; ++i) {
     for (int j = -5; j <= +5; ++j) {
-      createBox(Vector(i, j, -5.0), Vector(0.5, 0.5, 0.5));
+      createBox(Vector(i, j, -5.0), dimensions, mesh);
     }
   }
 }
@@ -162,7 +332,14 @@ void createPlayer() {
   entityx::Entity player = entities.create();
   player.assign<AccelerationComponent>();
   player.assign<BodyComponent>();
-  player.assign<CameraComponent>(M_PI / 4.0, 0.75, 0.5, 1000.0);
+  entityx::ComponentHandle<CameraComponent> camera =
+    player.assign<CameraComponent>(
+      M_PI / 4.0,
+      0.75 * observerCount,
+      0.5,
+      1000.0);
+  camera->viewportWidth = 1.0 / observerCount;
+  player.assign<IntegratorComponent>();
   player.assign<PlayerComponent>(
     GLFW_KEY_W,
     GLFW_KEY_S,
@@ -174,79 +351,61 @@ void createPlayer() {
     0.5);
 }
 
-void createBox(Vector position, Vector dimensions) {
+void createObserver(unsigned int index) {
   
-  GLfloat x1 = -dimensions.x / 2.0;
-  GLfloat x2 = +dimensions.x / 2.0;
-  GLfloat y1 = -dimensions.y / 2.0;
-  GLfloat y2 = +dimensions.y / 2.0;
-  GLfloat z1 = -dimensions.z / 2.0;
-  GLfloat z2 = +dimensions.z / 2.0;
-  
-  std::initializer_list<Vertex> vertices = {
-    
-    // Constant x surfaces of the cube:
-    { x1, y1, z1, 0, 0.0, 0.0 },
-    { x1, y1, z2, 0, 0.0, 0.0 },
-    { x1, y2, z1, 0, 0.0, 0.0 },
-    { x1, y2, z1, 0, 0.0, 0.0 },
-    { x1, y1, z2, 0, 0.0, 0.0 },
-    { x1, y2, z2, 0, 0.0, 0.0 },
-    
-    { x2, y1, z1, 0, 0.0, 0.0 },
-    { x2, y2, z1, 0, 0.0, 0.0 },
-    { x2, y1, z2, 0, 0.0, 0.0 },
-    { x2, y1, z2, 0, 0.0, 0.0 },
-    { x2, y2, z1, 0, 0.0, 0.0 },
-    { x2, y2, z2, 0, 0.0, 0.0 },
-    
-    // Constant y surfaces of the cube:
-    { x1, y1, z1, 0, 0.0, 0.0 },
-    { x2, y1, z1, 0, 0.0, 0.0 },
-    { x1, y1, z2, 0, 0.0, 0.0 },
-    { x1, y1, z2, 0, 0.0, 0.0 },
-    { x2, y1, z1, 0, 0.0, 0.0 },
-    { x2, y1, z2, 0, 0.0, 0.0 },
-    
-    { x1, y2, z1, 0, 0.0, 0.0 },
-    { x1, y2, z2, 0, 0.0, 0.0 },
-    { x2, y2, z1, 0, 0.0, 0.0 },
-    { x2, y2, z1, 0, 0.0, 0.0 },
-    { x1, y2, z2, 0, 0.0, 0.0 },
-    { x2, y2, z2, 0, 0.0, 0.0 },
-    
-    // Constant z surfaces of the cube:
-    { x1, y1, z1, 0, 0.0, 0.0 },
-    { x1, y2, z1, 0, 0.0, 0.0 },
-    { x2, y1, z1, 0, 0.0, 0.0 },
-    { x2, y1, z1, 0, 0.0, 0.0 },
-    { x1, y2, z1, 0, 0.0, 0.0 },
-    { x2, y2, z1, 0, 0.0, 0.0 },
-    
-    { x1, y1, z2, 0, 0.0, 0.0 },
-    { x2, y1, z2, 0, 0.0, 0.0 },
-    { x1, y2, z2, 0, 0.0, 0.0 },
-    { x1, y2, z2, 0, 0.0, 0.0 },
-    { x2, y1, z2, 0, 0.0, 0.0 },
-    { x2, y2, z2, 0, 0.0, 0.0 }
-  };
-  
-  std::initializer_list<Texture*> textures = { NULL };
+  // Each observer gets the next column of the window.
+  entityx::Entity observer = entities.create();
+  observer.assign<BodyComponent>(
+    Vector(2.0 * index, 0.0, 0.0),
+    Quaternion(1.0, Vector()),
+    Vector());
+  entityx::ComponentHandle<CameraComponent> camera =
+    observer.assign<CameraComponent>(
+      M_PI / 4.0,
+      0.75 * observerCount,
+      0.5,
+      1000.0);
+  camera->viewportX = (double) index / observerCount;
+  camera->viewportWidth = 1.0 / observerCount;
+}
+
+void createBox(Vector position, Vector dimensions, Mesh mesh) {
   
   entityx::Entity box = entities.create();
   box.assign<BodyComponent>(position, Quaternion(1.0, Vector()), Vector());
-  box.assign<ModelComponent>(vertices, textures);
+  box.assign<CollisionComponent>(dimensions / 2.0);
+  box.assign<ModelComponent>(mesh);
   box.assign<TimelineComponent<BodyComponent> >(10.0);
 }
 
 void onInitialize(GLFWwindow* window) {
   
+  std::shared_ptr<WorldlineSystem> worldlines =
+    std::make_shared<WorldlineSystem>();
+  
+  if (scene && streamScene) {
+    systems.add<StreamingSystem>(scene);
+  }
+  else if (scene) {
+    systems.add<SceneSystem>(scene);
+  }
   systems.add<AccelerationSystem>();
   systems.add<MovementSystem>();
   systems.add<PlayerSystem>();
+  systems.add<InteractionSystem>();
   systems.add<RelativisticUpdateSystem>();
-  systems.add<RenderSystem>();
-  systems.add<TimelineSystem<BodyComponent> >();
+  systems.add<CollisionSystem>();
+  systems.add<RenderSystem>(
+    worldlines.get(),
+    occlusionCulling,
+    shaderCounters.get());
+  // The frame has to be drawn before it can be recorded.
+  if (!recordPrefix.empty()) {
+    systems.add<CaptureSystem>(recordPrefix, recordFormat);
+  }
+  systems.add<TimelineSystem<BodyComponent> >(sampleInterval);
+  systems.add<TimelineSystem<DeformationComponent> >(sampleInterval);
+  systems.add(worldlines);
   systems.configure();
   
   events.emit<InitializeEvent>();
@@ -257,19 +416,22 @@ void onFinalize(GLFWwindow* window) {
 }
 
 void onUpdate(GLFWwindow* window, double delta) {
+  PROFILE_SCOPE("update");
+  input.flush(events);
   systems.update_all(delta);
 }
 
 void onRender(GLFWwindow* window, int viewportWidth, int viewportHeight) {
+  PROFILE_SCOPE("render");
   events.emit<RenderEvent>(viewportWidth, viewportHeight);
 }
 
 void onMousePosition(GLFWwindow* window, double xpos, double ypos) {
-  events.emit<MousePositionEvent>(xpos, ypos);
+  input.replace(MousePositionEvent(xpos, ypos));
 }
 
 void onMouseButton(GLFWwindow* window, int button, int action, int mods) {
-  events.emit<MouseButtonEvent>(button, action, mods);
+  input.push(MouseButtonEvent(button, action, mods));
 }
 
 void onKeyboard(
@@ -278,8 +440,8 @@ void onKeyboard(
     int scancode,
     int action,
     int mods) {
-  
-  events.emit<KeyboardEvent>(key, scancode, action, mods);
+      
+  input.push(KeyboardEvent(key, scancode, action, mods));
 }
 
 void onGlfwError(int error, char const* description) {
@@ -293,3 +455,14 @@ void onGlError(int error) {
   exit(RESULT_FAILURE);
 }
 
+void writeTrace() {
+  if (traceFileName.empty()) {
+    return;
+  }
+  std::ofstream file(traceFileName);
+  if (!file) {
+    std::cerr << "Couldn't write the trace to " << traceFileName << '\n';
+    return;
+  }
+  Profiler::instance().writeChromeTrace(file);
+}
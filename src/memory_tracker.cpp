@@ -0,0 +1,141 @@
+#include "memory_tracker.h"
+
+#include <atomic>
+#include <cstddef>
+#include <iomanip>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace lightspeed;
+
+MemoryCounter::MemoryCounter(std::string category) :
+    m_category(category),
+    m_bytes(0),
+    m_peakBytes(0),
+    m_allocations(0) {
+}
+
+void MemoryCounter::allocate(std::size_t bytes) {
+  m_allocations += 1;
+  updatePeak(m_bytes += bytes);
+}
+
+void MemoryCounter::deallocate(std::size_t bytes) {
+  m_allocations -= 1;
+  m_bytes -= bytes;
+}
+
+void MemoryCounter::resize(std::size_t oldBytes, std::size_t newBytes) {
+  if (newBytes >= oldBytes) {
+    updatePeak(m_bytes += newBytes - oldBytes);
+  }
+  else {
+    m_bytes -= oldBytes - newBytes;
+  }
+}
+
+MemoryUsage MemoryCounter::usage() const {
+  MemoryUsage usage;
+  usage.category = m_category;
+  usage.bytes = m_bytes;
+  usage.peakBytes = m_peakBytes;
+  usage.allocations = m_allocations;
+  return usage;
+}
+
+void MemoryCounter::resetPeak() {
+  m_peakBytes = m_bytes.load();
+}
+
+void MemoryCounter::updatePeak(std::size_t bytes) {
+  std::size_t peak = m_peakBytes.load();
+  while (bytes > peak && !m_peakBytes.compare_exchange_weak(peak, bytes)) {
+  }
+}
+
+MemoryTracker& MemoryTracker::instance() {
+  // The tracker is never destroyed, since containers in other static objects
+  // may still free memory into it while the program exits.
+  static MemoryTracker* tracker = new MemoryTracker();
+  return *tracker;
+}
+
+MemoryTracker::MemoryTracker() :
+    m_mutex(),
+    m_counters() {
+}
+
+MemoryCounter& MemoryTracker::counter(std::string const& category) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto const& counter : m_counters) {
+    if (counter->usage().category == category) {
+      return *counter;
+    }
+  }
+  m_counters.emplace_back(new MemoryCounter(category));
+  return *m_counters.back();
+}
+
+MemoryUsage MemoryTracker::usage(std::string const& category) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto const& counter : m_counters) {
+    MemoryUsage usage = counter->usage();
+    if (usage.category == category) {
+      return usage;
+    }
+  }
+  MemoryUsage usage;
+  usage.category = category;
+  return usage;
+}
+
+std::vector<MemoryUsage> MemoryTracker::usage() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  std::vector<MemoryUsage> result;
+  for (auto const& counter : m_counters) {
+    result.push_back(counter->usage());
+  }
+  return result;
+}
+
+void MemoryTracker::resetPeaks() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (auto const& counter : m_counters) {
+    counter->resetPeak();
+  }
+}
+
+void MemoryTracker::dump(std::ostream& stream) const {
+  std::vector<MemoryUsage> usages = usage();
+  std::ios::fmtflags flags = stream.flags();
+  std::streamsize precision = stream.precision();
+  
+  // The total of the peaks is an upper bound, since the categories may not
+  // have peaked at the same time.
+  MemoryUsage total;
+  total.category = "total";
+  for (MemoryUsage const& usage : usages) {
+    total.bytes += usage.bytes;
+    total.peakBytes += usage.peakBytes;
+    total.allocations += usage.allocations;
+  }
+  usages.push_back(total);
+  
+  stream << std::left << std::setw(32) << "category" << std::right
+         << std::setw(14) << "KiB"
+         << std::setw(14) << "peak KiB"
+         << std::setw(14) << "allocations" << '\n';
+  stream << std::fixed << std::setprecision(1);
+  for (MemoryUsage const& usage : usages) {
+    stream << std::left << std::setw(32) << usage.category << std::right
+           << std::setw(14) << usage.bytes / 1024.0
+           << std::setw(14) << usage.peakBytes / 1024.0
+           << std::setw(14) << usage.allocations << '\n';
+  }
+  stream.flags(flags);
+  stream.precision(precision);
+}
@@ -0,0 +1,334 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include "memory_tracker.h"
+#include "texture.h"
+#include "vector.h"
+#include "vertex.h"
+
+using namespace lightspeed;
+
+Mesh::Mesh() :
+    m_arena(NULL),
+    m_index(0) {
+}
+
+Mesh::Mesh(MeshArena* arena, uint32_t index) :
+    m_arena(arena),
+    m_index(index) {
+  m_arena->retain(m_index);
+}
+
+Mesh::Mesh(Mesh const& other) :
+    m_arena(other.m_arena),
+    m_index(other.m_index) {
+  if (m_arena != NULL) {
+    m_arena->retain(m_index);
+  }
+}
+
+Mesh& Mesh::operator=(Mesh const& other) {
+  // Retain first, in case both handles refer to the same mesh.
+  if (other.m_arena != NULL) {
+    other.m_arena->retain(other.m_index);
+  }
+  if (m_arena != NULL) {
+    m_arena->release(m_index);
+  }
+  m_arena = other.m_arena;
+  m_index = other.m_index;
+  return *this;
+}
+
+Mesh::~Mesh() {
+  if (m_arena != NULL) {
+    m_arena->release(m_index);
+  }
+}
+
+Mesh::operator bool() const {
+  return m_arena != NULL;
+}
+
+bool Mesh::operator==(Mesh const& rhs) const {
+  return m_arena == rhs.m_arena && m_index == rhs.m_index;
+}
+
+bool Mesh::operator!=(Mesh const& rhs) const {
+  return !(*this == rhs);
+}
+
+std::size_t Mesh::id() const {
+  return m_index;
+}
+
+std::size_t Mesh::useCount() const {
+  return m_arena != NULL ? m_arena->m_records[m_index].references : 0;
+}
+
+Vertex const* Mesh::vertices() const {
+  return m_arena->m_records[m_index].vertices;
+}
+
+std::size_t Mesh::vertexCount() const {
+  return m_arena->m_records[m_index].vertexCount;
+}
+
+double Mesh::radius() const {
+  return m_arena->m_records[m_index].radius;
+}
+
+std::vector<Texture*> const& Mesh::textures() const {
+  return m_arena->m_records[m_index].textures;
+}
+
+void Mesh::discardVertices() const {
+  m_arena->discard(m_index);
+}
+
+MeshArena::MeshArena(std::size_t blockSize) :
+    m_blockSize(blockSize),
+    m_records(),
+    m_freeRecords(),
+    m_blocks(),
+    m_usedVertices(0),
+    m_memory(MemoryTracker::instance().counter("ModelComponent meshes")) {
+}
+
+MeshArena::~MeshArena() {
+  for (Block const& block : m_blocks) {
+    m_memory.deallocate(block.capacity * sizeof(Vertex));
+  }
+}
+
+Mesh MeshArena::create(
+    Vertex const* vertices,
+    std::size_t vertexCount,
+    std::initializer_list<Texture*> textures) {
+  std::size_t block = allocate(vertexCount);
+  Block& storage = m_blocks[block];
+  Vertex* copy = storage.vertices.get() + storage.used;
+  std::copy(vertices, vertices + vertexCount, copy);
+  storage.used += vertexCount;
+  storage.meshes += 1;
+  m_usedVertices += vertexCount;
+  return add(copy, vertexCount, block, textures);
+}
+
+Mesh MeshArena::create(
+    std::vector<Vertex> const& vertices,
+    std::initializer_list<Texture*> textures) {
+  return create(vertices.data(), vertices.size(), textures);
+}
+
+Mesh MeshArena::borrow(
+    Vertex const* vertices,
+    std::size_t vertexCount,
+    std::initializer_list<Texture*> textures) {
+  return add(vertices, vertexCount, NO_BLOCK, textures);
+}
+
+std::size_t MeshArena::meshCount() const {
+  return m_records.size() - m_freeRecords.size();
+}
+
+std::size_t MeshArena::reservedBytes() const {
+  std::size_t capacity = 0;
+  for (Block const& block : m_blocks) {
+    capacity += block.capacity;
+  }
+  return capacity * sizeof(Vertex);
+}
+
+std::size_t MeshArena::usedBytes() const {
+  return m_usedVertices * sizeof(Vertex);
+}
+
+Mesh MeshArena::add(
+    Vertex const* vertices,
+    std::size_t vertexCount,
+    std::size_t block,
+    std::initializer_list<Texture*> textures) {
+  Record record;
+  record.vertices = vertices;
+  record.vertexCount = vertexCount;
+  record.radius = 0.0;
+  record.textures = textures;
+  record.block = block;
+  record.references = 0;
+  for (std::size_t i = 0; i < vertexCount; ++i) {
+    Vector position(vertices[i].x, vertices[i].y, vertices[i].z);
+    record.radius = std::max(record.radius, position.norm());
+  }
+  
+  uint32_t index;
+  if (!m_freeRecords.empty()) {
+    index = m_freeRecords.back();
+    m_freeRecords.pop_back();
+    m_records[index] = record;
+  }
+  else {
+    index = m_records.size();
+    m_records.push_back(record);
+  }
+  return Mesh(this, index);
+}
+
+std::size_t MeshArena::allocate(std::size_t vertexCount) {
+  // Meshes are usually created in bursts of the same few shapes, so the most
+  // recently used blocks are the most likely to have room.
+  for (std::size_t i = m_blocks.size(); i-- > 0;) {
+    if (m_blocks[i].capacity - m_blocks[i].used >= vertexCount) {
+      return i;
+    }
+  }
+  
+  Block block;
+  block.capacity = std::max(m_blockSize, vertexCount);
+  block.vertices.reset(new Vertex[block.capacity]);
+  m_memory.allocate(block.capacity * sizeof(Vertex));
+  block.used = 0;
+  block.meshes = 0;
+  m_blocks.push_back(std::move(block));
+  return m_blocks.size() - 1;
+}
+
+void MeshArena::retain(uint32_t index) {
+  m_records[index].references += 1;
+}
+
+void MeshArena::release(uint32_t index) {
+  Record& record = m_records[index];
+  record.references -= 1;
+  if (record.references == 0) {
+    discard(index);
+    record.textures.clear();
+    m_freeRecords.push_back(index);
+  }
+}
+
+void MeshArena::discard(uint32_t index) {
+  Record& record = m_records[index];
+  if (record.block != NO_BLOCK) {
+    Block& block = m_blocks[record.block];
+    block.meshes -= 1;
+    if (block.meshes == 0) {
+      block.used = 0;
+    }
+    m_usedVertices -= record.vertexCount;
+  }
+  // Borrowed vertices aren't owned by the arena, but they are dropped as well
+  // so that discarding behaves the same for every mesh.
+  record.vertices = NULL;
+  record.block = NO_BLOCK;
+}
+
+std::vector<Vertex> lightspeed::boxMesh(Vector dimensions) {
+  
+  float x1 = -dimensions.x / 2.0;
+  float x2 = +dimensions.x / 2.0;
+  float y1 = -dimensions.y / 2.0;
+  float y2 = +dimensions.y / 2.0;
+  float z1 = -dimensions.z / 2.0;
+  float z2 = +dimensions.z / 2.0;
+  
+  return {
+    
+    // Constant x surfaces of the cube:
+    { x1, y1, z1, 0, 0.0, 0.0 },
+    { x1, y1, z2, 0, 0.0, 0.0 },
+    { x1, y2, z1, 0, 0.0, 0.0 },
+    { x1, y2, z1, 0, 0.0, 0.0 },
+    { x1, y1, z2, 0, 0.0, 0.0 },
+    { x1, y2, z2, 0, 0.0, 0.0 },
+    
+    { x2, y1, z1, 0, 0.0, 0.0 },
+    { x2, y2, z1, 0, 0.0, 0.0 },
+    { x2, y1, z2, 0, 0.0, 0.0 },
+    { x2, y1, z2, 0, 0.0, 0.0 },
+    { x2, y2, z1, 0, 0.0, 0.0 },
+    { x2, y2, z2, 0, 0.0, 0.0 },
+    
+    // Constant y surfaces of the cube:
+    { x1, y1, z1, 0, 0.0, 0.0 },
+    { x2, y1, z1, 0, 0.0, 0.0 },
+    { x1, y1, z2, 0, 0.0, 0.0 },
+    { x1, y1, z2, 0, 0.0, 0.0 },
+    { x2, y1, z1, 0, 0.0, 0.0 },
+    { x2, y1, z2, 0, 0.0, 0.0 },
+    
+    { x1, y2, z1, 0, 0.0, 0.0 },
+    { x1, y2, z2, 0, 0.0, 0.0 },
+    { x2, y2, z1, 0, 0.0, 0.0 },
+    { x2, y2, z1, 0, 0.0, 0.0 },
+    { x1, y2, z2, 0, 0.0, 0.0 },
+    { x2, y2, z2, 0, 0.0, 0.0 },
+    
+    // Constant z surfaces of the cube:
+    { x1, y1, z1, 0, 0.0, 0.0 },
+    { x1, y2, z1, 0, 0.0, 0.0 },
+    { x2, y1, z1, 0, 0.0, 0.0 },
+    { x2, y1, z1, 0, 0.0, 0.0 },
+    { x1, y2, z1, 0, 0.0, 0.0 },
+    { x2, y2, z1, 0, 0.0, 0.0 },
+    
+    { x1, y1, z2, 0, 0.0, 0.0 },
+    { x2, y1, z2, 0, 0.0, 0.0 },
+    { x1, y2, z2, 0, 0.0, 0.0 },
+    { x1, y2, z2, 0, 0.0, 0.0 },
+    { x2, y1, z2, 0, 0.0, 0.0 },
+    { x2, y2, z2, 0, 0.0, 0.0 }
+  };
+}
+
+std::vector<Vertex> lightspeed::sphereMesh(
+    double radius,
+    unsigned int segments) {
+  
+  unsigned int around = std::max(segments, 3u);
+  unsigned int rings = std::max(segments / 2, 2u);
+  auto point = [radius, around, rings](unsigned int ring, unsigned int step) {
+    double theta = M_PI * ring / rings;
+    double phi = 2.0 * M_PI * step / around;
+    Vertex vertex = {
+      (float) (radius * std::sin(theta) * std::cos(phi)),
+      (float) (radius * std::cos(theta)),
+      (float) (radius * std::sin(theta) * std::sin(phi)),
+      0,
+      (float) ((double) step / around),
+      (float) ((double) ring / rings)
+    };
+    return vertex;
+  };
+  
+  // Each quad between two rings is split into two triangles, except at the
+  // poles where one of them would have no area.
+  std::vector<Vertex> vertices;
+  vertices.reserve(6 * around * rings);
+  for (unsigned int ring = 0; ring < rings; ++ring) {
+    for (unsigned int step = 0; step < around; ++step) {
+      Vertex a = point(ring, step);
+      Vertex b = point(ring + 1, step);
+      Vertex c = point(ring, step + 1);
+      Vertex d = point(ring + 1, step + 1);
+      if (ring != 0) {
+        vertices.push_back(a);
+        vertices.push_back(c);
+        vertices.push_back(b);
+      }
+      if (ring != rings - 1) {
+        vertices.push_back(b);
+        vertices.push_back(c);
+        vertices.push_back(d);
+      }
+    }
+  }
+  return vertices;
+}
@@ -0,0 +1,205 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ios>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace lightspeed;
+
+void writeJsonString(std::ostream& stream, char const* string);
+
+std::size_t const Profiler::BUFFER_SIZE;
+
+Profiler& Profiler::instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler() :
+    m_epoch(std::chrono::steady_clock::now()),
+    m_mutex(),
+    m_buffers() {
+}
+
+uint64_t Profiler::now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now() - m_epoch).count();
+}
+
+void Profiler::record(char const* name, uint64_t start, uint64_t end) {
+  ThreadBuffer& buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.events[buffer.recorded % BUFFER_SIZE] =
+    ProfileEvent(name, start, end - start);
+  ++buffer.recorded;
+}
+
+void Profiler::nameThread(char const* name) {
+  ThreadBuffer& buffer = threadBuffer();
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  buffer.name = name;
+}
+
+void Profiler::writeChromeTrace(std::ostream& stream) const {
+  
+  std::vector<ThreadBuffer*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto const& buffer : m_buffers) {
+      buffers.push_back(buffer.get());
+    }
+  }
+  
+  // The timestamps are written in microseconds.
+  std::ios::fmtflags flags = stream.flags();
+  std::streamsize precision = stream.precision();
+  stream << std::fixed << std::setprecision(3);
+  stream << "{\"traceEvents\":[";
+  bool first = true;
+  std::vector<ProfileEvent> events;
+  for (ThreadBuffer* buffer : buffers) {
+    char const* threadName;
+    {
+      std::lock_guard<std::mutex> lock(buffer->mutex);
+      threadName = buffer->name;
+    }
+    collect(*buffer, events);
+    
+    if (threadName != NULL) {
+      stream << (first ? "" : ",") << "\n"
+             << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+             << buffer->thread << ",\"args\":{\"name\":";
+      writeJsonString(stream, threadName);
+      stream << "}}";
+      first = false;
+    }
+    for (ProfileEvent const& event : events) {
+      stream << (first ? "" : ",") << "\n{\"ph\":\"X\",\"name\":";
+      writeJsonString(stream, event.name);
+      stream << ",\"pid\":1,\"tid\":" << buffer->thread
+             << ",\"ts\":" << event.start / 1000.0
+             << ",\"dur\":" << event.duration / 1000.0 << "}";
+      first = false;
+    }
+  }
+  stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+  stream.flags(flags);
+  stream.precision(precision);
+}
+
+std::vector<ProfileSummary> Profiler::summary(double window) const {
+  
+  std::vector<ThreadBuffer*> buffers;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto const& buffer : m_buffers) {
+      buffers.push_back(buffer.get());
+    }
+  }
+  
+  uint64_t end = now();
+  uint64_t windowNanoseconds = (uint64_t) (window * 1e9);
+  uint64_t start = (end > windowNanoseconds) ? end - windowNanoseconds : 0;
+  
+  std::map<std::string, ProfileSummary> totals;
+  std::vector<ProfileEvent> events;
+  for (ThreadBuffer* buffer : buffers) {
+    collect(*buffer, events);
+    for (ProfileEvent const& event : events) {
+      if (event.start + event.duration < start) {
+        continue;
+      }
+      ProfileSummary& total = totals[event.name];
+      double duration = event.duration / 1e9;
+      total.name = event.name;
+      total.count += 1;
+      total.total += duration;
+      total.max = std::max(total.max, duration);
+    }
+  }
+  
+  std::vector<ProfileSummary> result;
+  for (auto const& total : totals) {
+    result.push_back(total.second);
+  }
+  std::sort(
+    result.begin(),
+    result.end(),
+    [](ProfileSummary const& lhs, ProfileSummary const& rhs) {
+      return lhs.total > rhs.total;
+    });
+  return result;
+}
+
+void Profiler::writeSummary(std::ostream& stream, double window) const {
+  std::vector<ProfileSummary> totals = summary(window);
+  std::ios::fmtflags flags = stream.flags();
+  std::streamsize precision = stream.precision();
+  stream << std::left << std::setw(40) << "scope" << std::right
+         << std::setw(10) << "calls/s"
+         << std::setw(12) << "ms/s"
+         << std::setw(12) << "mean ms"
+         << std::setw(12) << "max ms" << '\n';
+  stream << std::fixed << std::setprecision(3);
+  for (ProfileSummary const& total : totals) {
+    stream << std::left << std::setw(40) << total.name << std::right
+           << std::setw(10) << std::setprecision(1) << total.count / window
+           << std::setw(12) << std::setprecision(3)
+           << 1e3 * total.total / window
+           << std::setw(12) << 1e3 * total.total / total.count
+           << std::setw(12) << 1e3 * total.max << '\n';
+  }
+  stream.flags(flags);
+  stream.precision(precision);
+}
+
+Profiler::ThreadBuffer& Profiler::threadBuffer() {
+  
+  // Each thread looks up its buffer once, and then keeps a pointer to it.
+  thread_local ThreadBuffer* threadBuffer = NULL;
+  if (threadBuffer == NULL) {
+    std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+    buffer->events.resize(BUFFER_SIZE);
+    buffer->recorded = 0;
+    buffer->name = NULL;
+    threadBuffer = buffer.get();
+    
+    std::lock_guard<std::mutex> lock(m_mutex);
+    buffer->thread = m_buffers.size();
+    m_buffers.push_back(std::move(buffer));
+  }
+  return *threadBuffer;
+}
+
+void Profiler::collect(
+    ThreadBuffer& buffer,
+    std::vector<ProfileEvent>& events) {
+  
+  std::lock_guard<std::mutex> lock(buffer.mutex);
+  std::size_t count = std::min(buffer.recorded, BUFFER_SIZE);
+  events.clear();
+  events.reserve(count);
+  for (std::size_t i = buffer.recorded - count; i < buffer.recorded; ++i) {
+    events.push_back(buffer.events[i % BUFFER_SIZE]);
+  }
+}
+
+void writeJsonString(std::ostream& stream, char const* string) {
+  stream << '"';
+  for (char const* c = string; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      stream << '\\';
+    }
+    stream << *c;
+  }
+  stream << '"';
+}
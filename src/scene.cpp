@@ -0,0 +1,745 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <entityx/entityx.h>
+
+#include "component/acceleration_component.h"
+#include "component/body_component.h"
+#include "component/charge_component.h"
+#include "component/collision_component.h"
+#include "component/field_component.h"
+#include "component/model_component.h"
+#include "component/timeline_component.h"
+
+#include "mesh.h"
+#include "quaternion.h"
+#include "scene_generator.h"
+#include "utility.h"
+#include "vector.h"
+#include "vertex.h"
+
+// All of the arrays in a scene file start on a multiple of this.
+#define SCENE_ALIGNMENT 8
+
+using namespace lightspeed;
+using namespace lightspeed::scene_format;
+
+// Distinguishes the meshes stored in the file from the handles to them.
+typedef lightspeed::scene_format::Mesh MeshRecord;
+
+// Checks that an array of records lies entirely within the file.
+bool arrayInFile(
+  std::size_t fileSize,
+  uint64_t offset,
+  uint64_t count,
+  std::size_t recordSize);
+
+uint64_t alignOffset(uint64_t offset);
+
+Vector readVector(double const* values);
+Quaternion readQuaternion(double const* values);
+void writeVector(Vector vector, double* values);
+void writeQuaternion(Quaternion quaternion, double* values);
+
+// Helpers for parsing scene descriptions.
+std::runtime_error parseError(std::size_t line, std::string message);
+double parseNumber(std::string text, std::size_t line);
+std::vector<double> parseNumbers(std::string text, std::size_t line);
+Vector parseVector(std::string text, std::size_t line);
+Quaternion parseQuaternion(std::string text, std::size_t line);
+std::map<std::string, std::string> parseKeys(
+  std::istringstream& stream,
+  std::size_t line);
+
+Scene::Scene(std::string fileName, MeshArena& meshes) :
+    m_data(NULL),
+    m_size(0),
+    m_buffer(),
+    m_header(NULL),
+    m_meshes(NULL),
+    m_vertices(NULL),
+    m_entities(NULL),
+    m_samples(NULL),
+    m_meshArena(&meshes),
+    m_meshHandles() {
+  int file = open(fileName.c_str(), O_RDONLY);
+  if (file < 0) {
+    throw std::runtime_error(
+      "Couldn't open scene '" + fileName + "': " + std::strerror(errno));
+  }
+  
+  struct stat status;
+  if (fstat(file, &status) != 0 || status.st_size < (off_t) sizeof(Header)) {
+    close(file);
+    throw std::runtime_error("Scene '" + fileName + "' is too small.");
+  }
+  m_size = status.st_size;
+  
+  // The mapping stays valid after the file is closed. The pages are only read
+  // in from the disk once they are touched.
+  m_data = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (m_data == MAP_FAILED) {
+    m_data = NULL;
+    throw std::runtime_error(
+      "Couldn't map scene '" + fileName + "': " + std::strerror(errno));
+  }
+  
+  try {
+    attach("'" + fileName + "'");
+  }
+  catch (...) {
+    munmap(m_data, m_size);
+    throw;
+  }
+}
+
+Scene::Scene(SceneBuilder const& builder, MeshArena& meshes) :
+    m_data(NULL),
+    m_size(0),
+    m_buffer(),
+    m_header(NULL),
+    m_meshes(NULL),
+    m_vertices(NULL),
+    m_entities(NULL),
+    m_samples(NULL),
+    m_meshArena(&meshes),
+    m_meshHandles() {
+  // The builder writes straight into the buffer, so that a large generated
+  // scene is only held once more while it is being made.
+  m_size = builder.write(m_buffer);
+  m_data = m_buffer.data();
+  attach("generated scene");
+}
+
+Scene::~Scene() {
+  m_meshHandles.clear();
+  if (m_data != NULL && m_buffer.empty()) {
+    munmap(m_data, m_size);
+  }
+}
+
+void Scene::attach(std::string const& name) {
+  if (m_size < sizeof(Header)) {
+    throw std::runtime_error("Scene " + name + " is too small.");
+  }
+  char const* bytes = static_cast<char const*>(m_data);
+  m_header = reinterpret_cast<Header const*>(bytes);
+  
+  bool valid =
+    std::memcmp(m_header->magic, MAGIC, sizeof(MAGIC)) == 0 &&
+    m_header->version == VERSION &&
+    arrayInFile(
+      m_size, m_header->meshOffset, m_header->meshCount, sizeof(MeshRecord)) &&
+    arrayInFile(
+      m_size, m_header->vertexOffset, m_header->vertexCount, sizeof(Vertex)) &&
+    arrayInFile(
+      m_size, m_header->entityOffset, m_header->entityCount, sizeof(Entity)) &&
+    arrayInFile(
+      m_size, m_header->sampleOffset, m_header->sampleCount, sizeof(Sample));
+  if (!valid) {
+    throw std::runtime_error(name + " is not a valid scene.");
+  }
+  
+  m_meshes = reinterpret_cast<MeshRecord const*>(bytes + m_header->meshOffset);
+  m_vertices = reinterpret_cast<Vertex const*>(bytes + m_header->vertexOffset);
+  m_entities = reinterpret_cast<Entity const*>(bytes + m_header->entityOffset);
+  m_samples = reinterpret_cast<Sample const*>(bytes + m_header->sampleOffset);
+  
+  // The meshes are few enough that they can be checked up front. Entities are
+  // only checked when they are instantiated.
+  for (std::size_t index = 0; index < m_header->meshCount; ++index) {
+    MeshRecord const& mesh = m_meshes[index];
+    if (mesh.firstVertex > m_header->vertexCount ||
+        mesh.vertexCount > m_header->vertexCount - mesh.firstVertex) {
+      throw std::runtime_error(name + " has an invalid mesh.");
+    }
+  }
+  m_meshHandles.resize(m_header->meshCount);
+}
+
+std::size_t Scene::meshCount() const {
+  return m_header->meshCount;
+}
+
+std::size_t Scene::entityCount() const {
+  return m_header->entityCount;
+}
+
+Vertex const* Scene::meshVertices(std::size_t mesh) const {
+  return m_vertices + m_meshes[mesh].firstVertex;
+}
+
+std::size_t Scene::meshVertexCount(std::size_t mesh) const {
+  return m_meshes[mesh].vertexCount;
+}
+
+lightspeed::Mesh Scene::mesh(std::size_t index) const {
+  if (!m_meshHandles[index]) {
+    m_meshHandles[index] = m_meshArena->borrow(
+      meshVertices(index),
+      meshVertexCount(index));
+  }
+  return m_meshHandles[index];
+}
+
+Entity const& Scene::entity(std::size_t index) const {
+  return m_entities[index];
+}
+
+Sample const* Scene::samples(std::size_t index) const {
+  return m_samples + m_entities[index].firstSample;
+}
+
+std::size_t Scene::instantiate(
+    entityx::EntityManager& entities,
+    std::size_t first,
+    std::size_t count) const {
+  if (first >= entityCount()) {
+    return 0;
+  }
+  if (count > entityCount() - first) {
+    count = entityCount() - first;
+  }
+  for (std::size_t index = first; index < first + count; ++index) {
+    instantiateEntity(entities, index, 0.0);
+  }
+  return count;
+}
+
+entityx::Entity Scene::instantiateEntity(
+    entityx::EntityManager& entities,
+    std::size_t index,
+    double time) const {
+  Entity const& description = m_entities[index];
+  if ((description.mesh != NO_MESH &&
+        description.mesh >= m_header->meshCount) ||
+      description.firstSample > m_header->sampleCount ||
+      description.sampleCount >
+        m_header->sampleCount - description.firstSample) {
+    throw std::runtime_error("Scene has an invalid entity.");
+  }
+  
+  BodyComponent start(
+    readVector(description.position),
+    readQuaternion(description.rotation),
+    readVector(description.momentum));
+  BodyComponent body = start;
+  body.position += time * body.momentum * LIGHT_SPEED / body.energy;
+  
+  entityx::Entity entity = entities.create();
+  entity.assign<BodyComponent>(body);
+  
+  if (description.mesh != NO_MESH) {
+    entity.assign<ModelComponent>(mesh(description.mesh));
+  }
+  if (description.flags & FLAG_COLLISION) {
+    entity.assign<CollisionComponent>(readVector(description.collision));
+  }
+  if (description.flags & FLAG_CHARGE) {
+    entity.assign<ChargeComponent>(description.charge);
+    entity.assign<FieldComponent>();
+    entity.assign<AccelerationComponent>();
+  }
+  if (description.flags & FLAG_TIMELINE) {
+    entityx::ComponentHandle<TimelineComponent<BodyComponent> > timeline =
+      entity.assign<TimelineComponent<BodyComponent> >(
+        description.timeInterval);
+    Sample const* samples = m_samples + description.firstSample;
+    for (std::size_t sample = 0; sample < description.sampleCount; ++sample) {
+      if (samples[sample].time - time < -description.timeInterval) {
+        continue;
+      }
+      timeline->timeline.push_back(std::make_pair(
+        samples[sample].time - time,
+        BodyComponent(
+          readVector(samples[sample].position),
+          readQuaternion(samples[sample].rotation),
+          readVector(samples[sample].momentum))));
+    }
+    
+    // The rest of the history is a straight line up to the present, so the
+    // state at the start of the scene is enough to fill it in.
+    if (time > 0.0) {
+      double oldestTime = std::max(-time, -description.timeInterval);
+      BodyComponent oldest = start;
+      oldest.position +=
+        (time + oldestTime) * start.momentum * LIGHT_SPEED / start.energy;
+      timeline->timeline.push_back(std::make_pair(oldestTime, oldest));
+    }
+  }
+  
+  return entity;
+}
+
+void Scene::prefetch(std::size_t index) const {
+  // Reading a single byte from each page is enough to fault it in.
+  long pageSize = sysconf(_SC_PAGESIZE);
+  auto touch = [&](void const* data, std::size_t size) {
+    char const* begin = static_cast<char const*>(data);
+    char const* end = begin + size;
+    volatile char sum = 0;
+    for (char const* page = begin; page < end; page += pageSize) {
+      sum += *page;
+    }
+    if (size != 0) {
+      sum += *(end - 1);
+    }
+  };
+  
+  Entity const& description = m_entities[index];
+  touch(&description, sizeof(Entity));
+  if (description.firstSample < m_header->sampleCount) {
+    std::size_t count = std::min<uint64_t>(
+      description.sampleCount,
+      m_header->sampleCount - description.firstSample);
+    touch(m_samples + description.firstSample, count * sizeof(Sample));
+  }
+  if (description.mesh < m_header->meshCount) {
+    touch(
+      meshVertices(description.mesh),
+      meshVertexCount(description.mesh) * sizeof(Vertex));
+  }
+}
+
+SceneBuilder::EntityDescription::EntityDescription() :
+    mesh(NO_MESH),
+    position(),
+    rotation(1.0, Vector()),
+    momentum(),
+    timeInterval(0.0),
+    collision(),
+    charge(0.0) {
+}
+
+uint32_t SceneBuilder::addMesh(std::vector<Vertex> const& vertices) {
+  MeshRecord mesh;
+  mesh.firstVertex = m_vertices.size();
+  mesh.vertexCount = vertices.size();
+  m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
+  m_meshes.push_back(mesh);
+  return m_meshes.size() - 1;
+}
+
+uint32_t SceneBuilder::addBoxMesh(Vector dimensions) {
+  return addMesh(boxMesh(dimensions));
+}
+
+void SceneBuilder::addEntity(EntityDescription const& description) {
+  Entity entity;
+  std::memset(&entity, 0, sizeof(entity));
+  entity.mesh = description.mesh;
+  entity.flags = 0;
+  writeVector(description.position, entity.position);
+  writeQuaternion(description.rotation, entity.rotation);
+  writeVector(description.momentum, entity.momentum);
+  if (description.timeInterval > 0.0) {
+    entity.flags |= FLAG_TIMELINE;
+    entity.timeInterval = description.timeInterval;
+  }
+  if (description.collision.normSq() > 0.0) {
+    entity.flags |= FLAG_COLLISION;
+    writeVector(description.collision, entity.collision);
+  }
+  if (description.charge != 0.0) {
+    entity.flags |= FLAG_CHARGE;
+    entity.charge = description.charge;
+  }
+  entity.firstSample = m_samples.size();
+  entity.sampleCount = 0;
+  m_entities.push_back(entity);
+}
+
+void SceneBuilder::addSample(
+    double time,
+    Vector position,
+    Quaternion rotation,
+    Vector momentum) {
+  if (m_entities.empty()) {
+    throw std::runtime_error("can't add a sample before any entities");
+  }
+  if (!(m_entities.back().flags & FLAG_TIMELINE)) {
+    throw std::runtime_error(
+      "can't add a sample to an entity with no timeline");
+  }
+  Sample sample;
+  sample.time = time;
+  writeVector(position, sample.position);
+  writeQuaternion(rotation, sample.rotation);
+  writeVector(momentum, sample.momentum);
+  m_samples.push_back(sample);
+  m_entities.back().sampleCount += 1;
+}
+
+std::size_t SceneBuilder::meshCount() const {
+  return m_meshes.size();
+}
+
+std::size_t SceneBuilder::entityCount() const {
+  return m_entities.size();
+}
+
+void SceneBuilder::write(std::string fileName) const {
+  std::ofstream file(fileName.c_str(), std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Couldn't open '" + fileName + "' for writing.");
+  }
+  write(file);
+  if (!file) {
+    throw std::runtime_error("Couldn't write scene '" + fileName + "'.");
+  }
+}
+
+void SceneBuilder::write(std::ostream& stream) const {
+  Header header = this->header();
+  
+  // Writes an array at an offset, padding the file up to that offset first.
+  uint64_t position = 0;
+  auto writeArray = [&](uint64_t offset, void const* data, std::size_t size) {
+    static char const padding[SCENE_ALIGNMENT] = { 0 };
+    stream.write(padding, offset - position);
+    stream.write(static_cast<char const*>(data), size);
+    position = offset + size;
+  };
+  writeArray(0, &header, sizeof(header));
+  writeArray(
+    header.meshOffset, m_meshes.data(), m_meshes.size() * sizeof(MeshRecord));
+  writeArray(
+    header.vertexOffset, m_vertices.data(), m_vertices.size() * sizeof(Vertex));
+  writeArray(
+    header.entityOffset, m_entities.data(), m_entities.size() * sizeof(Entity));
+  writeArray(
+    header.sampleOffset, m_samples.data(), m_samples.size() * sizeof(Sample));
+}
+
+std::size_t SceneBuilder::write(std::vector<uint64_t>& buffer) const {
+  Header header = this->header();
+  std::size_t fileSize =
+    header.sampleOffset + m_samples.size() * sizeof(Sample);
+  
+  // The padding between the arrays is left as the zeroes that the buffer
+  // starts with.
+  buffer.assign((fileSize + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+  char* bytes = reinterpret_cast<char*>(buffer.data());
+  auto writeArray = [bytes](
+      uint64_t offset,
+      void const* data,
+      std::size_t size) {
+    if (size > 0) {
+      std::memcpy(bytes + offset, data, size);
+    }
+  };
+  writeArray(0, &header, sizeof(header));
+  writeArray(
+    header.meshOffset, m_meshes.data(), m_meshes.size() * sizeof(MeshRecord));
+  writeArray(
+    header.vertexOffset, m_vertices.data(), m_vertices.size() * sizeof(Vertex));
+  writeArray(
+    header.entityOffset, m_entities.data(), m_entities.size() * sizeof(Entity));
+  writeArray(
+    header.sampleOffset, m_samples.data(), m_samples.size() * sizeof(Sample));
+  return fileSize;
+}
+
+Header SceneBuilder::header() const {
+  Header header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  
+  header.meshCount = m_meshes.size();
+  header.meshOffset = alignOffset(sizeof(Header));
+  header.vertexCount = m_vertices.size();
+  header.vertexOffset = alignOffset(
+    header.meshOffset + header.meshCount * sizeof(MeshRecord));
+  header.entityCount = m_entities.size();
+  header.entityOffset = alignOffset(
+    header.vertexOffset + header.vertexCount * sizeof(Vertex));
+  header.sampleCount = m_samples.size();
+  header.sampleOffset = alignOffset(
+    header.entityOffset + header.entityCount * sizeof(Entity));
+  return header;
+}
+
+void lightspeed::parseSceneDescription(
+    std::istream& input,
+    SceneBuilder& builder) {
+  std::map<std::string, uint32_t> meshes;
+  meshes["none"] = NO_MESH;
+  
+  // The mesh currently being read, if any.
+  std::string meshName;
+  std::vector<Vertex> meshVertices;
+  bool readingMesh = false;
+  
+  std::string text;
+  std::size_t line = 0;
+  while (std::getline(input, text)) {
+    ++line;
+    std::size_t comment = text.find('#');
+    if (comment != std::string::npos) {
+      text.erase(comment);
+    }
+    
+    std::istringstream stream(text);
+    std::string command;
+    if (!(stream >> command)) {
+      continue;
+    }
+    
+    if (readingMesh) {
+      if (command == "vertex") {
+        double x, y, z;
+        if (!(stream >> x >> y >> z)) {
+          throw parseError(line, "vertex needs three coordinates");
+        }
+        Vertex vertex = { (float) x, (float) y, (float) z, 0, 0.0, 0.0 };
+        meshVertices.push_back(vertex);
+      }
+      else if (command == "end") {
+        if (meshVertices.size() % 3 != 0) {
+          throw parseError(line, "mesh isn't made of triangles");
+        }
+        meshes[meshName] = builder.addMesh(meshVertices);
+        meshVertices.clear();
+        readingMesh = false;
+      }
+      else {
+        throw parseError(line, "expected vertex or end inside mesh");
+      }
+      continue;
+    }
+    
+    if (command == "box" || command == "mesh") {
+      std::string name;
+      if (!(stream >> name) || meshes.count(name) != 0) {
+        throw parseError(line, "expected a new mesh name");
+      }
+      if (command == "box") {
+        double x, y, z;
+        if (!(stream >> x >> y >> z)) {
+          throw parseError(line, "box needs three dimensions");
+        }
+        meshes[name] = builder.addBoxMesh(Vector(x, y, z));
+      }
+      else {
+        meshName = name;
+        readingMesh = true;
+      }
+    }
+    else if (command == "entity" || command == "grid") {
+      std::string name;
+      if (!(stream >> name) || meshes.count(name) == 0) {
+        throw parseError(line, "expected a known mesh name");
+      }
+      std::map<std::string, std::string> keys = parseKeys(stream, line);
+      
+      SceneBuilder::EntityDescription entity;
+      entity.mesh = meshes[name];
+      Vector count(1.0, 1.0, 1.0);
+      Vector spacing;
+      for (auto const& key : keys) {
+        if (key.first == "position") {
+          entity.position = parseVector(key.second, line);
+        }
+        else if (key.first == "rotation") {
+          entity.rotation = parseQuaternion(key.second, line);
+        }
+        else if (key.first == "momentum") {
+          entity.momentum = parseVector(key.second, line);
+        }
+        else if (key.first == "timeline") {
+          entity.timeInterval = parseNumber(key.second, line);
+        }
+        else if (key.first == "collision") {
+          entity.collision = parseVector(key.second, line);
+        }
+        else if (key.first == "charge") {
+          entity.charge = parseNumber(key.second, line);
+        }
+        else if (command == "grid" && key.first == "count") {
+          count = parseVector(key.second, line);
+        }
+        else if (command == "grid" && key.first == "spacing") {
+          spacing = parseVector(key.second, line);
+        }
+        else {
+          throw parseError(line, "unknown key '" + key.first + "'");
+        }
+      }
+      
+      Vector origin = entity.position;
+      for (int i = 0; i < (int) count.x; ++i) {
+        for (int j = 0; j < (int) count.y; ++j) {
+          for (int k = 0; k < (int) count.z; ++k) {
+            entity.position = origin + Vector(
+              i * spacing.x,
+              j * spacing.y,
+              k * spacing.z);
+            builder.addEntity(entity);
+          }
+        }
+      }
+    }
+    else if (command == "generate") {
+      std::map<std::string, std::string> keys = parseKeys(stream, line);
+      GeneratorParameters parameters;
+      try {
+        for (auto const& key : keys) {
+          setGeneratorParameter(parameters, key.first, key.second);
+        }
+        generateScene(parameters, builder);
+      }
+      catch (std::runtime_error const& error) {
+        throw parseError(line, error.what());
+      }
+    }
+    else if (command == "sample") {
+      std::map<std::string, std::string> keys = parseKeys(stream, line);
+      if (keys.count("time") == 0) {
+        throw parseError(line, "sample needs a time");
+      }
+      double time = parseNumber(keys["time"], line);
+      Vector position;
+      Quaternion rotation(1.0, Vector());
+      Vector momentum;
+      for (auto const& key : keys) {
+        if (key.first == "position") {
+          position = parseVector(key.second, line);
+        }
+        else if (key.first == "rotation") {
+          rotation = parseQuaternion(key.second, line);
+        }
+        else if (key.first == "momentum") {
+          momentum = parseVector(key.second, line);
+        }
+        else if (key.first != "time") {
+          throw parseError(line, "unknown key '" + key.first + "'");
+        }
+      }
+      try {
+        builder.addSample(time, position, rotation, momentum);
+      }
+      catch (std::runtime_error const& error) {
+        throw parseError(line, error.what());
+      }
+    }
+    else {
+      throw parseError(line, "unknown command '" + command + "'");
+    }
+  }
+  
+  if (readingMesh) {
+    throw parseError(line, "mesh '" + meshName + "' is missing its end");
+  }
+}
+
+bool arrayInFile(
+    std::size_t fileSize,
+    uint64_t offset,
+    uint64_t count,
+    std::size_t recordSize) {
+  return
+    offset % SCENE_ALIGNMENT == 0 &&
+    offset <= fileSize &&
+    count <= (fileSize - offset) / recordSize;
+}
+
+uint64_t alignOffset(uint64_t offset) {
+  return (offset + SCENE_ALIGNMENT - 1) / SCENE_ALIGNMENT * SCENE_ALIGNMENT;
+}
+
+Vector readVector(double const* values) {
+  return Vector(values[0], values[1], values[2]);
+}
+
+Quaternion readQuaternion(double const* values) {
+  return Quaternion(values[0], Vector(values[1], values[2], values[3]));
+}
+
+void writeVector(Vector vector, double* values) {
+  values[0] = vector.x;
+  values[1] = vector.y;
+  values[2] = vector.z;
+}
+
+void writeQuaternion(Quaternion quaternion, double* values) {
+  values[0] = quaternion.real;
+  writeVector(quaternion.pure, values + 1);
+}
+
+std::runtime_error parseError(std::size_t line, std::string message) {
+  std::ostringstream stream;
+  stream << "Scene description line " << line << ": " << message << ".";
+  return std::runtime_error(stream.str());
+}
+
+double parseNumber(std::string text, std::size_t line) {
+  std::istringstream stream(text);
+  double value;
+  if (!(stream >> value) || !stream.eof()) {
+    throw parseError(line, "expected a number but got '" + text + "'");
+  }
+  return value;
+}
+
+std::vector<double> parseNumbers(std::string text, std::size_t line) {
+  std::vector<double> values;
+  std::size_t start = 0;
+  while (true) {
+    std::size_t comma = text.find(',', start);
+    values.push_back(parseNumber(text.substr(start, comma - start), line));
+    if (comma == std::string::npos) {
+      return values;
+    }
+    start = comma + 1;
+  }
+}
+
+Vector parseVector(std::string text, std::size_t line) {
+  std::vector<double> values = parseNumbers(text, line);
+  if (values.size() != 3) {
+    throw parseError(line, "expected three components in '" + text + "'");
+  }
+  return Vector(values[0], values[1], values[2]);
+}
+
+Quaternion parseQuaternion(std::string text, std::size_t line) {
+  std::vector<double> values = parseNumbers(text, line);
+  if (values.size() != 4) {
+    throw parseError(line, "expected four components in '" + text + "'");
+  }
+  return Quaternion(values[0], Vector(values[1], values[2], values[3])).unit();
+}
+
+std::map<std::string, std::string> parseKeys(
+    std::istringstream& stream,
+    std::size_t line) {
+  std::map<std::string, std::string> keys;
+  std::string token;
+  while (stream >> token) {
+    std::size_t equals = token.find('=');
+    if (equals == std::string::npos || equals == 0) {
+      throw parseError(line, "expected key=value but got '" + token + "'");
+    }
+    keys[token.substr(0, equals)] = token.substr(equals + 1);
+  }
+  return keys;
+}
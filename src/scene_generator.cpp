@@ -0,0 +1,413 @@
+#include "scene_generator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mesh.h"
+#include "quaternion.h"
+#include "scene.h"
+#include "utility.h"
+#include "vector.h"
+#include "vertex.h"
+
+// The most times a position is redrawn when it lands too close to the player.
+#define GENERATOR_MAX_ATTEMPTS 1000
+
+using namespace lightspeed;
+
+typedef GeneratorParameters::Layout Layout;
+typedef GeneratorParameters::Speeds Speeds;
+typedef GeneratorParameters::Motion Motion;
+
+// The distributions of the standard library aren't the same everywhere, so
+// these are built directly on the (fully specified) Mersenne twister.
+double generatorUniform(std::mt19937_64& random);
+double generatorNormal(std::mt19937_64& random);
+Vector generatorDirection(std::mt19937_64& random);
+
+double parseGeneratorNumber(std::string const& name, std::string const& value);
+void checkGeneratorParameters(GeneratorParameters const& parameters);
+
+Vector generatePosition(
+  GeneratorParameters const& parameters,
+  std::vector<Vector> const& grid,
+  std::vector<Vector> const& clusters,
+  std::size_t index,
+  std::mt19937_64& random);
+std::vector<Vector> generateGrid(GeneratorParameters const& parameters);
+double generateSpeed(
+  GeneratorParameters const& parameters,
+  std::mt19937_64& random);
+
+void lightspeed::setGeneratorParameter(
+    GeneratorParameters& parameters,
+    std::string const& name,
+    std::string const& value) {
+  if (name == "seed") {
+    parameters.seed = std::strtoull(value.c_str(), NULL, 10);
+  }
+  else if (name == "entities") {
+    parameters.entities = (std::size_t) parseGeneratorNumber(name, value);
+  }
+  else if (name == "meshes") {
+    parameters.meshes = (std::size_t) parseGeneratorNumber(name, value);
+  }
+  else if (name == "detail") {
+    parameters.detail = (unsigned int) parseGeneratorNumber(name, value);
+  }
+  else if (name == "size") {
+    parameters.size = parseGeneratorNumber(name, value);
+  }
+  else if (name == "collision") {
+    parameters.collision = parseGeneratorNumber(name, value) != 0.0;
+  }
+  else if (name == "layout") {
+    if (value == "grid") {
+      parameters.layout = Layout::GRID;
+    }
+    else if (value == "uniform") {
+      parameters.layout = Layout::UNIFORM;
+    }
+    else if (value == "shell") {
+      parameters.layout = Layout::SHELL;
+    }
+    else if (value == "clustered") {
+      parameters.layout = Layout::CLUSTERED;
+    }
+    else {
+      throw std::runtime_error("unknown layout '" + value + "'");
+    }
+  }
+  else if (name == "extent") {
+    parameters.extent = parseGeneratorNumber(name, value);
+  }
+  else if (name == "clusters") {
+    parameters.clusters = (std::size_t) parseGeneratorNumber(name, value);
+  }
+  else if (name == "clearance") {
+    parameters.clearance = parseGeneratorNumber(name, value);
+  }
+  else if (name == "speeds") {
+    if (value == "fixed") {
+      parameters.speeds = Speeds::FIXED;
+    }
+    else if (value == "uniform") {
+      parameters.speeds = Speeds::UNIFORM;
+    }
+    else if (value == "rapidity") {
+      parameters.speeds = Speeds::RAPIDITY;
+    }
+    else {
+      throw std::runtime_error("unknown speed distribution '" + value + "'");
+    }
+  }
+  else if (name == "speed") {
+    parameters.speed = parseGeneratorNumber(name, value);
+  }
+  else if (name == "motion") {
+    if (value == "inertial") {
+      parameters.motion = Motion::INERTIAL;
+    }
+    else if (value == "oscillating") {
+      parameters.motion = Motion::OSCILLATING;
+    }
+    else if (value == "charged") {
+      parameters.motion = Motion::CHARGED;
+    }
+    else {
+      throw std::runtime_error("unknown motion '" + value + "'");
+    }
+  }
+  else if (name == "amplitude") {
+    parameters.amplitude = parseGeneratorNumber(name, value);
+  }
+  else if (name == "period") {
+    parameters.period = parseGeneratorNumber(name, value);
+  }
+  else if (name == "charge") {
+    parameters.charge = parseGeneratorNumber(name, value);
+  }
+  else if (name == "history") {
+    parameters.history = parseGeneratorNumber(name, value);
+  }
+  else if (name == "samples") {
+    parameters.sampleInterval = parseGeneratorNumber(name, value);
+  }
+  else {
+    throw std::runtime_error("unknown generator parameter '" + name + "'");
+  }
+}
+
+void lightspeed::parseGeneratorParameters(
+    std::string const& text,
+    GeneratorParameters& parameters) {
+  std::size_t start = 0;
+  while (start < text.size()) {
+    std::size_t end = text.find_first_of(", ", start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    std::string pair = text.substr(start, end - start);
+    start = end + 1;
+    if (pair.empty()) {
+      continue;
+    }
+    std::size_t equals = pair.find('=');
+    if (equals == std::string::npos) {
+      throw std::runtime_error("expected name=value, not '" + pair + "'");
+    }
+    setGeneratorParameter(
+      parameters,
+      pair.substr(0, equals),
+      pair.substr(equals + 1));
+  }
+}
+
+void lightspeed::generateScene(
+    GeneratorParameters const& parameters,
+    SceneBuilder& builder) {
+  
+  checkGeneratorParameters(parameters);
+  std::mt19937_64 random(parameters.seed);
+  
+  // The meshes range from half of the size up to the full size.
+  std::vector<uint32_t> meshes;
+  std::vector<double> meshSizes;
+  for (std::size_t index = 0; index < parameters.meshes; ++index) {
+    double size =
+      parameters.size * (0.5 + 0.5 * (index + 1) / parameters.meshes);
+    if (parameters.detail == 0) {
+      meshes.push_back(builder.addBoxMesh(Vector(size, size, size)));
+    }
+    else {
+      meshes.push_back(
+        builder.addMesh(sphereMesh(size / 2.0, parameters.detail)));
+    }
+    meshSizes.push_back(size);
+  }
+  
+  std::vector<Vector> grid;
+  if (parameters.layout == Layout::GRID) {
+    grid = generateGrid(parameters);
+  }
+  std::vector<Vector> clusters;
+  if (parameters.layout == Layout::CLUSTERED) {
+    for (std::size_t index = 0; index < parameters.clusters; ++index) {
+      clusters.push_back(parameters.extent * Vector(
+        2.0 * generatorUniform(random) - 1.0,
+        2.0 * generatorUniform(random) - 1.0,
+        2.0 * generatorUniform(random) - 1.0));
+    }
+  }
+  
+  double frequency = 2.0 * M_PI / parameters.period;
+  for (std::size_t index = 0; index < parameters.entities; ++index) {
+    
+    SceneBuilder::EntityDescription entity;
+    std::size_t mesh =
+      (std::size_t) (generatorUniform(random) * meshes.size());
+    entity.mesh = meshes[mesh];
+    entity.position =
+      generatePosition(parameters, grid, clusters, index, random);
+    entity.rotation = Quaternion(
+      generatorNormal(random),
+      Vector(
+        generatorNormal(random),
+        generatorNormal(random),
+        generatorNormal(random))).unit();
+    if (parameters.collision) {
+      double halfSize = meshSizes[mesh] / 2.0;
+      entity.collision = Vector(halfSize, halfSize, halfSize);
+    }
+    entity.timeInterval = parameters.history;
+    
+    // The oscillation passes through the present position, where it is moving
+    // fastest. From then on the entity carries on at that velocity.
+    Vector drift =
+      generateSpeed(parameters, random) * generatorDirection(random);
+    Vector axis;
+    if (parameters.motion == Motion::OSCILLATING) {
+      axis = generatorDirection(random);
+    }
+    auto velocityAt = [&](double time) {
+      return drift + parameters.amplitude * frequency *
+        std::cos(frequency * time) * axis;
+    };
+    auto momentumOf = [](Vector velocity) {
+      return velocity * LIGHT_SPEED / std::sqrt(
+        1.0 - velocity.normSq() / (LIGHT_SPEED * LIGHT_SPEED));
+    };
+    entity.momentum = momentumOf(velocityAt(0.0));
+    if (parameters.motion == Motion::CHARGED) {
+      entity.charge = generatorUniform(random) < 0.5 ?
+        -parameters.charge :
+        +parameters.charge;
+    }
+    builder.addEntity(entity);
+    
+    if (parameters.history <= 0.0 || parameters.sampleInterval <= 0.0) {
+      continue;
+    }
+    std::size_t samples =
+      (std::size_t) std::ceil(parameters.history / parameters.sampleInterval);
+    for (std::size_t sample = samples; sample > 0; --sample) {
+      double time = -(double) sample * parameters.sampleInterval;
+      Vector position = entity.position + time * drift +
+        parameters.amplitude * std::sin(frequency * time) * axis;
+      builder.addSample(
+        time,
+        position,
+        entity.rotation,
+        momentumOf(velocityAt(time)));
+    }
+  }
+}
+
+double generatorUniform(std::mt19937_64& random) {
+  // The top 53 bits fill the mantissa of a double in [0, 1).
+  return (random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double generatorNormal(std::mt19937_64& random) {
+  double radius = std::sqrt(-2.0 * std::log(1.0 - generatorUniform(random)));
+  return radius * std::cos(2.0 * M_PI * generatorUniform(random));
+}
+
+Vector generatorDirection(std::mt19937_64& random) {
+  double z = 2.0 * generatorUniform(random) - 1.0;
+  double phi = 2.0 * M_PI * generatorUniform(random);
+  double radius = std::sqrt(1.0 - z * z);
+  return Vector(radius * std::cos(phi), radius * std::sin(phi), z);
+}
+
+double parseGeneratorNumber(std::string const& name, std::string const& value) {
+  char* end = NULL;
+  double number = std::strtod(value.c_str(), &end);
+  if (value.empty() || *end != '\0' || !(number >= 0.0)) {
+    throw std::runtime_error(
+      "expected a non-negative number for '" + name + "', not '" + value +
+      "'");
+  }
+  return number;
+}
+
+void checkGeneratorParameters(GeneratorParameters const& parameters) {
+  if (parameters.meshes == 0 || parameters.size <= 0.0) {
+    throw std::runtime_error("generated scenes need at least one mesh");
+  }
+  if (parameters.clearance >= parameters.extent) {
+    throw std::runtime_error(
+      "the clearance around the player must be less than the extent");
+  }
+  if (parameters.layout == Layout::CLUSTERED && parameters.clusters == 0) {
+    throw std::runtime_error("clustered scenes need at least one cluster");
+  }
+  
+  // The fastest an entity can move is when its drift lines up with its
+  // oscillation.
+  double fastest = parameters.speed;
+  if (parameters.motion == Motion::OSCILLATING) {
+    if (parameters.period <= 0.0) {
+      throw std::runtime_error("the period of oscillation must be positive");
+    }
+    fastest += 2.0 * M_PI * parameters.amplitude / parameters.period;
+  }
+  if (fastest >= 1.0) {
+    throw std::runtime_error(
+      "generated entities must move slower than the speed of light");
+  }
+}
+
+Vector generatePosition(
+    GeneratorParameters const& parameters,
+    std::vector<Vector> const& grid,
+    std::vector<Vector> const& clusters,
+    std::size_t index,
+    std::mt19937_64& random) {
+  
+  if (parameters.layout == Layout::GRID) {
+    return grid[index];
+  }
+  if (parameters.layout == Layout::SHELL) {
+    return parameters.extent * generatorDirection(random);
+  }
+  
+  // The clusters are about as wide as they are far apart.
+  double spread = parameters.extent /
+    (2.0 * std::cbrt((double) std::max(parameters.clusters, (std::size_t) 1)));
+  Vector position;
+  for (int attempt = 0; attempt < GENERATOR_MAX_ATTEMPTS; ++attempt) {
+    if (parameters.layout == Layout::CLUSTERED) {
+      Vector center = clusters[
+        (std::size_t) (generatorUniform(random) * clusters.size())];
+      position = center + spread * Vector(
+        generatorNormal(random),
+        generatorNormal(random),
+        generatorNormal(random));
+    }
+    else {
+      position = parameters.extent * Vector(
+        2.0 * generatorUniform(random) - 1.0,
+        2.0 * generatorUniform(random) - 1.0,
+        2.0 * generatorUniform(random) - 1.0);
+    }
+    if (position.normSq() >= parameters.clearance * parameters.clearance) {
+      break;
+    }
+  }
+  return position;
+}
+
+std::vector<Vector> generateGrid(GeneratorParameters const& parameters) {
+  
+  // Grow the grid until there are enough cells outside of the clearance.
+  double clearanceSq = parameters.clearance * parameters.clearance;
+  std::size_t side = std::max(
+    (std::size_t) std::ceil(std::cbrt((double) parameters.entities)),
+    (std::size_t) 1);
+  std::vector<Vector> cells;
+  while (true) {
+    double spacing = 2.0 * parameters.extent / side;
+    cells.clear();
+    for (std::size_t i = 0; i < side; ++i) {
+      for (std::size_t j = 0; j < side; ++j) {
+        for (std::size_t k = 0; k < side; ++k) {
+          Vector cell = Vector(
+            (i + 0.5) * spacing,
+            (j + 0.5) * spacing,
+            (k + 0.5) * spacing) - Vector(
+              parameters.extent,
+              parameters.extent,
+              parameters.extent);
+          if (cell.normSq() >= clearanceSq) {
+            cells.push_back(cell);
+          }
+        }
+      }
+    }
+    if (cells.size() >= parameters.entities) {
+      cells.resize(parameters.entities);
+      return cells;
+    }
+    ++side;
+  }
+}
+
+double generateSpeed(
+    GeneratorParameters const& parameters,
+    std::mt19937_64& random) {
+  if (parameters.speeds == Speeds::UNIFORM) {
+    return parameters.speed * generatorUniform(random);
+  }
+  else if (parameters.speeds == Speeds::RAPIDITY) {
+    return std::tanh(std::atanh(parameters.speed) * generatorUniform(random));
+  }
+  return parameters.speed;
+}
@@ -0,0 +1,285 @@
+#include "shader_counters.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "internal/opengl.h"
+
+#include "memory_tracker.h"
+#include "profiler.h"
+
+// The number of buffers that the counters are copied into. A frame is read
+// back this many frames after it was drawn, unless the GPU finishes sooner.
+#define COUNTER_BUFFERS (3)
+// How long to wait for a frame at a time when it has to be read back.
+#define COUNTER_WAIT_NANOSECONDS (1000000000)
+
+// The layout of the counters of each timeline in each view, which has to
+// match the vertex shader.
+#define COUNTER_FIELDS (13)
+#define COUNTER_VERTICES (0)
+#define COUNTER_STEPS (1)
+#define COUNTER_WARM_STARTS (2)
+#define COUNTER_FULL_SEARCHES (3)
+#define COUNTER_DISCRIMINANT_FAILURES (4)
+#define COUNTER_HISTOGRAM (5)
+#define COUNTER_HISTOGRAM_BUCKETS (8)
+
+#define BUFFER_COUNTERS (12)
+
+using namespace lightspeed;
+
+ShaderCounters::ShaderCounters(std::string fileName) :
+    m_file(fileName),
+    m_buffer(0),
+    m_bytes(0),
+    m_readbacks(),
+    m_next(0),
+    m_values(),
+    m_totals(),
+    m_stalls(0),
+    m_memory(MemoryTracker::instance().counter("GPU shader counters")) {
+  if (!m_file) {
+    throw std::runtime_error(
+      "Couldn't write the shader counters to " + fileName + ".");
+  }
+  
+  // Each bucket of the histogram counts the vertices that checked from a
+  // power of two entries up to the next one.
+  m_file << "frame,entity,view,distance,vertices,steps,warm_starts,"
+         << "full_searches,discriminant_failures";
+  for (int bucket = 0; bucket < COUNTER_HISTOGRAM_BUCKETS; ++bucket) {
+    m_file << ",steps_" << (1 << bucket);
+    if (bucket + 1 == COUNTER_HISTOGRAM_BUCKETS) {
+      m_file << "_up";
+    }
+  }
+  m_file << '\n';
+}
+
+std::string ShaderCounters::shaderDefines() {
+  return "#define SHADER_COUNTERS\n";
+}
+
+void ShaderCounters::initialize() {
+  glGenBuffers(1, &m_buffer);
+  m_readbacks.resize(COUNTER_BUFFERS);
+  for (Readback& readback : m_readbacks) {
+    glGenBuffers(1, &readback.buffer);
+    readback.bytes = 0;
+    readback.fence = 0;
+    readback.frame = 0;
+  }
+  m_memory.allocate(0);
+}
+
+void ShaderCounters::finalize() {
+  
+  PROFILE_SCOPE("ShaderCounters::finalize");
+  
+  // The frames still waiting are read back from the oldest, waiting for the
+  // GPU if it hasn't finished them.
+  for (std::size_t i = 0; i < m_readbacks.size(); ++i) {
+    Readback& readback = m_readbacks[(m_next + i) % m_readbacks.size()];
+    if (readback.fence != 0) {
+      readBack(readback);
+    }
+  }
+  for (Readback& readback : m_readbacks) {
+    glDeleteBuffers(1, &readback.buffer);
+    m_memory.deallocate(readback.bytes);
+  }
+  m_readbacks.clear();
+  glDeleteBuffers(1, &m_buffer);
+  m_memory.deallocate(m_bytes);
+  m_bytes = 0;
+  m_file.flush();
+}
+
+void ShaderCounters::begin(std::size_t counters) {
+  
+  // The counters are laid out in the same way as the hints, so they are only
+  // reallocated when the hints are.
+  std::size_t bytes = sizeof(GLuint) * COUNTER_FIELDS * counters;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_buffer);
+  if (bytes != m_bytes) {
+    GLuint zero = 0;
+    glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, NULL, GL_DYNAMIC_COPY);
+    glClearBufferData(
+      GL_SHADER_STORAGE_BUFFER,
+      GL_R32UI,
+      GL_RED_INTEGER,
+      GL_UNSIGNED_INT,
+      &zero);
+    m_memory.resize(m_bytes, bytes);
+    m_bytes = bytes;
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_COUNTERS, m_buffer);
+}
+
+void ShaderCounters::end(
+    std::size_t frame,
+    std::vector<ShaderCounterSource> sources) {
+  
+  PROFILE_SCOPE("ShaderCounters::end");
+  
+  // Report every frame that the GPU has already finished with, from the
+  // oldest, without waiting on any of them.
+  for (std::size_t i = 0; i < m_readbacks.size(); ++i) {
+    Readback& readback = m_readbacks[(m_next + i) % m_readbacks.size()];
+    if (readback.fence == 0) {
+      continue;
+    }
+    GLenum status = glClientWaitSync(readback.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    readBack(readback);
+  }
+  
+  // The next buffer can only be reused once its frame has been read back,
+  // which means waiting for it if the GPU is a whole ring behind.
+  Readback& readback = m_readbacks[m_next];
+  if (readback.fence != 0) {
+    ++m_stalls;
+    readBack(readback);
+  }
+  m_next = (m_next + 1) % m_readbacks.size();
+  
+  // The shader writes have to land before they are copied, and the copy has
+  // to be made before they are cleared for the next frame.
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBuffer(GL_COPY_READ_BUFFER, m_buffer);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, readback.buffer);
+  if (readback.bytes != m_bytes) {
+    glBufferData(GL_COPY_WRITE_BUFFER, m_bytes, NULL, GL_STREAM_READ);
+    m_memory.resize(readback.bytes, m_bytes);
+    readback.bytes = m_bytes;
+  }
+  glCopyBufferSubData(
+    GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER,
+    0,
+    0,
+    m_bytes);
+  GLuint zero = 0;
+  glClearBufferData(
+    GL_COPY_READ_BUFFER,
+    GL_R32UI,
+    GL_RED_INTEGER,
+    GL_UNSIGNED_INT,
+    &zero);
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  readback.frame = frame;
+  readback.sources = std::move(sources);
+}
+
+void ShaderCounters::writeSummary(std::ostream& stream, std::size_t count) {
+  
+  // The entities that checked the most entries are the ones that cost the
+  // most to draw.
+  std::vector<std::pair<uint64_t, Totals> > totals(
+    m_totals.begin(),
+    m_totals.end());
+  std::sort(
+    totals.begin(),
+    totals.end(),
+    [](std::pair<uint64_t, Totals> const& a,
+       std::pair<uint64_t, Totals> const& b) {
+      return a.second.steps > b.second.steps;
+    });
+  totals.resize(std::min(totals.size(), count));
+  
+  std::ios::fmtflags flags = stream.flags();
+  std::streamsize precision = stream.precision();
+  stream << std::left << std::setw(12) << "entity" << std::right
+         << std::setw(14) << "distance"
+         << std::setw(14) << "steps/vertex"
+         << std::setw(14) << "full search %"
+         << std::setw(14) << "missed %" << '\n';
+  stream << std::fixed << std::setprecision(1);
+  for (std::pair<uint64_t, Totals> const& entry : totals) {
+    Totals const& entity = entry.second;
+    double vertices = std::max<double>(entity.vertices, 1.0);
+    stream << std::left << std::setw(12) << entry.first << std::right
+           << std::setw(14) << entity.distance
+           << std::setw(14) << entity.steps / vertices
+           << std::setw(14) << 100.0 * entity.fullSearches / vertices
+           << std::setw(14) << 100.0 * entity.discriminantFailures / vertices
+           << '\n';
+  }
+  stream << m_stalls << " frames waited for their counters to be copied.\n";
+  stream.flags(flags);
+  stream.precision(precision);
+  m_totals.clear();
+  m_stalls = 0;
+}
+
+void ShaderCounters::readBack(Readback& readback) {
+  
+  PROFILE_SCOPE("ShaderCounters::readBack");
+  
+  // The wait is given up on in steps of a second, so that it can't hang if
+  // the fence fails rather than being signalled.
+  while (glClientWaitSync(
+      readback.fence,
+      GL_SYNC_FLUSH_COMMANDS_BIT,
+      COUNTER_WAIT_NANOSECONDS) == GL_TIMEOUT_EXPIRED) {
+  }
+  glDeleteSync(readback.fence);
+  readback.fence = 0;
+  
+  m_values.assign(readback.bytes / sizeof(GLuint), 0);
+  if (readback.bytes > 0) {
+    glBindBuffer(GL_COPY_READ_BUFFER, readback.buffer);
+    void const* data = glMapBufferRange(
+      GL_COPY_READ_BUFFER,
+      0,
+      readback.bytes,
+      GL_MAP_READ_BIT);
+    if (data != NULL) {
+      std::memcpy(m_values.data(), data, readback.bytes);
+      glUnmapBuffer(GL_COPY_READ_BUFFER);
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  }
+  
+  // Timelines that weren't drawn in a view, such as those that were culled,
+  // never ran the shader there and are left out.
+  for (ShaderCounterSource const& source : readback.sources) {
+    std::size_t base = COUNTER_FIELDS * source.index;
+    if (base + COUNTER_FIELDS > m_values.size() ||
+        m_values[base + COUNTER_VERTICES] == 0) {
+      continue;
+    }
+    GLuint const* values = m_values.data() + base;
+    m_file << readback.frame << ',' << source.entity << ','
+           << source.view << ',' << source.distance;
+    for (int field = 0; field < COUNTER_FIELDS; ++field) {
+      m_file << ',' << values[field];
+    }
+    m_file << '\n';
+    
+    Totals& totals = m_totals[source.entity];
+    if (totals.vertices == 0) {
+      totals.distance = source.distance;
+    }
+    totals.vertices += values[COUNTER_VERTICES];
+    totals.steps += values[COUNTER_STEPS];
+    totals.fullSearches += values[COUNTER_FULL_SEARCHES];
+    totals.discriminantFailures += values[COUNTER_DISCRIMINANT_FAILURES];
+    totals.distance = std::min(totals.distance, source.distance);
+  }
+  readback.sources.clear();
+}
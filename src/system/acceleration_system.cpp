@@ -2,17 +2,32 @@
 
 #include <cmath>
 
+#include "integrator.h"
+#include "profiler.h"
 #include "vector.h"
 
 #include "component/acceleration_component.h"
 #include "component/body_component.h"
+#include "component/charge_component.h"
+#include "component/field_component.h"
+#include "component/integrator_component.h"
 
+#include "event/event_batch.h"
 #include "event/relativistic_update_event.h"
 
 #include "utility.h"
 
 using namespace lightspeed;
 
+// Finds the force on a body with a momentum from the force applied to it and,
+// if it is charged, from the field that it is in.
+Vector bodyForce(
+  Vector const& applied,
+  double charge,
+  Vector const& electric,
+  Vector const& magnetic,
+  Vector const& momentum);
+
 void AccelerationSystem::configure(
     entityx::EntityManager& entities,
     entityx::EventManager& events) {
@@ -20,25 +35,82 @@ void AccelerationSystem::configure(
   m_entities = &entities;
   m_events = &events;
   
-  events.subscribe<RelativisticUpdateEvent>(*this);
+  events.subscribe<EventBatch<RelativisticUpdateEvent> >(*this);
 }
 
-void AccelerationSystem::receive(RelativisticUpdateEvent const& event) {
+void AccelerationSystem::receive(
+    EventBatch<RelativisticUpdateEvent> const& batch) {
+  
+  PROFILE_SCOPE("AccelerationSystem::receive");
   
+  // Each body is visited once for the whole batch, and its force is only set
+  // up once before it is stepped through every update in turn.
   m_entities->each<BodyComponent, AccelerationComponent>(
-    [event](
+    [&batch](
         entityx::Entity entity,
         BodyComponent& body,
         AccelerationComponent& acceleration) {
       
-      // The momentum of the particle should be increased based on the
-      // acceleration that the particle is experiencing.
-      body.momentum += event.deltaPrime * acceleration.acceleration;
+      // Charged bodies are also pushed around by the field that they are in.
+      // The magnetic part of the force depends on the velocity, so it has to
+      // be recalculated as the body speeds up.
+      Vector applied = acceleration.acceleration;
+      double charge = 0.0;
+      Vector electric;
+      Vector magnetic;
+      entityx::ComponentHandle<ChargeComponent> chargeComponent =
+        entity.component<ChargeComponent>();
+      entityx::ComponentHandle<FieldComponent> field =
+        entity.component<FieldComponent>();
+      if (chargeComponent && field) {
+        charge = chargeComponent->charge;
+        electric = field->electric;
+        magnetic = field->magnetic;
+      }
+      // Only the integrator needs the force as a function of the state.
+      entityx::ComponentHandle<IntegratorComponent> integrator =
+        entity.component<IntegratorComponent>();
+      ForceFunction force;
+      if (integrator) {
+        force = [applied, charge, electric, magnetic](
+            double time,
+            PhaseState const& state) {
+          return bodyForce(applied, charge, electric, magnetic, state.momentum);
+        };
+      }
       
-      // Then, the energy should be adjusted so that the energy-momentum
-      // relationship is still satisfied.
-      body.energy = std::sqrt(
-        LIGHT_SPEED * LIGHT_SPEED + body.momentum.normSq());
+      for (RelativisticUpdateEvent const& event : batch.events) {
+        if (integrator) {
+          // The position and the momentum depend on each other, so they have
+          // to be integrated together.
+          PhaseState state(body.position, body.momentum);
+          integrate(state, force, event.deltaPrime, *integrator.get());
+          body.position = state.position;
+          body.momentum = state.momentum;
+        }
+        else {
+          // The momentum of the particle should be increased based on the
+          // force that the particle is experiencing.
+          body.momentum += event.deltaPrime * bodyForce(
+            applied,
+            charge,
+            electric,
+            magnetic,
+            body.momentum);
+        }
+        
+        // Then, the energy should be adjusted so that the energy-momentum
+        // relationship is still satisfied.
+        body.energy = std::sqrt(
+          LIGHT_SPEED * LIGHT_SPEED + body.momentum.normSq());
+        
+        // The movement system skips accelerating bodies, so the rest are moved
+        // here at their new velocity before the next update speeds them up.
+        if (!integrator) {
+          body.position +=
+            event.deltaPrime * body.momentum * LIGHT_SPEED / body.energy;
+        }
+      }
     });
 }
 
@@ -48,3 +120,16 @@ void AccelerationSystem::update(
     entityx::TimeDelta delta) {
 }
 
+Vector bodyForce(
+    Vector const& applied,
+    double charge,
+    Vector const& electric,
+    Vector const& magnetic,
+    Vector const& momentum) {
+  if (charge == 0.0) {
+    return applied;
+  }
+  Vector velocity = momentum * LIGHT_SPEED / std::sqrt(
+    LIGHT_SPEED * LIGHT_SPEED + momentum.normSq());
+  return applied + charge * (electric + velocity.cross(magnetic) / LIGHT_SPEED);
+}
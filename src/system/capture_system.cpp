@@ -0,0 +1,151 @@
+#include "system/capture_system.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "internal/opengl.h"
+
+#include "event/finalize_event.h"
+#include "event/initialize_event.h"
+#include "event/render_event.h"
+
+#include "frame_writer.h"
+#include "memory_tracker.h"
+#include "profiler.h"
+
+// The number of pixel buffers that frames are read back into. A frame is
+// mapped this many frames after it was drawn.
+#define CAPTURE_BUFFERS (3)
+
+using namespace lightspeed;
+
+CaptureSystem::CaptureSystem(std::string prefix, FrameFormat format) :
+    m_prefix(prefix),
+    m_format(format),
+    m_writer(),
+    m_buffers(),
+    m_frame(0),
+    m_memory(MemoryTracker::instance().counter("GPU capture buffers")) {
+}
+
+void CaptureSystem::configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) {
+  events.subscribe<InitializeEvent>(*this);
+  events.subscribe<FinalizeEvent>(*this);
+  events.subscribe<RenderEvent>(*this);
+}
+
+void CaptureSystem::update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) {
+}
+
+void CaptureSystem::receive(InitializeEvent const& event) {
+  m_writer.reset(new FrameWriter(m_prefix, m_format));
+  m_buffers.resize(CAPTURE_BUFFERS);
+  for (CaptureBuffer& capture : m_buffers) {
+    glGenBuffers(1, &capture.buffer);
+    capture.bytes = 0;
+    capture.width = 0;
+    capture.height = 0;
+    capture.pending = false;
+  }
+  m_memory.allocate(0);
+}
+
+void CaptureSystem::receive(FinalizeEvent const& event) {
+  
+  PROFILE_SCOPE("CaptureSystem::receive(FinalizeEvent)");
+  
+  // The last few frames are still waiting in the buffers, starting from the
+  // oldest. Destroying the writer waits for all of them to be written.
+  for (std::size_t i = 0; i < m_buffers.size(); ++i) {
+    CaptureBuffer& capture = m_buffers[(m_frame + i) % m_buffers.size()];
+    if (capture.pending && m_writer) {
+      readBack(capture);
+    }
+  }
+  for (CaptureBuffer& capture : m_buffers) {
+    glDeleteBuffers(1, &capture.buffer);
+    m_memory.deallocate(capture.bytes);
+  }
+  m_buffers.clear();
+  m_writer.reset();
+}
+
+void CaptureSystem::receive(RenderEvent const& event) {
+  
+  PROFILE_SCOPE("CaptureSystem::receive(RenderEvent)");
+  
+  if (!m_writer || event.viewportWidth <= 0 || event.viewportHeight <= 0) {
+    return;
+  }
+  
+  // The buffer was last read into a full ring ago, so its copy is done.
+  CaptureBuffer& capture = m_buffers[m_frame % m_buffers.size()];
+  if (capture.pending) {
+    readBack(capture);
+  }
+  if (!m_writer) {
+    return;
+  }
+  
+  std::size_t width = event.viewportWidth;
+  std::size_t height = event.viewportHeight;
+  std::size_t bytes = 3 * width * height;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.buffer);
+  if (bytes != capture.bytes) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    m_memory.resize(capture.bytes, bytes);
+    capture.bytes = bytes;
+  }
+  
+  // With a pixel buffer bound, reading the pixels only starts the copy rather
+  // than waiting for the frame to finish drawing.
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadBuffer(GL_BACK);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  capture.width = width;
+  capture.height = height;
+  capture.pending = true;
+  ++m_frame;
+}
+
+void CaptureSystem::readBack(CaptureBuffer& capture) {
+  
+  PROFILE_SCOPE("CaptureSystem::readBack");
+  
+  capture.pending = false;
+  std::size_t bytes = 3 * capture.width * capture.height;
+  std::vector<uint8_t> pixels = m_writer->acquire(bytes);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.buffer);
+  void const* data = glMapBufferRange(
+    GL_PIXEL_PACK_BUFFER,
+    0,
+    bytes,
+    GL_MAP_READ_BIT);
+  if (data != NULL) {
+    std::memcpy(pixels.data(), data, bytes);
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  
+  // Once a frame fails to be written, the recording stops rather than
+  // leaving gaps in it.
+  try {
+    m_writer->submit(capture.width, capture.height, std::move(pixels));
+  }
+  catch (std::runtime_error const& error) {
+    std::cerr << error.what() << " Recording has stopped." << '\n';
+    m_writer.reset();
+  }
+}
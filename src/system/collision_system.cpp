@@ -0,0 +1,315 @@
+#include "system/collision_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/collision_component.h"
+
+#include "event/collision_event.h"
+
+#include "profiler.h"
+#include "utility.h"
+#include "vector.h"
+
+using namespace lightspeed;
+
+// Gets a single component of a vector by index.
+double axisComponent(Vector const& vec, int axis);
+// Checks whether two boxes overlap, using the separating axis theorem. If they
+// do, the direction and depth of the smallest overlap are found.
+bool boxesOverlap(
+  Vector const& centerA,
+  Vector const* edgesA,
+  Vector const& centerB,
+  Vector const* edgesB,
+  Vector& normal,
+  double& depth);
+
+void CollisionSystem::configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) {
+  
+  // Store internal references to the entity and event managers.
+  m_entities = &entities;
+  m_events = &events;
+  
+  // Subscribe to all of the events.
+  events.subscribe<entityx::ComponentAddedEvent<CollisionComponent> >(*this);
+  events.subscribe<entityx::ComponentRemovedEvent<CollisionComponent> >(*this);
+}
+
+void CollisionSystem::receive(
+    entityx::ComponentAddedEvent<CollisionComponent> const& event) {
+  
+  // A component that was removed since the last update still has its proxy,
+  // which is kept rather than adding a second one for the same entity.
+  if (m_removed.erase(event.entity.id().id()) != 0) {
+    return;
+  }
+  
+  Proxy proxy;
+  proxy.entity = event.entity;
+  proxy.active = false;
+  
+  SweepEntry entry = SweepEntry();
+  entry.proxy = m_proxies.size();
+  
+  m_proxies.push_back(proxy);
+  m_sweep.push_back(entry);
+}
+
+void CollisionSystem::receive(
+    entityx::ComponentRemovedEvent<CollisionComponent> const& event) {
+  
+  // The proxy is removed during the next update, so that the list doesn't have
+  // to be searched every time a component is removed.
+  m_removed.insert(event.entity.id().id());
+}
+
+void CollisionSystem::update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) {
+  
+  PROFILE_SCOPE("CollisionSystem::update");
+  
+  // Get rid of any proxies that belong to removed components, keeping track of
+  // where the remaining ones end up so that the sweep entries can follow them.
+  if (!m_removed.empty()) {
+    std::size_t const removed = m_proxies.size();
+    std::vector<std::size_t> newIndices(m_proxies.size());
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < m_proxies.size(); ++i) {
+      if (m_removed.count(m_proxies[i].entity.id().id()) != 0) {
+        newIndices[i] = removed;
+      }
+      else {
+        newIndices[i] = count;
+        m_proxies[count++] = m_proxies[i];
+      }
+    }
+    m_proxies.resize(count);
+    
+    count = 0;
+    for (std::size_t i = 0; i < m_sweep.size(); ++i) {
+      std::size_t proxy = newIndices[m_sweep[i].proxy];
+      if (proxy != removed) {
+        m_sweep[count] = m_sweep[i];
+        m_sweep[count++].proxy = proxy;
+      }
+    }
+    m_sweep.resize(count);
+    m_removed.clear();
+  }
+  
+  // Update the shape of every proxy from its body.
+  Vector mean;
+  Vector meanSq;
+  std::size_t activeCount = 0;
+  for (SweepEntry& entry : m_sweep) {
+    
+    Proxy& proxy = m_proxies[entry.proxy];
+    entityx::ComponentHandle<BodyComponent> body =
+      proxy.entity.component<BodyComponent>();
+    entityx::ComponentHandle<CollisionComponent> collision =
+      proxy.entity.component<CollisionComponent>();
+    proxy.active = body && collision;
+    if (!proxy.active) {
+      continue;
+    }
+    
+    // The edges of the box are rotated, and then contracted along the
+    // direction of motion, in the same way as the vertices are when they are
+    // rendered.
+    Vector velocity = body->momentum * LIGHT_SPEED / body->energy;
+    Vector beta = velocity / LIGHT_SPEED;
+    double betaSq = beta.normSq();
+    double contraction = std::sqrt(1.0 - betaSq);
+    Vector halfExtents = collision->halfExtents;
+    Vector axes[3] = {
+      Vector(halfExtents.x, 0.0, 0.0),
+      Vector(0.0, halfExtents.y, 0.0),
+      Vector(0.0, 0.0, halfExtents.z)
+    };
+    Vector extent;
+    for (int i = 0; i < 3; ++i) {
+      Vector edge = body->rotation.rotate(axes[i]);
+      if (betaSq != 0.0) {
+        Vector parallel = edge.dot(beta) / betaSq * beta;
+        edge += (contraction - 1.0) * parallel;
+      }
+      proxy.edges[i] = edge;
+      extent += Vector(std::abs(edge.x), std::abs(edge.y), std::abs(edge.z));
+    }
+    proxy.center = body->position;
+    
+    Vector min = proxy.center - extent;
+    Vector max = proxy.center + extent;
+    entry.min[0] = min.x;
+    entry.min[1] = min.y;
+    entry.min[2] = min.z;
+    entry.max[0] = max.x;
+    entry.max[1] = max.y;
+    entry.max[2] = max.z;
+    
+    mean += proxy.center;
+    meanSq += Vector(
+      proxy.center.x * proxy.center.x,
+      proxy.center.y * proxy.center.y,
+      proxy.center.z * proxy.center.z);
+    ++activeCount;
+  }
+  
+  if (activeCount < 2) {
+    return;
+  }
+  
+  // Sweep along the axis where the bodies are most spread out, so that as few
+  // of them overlap along it as possible.
+  mean /= activeCount;
+  meanSq /= activeCount;
+  Vector variance = meanSq - Vector(
+    mean.x * mean.x,
+    mean.y * mean.y,
+    mean.z * mean.z);
+  int axis = 0;
+  if (variance.y > variance.x) {
+    axis = 1;
+  }
+  if (variance.z > axisComponent(variance, axis)) {
+    axis = 2;
+  }
+  
+  auto less = [axis](SweepEntry const& a, SweepEntry const& b) {
+    return a.min[axis] < b.min[axis];
+  };
+  if (axis != m_axis) {
+    std::sort(m_sweep.begin(), m_sweep.end(), less);
+    m_axis = axis;
+  }
+  else {
+    // The entries are almost sorted already from the last update, so insertion
+    // sort only has to do a little bit of work.
+    for (std::size_t i = 1; i < m_sweep.size(); ++i) {
+      if (!less(m_sweep[i], m_sweep[i - 1])) {
+        continue;
+      }
+      SweepEntry entry = m_sweep[i];
+      std::size_t j = i;
+      while (j > 0 && less(entry, m_sweep[j - 1])) {
+        m_sweep[j] = m_sweep[j - 1];
+        --j;
+      }
+      m_sweep[j] = entry;
+    }
+  }
+  
+  // Go through the sorted entries, and compare each one against the ones after
+  // it that start before it ends.
+  int otherAxis1 = (axis + 1) % 3;
+  int otherAxis2 = (axis + 2) % 3;
+  std::vector<CollisionEvent> collisions;
+  for (std::size_t i = 0; i < m_sweep.size(); ++i) {
+    SweepEntry const& a = m_sweep[i];
+    Proxy const& proxyA = m_proxies[a.proxy];
+    if (!proxyA.active) {
+      continue;
+    }
+    for (std::size_t j = i + 1; j < m_sweep.size(); ++j) {
+      SweepEntry const& b = m_sweep[j];
+      if (b.min[axis] > a.max[axis]) {
+        break;
+      }
+      if (a.min[otherAxis1] > b.max[otherAxis1] ||
+          a.max[otherAxis1] < b.min[otherAxis1] ||
+          a.min[otherAxis2] > b.max[otherAxis2] ||
+          a.max[otherAxis2] < b.min[otherAxis2]) {
+        continue;
+      }
+      Proxy const& proxyB = m_proxies[b.proxy];
+      if (!proxyB.active || proxyB.entity == proxyA.entity) {
+        continue;
+      }
+      
+      Vector normal;
+      double depth;
+      if (boxesOverlap(
+            proxyA.center, proxyA.edges,
+            proxyB.center, proxyB.edges,
+            normal, depth)) {
+        collisions.push_back(
+          CollisionEvent(proxyA.entity, proxyB.entity, normal, depth));
+      }
+    }
+  }
+  
+  // The events are only sent once everything has been checked, in case any of
+  // the receivers change the entities.
+  for (CollisionEvent const& collision : collisions) {
+    events.emit<CollisionEvent>(collision);
+  }
+}
+
+double axisComponent(Vector const& vec, int axis) {
+  return axis == 0 ? vec.x : (axis == 1 ? vec.y : vec.z);
+}
+
+bool boxesOverlap(
+    Vector const& centerA,
+    Vector const* edgesA,
+    Vector const& centerB,
+    Vector const* edgesB,
+    Vector& normal,
+    double& depth) {
+  
+  // The possible separating axes are the face normals of both boxes, and the
+  // cross products of their edges.
+  Vector axes[15];
+  int axisCount = 0;
+  for (int i = 0; i < 3; ++i) {
+    axes[axisCount++] = edgesA[i].cross(edgesA[(i + 1) % 3]);
+    axes[axisCount++] = edgesB[i].cross(edgesB[(i + 1) % 3]);
+  }
+  for (int i = 0; i < 3; ++i) {
+    for (int j = 0; j < 3; ++j) {
+      axes[axisCount++] = edgesA[i].cross(edgesB[j]);
+    }
+  }
+  
+  Vector offset = centerB - centerA;
+  bool found = false;
+  for (int i = 0; i < axisCount; ++i) {
+    
+    // Parallel edges don't give a useful axis.
+    double lengthSq = axes[i].normSq();
+    if (lengthSq < 1e-24) {
+      continue;
+    }
+    Vector axis = axes[i] / std::sqrt(lengthSq);
+    
+    // Project both boxes onto the axis, and see how much they overlap.
+    double radiusA = 0.0;
+    double radiusB = 0.0;
+    for (int j = 0; j < 3; ++j) {
+      radiusA += std::abs(edgesA[j].dot(axis));
+      radiusB += std::abs(edgesB[j].dot(axis));
+    }
+    double distance = offset.dot(axis);
+    double overlap = radiusA + radiusB - std::abs(distance);
+    if (overlap < 0.0) {
+      return false;
+    }
+    if (!found || overlap < depth) {
+      found = true;
+      depth = overlap;
+      normal = (distance < 0.0) ? -axis : axis;
+    }
+  }
+  
+  // If every axis was degenerate then the boxes must have no volume.
+  return found;
+}
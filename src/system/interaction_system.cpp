@@ -0,0 +1,306 @@
+#include "system/interaction_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/charge_component.h"
+#include "component/field_component.h"
+#include "component/timeline_component.h"
+
+#include "light_cone.h"
+#include "profiler.h"
+#include "utility.h"
+#include "vector.h"
+
+// The most sources that a node can hold before it is split up.
+#define LEAF_SIZE (8)
+// Nodes are never split past this depth, in case many sources are at the same
+// position.
+#define MAX_DEPTH (32)
+#define NULL_NODE (-1)
+
+using namespace lightspeed;
+
+void InteractionSystem::update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) {
+  
+  PROFILE_SCOPE("InteractionSystem::update");
+  
+  // Gather up all of the bodies that produce a field.
+  m_sources.clear();
+  entities.each<ChargeComponent, BodyComponent>(
+    [this](
+        entityx::Entity entity,
+        ChargeComponent& charge,
+        BodyComponent& body) {
+      
+      if (charge.charge == 0.0) {
+        return;
+      }
+      entityx::ComponentHandle<TimelineComponent<BodyComponent> > timeline =
+        entity.component<TimelineComponent<BodyComponent> >();
+      
+      Source source;
+      source.entity = entity;
+      source.charge = charge.charge;
+      source.position = body.position;
+      source.velocity = body.momentum * LIGHT_SPEED / body.energy;
+      source.timeline =
+        (timeline && !timeline->timeline.empty()) ? timeline.get() : nullptr;
+      m_sources.push_back(source);
+    });
+  
+  // Build the octree over the current positions of the sources.
+  m_nodes.clear();
+  m_order.resize(m_sources.size());
+  int root = NULL_NODE;
+  if (!m_sources.empty()) {
+    Vector min = m_sources[0].position;
+    Vector max = m_sources[0].position;
+    for (std::size_t i = 0; i < m_sources.size(); ++i) {
+      Vector const& position = m_sources[i].position;
+      min = Vector(
+        std::min(min.x, position.x),
+        std::min(min.y, position.y),
+        std::min(min.z, position.z));
+      max = Vector(
+        std::max(max.x, position.x),
+        std::max(max.y, position.y),
+        std::max(max.z, position.z));
+      m_order[i] = i;
+    }
+    Vector size = max - min;
+    double halfSize = std::max(std::max(size.x, size.y), size.z) / 2.0;
+    root = buildNode((min + max) / 2.0, halfSize, 0, m_sources.size(), 0);
+  }
+  
+  // Now find the field at each charged body.
+  std::vector<int> stack;
+  entities.each<ChargeComponent, BodyComponent, FieldComponent>(
+    [this, root, &stack](
+        entityx::Entity entity,
+        ChargeComponent& charge,
+        BodyComponent& body,
+        FieldComponent& field) {
+      
+      Vector electric;
+      Vector magnetic;
+      Vector position = body.position;
+      
+      stack.clear();
+      if (root != NULL_NODE) {
+        stack.push_back(root);
+      }
+      while (!stack.empty()) {
+        Node const& node = m_nodes[stack.back()];
+        stack.pop_back();
+        
+        // A node can be approximated if it looks small from the position of
+        // the body, as long as the body isn't inside of it.
+        Vector offset = position - node.center;
+        bool inside =
+          std::abs(offset.x) <= node.halfSize &&
+          std::abs(offset.y) <= node.halfSize &&
+          std::abs(offset.z) <= node.halfSize;
+        if (!inside && 2.0 * node.halfSize < m_openingAngle * offset.norm()) {
+          if (node.positive.charge != 0.0) {
+            addUniformField(node.positive, position, electric, magnetic);
+          }
+          if (node.negative.charge != 0.0) {
+            addUniformField(node.negative, position, electric, magnetic);
+          }
+        }
+        else if (node.children[0] == NULL_NODE) {
+          for (std::size_t i = 0; i < node.count; ++i) {
+            Source const& source = m_sources[m_order[node.first + i]];
+            if (source.entity != entity) {
+              addSourceField(source, position, electric, magnetic);
+            }
+          }
+        }
+        else {
+          for (int i = 0; i < 8; ++i) {
+            if (node.children[i] != NULL_NODE) {
+              stack.push_back(node.children[i]);
+            }
+          }
+        }
+      }
+      
+      field.electric = electric;
+      field.magnetic = magnetic;
+    });
+}
+
+int InteractionSystem::buildNode(
+    Vector center,
+    double halfSize,
+    std::size_t first,
+    std::size_t count,
+    unsigned int depth) {
+  
+  int index = m_nodes.size();
+  m_nodes.push_back(Node());
+  
+  // Add up the positive and negative charges separately, since a mixture of
+  // them has no sensible center.
+  Aggregate positive = { 0.0, Vector(), Vector() };
+  Aggregate negative = { 0.0, Vector(), Vector() };
+  for (std::size_t i = first; i < first + count; ++i) {
+    Source const& source = m_sources[m_order[i]];
+    Aggregate& aggregate = (source.charge > 0.0) ? positive : negative;
+    aggregate.charge += source.charge;
+    aggregate.position += std::abs(source.charge) * source.position;
+    aggregate.velocity += std::abs(source.charge) * source.velocity;
+  }
+  if (positive.charge != 0.0) {
+    positive.position /= positive.charge;
+    positive.velocity /= positive.charge;
+  }
+  if (negative.charge != 0.0) {
+    negative.position /= -negative.charge;
+    negative.velocity /= -negative.charge;
+  }
+  
+  m_nodes[index].center = center;
+  m_nodes[index].halfSize = halfSize;
+  m_nodes[index].first = first;
+  m_nodes[index].count = count;
+  m_nodes[index].positive = positive;
+  m_nodes[index].negative = negative;
+  std::fill(m_nodes[index].children, m_nodes[index].children + 8, NULL_NODE);
+  
+  if (count <= LEAF_SIZE || depth >= MAX_DEPTH) {
+    return index;
+  }
+  
+  // Sort the sources into octants, by counting how many go into each one and
+  // then placing them.
+  auto octant = [this, center](std::size_t source) {
+    Vector const& position = m_sources[source].position;
+    return (position.x >= center.x ? 1 : 0) +
+           (position.y >= center.y ? 2 : 0) +
+           (position.z >= center.z ? 4 : 0);
+  };
+  std::size_t counts[8] = { 0 };
+  for (std::size_t i = first; i < first + count; ++i) {
+    ++counts[octant(m_order[i])];
+  }
+  std::size_t starts[8];
+  std::size_t offsets[8];
+  starts[0] = first;
+  for (int i = 1; i < 8; ++i) {
+    starts[i] = starts[i - 1] + counts[i - 1];
+  }
+  std::copy(starts, starts + 8, offsets);
+  std::vector<std::size_t> sorted(count);
+  for (std::size_t i = first; i < first + count; ++i) {
+    sorted[offsets[octant(m_order[i])]++ - first] = m_order[i];
+  }
+  std::copy(sorted.begin(), sorted.end(), m_order.begin() + first);
+  
+  for (int i = 0; i < 8; ++i) {
+    if (counts[i] == 0) {
+      continue;
+    }
+    double childHalfSize = halfSize / 2.0;
+    Vector childCenter = center + Vector(
+      (i & 1) ? childHalfSize : -childHalfSize,
+      (i & 2) ? childHalfSize : -childHalfSize,
+      (i & 4) ? childHalfSize : -childHalfSize);
+    int child = buildNode(
+      childCenter,
+      childHalfSize,
+      starts[i],
+      counts[i],
+      depth + 1);
+    m_nodes[index].children[i] = child;
+  }
+  
+  return index;
+}
+
+void InteractionSystem::addSourceField(
+    Source const& source,
+    Vector const& position,
+    Vector& electric,
+    Vector& magnetic) const {
+  
+  if (source.timeline == nullptr) {
+    Aggregate aggregate = { source.charge, source.position, source.velocity };
+    addUniformField(aggregate, position, electric, magnetic);
+    return;
+  }
+  
+  // The retarded position is where the light cone of the present moment at
+  // the position crosses the timeline. If the light cone crosses before the
+  // timeline begins, then the source is treated as having been at rest at its
+  // oldest entry.
+  TimelineComponent<BodyComponent>::Entry sample;
+  if (!retardedSample(*source.timeline, ObserverEvent(position), sample)) {
+    addField(
+      source.charge,
+      source.timeline->timeline.front().second.position,
+      Vector(),
+      position,
+      electric,
+      magnetic);
+    return;
+  }
+  
+  BodyComponent const& retarded = sample.second;
+  addField(
+    source.charge,
+    retarded.position,
+    retarded.momentum * LIGHT_SPEED / retarded.energy,
+    position,
+    electric,
+    magnetic);
+}
+
+void InteractionSystem::addUniformField(
+    Aggregate const& aggregate,
+    Vector const& position,
+    Vector& electric,
+    Vector& magnetic) const {
+  
+  double time = retardedTime(
+    aggregate.position - position,
+    aggregate.velocity);
+  
+  addField(
+    aggregate.charge,
+    aggregate.position + time * aggregate.velocity,
+    aggregate.velocity,
+    position,
+    electric,
+    magnetic);
+}
+
+void InteractionSystem::addField(
+    double charge,
+    Vector const& retardedPosition,
+    Vector const& velocity,
+    Vector const& position,
+    Vector& electric,
+    Vector& magnetic) const {
+  
+  // The velocity part of the Lienard-Wiechert field.
+  Vector offset = position - retardedPosition;
+  double distanceSq = offset.normSq() + m_softening * m_softening;
+  Vector direction = offset / std::sqrt(distanceSq);
+  Vector beta = velocity / LIGHT_SPEED;
+  double gammaSqInv = 1.0 - beta.normSq();
+  double k = 1.0 - direction.dot(beta);
+  
+  Vector field = m_coupling * charge * (direction - beta) *
+    gammaSqInv / (k * k * k * distanceSq);
+  electric += field;
+  magnetic += direction.cross(field);
+}
@@ -1,9 +1,12 @@
 #include "system/movement_system.h"
 
+#include "profiler.h"
 #include "vector.h"
 
+#include "component/acceleration_component.h"
 #include "component/body_component.h"
 
+#include "event/event_batch.h"
 #include "event/relativistic_update_event.h"
 
 using namespace lightspeed;
@@ -15,15 +18,29 @@ void MovementSystem::configure(
   m_entities = &entities;
   m_events = &events;
   
-  events.subscribe<RelativisticUpdateEvent>(*this);
+  events.subscribe<EventBatch<RelativisticUpdateEvent> >(*this);
 }
 
-void MovementSystem::receive(RelativisticUpdateEvent const& event) {
+void MovementSystem::receive(
+    EventBatch<RelativisticUpdateEvent> const& batch) {
   
+  PROFILE_SCOPE("MovementSystem::receive");
+  
+  // Nothing changes the velocities here, but the updates of a batch are still
+  // applied one at a time, so that the bodies end up exactly where separate
+  // updates would have put them.
   m_entities->each<BodyComponent>(
-    [event](entityx::Entity entity, BodyComponent& body) {
-      body.position +=
-        event.deltaPrime * body.momentum * LIGHT_SPEED / body.energy;
+    [&batch](entityx::Entity entity, BodyComponent& body) {
+      
+      // Accelerating bodies have already been moved by the acceleration
+      // system, between the changes to their velocities.
+      if (entity.has_component<AccelerationComponent>()) {
+        return;
+      }
+      for (RelativisticUpdateEvent const& event : batch.events) {
+        body.position +=
+          event.deltaPrime * body.momentum * LIGHT_SPEED / body.energy;
+      }
   });
 }
 
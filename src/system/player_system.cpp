@@ -10,6 +10,8 @@
 #include "component/body_component.h"
 #include "component/player_component.h"
 
+#include "profiler.h"
+
 using namespace lightspeed;
 
 void PlayerSystem::configure(
@@ -21,9 +23,8 @@ void PlayerSystem::configure(
   m_events = &events;
   
   // Subscribe to all of the events.
-  events.subscribe<KeyboardEvent>(*this);
-  events.subscribe<MouseButtonEvent>(*this);
-  events.subscribe<MousePositionEvent>(*this);
+  events.subscribe<EventBatch<KeyboardEvent> >(*this);
+  events.subscribe<EventBatch<MousePositionEvent> >(*this);
 }
 
 void PlayerSystem::update(
@@ -31,6 +32,8 @@ void PlayerSystem::update(
     entityx::EventManager& events,
     entityx::TimeDelta delta) {
   
+  PROFILE_SCOPE("PlayerSystem::update");
+  
   // Find every entity that has a player component and a body component, and
   // apply the correct rotation to it.
   entities.each<PlayerComponent, BodyComponent>(
@@ -93,47 +96,53 @@ void PlayerSystem::update(
   
 }
 
-void PlayerSystem::receive(KeyboardEvent const& event) {
+void PlayerSystem::receive(EventBatch<KeyboardEvent> const& batch) {
+  
+  PROFILE_SCOPE("PlayerSystem::receive(KeyboardEvent)");
   
   // Set the keyboard variables of each player component to the appropriate
-  // values.
+  // values. The events are applied in order, so a key that was pressed and
+  // released within the frame ends up released.
   m_entities->each<PlayerComponent>(
-    [event](entityx::Entity entity, PlayerComponent& player) {
+    [&batch](entityx::Entity entity, PlayerComponent& player) {
       
-      bool pressed = (event.action == GLFW_PRESS ||
-                      event.action == GLFW_REPEAT);
-      if (event.key == player.forwardKey) {
-        player.forwardKeyPressed = pressed;
-      }
-      if (event.key == player.backwardKey) {
-        player.backwardKeyPressed = pressed;
-      }
-      if (event.key == player.leftKey) {
-        player.leftKeyPressed = pressed;
-      }
-      if (event.key == player.rightKey) {
-        player.rightKeyPressed = pressed;
-      }
-      if (event.key == player.upKey) {
-        player.upKeyPressed = pressed;
-      }
-      if (event.key == player.downKey) {
-        player.downKeyPressed = pressed;
+      for (KeyboardEvent const& event : batch.events) {
+        bool pressed = (event.action == GLFW_PRESS ||
+                        event.action == GLFW_REPEAT);
+        if (event.key == player.forwardKey) {
+          player.forwardKeyPressed = pressed;
+        }
+        if (event.key == player.backwardKey) {
+          player.backwardKeyPressed = pressed;
+        }
+        if (event.key == player.leftKey) {
+          player.leftKeyPressed = pressed;
+        }
+        if (event.key == player.rightKey) {
+          player.rightKeyPressed = pressed;
+        }
+        if (event.key == player.upKey) {
+          player.upKeyPressed = pressed;
+        }
+        if (event.key == player.downKey) {
+          player.downKeyPressed = pressed;
+        }
       }
     });
 }
 
-void PlayerSystem::receive(MouseButtonEvent const& event) {
+void PlayerSystem::receive(EventBatch<MousePositionEvent> const& batch) {
   
-}
-
-void PlayerSystem::receive(MousePositionEvent const& event) {
+  PROFILE_SCOPE("PlayerSystem::receive(MousePositionEvent)");
   
   double lastMouseX = m_lastMouseX;
   double lastMouseY = m_lastMouseY;
   
+  // Only the latest position is usually queued, but the mouse has moved by
+  // the same amount in all however many positions there are.
+  MousePositionEvent const& event = batch.events.back();
   m_entities->each<PlayerComponent>(
-    [event, &lastMouseX, &lastMouseY](
+    [&event, &lastMouseX, &lastMouseY](
         entityx::Entity entity,
         PlayerComponent& player) {
       
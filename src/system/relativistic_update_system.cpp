@@ -7,6 +7,8 @@
 
 #include "event/relativistic_update_event.h"
 
+#include "event_queue.h"
+#include "profiler.h"
 #include "utility.h"
 
 using namespace lightspeed;
@@ -16,8 +18,13 @@ void RelativisticUpdateSystem::update(
     entityx::EventManager& events,
     entityx::TimeDelta delta) {
   
+  PROFILE_SCOPE("RelativisticUpdateSystem::update");
+  
+  // The receivers each go through the entities once for the whole batch,
+  // rather than once for every player.
+  EventQueue& updates = m_updates;
   entities.each<PlayerComponent, BodyComponent>(
-    [delta, &events](
+    [delta, &updates](
         entityx::Entity entity,
         PlayerComponent& player,
         BodyComponent& body) {
@@ -26,7 +33,8 @@ void RelativisticUpdateSystem::update(
       double gamma = (body.energy * body.energy - body.momentum.normSq()) /
                       LIGHT_SPEED / LIGHT_SPEED;
       
-      // Emit an event storing the time dilation information.
-      events.emit<RelativisticUpdateEvent>(delta, gamma * delta);
+      // Queue an event storing the time dilation information.
+      updates.push(RelativisticUpdateEvent(delta, gamma * delta));
     });
+  m_updates.flush(events);
 }
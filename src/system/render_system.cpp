@@ -3,15 +3,18 @@
 #include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <limits>
 #include <stdexcept>
 #include <streambuf>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "internal/opengl.h"
 
 #include "component/body_component.h"
 #include "component/camera_component.h"
+#include "component/deformation_component.h"
 #include "component/model_component.h"
 #include "component/timeline_component.h"
 
@@ -19,19 +22,69 @@
 #include "event/initialize_event.h"
 #include "event/render_event.h"
 
+#include "four_vector.h"
+#include "light_cone.h"
+#include "lorentz_transform.h"
+#include "memory_tracker.h"
+#include "mesh.h"
+#include "profiler.h"
 #include "quaternion.h"
+#include "shader_counters.h"
+#include "timeline_packing.h"
 #include "utility.h"
 #include "vector.h"
 #include "vertex.h"
 
-#define UNIFORM_OBSERVER (0)
-#define UNIFORM_OBSERVER_POSITION (0)
-#define UNIFORM_OBSERVER_VELOCITY (1)
-#define UNIFORM_OBSERVER_ROTATION (2)
-#define UNIFORM_PROJECTION (3)
 #define UNIFORM_LIGHTSPEED (4)
+#define UNIFORM_FIRST_VIEW (5)
+#define UNIFORM_HINT_BASE (6)
+#define UNIFORM_TIMELINE_ORIGIN (7)
+#define UNIFORM_MORPH_TARGETS (8)
 
 #define BUFFER_TIMELINE (0)
+#define BUFFER_VIEWS (1)
+#define BUFFER_HINTS (2)
+// The morph targets take up a binding each, starting from this one.
+#define BUFFER_MORPH_TARGETS (3)
+#define BUFFER_WEIGHTS (7)
+#define BUFFER_CULL_DRAWS (8)
+#define BUFFER_SPHERES (9)
+#define BUFFER_VIEWPORTS (10)
+#define BUFFER_COMMANDS (11)
+
+// The uniforms of the compute shaders that build the depth pyramid and cull
+// against it.
+#define UNIFORM_HIZ_SOURCE_LEVEL (0)
+#define UNIFORM_HIZ_REDUCE (1)
+#define UNIFORM_CULL_DRAW_COUNT (0)
+#define UNIFORM_CULL_HAS_HIZ (1)
+
+#define TEXTURE_HIZ (0)
+#define IMAGE_HIZ (0)
+
+// The sizes of the work groups of the compute shaders, which have to match
+// the shaders.
+#define HIZ_GROUP_SIZE (8)
+#define CULL_GROUP_SIZE (64)
+
+// The number of unsigned ints in each indirect draw command, and in each draw
+// read by the culling pass.
+#define COMMAND_UINTS (4)
+#define CULL_DRAW_UINTS (4)
+
+// Marks a draw that is made directly, rather than with a culled command.
+#define NO_COMMAND ((std::size_t) -1)
+
+// How many buffers are generated at once when the pool runs out, and how many
+// can be left in the pool before the rest are deleted.
+#define BUFFER_POOL_BLOCK (64)
+#define BUFFER_POOL_MAX (1024)
+
+// Marks a hint as unknown, so that the shader searches the whole timeline.
+#define NO_HINT (0xFFFFFFFFu)
+
+// The number of floats taken by the observer at the start of a view.
+#define VIEW_OBSERVER_FLOATS (12)
 
 #define ATTRIBUTE_POSITION (0)
 
@@ -40,18 +93,40 @@ using namespace lightspeed;
 GLuint createShader(
     unsigned int num,
     GLenum* shaderTypes,
-    std::string* fileNames);
+    std::string* fileNames,
+    std::string const& defines = std::string());
 void destroyShader(GLuint shader);
 
-void fillObserver(BodyComponent& body);
-void fillProjection(CameraComponent& camera);
+void packView(
+  BodyComponent const& body,
+  CameraComponent const& camera,
+  Vector const& origin,
+  std::vector<GLfloat>& data);
+void viewportRect(
+  CameraComponent const& camera,
+  RenderEvent const& event,
+  GLint* rect);
 void fillLightspeed();
-void fillTimeline(TimelineComponent<BodyComponent>& timeline, GLuint buffer);
+std::size_t fillTimeline(
+  TimelineComponent<BodyComponent> const& timeline,
+  Vector const& origin,
+  GLuint buffer,
+  std::vector<GLfloat>& data);
+std::size_t fillWeights(
+  TimelineComponent<BodyComponent> const& timeline,
+  TimelineComponent<DeformationComponent> const& deformations,
+  GLuint buffer,
+  std::vector<GLfloat>& data);
+void apparentSphere(
+  TimelineComponent<BodyComponent> const& timeline,
+  double radius,
+  BodyComponent const& observer,
+  std::vector<GLfloat>& data);
 
 void RenderSystem::configure(
     entityx::EntityManager& entities,
     entityx::EventManager& events) {
-  
+      
   // Store internal references to the entity and event managers.
   m_entities = &entities;
   m_events = &events;
@@ -74,10 +149,42 @@ void RenderSystem::update(
     entityx::EntityManager& entities,
     entityx::EventManager& events,
     entityx::TimeDelta delta) {
+      
+  PROFILE_SCOPE("RenderSystem::update");
+  
+  // Clean up the buffers of any meshes that only the render system still
+  // refers to.
+  for (auto it = m_meshBuffers.begin(); it != m_meshBuffers.end();) {
+    if (it->second.models == 0 && it->second.mesh.useCount() == 1) {
+      if (it->second.buffer != 0) {
+        glDeleteBuffers(1, &it->second.buffer);
+        m_meshMemory.deallocate(
+          sizeof(Vertex) * it->second.mesh.vertexCount());
+      }
+      it = m_meshBuffers.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  
+  // Only keep enough buffers around for a burst of spawning, and delete the
+  // rest all at once.
+  if (m_bufferPool.size() > BUFFER_POOL_MAX) {
+    std::vector<GLuint> buffers;
+    for (std::size_t i = BUFFER_POOL_MAX; i < m_bufferPool.size(); ++i) {
+      buffers.push_back(m_bufferPool[i].buffer);
+      m_timelineMemory.deallocate(m_bufferPool[i].bytes);
+    }
+    glDeleteBuffers(buffers.size(), buffers.data());
+    m_bufferPool.resize(BUFFER_POOL_MAX);
+  }
 }
 
 void RenderSystem::receive(InitializeEvent const& event) {
   
+  PROFILE_SCOPE("RenderSystem::receive(InitializeEvent)");
+  
   // Create the shaders.
   std::string renderRelativisticShaderFilenames[] = {
     "render_relativistic.vert",
@@ -88,174 +195,898 @@ void RenderSystem::receive(InitializeEvent const& event) {
     GL_FRAGMENT_SHADER
   };
   
+  // The counters are compiled into the shader only when they are wanted.
   m_renderRelativisticShader = createShader(
     2,
     renderRelativisticShaderTypes,
-    renderRelativisticShaderFilenames
+    renderRelativisticShaderFilenames,
+    m_counters != nullptr ? ShaderCounters::shaderDefines() : std::string()
   );
+  if (m_counters != nullptr) {
+    m_counters->initialize();
+  }
+  
+  // The targets are only made once the size of the window is known.
+  if (m_occlusionCulling) {
+    std::string hiZBuildShaderFilenames[] = { "hiz_build.comp" };
+    std::string hiZCullShaderFilenames[] = { "hiz_cull.comp" };
+    GLenum computeShaderTypes[] = { GL_COMPUTE_SHADER };
+    m_hiZBuildShader = createShader(
+      1,
+      computeShaderTypes,
+      hiZBuildShaderFilenames);
+    m_hiZCullShader = createShader(
+      1,
+      computeShaderTypes,
+      hiZCullShaderFilenames);
+    glGenFramebuffers(1, &m_framebuffer);
+    glGenBuffers(1, &m_cullDrawBuffer);
+    glGenBuffers(1, &m_sphereBuffer);
+    glGenBuffers(1, &m_viewportBuffer);
+    glGenBuffers(1, &m_commandBuffer);
+    m_occlusionMemory.allocate(0);
+  }
+  
+  // The views are all drawn at once if the vertex shader can pick which
+  // viewport each instance goes to.
+  glGenBuffers(1, &m_viewBuffer);
+  glGenBuffers(1, &m_hintBuffer);
+  m_timelineMemory.allocate(0);
+#ifdef GLEW_ARB_shader_viewport_layer_array
+  m_multiViewport = GLEW_ARB_shader_viewport_layer_array;
+#else
+  m_multiViewport = false;
+#endif
+  glGetIntegerv(GL_MAX_VIEWPORTS, &m_maxViewports);
 }
 
 void RenderSystem::receive(FinalizeEvent const& event) {
   
+  PROFILE_SCOPE("RenderSystem::receive(FinalizeEvent)");
+  
   // Clean up the shaders.
   destroyShader(m_renderRelativisticShader);
+  if (m_counters != nullptr) {
+    m_counters->finalize();
+  }
+  glDeleteBuffers(1, &m_viewBuffer);
+  glDeleteBuffers(1, &m_hintBuffer);
+  m_timelineMemory.deallocate(
+    sizeof(GLuint) * m_hintCapacity * m_hintViews);
+  for (PooledBuffer const& pooled : m_bufferPool) {
+    glDeleteBuffers(1, &pooled.buffer);
+    m_timelineMemory.deallocate(pooled.bytes);
+  }
+  m_bufferPool.clear();
+  
+  if (m_occlusionCulling) {
+    resizeTargets(0, 0);
+    destroyShader(m_hiZBuildShader);
+    destroyShader(m_hiZCullShader);
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteBuffers(1, &m_cullDrawBuffer);
+    glDeleteBuffers(1, &m_sphereBuffer);
+    glDeleteBuffers(1, &m_viewportBuffer);
+    glDeleteBuffers(1, &m_commandBuffer);
+    m_occlusionMemory.deallocate(m_cullBytes);
+    m_cullBytes = 0;
+  }
 }
 
 void RenderSystem::receive(
     entityx::ComponentAddedEvent<ModelComponent> const& event) {
+      
+  Mesh const& mesh = event.component->mesh;
+  if (!mesh) {
+    return;
+  }
   
-  // Create a new vertex buffer array to hold the geometry.
-  GLuint vertexBuffer;
-  glGenBuffers(1, &vertexBuffer);
-  glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-  
-  // Fill the buffer with the vertex data.
-  glBufferData(
-    GL_ARRAY_BUFFER,
-    sizeof(Vertex) * event.component->vertices.size(),
-    event.component->vertices.data(),
-    GL_STATIC_DRAW);
-  
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // The morph targets are read by vertex index alongside the mesh, so they
+  // have to match it vertex for vertex.
+  std::vector<Mesh> const& targets = event.component->morphTargets;
+  if (targets.size() > MORPH_TARGET_COUNT) {
+    throw std::runtime_error("A model has too many morph targets.");
+  }
+  for (Mesh const& target : targets) {
+    if (!target || target.vertexCount() != mesh.vertexCount()) {
+      throw std::runtime_error(
+        "The morph targets of a model must have as many vertices as its mesh.");
+    }
+  }
   
-  // Store the buffer index in the map.
-  m_vertexBuffers[event.component.get()] = vertexBuffer;
+  acquireMesh(mesh);
+  for (Mesh const& target : targets) {
+    acquireMesh(target);
+  }
 }
 
 void RenderSystem::receive(
     entityx::ComponentAddedEvent<
       TimelineComponent<BodyComponent> > const& event) {
+        
+  // The timeline gets a buffer when it is first drawn, so that entities that
+  // are removed before then never touch the GPU.
+  TimelineBuffer timelineBuffer = { 0, 0, 0, 0, Vector(), 0, 0 };
   
-  // Create a buffer to store timeline information.
-  GLuint timelineBuffer;
-  glGenBuffers(1, &timelineBuffer);
+  // The hints left in a reused slot would only send the search to the wrong
+  // place, so they are cleared before the next frame is drawn.
+  if (!m_freeHintSlots.empty()) {
+    timelineBuffer.hintSlot = m_freeHintSlots.back();
+    m_freeHintSlots.pop_back();
+    m_staleHintSlots.push_back(timelineBuffer.hintSlot);
+  }
+  else {
+    timelineBuffer.hintSlot = m_hintSlots++;
+  }
   m_timelineBuffers[event.component.get()] = timelineBuffer;
 }
 
 void RenderSystem::receive(
     entityx::ComponentRemovedEvent<ModelComponent> const& event) {
-  
-  // Look up the buffer from the map, remove it, and clean it up.
-  GLuint vertexBuffer = m_vertexBuffers[event.component.get()];
-  m_vertexBuffers.erase(event.component.get());
-  glDeleteBuffers(1, &vertexBuffer);
+      
+  // The buffer isn't cleaned up here, since the vertices it holds are gone and
+  // another model could still be given the same mesh. It is left for the
+  // update to clean up once nothing else refers to the mesh.
+  if (event.component->mesh) {
+    releaseMesh(event.component->mesh);
+    for (Mesh const& target : event.component->morphTargets) {
+      releaseMesh(target);
+    }
+  }
 }
 
 void RenderSystem::receive(
     entityx::ComponentRemovedEvent<
       TimelineComponent<BodyComponent> > const& event) {
-  
-  // Clean up any buffers corresponding to timeline components as well.
-  GLuint timelineBuffer = m_timelineBuffers[event.component.get()];
+        
+  // The buffers go back to the pool for the next timelines to use.
+  TimelineBuffer timelineBuffer = m_timelineBuffers[event.component.get()];
   m_timelineBuffers.erase(event.component.get());
-  glDeleteBuffers(1, &timelineBuffer);
+  m_freeHintSlots.push_back(timelineBuffer.hintSlot);
+  if (timelineBuffer.buffer != 0) {
+    giveBuffer(timelineBuffer.buffer, timelineBuffer.bytes);
+  }
+  if (timelineBuffer.weightBuffer != 0) {
+    giveBuffer(timelineBuffer.weightBuffer, timelineBuffer.weightBytes);
+  }
 }
 
 void RenderSystem::receive(RenderEvent const& event) {
   
-  // Find an entity with a camera component, and use it to create the projection
-  // matrix. Exactly one entity should have a camera component.
-  bool hasCamera = false;
-  CameraComponent camera;
-  BodyComponent body;
+  PROFILE_SCOPE("RenderSystem::receive(RenderEvent)");
+  
+  // Every entity with a camera component gets its own view. If it has a body
+  // component, then that is where the view is seen from.
+  std::size_t viewCount = 0;
   m_entities->each<CameraComponent>(
-    [&hasCamera, &camera, &body](entityx::Entity entity, CameraComponent& c) {
+    [this, &viewCount](entityx::Entity entity, CameraComponent& camera) {
       
-      if (hasCamera) {
-        throw std::runtime_error(
-          "Can't have multiple entities with a camera component.");
+      if (viewCount == m_views.size()) {
+        m_views.emplace_back();
       }
-      camera = c;
-      hasCamera = true;
+      View& view = m_views[viewCount++];
+      view.camera = camera;
+      view.body = BodyComponent();
       
-      // Check if a body component is present, and if so, remember it.
-      entityx::ComponentHandle<BodyComponent> b =
+      entityx::ComponentHandle<BodyComponent> body =
         entity.component<BodyComponent>();
-      if (b) {
-        body = *b.get();
+      if (body) {
+        view.body = *body.get();
       }
     });
-  if (!hasCamera) {
+  if (viewCount == 0) {
     throw std::runtime_error("Must have an entity with a camera component.");
   }
+  m_views.resize(viewCount);
+  reserveHints();
+  flushPending();
+  
+  // Find what each view could see, uploading the timelines as they are found.
+  // An entity seen by several views is still only uploaded once.
+  ++m_frame;
+  m_origin = m_views.front().body.position;
+  m_drawList.clear();
+  for (View& view : m_views) {
+    view.visible.clear();
+    if (m_worldlines != nullptr) {
+      m_worldlines->queryVisible(view.body, view.camera, view.visible);
+    }
+    else if (&view != &m_views.front()) {
+      view.visible = m_views.front().visible;
+    }
+    else {
+      m_entities->each<ModelComponent, TimelineComponent<BodyComponent> >(
+        [&view](
+            entityx::Entity entity,
+            ModelComponent& model,
+            TimelineComponent<BodyComponent>& timeline) {
+          view.visible.push_back(entity);
+        });
+    }
+    for (entityx::Entity entity : view.visible) {
+      upload(entity);
+    }
+  }
+  
+  // The observers and projections of all of the views go in one buffer.
+  m_viewData.clear();
+  for (View const& view : m_views) {
+    packView(view.body, view.camera, m_origin, m_viewData);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_viewBuffer);
+  glBufferData(
+    GL_SHADER_STORAGE_BUFFER,
+    sizeof(GLfloat) * m_viewData.size(),
+    m_viewData.data(),
+    GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_VIEWS, m_viewBuffer);
+  
+  // The commands are written in the same order as the draws, so how the
+  // views are drawn has to be decided first. Nothing is culled while the
+  // window has no size, since there is nothing to draw into.
+  bool multiViewport =
+    m_multiViewport && m_views.size() <= (std::size_t) m_maxViewports;
+  bool culling = m_occlusionCulling &&
+    event.viewportWidth > 0 &&
+    event.viewportHeight > 0;
+  if (culling) {
+    resizeTargets(event.viewportWidth, event.viewportHeight);
+    cull(event, multiViewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  }
   
   // First set up the viewport and clear the background.
   glViewport(0, 0, event.viewportWidth, event.viewportHeight);
   glClearColor(0.0, 0.0, 0.0, 1.0);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glEnable(GL_DEPTH_TEST);
   
   // Set the shader that will be used.
   glUseProgram(m_renderRelativisticShader);
   
   // Set up the attributes of the vertices.
   glEnableVertexAttribArray(ATTRIBUTE_POSITION);
-  
-  // Pass relevent data about the observer to the shader.
-  fillObserver(body);
-  fillProjection(camera);
   fillLightspeed();
   
-  // Loop through every entity with a timeline and model component and render
-  // it.
-  m_entities->each<ModelComponent, TimelineComponent<BodyComponent> >(
-    [this](
-        entityx::Entity entity,
-        ModelComponent& model,
-        TimelineComponent<BodyComponent>& timeline) {
-      
-      // Get the indices of the buffers.
-      GLuint vertexBuffer = m_vertexBuffers[&model];
-      GLuint timelineBuffer = m_timelineBuffers[&timeline];
-      
-      fillTimeline(timeline, timelineBuffer);
-      glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-      glVertexAttribPointer(
-        ATTRIBUTE_POSITION,
-        3,
-        GL_FLOAT,
-        GL_FALSE,
-        sizeof(Vertex),
-        0);
-      glDrawArrays(GL_TRIANGLES, 0, model.vertices.size());
-    });
+  // The hints written on the last frame have to be visible to this one.
+  glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_HINTS, m_hintBuffer);
+  if (m_counters != nullptr) {
+    m_counters->begin(m_hintCapacity * m_hintViews);
+  }
+  
+  std::size_t command = 0;
+  if (multiViewport) {
+    
+    // Each entity is drawn into every view at once, with one instance per
+    // view. Entities that a view can't see are clipped away by the GPU.
+    for (std::size_t index = 0; index < m_views.size(); ++index) {
+      GLint rect[4];
+      viewportRect(m_views[index].camera, event, rect);
+      glViewportIndexedf(index, rect[0], rect[1], rect[2], rect[3]);
+    }
+    glUniform1i(UNIFORM_FIRST_VIEW, 0);
+    for (entityx::Entity entity : m_drawList) {
+      draw(entity, m_views.size(), culling ? command++ : NO_COMMAND);
+    }
+  }
+  else {
+    
+    // Otherwise each view is drawn in turn, but only the draw calls are
+    // repeated since everything has already been uploaded.
+    for (std::size_t index = 0; index < m_views.size(); ++index) {
+      GLint rect[4];
+      viewportRect(m_views[index].camera, event, rect);
+      glViewport(rect[0], rect[1], rect[2], rect[3]);
+      glUniform1i(UNIFORM_FIRST_VIEW, index);
+      for (entityx::Entity entity : m_views[index].visible) {
+        draw(entity, 1, culling ? command++ : NO_COMMAND);
+      }
+    }
+  }
+  
+  // The counters are kept at the same index as the hints, so each timeline
+  // in each view is reported from there.
+  if (m_counters != nullptr) {
+    std::vector<ShaderCounterSource> sources;
+    for (entityx::Entity entity : m_drawList) {
+      TimelineComponent<BodyComponent> const& timeline =
+        *entity.component<TimelineComponent<BodyComponent> >().get();
+      Vector position = timeline.timeline.empty() ?
+        Vector() :
+        timeline.timeline.back().second.position;
+      std::size_t hintSlot = m_timelineBuffers[&timeline].hintSlot;
+      for (std::size_t index = 0; index < m_views.size(); ++index) {
+        ShaderCounterSource source = {
+          hintSlot * m_views.size() + index,
+          entity.id().id(),
+          index,
+          (position - m_views[index].body.position).norm()
+        };
+        sources.push_back(source);
+      }
+    }
+    m_counters->end(m_frame, std::move(sources));
+  }
   
   // Unset things so that the state resets.
+  glViewport(0, 0, event.viewportWidth, event.viewportHeight);
   glDisableVertexAttribArray(ATTRIBUTE_POSITION);
+  glDisable(GL_DEPTH_TEST);
   glUseProgram(0);
+  
+  // The frame is copied to the window, and its depth is kept for culling the
+  // next one.
+  if (culling) {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(
+      0, 0, m_targetWidth, m_targetHeight,
+      0, 0, m_targetWidth, m_targetHeight,
+      GL_COLOR_BUFFER_BIT,
+      GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    buildHiZ();
+  }
 }
 
-// Passes the data from a body component to the shader.
-void fillObserver(BodyComponent& body) {
+void RenderSystem::acquireMesh(Mesh const& mesh) {
   
-  GLfloat position[4] = {
-    (GLfloat) body.position.x,
-    (GLfloat) body.position.y,
-    (GLfloat) body.position.z,
-    0.0
+  // Models with the same mesh share a vertex buffer, so only the first one
+  // needs to upload anything. Morph targets are uploaded in the same way, and
+  // are read from the same kind of buffer by the shader.
+  auto found = m_meshBuffers.find(mesh.id());
+  if (found != m_meshBuffers.end()) {
+    found->second.models += 1;
+    return;
+  }
+  if (mesh.vertices() == NULL) {
+    throw std::runtime_error(
+      "Can't upload a mesh whose vertices have been discarded.");
+  }
+  
+  // The buffer is created along with those of any other new meshes before
+  // the next frame is drawn.
+  MeshBuffer meshBuffer = { mesh, 0, 1 };
+  m_meshBuffers[mesh.id()] = meshBuffer;
+  m_pendingMeshes.push_back(mesh.id());
+}
+
+void RenderSystem::releaseMesh(Mesh const& mesh) {
+  m_meshBuffers[mesh.id()].models -= 1;
+}
+
+void RenderSystem::upload(entityx::Entity entity) {
+  
+  entityx::ComponentHandle<ModelComponent> model =
+    entity.component<ModelComponent>();
+  entityx::ComponentHandle<TimelineComponent<BodyComponent> > timeline =
+    entity.component<TimelineComponent<BodyComponent> >();
+  if (!model || !timeline || !model->mesh) {
+    return;
+  }
+  TimelineBuffer& timelineBuffer = m_timelineBuffers[timeline.get()];
+  if (timelineBuffer.frame == m_frame) {
+    return;
+  }
+  if (timelineBuffer.buffer == 0) {
+    PooledBuffer pooled = takeBuffer();
+    timelineBuffer.buffer = pooled.buffer;
+    timelineBuffer.bytes = pooled.bytes;
+  }
+  
+  // The origin only moves when the entity crosses into another chunk, so the
+  // packed positions stay the same while the observer moves around.
+  timelineBuffer.origin =
+    chunkOrigin(timeline->timeline.empty() ?
+      Vector() :
+      timeline->timeline.back().second.position);
+  std::size_t bytes = fillTimeline(
+    *timeline.get(),
+    timelineBuffer.origin,
+    timelineBuffer.buffer,
+    m_timelineData);
+  m_timelineMemory.resize(timelineBuffer.bytes, bytes);
+  timelineBuffer.bytes = bytes;
+  timelineBuffer.frame = m_frame;
+  
+  // The weights of the morph targets are packed at the same entries as the
+  // timeline, so that the shader finds them at the same index.
+  entityx::ComponentHandle<TimelineComponent<DeformationComponent> >
+    deformations = entity.component<TimelineComponent<DeformationComponent> >();
+  if (!model->morphTargets.empty() && deformations) {
+    if (timelineBuffer.weightBuffer == 0) {
+      PooledBuffer pooled = takeBuffer();
+      timelineBuffer.weightBuffer = pooled.buffer;
+      timelineBuffer.weightBytes = pooled.bytes;
+    }
+    std::size_t weightBytes = fillWeights(
+      *timeline.get(),
+      *deformations.get(),
+      timelineBuffer.weightBuffer,
+      m_weightData);
+    m_timelineMemory.resize(timelineBuffer.weightBytes, weightBytes);
+    timelineBuffer.weightBytes = weightBytes;
+  }
+  else if (timelineBuffer.weightBuffer != 0) {
+    giveBuffer(timelineBuffer.weightBuffer, timelineBuffer.weightBytes);
+    timelineBuffer.weightBuffer = 0;
+    timelineBuffer.weightBytes = 0;
+  }
+  m_drawList.push_back(entity);
+}
+
+void RenderSystem::draw(
+    entityx::Entity entity,
+    std::size_t views,
+    std::size_t command) {      
+  entityx::ComponentHandle<ModelComponent> model =
+    entity.component<ModelComponent>();
+  entityx::ComponentHandle<TimelineComponent<BodyComponent> > timeline =
+    entity.component<TimelineComponent<BodyComponent> >();
+  if (!model || !timeline || !model->mesh) {
+    return;
+  }
+  MeshBuffer const& meshBuffer = m_meshBuffers[model->mesh.id()];
+  TimelineBuffer const& timelineBuffer = m_timelineBuffers[timeline.get()];
+  
+  glBindBufferBase(
+    GL_SHADER_STORAGE_BUFFER,
+    BUFFER_TIMELINE,
+    timelineBuffer.buffer);
+  glUniform1ui(UNIFORM_HINT_BASE, timelineBuffer.hintSlot * m_views.size());
+  
+  // Both origins are large, but the difference between them is only as large
+  // as the distance to the entity, so it can be rounded to floats.
+  Vector offset = timelineBuffer.origin - m_origin;
+  glUniform3f(
+    UNIFORM_TIMELINE_ORIGIN,
+    (GLfloat) offset.x,
+    (GLfloat) offset.y,
+    (GLfloat) offset.z);
+  
+  // Entities without a deformation timeline are drawn with their plain mesh.
+  GLint morphTargets = 0;
+  if (timelineBuffer.weightBuffer != 0) {
+    morphTargets = model->morphTargets.size();
+    for (GLint index = 0; index < morphTargets; ++index) {
+      glBindBufferBase(
+        GL_SHADER_STORAGE_BUFFER,
+        BUFFER_MORPH_TARGETS + index,
+        m_meshBuffers[model->morphTargets[index].id()].buffer);
+    }
+    glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER,
+      BUFFER_WEIGHTS,
+      timelineBuffer.weightBuffer);
+  }
+  glUniform1i(UNIFORM_MORPH_TARGETS, morphTargets);
+  
+  glBindBuffer(GL_ARRAY_BUFFER, meshBuffer.buffer);
+  glVertexAttribPointer(
+    ATTRIBUTE_POSITION,
+    3,
+    GL_FLOAT,
+    GL_FALSE,
+    sizeof(Vertex),
+    0);
+  
+  // A culled command has the same vertex count, but no instances if the
+  // entity is hidden.
+  if (command != NO_COMMAND) {
+    glDrawArraysIndirect(
+      GL_TRIANGLES,
+      (void const*) (sizeof(GLuint) * COMMAND_UINTS * command));
+  }
+  else {
+    glDrawArraysInstanced(
+      GL_TRIANGLES,
+      0,
+      meshBuffer.mesh.vertexCount(),
+      views);
+  }
+}
+
+void RenderSystem::reserveHints() {
+  
+  if (m_hintSlots <= m_hintCapacity && m_views.size() == m_hintViews) {
+    return;
+  }
+  
+  // The slots are laid out by view, so the hints can't be kept when the
+  // number of views changes. Otherwise the capacity is doubled, and the hints
+  // are only lost when it grows.
+  std::size_t oldBytes = sizeof(GLuint) * m_hintCapacity * m_hintViews;
+  if (m_hintSlots > m_hintCapacity) {
+    m_hintCapacity = std::max(m_hintSlots, 2 * m_hintCapacity);
+  }
+  m_hintViews = m_views.size();
+  std::size_t bytes = sizeof(GLuint) * m_hintCapacity * m_hintViews;
+  
+  GLuint noHint = NO_HINT;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_hintBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, NULL, GL_DYNAMIC_COPY);
+  glClearBufferData(
+    GL_SHADER_STORAGE_BUFFER,
+    GL_R32UI,
+    GL_RED_INTEGER,
+    GL_UNSIGNED_INT,
+    &noHint);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  m_timelineMemory.resize(oldBytes, bytes);
+}
+
+void RenderSystem::flushPending() {
+  
+  PROFILE_SCOPE("RenderSystem::flushPending");
+  
+  // Every new mesh gets its buffer from a single call. A mesh that was added
+  // and cleaned up again since the last frame is skipped.
+  if (!m_pendingMeshes.empty()) {
+    std::vector<GLuint> buffers(m_pendingMeshes.size());
+    glGenBuffers(buffers.size(), buffers.data());
+    for (std::size_t i = 0; i < m_pendingMeshes.size(); ++i) {
+      auto found = m_meshBuffers.find(m_pendingMeshes[i]);
+      if (found == m_meshBuffers.end() || found->second.buffer != 0) {
+        glDeleteBuffers(1, &buffers[i]);
+        continue;
+      }
+      Mesh const& mesh = found->second.mesh;
+      glBindBuffer(GL_ARRAY_BUFFER, buffers[i]);
+      glBufferData(
+        GL_ARRAY_BUFFER,
+        sizeof(Vertex) * mesh.vertexCount(),
+        mesh.vertices(),
+        GL_STATIC_DRAW);
+      m_meshMemory.allocate(sizeof(Vertex) * mesh.vertexCount());
+      
+      // The GPU has its own copy of the vertices now, so the one in memory
+      // can be thrown away.
+      found->second.buffer = buffers[i];
+      mesh.discardVertices();
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    m_pendingMeshes.clear();
+  }
+  
+  // Reused slots tend to be freed and taken in runs when many entities come
+  // and go together, so each run is cleared at once. Slots past the end of
+  // the buffer were cleared when it grew.
+  if (!m_staleHintSlots.empty() && m_hintViews != 0) {
+    std::sort(m_staleHintSlots.begin(), m_staleHintSlots.end());
+    GLuint noHint = NO_HINT;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_hintBuffer);
+    std::size_t start = 0;
+    while (start < m_staleHintSlots.size()) {
+      std::size_t end = start + 1;
+      while (end < m_staleHintSlots.size() &&
+             m_staleHintSlots[end] <= m_staleHintSlots[end - 1] + 1) {
+        ++end;
+      }
+      std::size_t first = m_staleHintSlots[start];
+      std::size_t last =
+        std::min(m_staleHintSlots[end - 1] + 1, m_hintCapacity);
+      if (first < last) {
+        glClearBufferSubData(
+          GL_SHADER_STORAGE_BUFFER,
+          GL_R32UI,
+          sizeof(GLuint) * first * m_hintViews,
+          sizeof(GLuint) * (last - first) * m_hintViews,
+          GL_RED_INTEGER,
+          GL_UNSIGNED_INT,
+          &noHint);
+      }
+      start = end;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  }
+  m_staleHintSlots.clear();
+}
+
+RenderSystem::PooledBuffer RenderSystem::takeBuffer() {
+  if (m_bufferPool.empty()) {
+    GLuint buffers[BUFFER_POOL_BLOCK];
+    glGenBuffers(BUFFER_POOL_BLOCK, buffers);
+    for (GLuint buffer : buffers) {
+      PooledBuffer pooled = { buffer, 0 };
+      m_bufferPool.push_back(pooled);
+      m_timelineMemory.allocate(0);
+    }
+  }
+  PooledBuffer pooled = m_bufferPool.back();
+  m_bufferPool.pop_back();
+  return pooled;
+}
+
+void RenderSystem::giveBuffer(GLuint buffer, std::size_t bytes) {
+  PooledBuffer pooled = { buffer, bytes };
+  m_bufferPool.push_back(pooled);
+}
+
+void RenderSystem::resizeTargets(int width, int height) {
+  
+  if (width == m_targetWidth && height == m_targetHeight) {
+    return;
+  }
+  
+  // Each level of the pyramid is half the size of the one before, rounded
+  // down, until it is a single texel.
+  auto targetBytes = [](int width, int height, GLint levels) {
+    std::size_t bytes = 2 * sizeof(GLfloat) * width * height;
+    for (GLint level = 0; level < levels; ++level) {
+      bytes += sizeof(GLfloat) *
+        std::max(width >> level, 1) *
+        std::max(height >> level, 1);
+    }
+    return bytes;
   };
+  std::size_t oldBytes =
+    targetBytes(m_targetWidth, m_targetHeight, m_hiZLevels);
+  if (m_targetWidth != 0) {
+    glDeleteRenderbuffers(1, &m_colorBuffer);
+    glDeleteTextures(1, &m_depthTexture);
+    glDeleteTextures(1, &m_hiZTexture);
+  }
+  m_targetWidth = std::max(width, 0);
+  m_targetHeight = std::max(height, 0);
+  m_hiZLevels = 0;
+  m_hiZValid = false;
+  if (m_targetWidth == 0 || m_targetHeight == 0) {
+    m_targetWidth = 0;
+    m_targetHeight = 0;
+    m_occlusionMemory.resize(oldBytes, 0);
+    return;
+  }
+  m_hiZLevels = 1;
+  while ((std::max(m_targetWidth, m_targetHeight) >> m_hiZLevels) > 0) {
+    ++m_hiZLevels;
+  }
+  
+  glGenRenderbuffers(1, &m_colorBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+  
+  // The depth is drawn straight into a texture, so that the pyramid can be
+  // built from it without a copy.
+  glGenTextures(1, &m_depthTexture);
+  glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  
+  glGenTextures(1, &m_hiZTexture);
+  glBindTexture(GL_TEXTURE_2D, m_hiZTexture);
+  glTexStorage2D(GL_TEXTURE_2D, m_hiZLevels, GL_R32F, width, height);
+  glTexParameteri(
+    GL_TEXTURE_2D,
+    GL_TEXTURE_MIN_FILTER,
+    GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_hiZLevels - 1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  
+  glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+  glFramebufferRenderbuffer(
+    GL_FRAMEBUFFER,
+    GL_COLOR_ATTACHMENT0,
+    GL_RENDERBUFFER,
+    m_colorBuffer);
+  glFramebufferTexture2D(
+    GL_FRAMEBUFFER,
+    GL_DEPTH_ATTACHMENT,
+    GL_TEXTURE_2D,
+    m_depthTexture,
+    0);
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    throw std::runtime_error(
+      "Couldn't create the framebuffer for occlusion culling.");
+  }
+  m_occlusionMemory.resize(
+    oldBytes,
+    targetBytes(m_targetWidth, m_targetHeight, m_hiZLevels));
+}
+
+void RenderSystem::cull(RenderEvent const& event, bool multiViewport) {
   
-  GLfloat momentum[4] = {
+  PROFILE_SCOPE("RenderSystem::cull");
+  
+  m_cullDraws.clear();
+  m_sphereData.clear();
+  m_viewportData.clear();
+  for (View const& view : m_views) {
+    GLint rect[4];
+    viewportRect(view.camera, event, rect);
+    m_viewportData.insert(m_viewportData.end(), rect, rect + 4);
+  }
+  
+  // Every draw gets a sphere in each of the views that it is drawn into.
+  // Anything that can't be placed gets a sphere that covers everything, and
+  // is never culled.
+  auto addDraw = [this](
+      entityx::Entity entity,
+      std::size_t firstView,
+      std::size_t viewCount) {
+    
+    entityx::ComponentHandle<ModelComponent> model =
+      entity.component<ModelComponent>();
+    entityx::ComponentHandle<TimelineComponent<BodyComponent> > timeline =
+      entity.component<TimelineComponent<BodyComponent> >();
+    GLuint vertexCount = 0;
+    double radius = std::numeric_limits<double>::infinity();
+    if (model && timeline && model->mesh) {
+      vertexCount = model->mesh.vertexCount();
+      radius = model->mesh.radius();
+      for (Mesh const& target : model->morphTargets) {
+        radius = std::max(radius, target.radius());
+      }
+    }
+    GLuint draw[CULL_DRAW_UINTS] = {
+      vertexCount,
+      (GLuint) firstView,
+      (GLuint) viewCount,
+      (GLuint) (m_sphereData.size() / 4)
+    };
+    m_cullDraws.insert(m_cullDraws.end(), draw, draw + CULL_DRAW_UINTS);
+    for (std::size_t index = 0; index < viewCount; ++index) {
+      if (vertexCount != 0) {
+        apparentSphere(
+          *timeline.get(),
+          radius,
+          m_views[firstView + index].body,
+          m_sphereData);
+      }
+      else {
+        GLfloat everything[4] = {
+          0.0, 0.0, 0.0, std::numeric_limits<GLfloat>::infinity()
+        };
+        m_sphereData.insert(m_sphereData.end(), everything, everything + 4);
+      }
+    }
+  };
+  if (multiViewport) {
+    for (entityx::Entity entity : m_drawList) {
+      addDraw(entity, 0, m_views.size());
+    }
+  }
+  else {
+    for (std::size_t index = 0; index < m_views.size(); ++index) {
+      for (entityx::Entity entity : m_views[index].visible) {
+        addDraw(entity, index, 1);
+      }
+    }
+  }
+  
+  GLuint drawCount = m_cullDraws.size() / CULL_DRAW_UINTS;
+  std::size_t drawBytes = sizeof(GLuint) * m_cullDraws.size();
+  std::size_t sphereBytes = sizeof(GLfloat) * m_sphereData.size();
+  std::size_t viewportBytes = sizeof(GLfloat) * m_viewportData.size();
+  std::size_t commandBytes = sizeof(GLuint) * COMMAND_UINTS * drawCount;
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_cullDrawBuffer);
+  glBufferData(
+    GL_SHADER_STORAGE_BUFFER,
+    drawBytes,
+    m_cullDraws.data(),
+    GL_STREAM_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sphereBuffer);
+  glBufferData(
+    GL_SHADER_STORAGE_BUFFER,
+    sphereBytes,
+    m_sphereData.data(),
+    GL_STREAM_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_viewportBuffer);
+  glBufferData(
+    GL_SHADER_STORAGE_BUFFER,
+    viewportBytes,
+    m_viewportData.data(),
+    GL_STREAM_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, commandBytes, NULL, GL_STREAM_COPY);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  std::size_t bytes = drawBytes + sphereBytes + viewportBytes + commandBytes;
+  m_occlusionMemory.resize(m_cullBytes, bytes);
+  m_cullBytes = bytes;
+  
+  // Until the pyramid has been built, only the entities that are off screen
+  // are culled.
+  if (drawCount != 0) {
+    glUseProgram(m_hiZCullShader);
+    glUniform1ui(UNIFORM_CULL_DRAW_COUNT, drawCount);
+    glUniform1i(UNIFORM_CULL_HAS_HIZ, m_hiZValid);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_HIZ);
+    glBindTexture(GL_TEXTURE_2D, m_hiZTexture);
+    glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER,
+      BUFFER_CULL_DRAWS,
+      m_cullDrawBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_SPHERES, m_sphereBuffer);
+    glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER,
+      BUFFER_VIEWPORTS,
+      m_viewportBuffer);
+    glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER,
+      BUFFER_COMMANDS,
+      m_commandBuffer);
+    glDispatchCompute(
+      (drawCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE,
+      1,
+      1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+  }
+  
+  // The draws read the commands straight from the buffer they were written
+  // to, without them coming back to the CPU.
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+  glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+}
+
+void RenderSystem::buildHiZ() {
+  
+  PROFILE_SCOPE("RenderSystem::buildHiZ");
+  
+  // The first level is copied from the depth of the frame, and every level
+  // after it is reduced from the one before, which has to be finished first.
+  glUseProgram(m_hiZBuildShader);
+  glActiveTexture(GL_TEXTURE0 + TEXTURE_HIZ);
+  for (GLint level = 0; level < m_hiZLevels; ++level) {
+    GLuint width = std::max(m_targetWidth >> level, 1);
+    GLuint height = std::max(m_targetHeight >> level, 1);
+    glBindTexture(GL_TEXTURE_2D, level == 0 ? m_depthTexture : m_hiZTexture);
+    glUniform1i(UNIFORM_HIZ_SOURCE_LEVEL, level == 0 ? 0 : level - 1);
+    glUniform1i(UNIFORM_HIZ_REDUCE, level != 0);
+    glBindImageTexture(
+      IMAGE_HIZ,
+      m_hiZTexture,
+      level,
+      GL_FALSE,
+      0,
+      GL_WRITE_ONLY,
+      GL_R32F);
+    glDispatchCompute(
+      (width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+      (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+      1);
+    glMemoryBarrier(
+      GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(0);
+  m_hiZValid = true;
+}
+
+// Adds the observer and the projection matrix of a view to the data passed to
+// the shader, laid out as a View in the shader. The observer is placed
+// relative to the origin of the frame.
+void packView(
+    BodyComponent const& body,
+    CameraComponent const& camera,
+    Vector const& origin,
+    std::vector<GLfloat>& data) {
+      
+  // The observer is laid out in the same way as a timeline entry.
+  Vector position = body.position - origin;
+  GLfloat observer[VIEW_OBSERVER_FLOATS] = {
+    (GLfloat) position.x,
+    (GLfloat) position.y,
+    (GLfloat) position.z,
+    0.0,
     (GLfloat) body.momentum.x,
     (GLfloat) body.momentum.y,
     (GLfloat) body.momentum.z,
-    (GLfloat) body.energy
-  };
-  
-  GLfloat rotation[4] = {
+    (GLfloat) body.energy,
     (GLfloat) body.rotation.pure.x,
     (GLfloat) body.rotation.pure.y,
     (GLfloat) body.rotation.pure.z,
     (GLfloat) body.rotation.real
   };
   
-  glUniform4fv(UNIFORM_OBSERVER_POSITION, 1, position);
-  glUniform4fv(UNIFORM_OBSERVER_VELOCITY, 1, momentum);
-  glUniform4fv(UNIFORM_OBSERVER_ROTATION, 1, rotation);
-}
-
-void fillProjection(CameraComponent& camera) {
-  
-  // Calculate the projection matrix and pass it to the shader.
+  // Calculate the projection matrix. It is stored by rows.
   GLfloat projectionMatrix[16] = { 0.0 };
   
   double cotHorz = 1.0 / std::tan(camera.fov / camera.aspectRatio / 2.0);
@@ -270,45 +1101,35 @@ void fillProjection(CameraComponent& camera) {
   projectionMatrix[11] = (GLfloat) (-2 * clipProd / clipDiff);
   projectionMatrix[14] = -1.0;
   
-  glUniformMatrix4fv(UNIFORM_PROJECTION, 1, GL_TRUE, projectionMatrix);
+  data.insert(data.end(), observer, observer + VIEW_OBSERVER_FLOATS);
+  data.insert(data.end(), projectionMatrix, projectionMatrix + 16);
+}
+
+void viewportRect(
+    CameraComponent const& camera,
+    RenderEvent const& event,
+    GLint* rect) {
+  rect[0] = (GLint) std::lround(camera.viewportX * event.viewportWidth);
+  rect[1] = (GLint) std::lround(camera.viewportY * event.viewportHeight);
+  rect[2] = (GLint) std::lround(camera.viewportWidth * event.viewportWidth);
+  rect[3] = (GLint) std::lround(camera.viewportHeight * event.viewportHeight);
 }
 
 void fillLightspeed() {
   glUniform1f(UNIFORM_LIGHTSPEED, LIGHT_SPEED);
 }
 
-void fillTimeline(TimelineComponent<BodyComponent>& timeline, GLuint buffer) {
-  
+std::size_t fillTimeline(
+    TimelineComponent<BodyComponent> const& timeline,
+    Vector const& origin,
+    GLuint buffer,
+    std::vector<GLfloat>& data) {
+      
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
   
   // Translate the timeline component into a buffer that will be passed to the
   // shader.
-  unsigned int floatsPerEntry = 4 * 3;
-  std::vector<GLfloat> data(timeline.timeline.size() * floatsPerEntry);
-  for (unsigned int i = 0; i < timeline.timeline.size(); ++i) {
-    unsigned int dataIndex = floatsPerEntry * i;
-    BodyComponent body = timeline.timeline[i].second;
-    Vector position = body.position;
-    Vector momentum = body.momentum;
-    Quaternion rotation = body.rotation;
-    double energy = body.energy;
-    double time = timeline.timeline[i].first;
-    
-    data[dataIndex + 0] = (GLfloat) position.x;
-    data[dataIndex + 1] = (GLfloat) position.y;
-    data[dataIndex + 2] = (GLfloat) position.z;
-    data[dataIndex + 3] = (GLfloat) time;
-    
-    data[dataIndex + 4] = (GLfloat) momentum.x;
-    data[dataIndex + 5] = (GLfloat) momentum.y;
-    data[dataIndex + 6] = (GLfloat) momentum.z;
-    data[dataIndex + 7] = energy;
-    
-    data[dataIndex + 8] = (GLfloat) rotation.pure.x;
-    data[dataIndex + 9] = (GLfloat) rotation.pure.y;
-    data[dataIndex + 10] = (GLfloat) rotation.pure.z;
-    data[dataIndex + 11] = (GLfloat) rotation.real;
-  }
+  packTimeline(timeline, origin, data);
   
   glBufferData(
     GL_SHADER_STORAGE_BUFFER,
@@ -317,14 +1138,78 @@ void fillTimeline(TimelineComponent<BodyComponent>& timeline, GLuint buffer) {
     GL_DYNAMIC_DRAW);
   
   glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_TIMELINE, buffer);
+  return sizeof(GLfloat) * data.size();
+}
+
+std::size_t fillWeights(
+    TimelineComponent<BodyComponent> const& timeline,
+    TimelineComponent<DeformationComponent> const& deformations,
+    GLuint buffer,
+    std::vector<GLfloat>& data) {
+      
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+  packWeights(timeline, deformations, data);
+  glBufferData(
+    GL_SHADER_STORAGE_BUFFER,
+    sizeof(GLfloat) * data.size(),
+    data.data(),
+    GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  return sizeof(GLfloat) * data.size();
+}
+
+// Adds a sphere around everything that an observer can see of an entity to
+// the data passed to the culling pass, centered on where the entity appears
+// to be in the space of the view. If its light hasn't reached the observer,
+// the sphere covers everything.
+void apparentSphere(
+    TimelineComponent<BodyComponent> const& timeline,
+    double radius,
+    BodyComponent const& observer,
+    std::vector<GLfloat>& data) {      
+  TimelineComponent<BodyComponent>::Entry sample;
+  if (!retardedSample(timeline, ObserverEvent(observer.position), sample)) {
+    GLfloat everything[4] = {
+      0.0, 0.0, 0.0, std::numeric_limits<GLfloat>::infinity()
+    };
+    data.insert(data.end(), everything, everything + 4);
+    return;
+  }
+  
+  // The center goes into the frame of the observer in the same way as the
+  // vertices do in the vertex shader.
+  Vector velocity = observer.momentum * LIGHT_SPEED / observer.energy;
+  LorentzTransform<double> boost = LorentzTransform<double>::boost(velocity);
+  FourVector<double> center = boost * FourVector<double>::event(
+    sample.first,
+    sample.second.position - observer.position);
+  Vector position =
+    observer.rotation.unit().inverseUnit().rotateUnit(center.space());
+  
+  // The light from the far side of a moving entity left earlier than the
+  // light from the near side, which stretches how it looks along its motion
+  // by as much as its Doppler factor.
+  FourVector<double> momentum = boost * FourVector<double>(
+    sample.second.energy / LIGHT_SPEED,
+    sample.second.momentum);
+  double beta = std::min(
+    momentum.space().norm() / momentum.timeComponent(),
+    1.0 - std::numeric_limits<double>::epsilon());
+  GLfloat sphere[4] = {
+    (GLfloat) position.x,
+    (GLfloat) position.y,
+    (GLfloat) position.z,
+    (GLfloat) (radius * std::sqrt((1.0 + beta) / (1.0 - beta)))
+  };
+  data.insert(data.end(), sphere, sphere + 4);
 }
 
 GLuint createShader(
     unsigned int num,
     GLenum* shaderTypes,
-    std::string* fileNames) {
-  
+    std::string* fileNames,
+    std::string const& defines) {
+      
   // Create a vector to store every part of the shader (e.g. the vertex shader
   // part, the fragment shader part, and so on).
   std::vector<GLuint> shaders(num);
@@ -337,6 +1222,14 @@ GLuint createShader(
       (std::istreambuf_iterator<char>(file)),
       (std::istreambuf_iterator<char>()));
     
+    // The defines have to go after the version, which must come first.
+    if (!defines.empty()) {
+      std::size_t versionEnd = fileContents.find('\n');
+      fileContents.insert(
+        versionEnd == std::string::npos ? fileContents.size() : versionEnd + 1,
+        defines);
+    }
+    
     // Create and compile the shader.
     shaders[i] = glCreateShader(shaderTypes[i]);
     GLchar const* sourceChars = fileContents.c_str();
@@ -0,0 +1,49 @@
+#include "system/scene_system.h"
+
+#include <cstddef>
+#include <memory>
+
+#include <entityx/entityx.h>
+
+#include "profiler.h"
+#include "scene.h"
+
+using namespace lightspeed;
+
+SceneSystem::SceneSystem(
+    std::shared_ptr<Scene const> scene,
+    std::size_t chunkSize) :
+    m_entities(NULL),
+    m_events(NULL),
+    m_scene(scene),
+    m_chunkSize(chunkSize),
+    m_next(0) {
+}
+
+void SceneSystem::configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) {
+  
+  m_entities = &entities;
+  m_events = &events;
+}
+
+void SceneSystem::update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) {
+  
+  PROFILE_SCOPE("SceneSystem::update");
+  
+  if (!done()) {
+    m_next += m_scene->instantiate(entities, m_next, m_chunkSize);
+  }
+}
+
+bool SceneSystem::done() const {
+  return m_next >= m_scene->entityCount();
+}
+
+std::shared_ptr<Scene const> SceneSystem::scene() const {
+  return m_scene;
+}
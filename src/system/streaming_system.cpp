@@ -0,0 +1,333 @@
+#include "system/streaming_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "component/body_component.h"
+#include "component/player_component.h"
+
+#include "event/event_batch.h"
+#include "event/relativistic_update_event.h"
+
+#include "entity_batch.h"
+#include "profiler.h"
+#include "scene.h"
+#include "utility.h"
+#include "vector.h"
+#include "vertex.h"
+
+// The number of bits used for each coordinate when packing the coordinates of
+// a cell into a single key.
+#define CELL_KEY_BITS 21
+
+using namespace lightspeed;
+
+uint64_t streamingCellKey(Vector position, double cellSize);
+
+StreamingSystem::StreamingSystem(
+    std::shared_ptr<Scene const> scene,
+    double cellSize,
+    double renderDistance,
+    std::size_t budget) :
+    m_entities(NULL),
+    m_events(NULL),
+    m_scene(scene),
+    m_cellSize(cellSize),
+    m_renderDistance(renderDistance),
+    m_budget(budget),
+    m_time(0.0),
+    m_cells(),
+    m_resident(),
+    m_loaded(),
+    m_pending(),
+    m_mutex(),
+    m_condition(),
+    m_commands(),
+    m_requested(false),
+    m_requestPosition(),
+    m_requestTime(0.0),
+    m_stopping(false),
+    m_partitioned(false),
+    m_cellCount(0),
+    m_requestSerial(0),
+    m_answeredSerial(0),
+    m_thread() {
+}
+
+StreamingSystem::~StreamingSystem() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_condition.notify_all();
+  if (m_thread.joinable()) {
+    m_thread.join();
+  }
+}
+
+void StreamingSystem::configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) {
+  
+  m_entities = &entities;
+  m_events = &events;
+  
+  events.subscribe<EventBatch<RelativisticUpdateEvent> >(*this);
+  
+  m_thread = std::thread(&StreamingSystem::run, this);
+}
+
+void StreamingSystem::receive(
+    EventBatch<RelativisticUpdateEvent> const& batch) {
+  for (RelativisticUpdateEvent const& event : batch.events) {
+    m_time += event.deltaPrime;
+  }
+}
+
+void StreamingSystem::update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) {
+  
+  PROFILE_SCOPE("StreamingSystem::update");
+  
+  // Let the background thread know where the player is now, and collect
+  // whatever it has finished with since the last update.
+  Vector position;
+  entities.each<PlayerComponent, BodyComponent>(
+    [&position](
+        entityx::Entity entity,
+        PlayerComponent& player,
+        BodyComponent& body) {
+      position = body.position;
+  });
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_requested = true;
+    ++m_requestSerial;
+    m_requestPosition = position;
+    m_requestTime = m_time;
+    while (!m_commands.empty()) {
+      m_pending.push_back(m_commands.front());
+      m_commands.pop_front();
+    }
+  }
+  m_condition.notify_all();
+  
+  // Carry out the commands in order until the budget runs out. A cell that is
+  // only partly created is finished off in the next update.
+  std::size_t budget = m_budget;
+  while (!m_pending.empty()) {
+    Command& command = m_pending.front();
+    std::vector<entityx::Entity>& loaded = m_loaded[command.cell];
+    
+    if (!command.load) {
+      despawnBatch(loaded);
+      m_loaded.erase(command.cell);
+      m_pending.pop_front();
+      continue;
+    }
+    
+    Cell const& cell = m_cells[command.cell];
+    while (command.progress < cell.entities.size() && budget > 0) {
+      loaded.push_back(m_scene->instantiateEntity(
+        entities,
+        cell.entities[command.progress],
+        m_time));
+      ++command.progress;
+      --budget;
+    }
+    if (command.progress < cell.entities.size()) {
+      break;
+    }
+    m_pending.pop_front();
+  }
+}
+
+std::size_t StreamingSystem::cellCount() const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_cellCount;
+}
+
+std::size_t StreamingSystem::loadedCellCount() const {
+  return m_loaded.size();
+}
+
+void StreamingSystem::synchronize() const {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_condition.wait(lock, [this]() {
+    return m_stopping ||
+      (m_partitioned && m_answeredSerial == m_requestSerial);
+  });
+}
+
+void StreamingSystem::run() {
+  
+  PROFILE_THREAD("streaming");
+  partition();
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cellCount = m_cells.size();
+    m_partitioned = true;
+  }
+  m_condition.notify_all();
+  
+  while (true) {
+    Vector position;
+    double time;
+    std::size_t serial;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_condition.wait(lock, [this]() {
+        return m_requested || m_stopping;
+      });
+      if (m_stopping) {
+        return;
+      }
+      m_requested = false;
+      serial = m_requestSerial;
+      position = m_requestPosition;
+      time = m_requestTime;
+    }
+    
+    PROFILE_SCOPE("StreamingSystem::run");
+    for (std::size_t index = 0; index < m_cells.size(); ++index) {
+      Cell const& cell = m_cells[index];
+  
+      // Resident cells are given an extra cell width before they are
+      // unloaded, so that a player moving back and forth across the edge of
+      // the render distance doesn't keep loading the same cells.
+      double slack = m_resident[index] ? m_cellSize : 0.0;
+      bool needed = inRange(cell, position, time, slack);
+      if (needed == m_resident[index]) {
+        continue;
+      }
+  
+      // Read the cell in now, so that the update doesn't have to wait for the
+      // pages of the scene file to be read from the disk.
+      if (needed) {
+        for (std::size_t entity : cell.entities) {
+          m_scene->prefetch(entity);
+        }
+      }
+      m_resident[index] = needed;
+  
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stopping) {
+        return;
+      }
+      Command command = { index, needed, 0 };
+      m_commands.push_back(command);
+    }
+    
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_answeredSerial = serial;
+    }
+    m_condition.notify_all();
+  }
+}
+
+void StreamingSystem::partition() {
+  
+  PROFILE_SCOPE("StreamingSystem::partition");
+  
+  // The size of the largest mesh is used for the whole cell.
+  std::vector<double> meshRadii(m_scene->meshCount(), 0.0);
+  for (std::size_t mesh = 0; mesh < meshRadii.size(); ++mesh) {
+    Vertex const* vertices = m_scene->meshVertices(mesh);
+    for (std::size_t i = 0; i < m_scene->meshVertexCount(mesh); ++i) {
+      Vector vertex(vertices[i].x, vertices[i].y, vertices[i].z);
+      meshRadii[mesh] = std::max(meshRadii[mesh], vertex.norm());
+    }
+  }
+  
+  std::unordered_map<uint64_t, std::size_t> cellIndices;
+  for (std::size_t index = 0; index < m_scene->entityCount(); ++index) {
+    scene_format::Entity const& entity = m_scene->entity(index);
+    Vector position(
+      entity.position[0],
+      entity.position[1],
+      entity.position[2]);
+    Vector momentum(
+      entity.momentum[0],
+      entity.momentum[1],
+      entity.momentum[2]);
+    double energy = std::sqrt(
+      LIGHT_SPEED * LIGHT_SPEED + momentum.normSq());
+    double speed = momentum.norm() * LIGHT_SPEED / energy;
+    double radius =
+      entity.mesh < meshRadii.size() ? meshRadii[entity.mesh] : 0.0;
+    
+    uint64_t key = streamingCellKey(position, m_cellSize);
+    auto inserted = cellIndices.insert(std::make_pair(key, m_cells.size()));
+    if (inserted.second) {
+      Cell cell;
+      cell.min = position;
+      cell.max = position;
+      cell.speed = 0.0;
+      cell.radius = 0.0;
+      m_cells.push_back(cell);
+    }
+    
+    Cell& cell = m_cells[inserted.first->second];
+    cell.entities.push_back(index);
+    cell.min = Vector(
+      std::min(cell.min.x, position.x),
+      std::min(cell.min.y, position.y),
+      std::min(cell.min.z, position.z));
+    cell.max = Vector(
+      std::max(cell.max.x, position.x),
+      std::max(cell.max.y, position.y),
+      std::max(cell.max.z, position.z));
+    cell.speed = std::max(cell.speed, speed);
+    cell.radius = std::max(cell.radius, radius);
+  }
+  
+  m_resident.assign(m_cells.size(), false);
+}
+
+bool StreamingSystem::inRange(
+    Cell const& cell,
+    Vector position,
+    double time,
+    double slack) const {
+  
+  // The distance from the player to the cell at the start of the scene.
+  Vector offset(
+    std::max(0.0, std::max(cell.min.x - position.x, position.x - cell.max.x)),
+    std::max(0.0, std::max(cell.min.y - position.y, position.y - cell.max.y)),
+    std::max(0.0, std::max(cell.min.z - position.z, position.z - cell.max.z)));
+  double distance = offset.norm() - cell.radius;
+  
+  // Light seen from a distance d left at time t - d, when the entities could
+  // have moved up to speed * |t - d| from where they started. Since the
+  // distance light travels grows faster than that, the furthest light that
+  // could be seen (from the render distance) is the one to check against.
+  double reach =
+    m_renderDistance +
+    cell.speed * std::abs(time - m_renderDistance) / LIGHT_SPEED;
+  return distance <= reach + slack;
+}
+
+uint64_t streamingCellKey(Vector position, double cellSize) {
+  uint64_t const offset = uint64_t(1) << (CELL_KEY_BITS - 1);
+  uint64_t const mask = (uint64_t(1) << CELL_KEY_BITS) - 1;
+  uint64_t key = 0;
+  for (double coordinate : { position.x, position.y, position.z }) {
+    int64_t cell = static_cast<int64_t>(std::floor(coordinate / cellSize));
+    key = (key << CELL_KEY_BITS) | ((uint64_t(cell) + offset) & mask);
+  }
+  return key;
+}
@@ -0,0 +1,332 @@
+#include "system/worldline_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "internal/opengl.h"
+
+#include "component/body_component.h"
+#include "component/camera_component.h"
+#include "component/model_component.h"
+#include "component/timeline_component.h"
+
+#include "event/event_batch.h"
+#include "event/mouse_button_event.h"
+#include "event/pick_event.h"
+#include "event/relativistic_update_event.h"
+
+#include "light_cone.h"
+#include "profiler.h"
+#include "quaternion.h"
+#include "utility.h"
+#include "vector.h"
+#include "worldline_tree.h"
+
+// How far into the future the bounds of an entity are padded, so that the tree
+// doesn't have to be restructured every time a new timeline entry is added.
+#define TIME_PADDING (1.0)
+// Extra spatial padding, in addition to how far the entity will move.
+#define SPACE_PADDING (0.1)
+
+using namespace lightspeed;
+
+void WorldlineSystem::configure(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events) {
+  
+  // Store internal references to the entity and event managers.
+  m_entities = &entities;
+  m_events = &events;
+  
+  // Subscribe to all of the events.
+  events.subscribe<EventBatch<RelativisticUpdateEvent> >(*this);
+  events.subscribe<EventBatch<MouseButtonEvent> >(*this);
+  events.subscribe<entityx::ComponentRemovedEvent<
+    TimelineComponent<BodyComponent> > >(*this);
+}
+
+void WorldlineSystem::update(
+    entityx::EntityManager& entities,
+    entityx::EventManager& events,
+    entityx::TimeDelta delta) {
+  
+  PROFILE_SCOPE("WorldlineSystem::update");
+  
+  double time = m_time;
+  entities.each<TimelineComponent<BodyComponent> >(
+    [this, time](
+        entityx::Entity entity,
+        TimelineComponent<BodyComponent>& timeline) {
+      
+      if (timeline.timeline.empty()) {
+        return;
+      }
+      
+      auto it = m_worldtubes.find(entity.id().id());
+      if (it == m_worldtubes.end()) {
+        it = m_worldtubes.insert(std::make_pair(
+          entity.id().id(),
+          Worldtube())).first;
+        rebuild(entity, timeline, it->second);
+      }
+      else {
+        Worldtube& worldtube = it->second;
+        
+        // Add any entries that have been added since last time. These are all
+        // at the back of the timeline.
+        std::size_t added = 0;
+        for (std::size_t i = timeline.timeline.size(); i-- != 0;) {
+          double entryTime = time + timeline.timeline[i].first;
+          if (entryTime <= worldtube.lastTime) {
+            break;
+          }
+          worldtube.bounds = worldtube.bounds.merge(WorldtubeBounds::event(
+            timeline.timeline[i].second.position,
+            worldtube.radius,
+            entryTime));
+          ++added;
+        }
+        worldtube.lastTime = time + timeline.timeline.back().first;
+        
+        // Old entries are removed from the front of the timeline. The bounds
+        // can't shrink without going through the whole timeline again, so that
+        // is only done once enough of the timeline has been replaced. Only the
+        // grid samples are counted, since the current value is replaced every
+        // time rather than culled.
+        if (timeline.hasCurrent && added > 0) {
+          --added;
+        }
+        worldtube.culled +=
+          worldtube.lastSize + added - timeline.sampleCount();
+        worldtube.lastSize = timeline.sampleCount();
+        if (2 * worldtube.culled > worldtube.lastSize) {
+          rebuild(entity, timeline, worldtube);
+        }
+        else if (!m_holdOldestSample) {
+          worldtube.bounds.timeMin = time + timeline.timeline.front().first;
+        }
+      }
+      
+      // Pad the bounds in the direction that the entity is moving.
+      Worldtube const& worldtube = it->second;
+      BodyComponent const& body = timeline.timeline.back().second;
+      Vector velocity = body.momentum * LIGHT_SPEED / body.energy;
+      Vector padding(SPACE_PADDING, SPACE_PADDING, SPACE_PADDING);
+      WorldtubeBounds fatBounds = worldtube.bounds;
+      fatBounds.min -= padding;
+      fatBounds.max += padding;
+      fatBounds.min.x += std::min(velocity.x, 0.0) * TIME_PADDING;
+      fatBounds.min.y += std::min(velocity.y, 0.0) * TIME_PADDING;
+      fatBounds.min.z += std::min(velocity.z, 0.0) * TIME_PADDING;
+      fatBounds.max.x += std::max(velocity.x, 0.0) * TIME_PADDING;
+      fatBounds.max.y += std::max(velocity.y, 0.0) * TIME_PADDING;
+      fatBounds.max.z += std::max(velocity.z, 0.0) * TIME_PADDING;
+      fatBounds.timeMax += TIME_PADDING;
+      
+      m_tree.update(entity, worldtube.bounds, fatBounds);
+    });
+}
+
+void WorldlineSystem::receive(
+    EventBatch<RelativisticUpdateEvent> const& batch) {
+  for (RelativisticUpdateEvent const& event : batch.events) {
+    m_time += event.deltaPrime;
+  }
+}
+
+void WorldlineSystem::receive(EventBatch<MouseButtonEvent> const& batch) {
+  
+  PROFILE_SCOPE("WorldlineSystem::receive(MouseButtonEvent)");
+  
+  // Nothing moves between the clicks of a single frame, so they would all
+  // pick the same entities. They are merged into one pick per observer for
+  // the frame, rather than sending the same picks again for each click.
+  bool clicked = std::any_of(
+    batch.events.begin(),
+    batch.events.end(),
+    [](MouseButtonEvent const& event) {
+      return event.button == GLFW_MOUSE_BUTTON_LEFT &&
+        event.action == GLFW_PRESS;
+    });
+  if (!clicked) {
+    return;
+  }
+  
+  // Each observer picks whatever is in the center of their view, which is
+  // straight ahead along the negative z axis.
+  std::vector<PickEvent> picks;
+  m_entities->each<CameraComponent, BodyComponent>(
+    [this, &picks](
+        entityx::Entity entity,
+        CameraComponent& camera,
+        BodyComponent& body) {
+      
+      entityx::Entity hit;
+      double hitDistance;
+      Vector forward(0.0, 0.0, -1.0);
+      if (pick(body, forward, camera.clipFar, hit, hitDistance)) {
+        picks.push_back(PickEvent(entity, hit, hitDistance));
+      }
+    });
+  
+  for (PickEvent const& pick : picks) {
+    m_events->emit<PickEvent>(pick);
+  }
+}
+
+void WorldlineSystem::receive(
+    entityx::ComponentRemovedEvent<
+      TimelineComponent<BodyComponent> > const& event) {
+  
+  m_tree.remove(event.entity);
+  m_worldtubes.erase(event.entity.id().id());
+}
+
+void WorldlineSystem::queryVisible(
+    BodyComponent const& observer,
+    CameraComponent const& camera,
+    std::vector<entityx::Entity>& result) const {
+  
+  // The view of the camera is approximated by a circular cone that contains
+  // the corners of the view.
+  double tanHorz = std::tan(camera.fov / camera.aspectRatio / 2.0);
+  double tanVert = std::tan(camera.fov / 2.0);
+  double halfAngle =
+    std::atan(std::sqrt(tanHorz * tanHorz + tanVert * tanVert));
+  Vector axis = observer.rotation.rotate(Vector(0.0, 0.0, -1.0)).unit();
+  
+  // Aberration changes the shape of the cone in the resting frame, but it is
+  // still a circular cone. Its edges in the plane containing the axis and the
+  // velocity are found, and the new cone is the one passing through them.
+  Vector velocity = observer.momentum * LIGHT_SPEED / observer.energy;
+  Vector restAxis = axis;
+  double restHalfAngle = halfAngle;
+  if (velocity.normSq() != 0.0) {
+    Vector perpendicular = velocity - velocity.dot(axis) * axis;
+    if (perpendicular.normSq() < 1e-12 * velocity.normSq()) {
+      perpendicular = axis.cross(std::abs(axis.x) < 0.9 ?
+        Vector(1.0, 0.0, 0.0) :
+        Vector(0.0, 1.0, 0.0));
+    }
+    perpendicular = perpendicular.unit();
+    
+    Vector edge1 = restDirection(
+      std::cos(halfAngle) * axis + std::sin(halfAngle) * perpendicular,
+      velocity);
+    Vector edge2 = restDirection(
+      std::cos(halfAngle) * axis - std::sin(halfAngle) * perpendicular,
+      velocity);
+    Vector sum = edge1 + edge2;
+    if (halfAngle >= M_PI / 2.0 || sum.normSq() < 1e-12) {
+      restHalfAngle = M_PI;
+    }
+    else {
+      // Two cones pass through the edges, so pick the one that contains the
+      // axis of the original cone.
+      restAxis = sum.unit();
+      restHalfAngle = std::acos(
+        std::min(std::max(edge1.dot(edge2), -1.0), 1.0)) / 2.0;
+      if (restAxis.dot(restDirection(axis, velocity)) < 0.0) {
+        restAxis = -restAxis;
+        restHalfAngle = M_PI - restHalfAngle;
+      }
+    }
+  }
+  
+  m_tree.queryVisible(
+    observer.position,
+    m_time,
+    camera.clipFar,
+    restAxis,
+    restHalfAngle,
+    result);
+}
+
+bool WorldlineSystem::pick(
+    BodyComponent const& observer,
+    Vector const& direction,
+    double distance,
+    entityx::Entity& hit,
+    double& hitDistance) const {
+  
+  Vector velocity = observer.momentum * LIGHT_SPEED / observer.energy;
+  Vector rayDirection = restDirection(
+    observer.rotation.rotate(direction).unit(),
+    velocity);
+  
+  // The tree only narrows down the entities that the ray could hit, and each
+  // of them is then followed back to where the ray meets it, if it does.
+  ObserverEvent event(observer.position);
+  bool holdOldestSample = m_holdOldestSample;
+  auto test = [this, &event, &rayDirection, holdOldestSample](
+      entityx::Entity entity,
+      double maxDistance,
+      double& entityDistance) {
+    
+    entityx::ComponentHandle<TimelineComponent<BodyComponent> > timeline =
+      entity.component<TimelineComponent<BodyComponent> >();
+    auto it = m_worldtubes.find(entity.id().id());
+    if (!timeline || it == m_worldtubes.end()) {
+      return false;
+    }
+    return lightRayHit(
+      *timeline,
+      event,
+      rayDirection,
+      it->second.radius,
+      maxDistance,
+      holdOldestSample,
+      entityDistance);
+  };
+  return m_tree.raycast(
+    observer.position,
+    m_time,
+    rayDirection,
+    distance,
+    test,
+    hit,
+    hitDistance);
+}
+
+void WorldlineSystem::rebuild(
+    entityx::Entity entity,
+    TimelineComponent<BodyComponent> const& timeline,
+    Worldtube& worldtube) const {
+  
+  // Every vertex of the model lies within this radius of the body, no matter
+  // how it is rotated, contracted or blended towards its morph targets.
+  double radius = 0.0;
+  entityx::ComponentHandle<ModelComponent> model =
+    entity.component<ModelComponent>();
+  if (model && model->mesh) {
+    radius = model->mesh.radius();
+    for (Mesh const& target : model->morphTargets) {
+      radius = std::max(radius, target.radius());
+    }
+  }
+  
+  WorldtubeBounds bounds = WorldtubeBounds::event(
+    timeline.timeline.front().second.position,
+    radius,
+    m_time + timeline.timeline.front().first);
+  for (auto const& entry : timeline.timeline) {
+    bounds = bounds.merge(WorldtubeBounds::event(
+      entry.second.position,
+      radius,
+      m_time + entry.first));
+  }
+  if (m_holdOldestSample) {
+    bounds.timeMin = -std::numeric_limits<double>::infinity();
+  }
+  
+  worldtube.bounds = bounds;
+  worldtube.radius = radius;
+  worldtube.lastTime = m_time + timeline.timeline.back().first;
+  worldtube.lastSize = timeline.sampleCount();
+  worldtube.culled = 0;
+}
@@ -0,0 +1,107 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+using namespace lightspeed;
+
+ThreadPool::ThreadPool(std::size_t threads) :
+    m_threads(),
+    m_job(nullptr),
+    m_count(0),
+    m_next(0),
+    m_mutex(),
+    m_start(),
+    m_finish(),
+    m_generation(0),
+    m_busy(0),
+    m_stop(false) {
+  if (threads == 0) {
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  for (std::size_t thread = 1; thread < threads; ++thread) {
+    m_threads.emplace_back(&ThreadPool::run, this, thread);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_start.notify_all();
+  for (std::thread& thread : m_threads) {
+    thread.join();
+  }
+}
+
+std::size_t ThreadPool::size() const {
+  return m_threads.size() + 1;
+}
+
+void ThreadPool::parallelFor(
+    std::size_t count,
+    std::function<void(std::size_t, std::size_t)> const& job) {
+  
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_job = &job;
+    m_count = count;
+    m_next = 0;
+    m_busy = m_threads.size();
+    ++m_generation;
+  }
+  m_start.notify_all();
+  
+  work(0);
+  
+  // The job can't be released until every worker has stopped looking at it.
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_finish.wait(lock, [this]() {
+    return m_busy == 0;
+  });
+  m_job = nullptr;
+}
+
+void ThreadPool::run(std::size_t thread) {
+  
+  PROFILE_THREAD("worker");
+  std::size_t generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_start.wait(lock, [this, generation]() {
+        return m_stop || m_generation != generation;
+      });
+      if (m_stop) {
+        return;
+      }
+      generation = m_generation;
+    }
+    
+    work(thread);
+    
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      --m_busy;
+    }
+    m_finish.notify_all();
+  }
+}
+
+void ThreadPool::work(std::size_t thread) {
+  // The indices are handed out one at a time, so that threads which finish
+  // their work early take on more of it.
+  std::size_t index;
+  while ((index = m_next++) < m_count) {
+    (*m_job)(index, thread);
+  }
+}
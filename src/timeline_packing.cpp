@@ -0,0 +1,93 @@
+#include "timeline_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "component/body_component.h"
+#include "component/deformation_component.h"
+#include "component/timeline_component.h"
+
+#include "vector.h"
+
+using namespace lightspeed;
+
+Vector lightspeed::chunkOrigin(Vector const& position) {
+  return TIMELINE_CHUNK_SIZE * Vector(
+    std::floor(position.x / TIMELINE_CHUNK_SIZE),
+    std::floor(position.y / TIMELINE_CHUNK_SIZE),
+    std::floor(position.z / TIMELINE_CHUNK_SIZE));
+}
+
+void lightspeed::packTimeline(
+    TimelineComponent<BodyComponent> const& timeline,
+    Vector const& origin,
+    std::vector<float>& data) {
+  
+  data.resize(timeline.timeline.size() * TIMELINE_ENTRY_FLOATS);
+  float* out = data.data();
+  for (auto const& entry : timeline.timeline) {
+    BodyComponent const& body = entry.second;
+    Vector position = body.position - origin;
+    
+    out[0] = (float) position.x;
+    out[1] = (float) position.y;
+    out[2] = (float) position.z;
+    out[3] = (float) entry.first;
+    
+    out[4] = (float) body.momentum.x;
+    out[5] = (float) body.momentum.y;
+    out[6] = (float) body.momentum.z;
+    out[7] = (float) body.energy;
+    
+    out[8] = (float) body.rotation.pure.x;
+    out[9] = (float) body.rotation.pure.y;
+    out[10] = (float) body.rotation.pure.z;
+    out[11] = (float) body.rotation.real;
+    
+    out += TIMELINE_ENTRY_FLOATS;
+  }
+}
+
+void lightspeed::packWeights(
+    TimelineComponent<BodyComponent> const& timeline,
+    TimelineComponent<DeformationComponent> const& deformations,
+    std::vector<float>& data) {
+  
+  data.resize(timeline.timeline.size() * MORPH_TARGET_COUNT);
+  float* out = data.data();
+  auto const& entries = deformations.timeline;
+  if (timeline.timeline.empty()) {
+    return;
+  }
+  if (entries.size() < 2) {
+    DeformationComponent deformation;
+    if (!entries.empty()) {
+      deformation = entries.front().second;
+    }
+    for (std::size_t i = 0; i < timeline.timeline.size(); ++i) {
+      std::copy(
+        deformation.weights.begin(),
+        deformation.weights.end(),
+        out + i * MORPH_TARGET_COUNT);
+    }
+    return;
+  }
+  
+  // Both timelines go forwards in time, so the deformation entry before each
+  // body entry is found by walking along them together.
+  std::size_t index = deformations.entryBefore(timeline.timeline.front().first);
+  for (auto const& entry : timeline.timeline) {
+    while (index + 2 < entries.size() &&
+           entries[index + 1].first <= entry.first) {
+      ++index;
+    }
+    DeformationComponent deformation = deformations.sampleAfter(
+      index,
+      entry.first,
+      TimelineInterpolation::LINEAR);
+    std::copy(deformation.weights.begin(), deformation.weights.end(), out);
+    out += MORPH_TARGET_COUNT;
+  }
+}
@@ -0,0 +1,594 @@
+#include "worldline_tree.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <entityx/entityx.h>
+
+#include "utility.h"
+#include "vector.h"
+
+#define NULL_NODE (-1)
+
+using namespace lightspeed;
+
+// Checks whether the past light cone of an event passes through the bounds.
+bool boundsIntersectLightCone(
+  WorldtubeBounds const& bounds,
+  Vector const& position,
+  double time,
+  double distance);
+// Checks whether the bounds lie at least partially within a cone of directions
+// as seen from a point.
+bool boundsIntersectViewCone(
+  WorldtubeBounds const& bounds,
+  Vector const& position,
+  Vector const& direction,
+  double halfAngle);
+// Finds the distance along a backwards light ray at which it enters the bounds,
+// returning false if it misses.
+bool boundsIntersectRay(
+  WorldtubeBounds const& bounds,
+  Vector const& position,
+  double time,
+  Vector const& direction,
+  double distance,
+  double& entryDistance);
+
+WorldtubeBounds::WorldtubeBounds() :
+    min(),
+    max(),
+    timeMin(0.0),
+    timeMax(0.0) {
+}
+
+WorldtubeBounds::WorldtubeBounds(
+    Vector min,
+    Vector max,
+    double timeMin,
+    double timeMax) :
+    min(min),
+    max(max),
+    timeMin(timeMin),
+    timeMax(timeMax) {
+}
+
+WorldtubeBounds WorldtubeBounds::event(
+    Vector position,
+    double radius,
+    double time) {
+  
+  Vector extent(radius, radius, radius);
+  return WorldtubeBounds(position - extent, position + extent, time, time);
+}
+
+bool WorldtubeBounds::contains(WorldtubeBounds const& other) const {
+  return
+    min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+    max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z &&
+    timeMin <= other.timeMin && timeMax >= other.timeMax;
+}
+
+WorldtubeBounds WorldtubeBounds::merge(WorldtubeBounds const& other) const {
+  return WorldtubeBounds(
+    Vector(
+      std::min(min.x, other.min.x),
+      std::min(min.y, other.min.y),
+      std::min(min.z, other.min.z)),
+    Vector(
+      std::max(max.x, other.max.x),
+      std::max(max.y, other.max.y),
+      std::max(max.z, other.max.z)),
+    std::min(timeMin, other.timeMin),
+    std::max(timeMax, other.timeMax));
+}
+
+double WorldtubeBounds::cost() const {
+  
+  Vector extent = max - min;
+  double result = extent.x + extent.y + extent.z;
+  
+  // A time extent with no beginning is shared by every entity that has one, so
+  // it can't help to decide between them.
+  double duration = timeMax - timeMin;
+  if (std::isfinite(duration)) {
+    result += LIGHT_SPEED * duration;
+  }
+  return result;
+}
+
+WorldlineTree::WorldlineTree() :
+    m_nodes(),
+    m_freeNodes(),
+    m_leaves(),
+    m_root(NULL_NODE) {
+}
+
+bool WorldlineTree::update(
+    entityx::Entity entity,
+    WorldtubeBounds const& bounds,
+    WorldtubeBounds const& fatBounds) {
+  
+  auto it = m_leaves.find(entity.id().id());
+  int leaf;
+  if (it != m_leaves.end()) {
+    
+    // If the entity still fits inside its old bounds, then nothing has to be
+    // done at all.
+    leaf = it->second;
+    if (m_nodes[leaf].bounds.contains(bounds)) {
+      return false;
+    }
+    removeLeaf(leaf);
+  }
+  else {
+    leaf = allocateNode();
+    m_nodes[leaf].entity = entity;
+    m_leaves[entity.id().id()] = leaf;
+  }
+  
+  m_nodes[leaf].bounds = fatBounds;
+  insertLeaf(leaf);
+  return true;
+}
+
+void WorldlineTree::remove(entityx::Entity entity) {
+  
+  auto it = m_leaves.find(entity.id().id());
+  if (it == m_leaves.end()) {
+    return;
+  }
+  int leaf = it->second;
+  m_leaves.erase(it);
+  removeLeaf(leaf);
+  freeNode(leaf);
+}
+
+void WorldlineTree::clear() {
+  m_nodes.clear();
+  m_freeNodes.clear();
+  m_leaves.clear();
+  m_root = NULL_NODE;
+}
+
+bool WorldlineTree::contains(entityx::Entity entity) const {
+  return m_leaves.find(entity.id().id()) != m_leaves.end();
+}
+
+std::size_t WorldlineTree::size() const {
+  return m_leaves.size();
+}
+
+void WorldlineTree::queryPastLightCone(
+    Vector const& position,
+    double time,
+    double distance,
+    std::vector<entityx::Entity>& result) const {
+  
+  if (m_root == NULL_NODE) {
+    return;
+  }
+  
+  std::vector<int> stack;
+  stack.push_back(m_root);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    Node const& node = m_nodes[index];
+    if (!boundsIntersectLightCone(node.bounds, position, time, distance)) {
+      continue;
+    }
+    if (isLeaf(index)) {
+      result.push_back(node.entity);
+    }
+    else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+}
+
+void WorldlineTree::queryVisible(
+    Vector const& position,
+    double time,
+    double distance,
+    Vector const& direction,
+    double halfAngle,
+    std::vector<entityx::Entity>& result) const {
+  
+  if (m_root == NULL_NODE) {
+    return;
+  }
+  
+  std::vector<int> stack;
+  stack.push_back(m_root);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    Node const& node = m_nodes[index];
+    if (!boundsIntersectLightCone(node.bounds, position, time, distance) ||
+        !boundsIntersectViewCone(
+          node.bounds, position, direction, halfAngle)) {
+      continue;
+    }
+    if (isLeaf(index)) {
+      result.push_back(node.entity);
+    }
+    else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+}
+
+bool WorldlineTree::raycast(
+    Vector const& position,
+    double time,
+    Vector const& direction,
+    double distance,
+    RayTest const& test,
+    entityx::Entity& hit,
+    double& hitDistance) const {
+  
+  if (m_root == NULL_NODE) {
+    return false;
+  }
+  
+  // Keep track of the closest hit so far, so that any nodes that the ray only
+  // enters further away than it can be skipped.
+  bool hasHit = false;
+  double closest = distance;
+  
+  std::vector<int> stack;
+  stack.push_back(m_root);
+  while (!stack.empty()) {
+    int index = stack.back();
+    stack.pop_back();
+    Node const& node = m_nodes[index];
+    double entryDistance;
+    if (!boundsIntersectRay(
+          node.bounds, position, time, direction, closest, entryDistance)) {
+      continue;
+    }
+    if (isLeaf(index)) {
+      double leafDistance;
+      if (test(node.entity, closest, leafDistance) && leafDistance < closest) {
+        hasHit = true;
+        closest = leafDistance;
+        hit = node.entity;
+      }
+    }
+    else {
+      stack.push_back(node.left);
+      stack.push_back(node.right);
+    }
+  }
+  
+  if (hasHit) {
+    hitDistance = closest;
+  }
+  return hasHit;
+}
+
+int WorldlineTree::allocateNode() {
+  
+  int node;
+  if (!m_freeNodes.empty()) {
+    node = m_freeNodes.back();
+    m_freeNodes.pop_back();
+  }
+  else {
+    node = m_nodes.size();
+    m_nodes.push_back(Node());
+  }
+  
+  m_nodes[node].bounds = WorldtubeBounds();
+  m_nodes[node].entity = entityx::Entity();
+  m_nodes[node].parent = NULL_NODE;
+  m_nodes[node].left = NULL_NODE;
+  m_nodes[node].right = NULL_NODE;
+  m_nodes[node].height = 0;
+  return node;
+}
+
+void WorldlineTree::freeNode(int node) {
+  m_nodes[node].height = -1;
+  m_freeNodes.push_back(node);
+}
+
+void WorldlineTree::insertLeaf(int leaf) {
+  
+  if (m_root == NULL_NODE) {
+    m_root = leaf;
+    m_nodes[leaf].parent = NULL_NODE;
+    return;
+  }
+  
+  // Walk down the tree to find the best sibling for the new leaf. At each step
+  // the cost of making a new parent here is compared against the cost of
+  // pushing the leaf further down into either child.
+  WorldtubeBounds leafBounds = m_nodes[leaf].bounds;
+  int index = m_root;
+  while (!isLeaf(index)) {
+    
+    Node const& node = m_nodes[index];
+    double cost = node.bounds.cost();
+    double combinedCost = node.bounds.merge(leafBounds).cost();
+    
+    // Creating a new parent here increases the size of every ancestor, which
+    // is paid for no matter which way we go.
+    double parentCost = 2.0 * combinedCost;
+    double inheritedCost = 2.0 * (combinedCost - cost);
+    
+    double childCosts[2];
+    int children[2] = { node.left, node.right };
+    for (int i = 0; i < 2; ++i) {
+      WorldtubeBounds const& childBounds = m_nodes[children[i]].bounds;
+      double mergedCost = childBounds.merge(leafBounds).cost();
+      if (isLeaf(children[i])) {
+        childCosts[i] = mergedCost + inheritedCost;
+      }
+      else {
+        childCosts[i] = mergedCost - childBounds.cost() + inheritedCost;
+      }
+    }
+    
+    if (parentCost < childCosts[0] && parentCost < childCosts[1]) {
+      break;
+    }
+    index = (childCosts[0] < childCosts[1]) ? children[0] : children[1];
+  }
+  
+  // Create a new parent for the sibling and the leaf.
+  int sibling = index;
+  int oldParent = m_nodes[sibling].parent;
+  int newParent = allocateNode();
+  m_nodes[newParent].parent = oldParent;
+  m_nodes[newParent].bounds = m_nodes[sibling].bounds.merge(leafBounds);
+  m_nodes[newParent].height = m_nodes[sibling].height + 1;
+  m_nodes[newParent].left = sibling;
+  m_nodes[newParent].right = leaf;
+  m_nodes[sibling].parent = newParent;
+  m_nodes[leaf].parent = newParent;
+  
+  if (oldParent != NULL_NODE) {
+    if (m_nodes[oldParent].left == sibling) {
+      m_nodes[oldParent].left = newParent;
+    }
+    else {
+      m_nodes[oldParent].right = newParent;
+    }
+  }
+  else {
+    m_root = newParent;
+  }
+  
+  // Fix up the bounds of all of the ancestors.
+  refit(m_nodes[leaf].parent);
+}
+
+void WorldlineTree::removeLeaf(int leaf) {
+  
+  if (leaf == m_root) {
+    m_root = NULL_NODE;
+    return;
+  }
+  
+  int parent = m_nodes[leaf].parent;
+  int grandParent = m_nodes[parent].parent;
+  int sibling = (m_nodes[parent].left == leaf) ?
+    m_nodes[parent].right :
+    m_nodes[parent].left;
+  
+  // The parent is no longer needed, so the sibling takes its place.
+  if (grandParent != NULL_NODE) {
+    if (m_nodes[grandParent].left == parent) {
+      m_nodes[grandParent].left = sibling;
+    }
+    else {
+      m_nodes[grandParent].right = sibling;
+    }
+    m_nodes[sibling].parent = grandParent;
+    freeNode(parent);
+    refit(grandParent);
+  }
+  else {
+    m_root = sibling;
+    m_nodes[sibling].parent = NULL_NODE;
+    freeNode(parent);
+  }
+}
+
+void WorldlineTree::refit(int node) {
+  
+  // Walk back up to the root, rebalancing and recalculating the bounds of each
+  // node along the way.
+  int index = node;
+  while (index != NULL_NODE) {
+    index = balance(index);
+    
+    int left = m_nodes[index].left;
+    int right = m_nodes[index].right;
+    m_nodes[index].height =
+      1 + std::max(m_nodes[left].height, m_nodes[right].height);
+    m_nodes[index].bounds =
+      m_nodes[left].bounds.merge(m_nodes[right].bounds);
+    
+    index = m_nodes[index].parent;
+  }
+}
+
+int WorldlineTree::balance(int a) {
+  
+  // If one child of the node is much taller than the other, then it is rotated
+  // up to take the place of the node.
+  if (isLeaf(a) || m_nodes[a].height < 2) {
+    return a;
+  }
+  
+  int b = m_nodes[a].left;
+  int c = m_nodes[a].right;
+  int difference = m_nodes[c].height - m_nodes[b].height;
+  if (difference >= -1 && difference <= 1) {
+    return a;
+  }
+  
+  // The child being rotated up, the child staying down, and the children of
+  // the child being rotated up.
+  int up = (difference > 1) ? c : b;
+  int down = (difference > 1) ? b : c;
+  int f = m_nodes[up].left;
+  int g = m_nodes[up].right;
+  
+  // Swap the node and the child that is being rotated up.
+  m_nodes[up].parent = m_nodes[a].parent;
+  m_nodes[a].parent = up;
+  if (m_nodes[up].parent != NULL_NODE) {
+    int parent = m_nodes[up].parent;
+    if (m_nodes[parent].left == a) {
+      m_nodes[parent].left = up;
+    }
+    else {
+      m_nodes[parent].right = up;
+    }
+  }
+  else {
+    m_root = up;
+  }
+  
+  // The taller grandchild stays with the rotated child, and the shorter one is
+  // given to the original node.
+  int keep = (m_nodes[f].height > m_nodes[g].height) ? f : g;
+  int give = (keep == f) ? g : f;
+  m_nodes[up].left = a;
+  m_nodes[up].right = keep;
+  if (difference > 1) {
+    m_nodes[a].right = give;
+  }
+  else {
+    m_nodes[a].left = give;
+  }
+  m_nodes[give].parent = a;
+  
+  m_nodes[a].bounds = m_nodes[down].bounds.merge(m_nodes[give].bounds);
+  m_nodes[a].height =
+    1 + std::max(m_nodes[down].height, m_nodes[give].height);
+  m_nodes[up].bounds = m_nodes[a].bounds.merge(m_nodes[keep].bounds);
+  m_nodes[up].height = 1 + std::max(m_nodes[a].height, m_nodes[keep].height);
+  
+  return up;
+}
+
+bool WorldlineTree::isLeaf(int node) const {
+  return m_nodes[node].left == NULL_NODE;
+}
+
+bool boundsIntersectLightCone(
+    WorldtubeBounds const& bounds,
+    Vector const& position,
+    double time,
+    double distance) {
+  
+  // Find the closest and furthest distances from the position to the box.
+  // Every distance in between is also reached somewhere in the box.
+  double lower[3] = {
+    bounds.min.x - position.x,
+    bounds.min.y - position.y,
+    bounds.min.z - position.z
+  };
+  double upper[3] = {
+    bounds.max.x - position.x,
+    bounds.max.y - position.y,
+    bounds.max.z - position.z
+  };
+  double closestSq = 0.0;
+  double furthestSq = 0.0;
+  for (int i = 0; i < 3; ++i) {
+    if (lower[i] > 0.0) {
+      closestSq += lower[i] * lower[i];
+    }
+    else if (upper[i] < 0.0) {
+      closestSq += upper[i] * upper[i];
+    }
+    furthestSq += std::max(lower[i] * lower[i], upper[i] * upper[i]);
+  }
+  
+  double closest = std::sqrt(closestSq);
+  if (closest > distance) {
+    return false;
+  }
+  double furthest = std::min(std::sqrt(furthestSq), distance);
+  
+  // Light arriving at the event from a distance d must have left at time
+  // t - d / c, so the range of emission times has to overlap with the bounds.
+  return time - furthest / LIGHT_SPEED <= bounds.timeMax &&
+         time - closest / LIGHT_SPEED >= bounds.timeMin;
+}
+
+bool boundsIntersectViewCone(
+    WorldtubeBounds const& bounds,
+    Vector const& position,
+    Vector const& direction,
+    double halfAngle) {
+  
+  if (halfAngle >= M_PI) {
+    return true;
+  }
+  
+  // Use a sphere around the box, since it is easy to find the range of angles
+  // that it covers.
+  Vector center = (bounds.min + bounds.max) / 2.0;
+  double radius = (bounds.max - bounds.min).norm() / 2.0;
+  Vector offset = center - position;
+  double distance = offset.norm();
+  if (distance <= radius) {
+    return true;
+  }
+  
+  double cosAngle = offset.dot(direction) / distance;
+  double angle = std::acos(std::min(std::max(cosAngle, -1.0), 1.0));
+  return angle - std::asin(radius / distance) <= halfAngle;
+}
+
+bool boundsIntersectRay(
+    WorldtubeBounds const& bounds,
+    Vector const& position,
+    double time,
+    Vector const& direction,
+    double distance,
+    double& entryDistance) {
+  
+  // The ray is x(s) = position + s * direction and t(s) = time - s / c. Each
+  // pair of faces of the box restricts s to an interval, and the ray hits the
+  // box if all of the intervals overlap.
+  double entry = 0.0;
+  double exit = distance;
+  
+  double origins[3] = { position.x, position.y, position.z };
+  double directions[3] = { direction.x, direction.y, direction.z };
+  double mins[3] = { bounds.min.x, bounds.min.y, bounds.min.z };
+  double maxs[3] = { bounds.max.x, bounds.max.y, bounds.max.z };
+  for (int i = 0; i < 3; ++i) {
+    if (directions[i] == 0.0) {
+      if (origins[i] < mins[i] || origins[i] > maxs[i]) {
+        return false;
+      }
+      continue;
+    }
+    double s1 = (mins[i] - origins[i]) / directions[i];
+    double s2 = (maxs[i] - origins[i]) / directions[i];
+    entry = std::max(entry, std::min(s1, s2));
+    exit = std::min(exit, std::max(s1, s2));
+  }
+  
+  entry = std::max(entry, LIGHT_SPEED * (time - bounds.timeMax));
+  exit = std::min(exit, LIGHT_SPEED * (time - bounds.timeMin));
+  
+  if (entry > exit) {
+    return false;
+  }
+  entryDistance = entry;
+  return true;
+}
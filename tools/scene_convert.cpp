@@ -0,0 +1,46 @@
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "scene.h"
+
+#define RESULT_SUCCESS (0)
+#define RESULT_FAILURE (-1)
+
+using namespace lightspeed;
+
+/**
+ * Converts a text description of a scene into a binary scene file that can be
+ * memory mapped by the main program. See parseSceneDescription for the format
+ * of the description.
+ */
+int main(int argc, char** argv) {
+  
+  if (argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " <description> <scene>" << '\n';
+    return RESULT_FAILURE;
+  }
+  
+  try {
+    std::ifstream input(argv[1]);
+    if (!input) {
+      throw std::runtime_error(
+        std::string("Couldn't open '") + argv[1] + "'.");
+    }
+    
+    SceneBuilder builder;
+    parseSceneDescription(input, builder);
+    builder.write(argv[2]);
+    
+    std::cout
+      << "Wrote " << builder.entityCount() << " entities and "
+      << builder.meshCount() << " meshes to '" << argv[2] << "'." << '\n';
+  }
+  catch (std::runtime_error const& error) {
+    std::cerr << error.what() << '\n';
+    return RESULT_FAILURE;
+  }
+  
+  return RESULT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include "scene.h"
+#include "scene_generator.h"
+
+#define RESULT_SUCCESS (0)
+#define RESULT_FAILURE (-1)
+
+using namespace lightspeed;
+
+/**
+ * Writes a procedurally generated scene to a binary scene file. The
+ * parameters are given as name=value arguments (see setGeneratorParameter),
+ * so that the same scene can be generated again from the same command line.
+ */
+int main(int argc, char** argv) {
+  
+  if (argc < 2) {
+    std::cerr
+      << "Usage: " << argv[0] << " [name=value ...] <scene>" << '\n';
+    return RESULT_FAILURE;
+  }
+  
+  try {
+    GeneratorParameters parameters;
+    for (int i = 1; i < argc - 1; ++i) {
+      parseGeneratorParameters(argv[i], parameters);
+    }
+    
+    SceneBuilder builder;
+    generateScene(parameters, builder);
+    builder.write(argv[argc - 1]);
+    
+    std::cout
+      << "Wrote " << builder.entityCount() << " entities and "
+      << builder.meshCount() << " meshes to '" << argv[argc - 1] << "'."
+      << '\n';
+  }
+  catch (std::runtime_error const& error) {
+    std::cerr << error.what() << '\n';
+    return RESULT_FAILURE;
+  }
+  
+  return RESULT_SUCCESS;
+}